@@ -0,0 +1,160 @@
+// Direct reference for the check scripts: recomputes every element of a
+// zero-padded conv_stride output from its input, in double, and compares.
+//
+//   conv_ref KERNEL.txt OUT sH sW H W     synthetic input (seed 1234)
+//   conv_ref KERNEL.txt OUT sH sW IN      .txt or .bin input
+//
+// OUT may be .txt (values printed to 3 decimals) or .bin.
+#include "file.h"
+#include "generate.h"
+#include "matrix.h"
+#include <math.h>
+#include <omp.h>
+#include <string.h>
+
+#define SYNTHETIC_SEED 1234
+
+static int is_text(const char* path) {
+    size_t len = strlen(path);
+    return len >= 4 && strcmp(path + len - 4, ".txt") == 0;
+}
+
+static float* read_kernel(const char* path, uint32_t* kH, uint32_t* kW) {
+    FILE* f = fopen(path, "r");
+    if (!f) return NULL;
+    float* k = NULL;
+    if (fscanf(f, "%u %u", kH, kW) == 2 && *kH && *kW) {
+        k = (float*)malloc((size_t)*kH * *kW * sizeof(float));
+        for (size_t i = 0; k && i < (size_t)*kH * *kW; ++i) {
+            if (fscanf(f, "%f", &k[i]) != 1) {
+                free(k);
+                k = NULL;
+            }
+        }
+    }
+    fclose(f);
+    return k;
+}
+
+// Sequential rows of a .txt or .bin matrix.
+typedef struct {
+    int text;
+    TextFile tf;
+    BinaryFile bf;
+    uint32_t height;
+    uint32_t width;
+} MatrixReader;
+
+static int open_reader(const char* path, MatrixReader* r) {
+    memset(r, 0, sizeof(*r));
+    r->text = is_text(path);
+    if (r->text) {
+        r->tf = open_txt_matrix_input((char*)path);
+        r->height = r->tf.height;
+        r->width = r->tf.width;
+        return r->tf.file ? 0 : -1;
+    }
+    r->bf = open_bin_matrix_input((char*)path);
+    r->height = r->bf.height;
+    r->width = r->bf.width;
+    return r->bf.file ? 0 : -1;
+}
+
+static int read_rows(MatrixReader* r, float* dst, uint32_t rows) {
+    return r->text ? read_txt_rows(&r->tf, dst, rows) : read_bin_f32(&r->bf, dst, (size_t)rows * r->width);
+}
+
+static void close_reader(MatrixReader* r) {
+    if (r->text) close_txt_matrix_input(&r->tf);
+    else if (r->bf.file) fclose(r->bf.file);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 6 && argc != 7) {
+        fprintf(stderr, "usage: %s KERNEL.txt OUT sH sW (H W | IN)\n", argv[0]);
+        return 2;
+    }
+    uint32_t kH = 0, kW = 0;
+    float* kernel = read_kernel(argv[1], &kH, &kW);
+    if (!kernel) {
+        fprintf(stderr, "Failed to read kernel %s\n", argv[1]);
+        return 2;
+    }
+    const uint32_t sH = (uint32_t)strtoul(argv[3], NULL, 10);
+    const uint32_t sW = (uint32_t)strtoul(argv[4], NULL, 10);
+
+    // synthetic elements are a pure function of their position; a file is
+    // small enough at the strides checked to be held whole
+    const uint64_t key = generate_key(SYNTHETIC_SEED);
+    uint32_t H = 0, W = 0;
+    float* input = NULL;
+    if (argc == 7) {
+        H = (uint32_t)strtoul(argv[5], NULL, 10);
+        W = (uint32_t)strtoul(argv[6], NULL, 10);
+    } else {
+        MatrixReader in;
+        if (open_reader(argv[5], &in) != 0) return 2;
+        H = in.height;
+        W = in.width;
+        input = (float*)malloc((size_t)H * W * sizeof(float));
+        if (!input || read_rows(&in, input, H) != 0) {
+            fprintf(stderr, "Failed to read %s\n", argv[5]);
+            return 2;
+        }
+        close_reader(&in);
+    }
+
+    MatrixReader out;
+    if (open_reader(argv[2], &out) != 0) return 2;
+    const uint32_t out_H = (uint32_t)calc_output_height((int)H, (int)kH, (int)sH, BOUNDARY_ZERO);
+    const uint32_t out_W = (uint32_t)calc_output_width((int)W, (int)kW, (int)sW, BOUNDARY_ZERO);
+    if (out.height != out_H || out.width != out_W) {
+        fprintf(stderr, "%s is %ux%u, expected %ux%u\n", argv[2], out.height, out.width, out_H, out_W);
+        return 1;
+    }
+
+    // fp32 accumulation in any tap order stays within a few ulps of the
+    // magnitude; text adds the rounding of its last printed digit
+    const double slack = out.text ? 5e-4 : 1e-6;
+    const int oH = calc_window_origin(kH, BOUNDARY_ZERO), oW = calc_window_origin(kW, BOUNDARY_ZERO);
+    const uint32_t block = 256;
+    float* rows = (float*)malloc((size_t)block * out_W * sizeof(float));
+    if (!rows) return 2;
+    uint64_t mismatches = 0;
+    double max_err = 0.0;
+    for (uint32_t r0 = 0; r0 < out_H; r0 += block) {
+        const uint32_t n = out_H - r0 < block ? out_H - r0 : block;
+        if (read_rows(&out, rows, n) != 0) {
+            fprintf(stderr, "Failed to read %s\n", argv[2]);
+            return 2;
+        }
+        #pragma omp parallel for schedule(static) reduction(+:mismatches) reduction(max:max_err)
+        for (uint32_t r = 0; r < n; ++r) {
+            for (uint32_t c = 0; c < out_W; ++c) {
+                double ref = 0.0, mag = 0.0;
+                for (uint32_t a = 0; a < kH; ++a) {
+                    const int64_t y = (int64_t)(r0 + r) * sH - oH + a;
+                    if (y < 0 || y >= H) continue;
+                    for (uint32_t b = 0; b < kW; ++b) {
+                        const int64_t x = (int64_t)c * sW - oW + b;
+                        if (x < 0 || x >= W) continue;
+                        const float v = input ? input[(size_t)y * W + x]
+                                              : generate_value(key, (uint32_t)y, (uint32_t)x);
+                        ref += (double)kernel[a * kW + b] * v;
+                        mag += fabs((double)kernel[a * kW + b] * v);
+                    }
+                }
+                const double err = fabs((double)rows[(size_t)r * out_W + c] - ref);
+                if (err > 1e-5 * mag + slack) mismatches++;
+                if (err > max_err) max_err = err;
+            }
+        }
+    }
+    close_reader(&out);
+    printf("[CHECK] %s %ux%u max_err=%.3g mismatches=%llu\n", argv[2], out_H, out_W, max_err,
+           (unsigned long long)mismatches);
+    free(rows);
+    free(input);
+    free(kernel);
+    return mismatches ? 1 : 0;
+}
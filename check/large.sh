@@ -0,0 +1,50 @@
+#!/bin/sh
+# Runs conv_stride past 2^32 elements and checks every output element
+# against check/conv_ref:
+#   1. a 65537x65536 synthetic input at strides 64x64 and 2x64
+#   2. the first output read back through the mpi source
+#
+# usage: check/large.sh [conv_stride] [conv_ref]
+# NP sets the rank count (default 2; the mpi source needs more than one),
+# MPIRUN the launcher (e.g. "mpirun --oversubscribe") and CHECK_DIR the
+# scratch directory.
+set -e
+
+BIN=${1:-./conv_stride}
+REF=${2:-build/check/conv_ref}
+NP=${NP:-2}
+DIR=${CHECK_DIR:-$(mktemp -d)}
+mkdir -p "$DIR"
+trap 'rm -f "$DIR"/k.txt "$DIR"/s64.bin "$DIR"/s2.bin "$DIR"/back.bin' EXIT
+
+MPIRUN="${MPIRUN:-mpirun} -np $NP"
+[ "$(id -u)" = 0 ] && MPIRUN="$MPIRUN --allow-run-as-root"
+
+cat > "$DIR/k.txt" <<EOF
+3 3
+-0.386 0.727 0.963
+0.109 -0.121 -0.020
+-0.965 -0.116 -0.378
+EOF
+
+SOURCE=
+run() {
+    out=$1
+    shift
+    rm -f "$out"
+    echo "== $BIN $* -o $out (np $NP)"
+    $MPIRUN -x CONVERT_BIN=0 -x CONV_SOURCE="$SOURCE" "$BIN" -g "$DIR/k.txt" -M 1 -o "$out" "$@" | grep '^mode=' || true
+    [ -s "$out" ]
+}
+
+run "$DIR/s64.bin" -H 65537 -W 65536 -sH 64 -sW 64
+"$REF" "$DIR/k.txt" "$DIR/s64.bin" 64 64 65537 65536
+
+run "$DIR/s2.bin" -H 65537 -W 65536 -sH 2 -sW 64
+"$REF" "$DIR/k.txt" "$DIR/s2.bin" 2 64 65537 65536
+
+SOURCE=mpi
+run "$DIR/back.bin" -f "$DIR/s64.bin" -sH 1 -sW 1
+"$REF" "$DIR/k.txt" "$DIR/back.bin" 1 1 "$DIR/s64.bin"
+
+echo "large checks passed"
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Convolves a small text matrix on 1 and 3 ranks, at four strides, with the
+# whole matrix in one chunk and with a budget that allows a few rows per
+# chunk, into text and .bin output, and checks each result against
+# check/conv_ref. Both also run under a budget below one row, which .bin
+# output meets with column tiles and text output with one-row chunks.
+# Extra arguments go to every conv_stride run (e.g. --bin-version=2).
+#
+# usage: check/regress.sh [conv_stride] [conv_ref] [conv_stride args...]
+# MPIRUN sets the launcher (e.g. "mpirun --oversubscribe") and CHECK_DIR the
+# scratch directory.
+
+BIN=${1:-./conv_stride}
+REF=${2:-build/check/conv_ref}
+[ $# -ge 2 ] && shift 2 || shift $#
+DIR=${CHECK_DIR:-$(mktemp -d)}
+mkdir -p "$DIR"
+trap 'rm -f "$DIR"/in.txt "$DIR"/k.txt "$DIR"/o.txt "$DIR"/o.bin "$DIR"/log.txt; rmdir "$DIR" 2>/dev/null' EXIT
+
+MPIRUN=${MPIRUN:-mpirun}
+[ "$(id -u)" = 0 ] && MPIRUN="$MPIRUN --allow-run-as-root"
+
+# 37x23 values in [0, 1) with three decimals
+awk 'BEGIN { print "37 23"; for (i = 0; i < 37; ++i) { line = "";
+     for (j = 0; j < 23; ++j) line = line sprintf("%s%.3f", j ? " " : "", ((i * 131 + j * 71 + i * j) % 1000) / 1000.0);
+     print line } }' > "$DIR/in.txt"
+cat > "$DIR/k.txt" <<EOF
+3 5
+0.81 1.00 0.26 0.20 0.75
+0.77 0.51 0.49 0.40 0.88
+0.80 0.58 0.04 0.85 0.46
+EOF
+
+fail=0
+run() {
+    np=$1 sH=$2 sW=$3 mem=$4 out=$5 convert=$6
+    shift 6
+    rm -f "$out"
+    if [ "$np" = 1 ]; then
+        CONVERT_BIN=$convert OMP_NUM_THREADS=2 "$BIN" -f "$DIR/in.txt" -g "$DIR/k.txt" -sH "$sH" -sW "$sW" \
+            -M "$mem" -o "$out" "$@" > "$DIR/log.txt" 2>&1
+    else
+        $MPIRUN -np "$np" -x CONVERT_BIN=$convert -x OMP_NUM_THREADS=1 "$BIN" -f "$DIR/in.txt" -g "$DIR/k.txt" \
+            -sH "$sH" -sW "$sW" -M "$mem" -o "$out" "$@" > "$DIR/log.txt" 2>&1
+    fi
+    result=$("$REF" "$DIR/k.txt" "$out" "$sH" "$sW" "$DIR/in.txt" 2>&1 | tail -1)
+    echo "np=$np s=${sH}x${sW} M=$mem $(basename "$out") $*: $result"
+    case "$result" in
+        *"mismatches=0") ;;
+        *) fail=1; tail -5 "$DIR/log.txt" ;;
+    esac
+}
+
+for np in 1 3; do
+    for s in "1 1" "2 1" "3 4" "5 7"; do
+        for mem in 32 0.000006; do
+            run $np $s $mem "$DIR/o.txt" 1 "$@"
+            run $np $s $mem "$DIR/o.bin" 0 "$@"
+        done
+        run $np $s 0.000002 "$DIR/o.txt" 1 "$@"
+        run $np $s 0.000002 "$DIR/o.bin" 0 "$@"
+    done
+done
+[ $fail = 0 ] && echo "regression checks passed"
+exit $fail
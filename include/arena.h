@@ -0,0 +1,57 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The chunk buffers of a run, carved from one reservation made up front and
+// released together by arena_destroy. The reservation is backed by explicit
+// huge pages (MAP_HUGETLB) when the system has them reserved, else marked for
+// transparent huge pages (MADV_HUGEPAGE). CONV_HUGE_PAGES=0 keeps base pages.
+// Requests past the reservation fall back to the heap.
+#define ARENA_HUGE_PAGE_BYTES ((size_t)2 << 20)
+
+typedef enum {
+    ARENA_PAGES_HEAP,       // no reservation
+    ARENA_PAGES_BASE,
+    ARENA_PAGES_THP,
+    ARENA_PAGES_HUGETLB
+} ArenaPages;
+
+typedef struct {
+    char* base;
+    size_t size;
+    size_t used;
+    ArenaPages pages;
+    uint32_t buffers;       // handed out from the reservation
+    uint32_t heap_count;    // handed out from the heap
+    uint32_t heap_capacity;
+    void** heap;
+    uint32_t runs;          // runs that rewound it, when kept across runs
+    // counters of the run, sampled by arena_init
+    long minflt;
+    long majflt;
+    int tlb_count;
+    int* tlb_fds;           // per OpenMP thread dTLB read-miss counters, -1 if unavailable
+} BufferArena;
+
+// Reserves bytes (rounded up to huge pages) and starts the fault and TLB
+// counters of a team of threads. Without a reservation buffers come from the
+// heap.
+void arena_init(BufferArena* arena, size_t bytes, int threads);
+// ALIGN_BYTES-aligned buffer of bytes, NULL when out of memory.
+void* arena_alloc(BufferArena* arena, size_t bytes);
+// Prints allocation, page fault and TLB miss counts since arena_init.
+void arena_report(const BufferArena* arena, const char* label);
+void arena_destroy(BufferArena* arena);
+
+// The arena of one run needing bytes. A caller that keeps an arena across
+// runs passes it as shared (see ConvRunOptions.arena): its buffers are
+// released, and the reservation is replaced only by a larger one when bytes
+// exceed it. Otherwise own is reserved for the run.
+BufferArena* arena_begin_run(BufferArena* shared, BufferArena* own, size_t bytes, int threads);
+// Reports an arena reserved for its run under label (NULL for none) and
+// releases it; a shared arena stays with its keeper.
+void arena_end_run(BufferArena* arena, const char* label);
+
+#endif // ARENA_H
@@ -0,0 +1,23 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <mpi.h>
+#include "libconv.h"
+
+// CONV_SOURCE picks how a binary input is read (file, mmap or, with several
+// ranks, the default mpi); without a path rows are generated on demand and
+// .cbin inputs are always block-decoded. A current "<path>.occ" occupancy
+// index is attached to the source.
+MatrixSource* open_input_source(const char* in_path, uint32_t H, uint32_t W, int use_mpi, const char* kind);
+
+// Manifest batch mode: every non-empty line not starting with '#' is an
+// "input output" job convolved with the plan's kernel. Rank 0 reads the
+// manifest and input headers once. Inputs above CONV_BATCH_SPLIT_MB (default
+// 64) are split across comm with the row decomposition of conv_mpi; the rest
+// are dealt out whole, largest first, to the least loaded rank. Each rank runs
+// its jobs largest first, carving their chunk buffers from one arena kept for
+// the batch. Returns 0 if every job succeeded, on every rank.
+int run_manifest(ConvPlan* plan, const char* manifest_path, MPI_Comm comm,
+                 const ConvRunOptions* opts, const char* tmp_dir);
+
+#endif // BATCH_H
@@ -1,8 +1,11 @@
 #ifndef CLI_PARSE_H
 #define CLI_PARSE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#define CLI_MAX_STAGES 16
+
 typedef struct {
     int H;
     int W;
@@ -14,11 +17,30 @@ typedef struct {
     const char* kernel_file;
     const char* output_file;
     double memory_gb;
+    int out_dtype;      // MatrixDType of .bin output
+    int quant_dtype;    // DTYPE_I8/DTYPE_I16 selects the integer engine, 0 = off
+    int bin_version;    // header version of .bin output (2 = aligned rows, 3 = 64-bit dims)
+    long long row_pitch;    // --row-pitch bytes between v2/v3 rows, 0 = narrowest aligned
+    int convert_only;   // rewrite -f into -o with bin_version, no convolution
+    int batch;          // N images of C channels stacked in the input rows
+    int channels;
+    int kernels;        // K kernels of C channels stacked in the kernel rows
+    const char* manifest_file;  // batch mode: "input output" lines replace -f/-o
+    int pipe_format;    // read -f front to back: 0 off, 1 text, 2 .bin
+    const char* stages[CLI_MAX_STAGES];  // --stage specs fused after -g, in order
+    int num_stages;
+    int boundary;       // BoundaryMode
+    double sparse_threshold;    // >= 0 compiles the kernel's taps above it, < 0 dense
+    int occupancy_rows; // --occupancy tile size; 0 = no index is built
+    int occupancy_cols;
+    int checkpoint;     // 1 = --checkpoint, 2 = --resume (see ConvRunOptions)
     int show_help;
 } CLIArgs;
 
 int parse_cli_args(int argc, char** argv, CLIArgs* args);
 void print_cli_usage(const char* program_name);
+// Splits a --stage spec "KERNEL[,sH[,sW]]"; strides default to 1, sW to sH.
+int parse_stage_spec(const char* spec, char* path, size_t path_cap, int* sH, int* sW);
 
 #endif // CLI_PARSE_H
 
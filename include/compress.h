@@ -0,0 +1,41 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Block-compressed matrix container (.cbin). Rows are grouped into blocks of
+// block_rows that are compressed independently, so any row range can be
+// decoded without touching the rest of the file:
+//
+//   CompressedHeader | uint64_t offsets[num_blocks + 1] | block 0 | block 1 ...
+//
+// offsets[b] is the absolute file offset of block b, offsets[num_blocks] the
+// end of the last one. Elements are stored as dtype (see dtype.h).
+#define BIN_COMPRESSED_MAGIC 0x5a564e43u   // "CNVZ"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t dtype;
+    uint32_t height;
+    uint32_t width;
+    uint32_t block_rows;
+    uint32_t num_blocks;
+    float scale;            // quantized dtypes only
+    int32_t zero_point;
+} CompressedHeader;
+
+// Codec: delta over the element bit patterns, byte shuffle into planes, then
+// run-length coding of the planes. Returns the compressed size, or 0 if dst
+// (of capacity cap) is too small.
+size_t zblock_bound(size_t n, size_t elem_size);
+size_t zblock_encode(const void* src, size_t n, size_t elem_size, unsigned char* dst, size_t cap, unsigned char* scratch);
+int zblock_decode(const unsigned char* src, size_t src_len, void* dst, size_t n, size_t elem_size, unsigned char* scratch);
+
+int read_compressed_header(const char* path, CompressedHeader* header);
+
+// Converts a .bin matrix (any header version) into a .cbin container; a
+// block_rows of 0 picks blocks of roughly 256 KiB. Returns 0 on success.
+int compress_bin_matrix(char* src_fp, char* dst_fp, uint32_t block_rows);
+
+#endif // COMPRESS_H
@@ -5,28 +5,138 @@
 #include <stdlib.h>
 #include <mpi.h>
 #include "matrix.h"
+#include "source.h"
+#include "conv_options.h"
+#include "arena.h"
 
-#define ALIGN_BYTES 64
+typedef struct RowStream RowStream;
+
+// integer engine state, fixed when a plan is quantized
+typedef struct {
+    const int16_t* kernel;  // kH x kW, quantized symmetrically
+    float kernel_scale;
+    float scale;            // input scale * kernel_scale, applied on store
+    int wide;               // window sums can overflow int32 and are kept in int64
+} ConvQuant;
+
+// Non-zero taps of every kernel plane in row-major order; plane p = k*C + c
+// owns taps [offsets[p], offsets[p + 1]). dy, dx are offsets in the window.
+typedef struct {
+    uint32_t* offsets;
+    int32_t* dy;
+    int32_t* dx;
+    float* weight;
+    uint32_t count;
+} ConvTaps;
+
+// Kept by a runner for its whole run: each OpenMP thread's own copy of the
+// kernel, on pages of its own that the thread allocates and first touches.
+typedef struct {
+    int threads;
+    float** kernel;
+} ConvThreadState;
+
+// A stage fused after the first convolution of a chain. H x W are the
+// stage's input dims, i.e. the output dims of the stage before it.
+typedef struct {
+    float* kernel;
+    uint32_t kH, kW;
+    uint32_t sH, sW;
+    uint32_t H, W;
+    ConvThreadState* thread_state;  // per-thread copies of kernel, kept by the chain's owner; may be NULL
+} ConvStage;
+
+typedef struct {
+    uint32_t count;
+    ConvStage* stages;
+} ConvChain;
 
 // convolution parameters
 typedef struct {
-    float* data;        // input chunk
-    float* kernel;      // kernel
-    float* output;      // output chunk
-    uint32_t H, W;      // chunk dims
+    float* data;        // input chunk: C planes of H x W (int16 rows without zero point if quant)
+    float* kernel;      // K x C x kH x kW
+    float* output;      // output chunk: K planes of out_H x out_W
+    uint32_t H, W;      // chunk dims (per plane)
     uint32_t kH, kW;    // kernel dims
     uint32_t sH, sW;    // stride
     uint32_t out_H;     // output dims
     uint32_t out_W;
     uint32_t input_offset_row;   // global input row offset
     uint32_t output_offset_row;  // global output row offset
+    uint32_t input_offset_col;   // column tiles: plane column of data column 0
+    uint32_t output_offset_col;  // and output column of output column 0
+    int threads;                 // OpenMP team size, 0 = runtime default
+    const ConvQuant* quant;      // non-NULL selects conv_quant
+    uint32_t N, C, K;            // images, input channels, kernels (1, or 0, for a matrix)
+    const ConvChain* chain;      // stages run on this one's output; out_H/out_W are the last stage's
+    BoundaryMode boundary;       // edge handling of every stage
+    uint32_t plane_H;            // rows of a whole input plane; padded modes map edge rows with it
+    const ConvTaps* taps;        // non-NULL runs conv_openmp over these taps only
+    const float* box;            // non-NULL: kernel plane k*C + c is the constant box[k*C + c], run as window sums
+    const OccupancyIndex* occupancy;    // zero tiles of the source; conv_openmp skips their outputs
+    uint32_t image;              // image of the chunk, placing its planes in the source
+    int gathered;                // data holds just the kH rows of each output row, back to back
+    const ConvThreadState* thread_state;    // per-thread kernel copies; NULL reads kernel directly
 } ConvParams;
 
 void conv_openmp(ConvParams *params);
-void conv_mpi(ConvParams *params, MPI_Comm comm, const char *input_path, const char *output_path, size_t budget_bytes);
+void conv_quant(ConvParams *params);
+// Return 0, or 1 if a fused chain could not allocate its scratch rows.
+int conv_compute(ConvParams *params);
+int conv_chain(ConvParams *params);
+// Fewest final rows a chain block (and a band of a chained chunk) spans.
+uint32_t conv_chain_min_block(const ConvParams* params);
+// Keeps the taps of planes kH x kW kernel planes with |weight| > threshold.
+int compile_kernel_taps(const float* kernel, uint32_t planes, uint32_t kH, uint32_t kW, float threshold,
+                        ConvTaps* taps);
+void free_kernel_taps(ConvTaps* taps);
+// Constant kernels of at least this many taps run as window sums
+#define CONV_BOX_MIN_TAPS 25
+// 1 with weight[p] set if every kernel plane p is constant, else 0.
+int compile_kernel_box(const float* kernel, uint32_t planes, uint32_t kH, uint32_t kW, float* weight);
+// Per-thread kernel copies for conv_openmp runs of params; NULL when its
+// engine does not copy the kernel.
+ConvThreadState* conv_thread_state_create(const ConvParams* params);
+void conv_thread_state_free(ConvThreadState* state);
+// Quantizes to the full int16 range; *wide is set when window sums of in_dtype
+// input need int64 accumulation.
+int quantize_kernel(const float* kernel, uint32_t kH, uint32_t kW, uint32_t in_dtype, int16_t* qkernel, float* scale,
+                    int* wide);
+void conv_mpi(ConvParams *params, MPI_Comm comm, MatrixSource *src, const char *output_path, const ConvRunOptions *opts);
+int conv_local(ConvParams *params, MatrixSource *src, const char *output_path, const ConvRunOptions *opts);
+int conv_txt_stream(ConvParams *params, const char *txt_path, const char *output_path, const ConvRunOptions *opts);
+// output_path "-" writes to stdout
+int conv_pipe(ConvParams *params, RowStream *in, const char *output_path, const ConvRunOptions *opts);
 
 float* alloc_aligned(size_t n);
 void calc_output_dims(ConvParams* params);
+
+// Tensors are stored as stacked planes: input plane (n, c) is source rows
+// [(n*C + c)*H, +H) and output plane (n, k) rows [(n*K + k)*out_H, +out_H).
+// Pipelines walk the N*out_H output rows of all images, never letting a
+// chunk cross from one image into the next.
+uint32_t calc_chunk_end(uint32_t row, uint32_t chunk_rows, uint32_t row_end, uint32_t out_H);
+uint32_t count_chunks(uint32_t row_start, uint32_t row_end, uint32_t chunk_rows, uint32_t out_H);
+// Starts reading the C planes of input rows [row_start, +rows) of image n
+// into dst, back to back; reqs holds 2*C requests, as a circular range that
+// runs past the last row continues at row 0.
+int start_input_planes(MatrixSource* src, const ConvParams* params, uint32_t image,
+                       uint32_t row_start, uint32_t rows, void* dst, MPI_Request* reqs);
+int wait_input_planes(MatrixSource* src, uint32_t C, MPI_Request* reqs);
+// With a row stride past the kernel height the windows of consecutive output
+// rows leave rows unread; zero-padded and VALID single convolutions then load
+// just the kH rows of each output row (see ConvParams.gathered).
+int gather_input_rows(const ConvParams* params);
+// Starts reading the kH window rows of output rows [out_row_start, +out_rows)
+// of image n, plane after plane, into dst; rows in the zero padding read as
+// zeros. Takes the 2*C requests of start_input_planes.
+int start_input_gather(MatrixSource* src, const ConvParams* params, uint32_t image,
+                       uint32_t out_row_start, uint32_t out_rows, void* dst, MPI_Request* reqs);
+// Rows of an H-row plane read by the windows of output rows [out_row_start,
+// out_row_end). Padded modes widen the range to the edge rows their halo
+// maps to; with CIRCULAR it is taken modulo H and may run past the end.
+void calc_window_rows(uint32_t out_row_start, uint32_t out_row_end, uint32_t sH, uint32_t kH,
+                      uint32_t H, BoundaryMode mode, uint32_t* input_row_start, uint32_t* num_input_rows);
 void calc_input_rows_for_output_range_clamped(uint32_t out_row_start,
                                               uint32_t out_row_end,
                                               uint32_t sH,
@@ -34,12 +144,57 @@ void calc_input_rows_for_output_range_clamped(uint32_t out_row_start,
                                               uint32_t max_input_H,
                                               uint32_t* input_row_start,
                                               uint32_t* num_input_rows);
+// Chain-aware row mapping for the full input (params->H is the plane
+// height), and the receptive field and stride of the whole chain in input
+// rows for chunk sizing. Without a chain these are the kernel's own.
+void calc_input_rows(const ConvParams* params, uint32_t out_row_start, uint32_t out_row_end,
+                     uint32_t* input_row_start, uint32_t* num_input_rows);
+void calc_row_span(const ConvParams* params, uint32_t* kH, uint32_t* sH);
 uint32_t calc_chunk_size(uint32_t W,
                          uint32_t out_W,
                          uint32_t kH,
                          uint32_t kW,
                          uint32_t sH,
                          size_t budget_bytes);
+// calc_chunk_size still gives one row when even that overflows the budget;
+// runners that cannot tile such rows warn so, with why, unless it is NULL.
+void check_row_budget(uint32_t W, uint32_t out_W, uint32_t kH, uint32_t kW, uint32_t sH, size_t budget_bytes,
+                      const char* why);
+// What keeps the rows of a run whole, or NULL when column tiles apply.
+const char* whole_row_reason(const ConvParams* params, int text_output);
+// Rows too wide for the budget are convolved in column tiles, whose windows
+// read (cols - 1) * sW + kW input columns; zero-padded and VALID single
+// convolutions only.
+int tile_columns(const ConvParams* params);
+// The most output columns of a tile one output row of which fits
+// budget_bytes, with in_bytes per input column (all planes) and out_bytes per
+// output column; out_W when whole rows fit.
+uint32_t calc_tile_cols(uint32_t out_W, size_t in_bytes, size_t out_bytes, uint32_t kH, uint32_t kW,
+                        uint32_t sH, uint32_t sW, size_t budget_bytes);
+// Narrow or pitched storage: chunks keep their input rows and packed output
+// rows as stored, and are convolved a band of output rows at a time through
+// fp32 scratch.
+typedef struct {
+    float* input;       // C planes of in_rows rows
+    float* output;      // K planes of rows rows
+    uint32_t rows;      // output rows per band
+    uint32_t in_rows;   // input rows per plane the windows of a band read, at most
+} ConvBand;
+// fp32 band scratch per compute thread
+#define CONV_BAND_THREAD_BYTES (1u << 20)
+// Sizes the bands of W input and out_W output columns for params (whole
+// plane dims) within budget_bytes; returns the scratch bytes they take.
+size_t conv_band_size(const ConvParams* params, uint32_t W, uint32_t out_W, size_t budget_bytes, ConvBand* band);
+// Runs chunk band by band: its data holds rows of in_dtype (int16 as loaded
+// for a quantized engine) and its output receives K planes of out_H rows of
+// out_dtype, row_pitch bytes apart.
+int conv_compute_bands(const ConvParams* chunk, uint32_t in_dtype, uint32_t out_dtype, size_t row_pitch,
+                       const ConvBand* band);
+// Starts reading input columns [col_start, +cols) of the C planes of rows
+// [row_start, +rows) of image n into dst, plane after plane, as rows of cols
+// elements. Takes the 2*C requests of start_input_planes.
+int start_input_tile(MatrixSource* src, const ConvParams* params, uint32_t image, uint32_t row_start, uint32_t rows,
+                     uint32_t col_start, uint32_t cols, void* dst, MPI_Request* reqs);
 ConvParams* init_conv_params(const char* input_file,
                              const char* kernel_file,
                              uint32_t sH,
@@ -0,0 +1,26 @@
+#ifndef CONV_OPTIONS_H
+#define CONV_OPTIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dtype.h"
+#include "arena.h"
+
+// Settings shared by the out-of-core pipelines that do not change the
+// convolution itself: memory budget and how the output is stored.
+typedef struct {
+    size_t budget_bytes;
+    int text_output;        // text matrix instead of .bin
+    uint32_t out_dtype;     // MatrixDType of .bin output, ignored for text
+    uint32_t bin_version;   // .bin header version: 1, 2 for aligned rows, 3 for 64-bit dims
+    size_t row_pitch;       // v2/v3 bytes between output rows, 0 = narrowest aligned
+    int checkpoint;         // 1 journals completed .bin rows (see journal.h), 2 also resumes from them
+    uint32_t tile_cols;     // output columns per column tile, 0 = only when a row exceeds the budget
+    int io_thread;          // conv_mpi runs its file I/O on a helper thread (needs MPI_THREAD_MULTIPLE)
+    int collective_io;      // conv_mpi deals chunks in rounds and reads and writes them collectively
+    uint32_t cb_nodes;      // collective I/O aggregators, 0 = library default
+    uint32_t striping_unit; // bytes file domains align to, 0 = CONV_STRIPING_UNIT_DEFAULT (see conv_mpi.c)
+    BufferArena* arena;     // chunk buffers kept across runs (batch mode), NULL = each run reserves its own
+} ConvRunOptions;
+
+#endif // CONV_OPTIONS_H
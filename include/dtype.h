@@ -0,0 +1,33 @@
+#ifndef DTYPE_H
+#define DTYPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Storage types of binary matrices. Computation is fp32 unless the quantized
+// engine is selected; narrower types are widened while a chunk is loaded and
+// narrowed while it is stored. The integer types are affine quantized:
+// real = scale * (q - zero_point).
+typedef enum {
+    DTYPE_F32 = 0,
+    DTYPE_F16 = 1,
+    DTYPE_BF16 = 2,
+    DTYPE_I8 = 3,
+    DTYPE_I16 = 4,
+} MatrixDType;
+
+size_t dtype_size(uint32_t dtype);
+const char* dtype_name(uint32_t dtype);
+int dtype_from_name(const char* name);
+int dtype_is_quantized(uint32_t dtype);
+
+void dtype_to_f32(uint32_t dtype, const void* src, float* dst, size_t n);
+void f32_to_dtype(uint32_t dtype, const float* src, void* dst, size_t n);
+
+// Integer storage. dequantize_to_i16 only removes the zero point (saturating),
+// which is what the quantized engine consumes.
+void dequantize_to_f32(uint32_t dtype, const void* src, float* dst, size_t n, float scale, int32_t zero_point);
+void dequantize_to_i16(uint32_t dtype, const void* src, int16_t* dst, size_t n, int32_t zero_point);
+void quantize_from_f32(uint32_t dtype, const float* src, void* dst, size_t n, float scale, int32_t zero_point);
+
+#endif // DTYPE_H
@@ -5,13 +5,84 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/types.h>
 #include "matrix.h"
+#include "dtype.h"
+
+// widest "%.3f" rendering of a finite float, sign included
+#define TXT_VALUE_MAX_CHARS 48
 
 typedef struct {
     uint32_t height;
     uint32_t width;
 } BinaryHeader;
 
+// Matrices stored in anything but fp32 start with a tagged header instead;
+// fp32 files keep the plain BinaryHeader so existing inputs stay readable.
+// Integer storage appends its quantization parameters to the tagged header.
+#define BIN_TYPED_MAGIC 0x54564e43u   // "CNVT"
+#define BIN_HEADER_MAX_BYTES 64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t dtype;
+    uint32_t height;
+    uint32_t width;
+} BinaryTypedHeader;
+
+typedef struct {
+    BinaryTypedHeader typed;
+    float scale;
+    int32_t zero_point;
+} BinaryQuantHeader;
+
+// Version 2 pads the header to BIN_V2_HEADER_BYTES and stores each row at a
+// row_pitch (a multiple of ALIGN_BYTES) so every row in the file starts
+// aligned. Pad bytes are zero.
+#define BIN_V2_MAGIC 0x32564e43u      // "CNV2"
+#define BIN_V2_HEADER_BYTES 4096
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dtype;
+    uint32_t height;
+    uint32_t width;
+    uint32_t reserved;
+    uint64_t row_pitch;
+    uint64_t data_offset;
+    float scale;
+    int32_t zero_point;
+} BinaryHeaderV2;
+
+// Version 3 is version 2 with 64-bit dimensions, for matrices past 2^32
+// elements. Readers still take at most UINT32_MAX rows and columns.
+#define BIN_V3_MAGIC 0x33564e43u      // "CNV3"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dtype;
+    uint32_t reserved;
+    uint64_t height;
+    uint64_t width;
+    uint64_t row_pitch;
+    uint64_t data_offset;
+    float scale;
+    int32_t zero_point;
+} BinaryHeaderV3;
+
+typedef struct {
+    uint32_t height;
+    uint32_t width;
+    uint32_t dtype;
+    size_t data_offset;
+    float scale;            // quantized dtypes only
+    int32_t zero_point;
+    uint32_t version;       // 0 or 1: packed rows, 2: aligned rows, 3: aligned rows and 64-bit dims
+    size_t row_pitch;       // bytes between row starts
+} BinaryLayout;
+
 typedef struct {
     uint32_t height;
     uint32_t width;
@@ -22,15 +93,81 @@ typedef struct {
     uint32_t height;
     uint32_t width;
     FILE* file;
+    uint32_t dtype;
+    size_t data_offset;
+    float scale;
+    int32_t zero_point;
+    size_t row_pitch;
+    size_t row_pos;         // elements of the current row already read
 } BinaryFile;
 
+typedef struct {
+    uint32_t height;
+    uint32_t width;
+    uint32_t next_row;
+    FILE* file;
+    char* text;             // raw lines of the batch being parsed
+    size_t text_capacity;
+    size_t* line_start;
+    uint32_t line_capacity;
+} TextFile;
+
+// Sequential row reader for inputs that cannot seek: pipes, FIFOs and stdin
+// ("-"). Text and .bin (any header version) are read front to back, one row
+// at a time, so nothing but the current row is buffered.
+typedef struct RowStream {
+    uint32_t height;
+    uint32_t width;
+    uint32_t next_row;
+    int text;
+    TextFile tf;
+    BinaryLayout layout;
+    FILE* file;
+    void* raw;              // one stored .bin row, row_pitch bytes
+} RowStream;
+
+ssize_t write_at_pos(int fd, const void* buffer, size_t bytes, off_t offset);
+
+int parse_bin_header(const void* raw, size_t bytes, BinaryLayout* layout);
+// Fills in data_offset and row_pitch (unless a v2 pitch is already set) and
+// writes the header; returns its size, which is less than data_offset for v2.
+size_t format_bin_header(void* raw, BinaryLayout* layout);
+size_t bin_aligned_pitch(uint32_t w, uint32_t dtype);
+// Bytes between the rows of a new .bin: packed for v1, else row_pitch or,
+// when 0, the narrowest aligned pitch.
+size_t bin_row_pitch(uint32_t version, uint32_t w, uint32_t dtype, size_t row_pitch);
+
 FILE* create_bin_matrix(char* filepath,  uint32_t h, uint32_t w);
+FILE* create_bin_matrix_typed(char* filepath, uint32_t h, uint32_t w, uint32_t dtype);
+FILE* create_bin_matrix_layout(char* filepath, BinaryLayout* layout);
 BinaryFile open_bin_matrix_input(char* filepath);
+int read_bin_elems(BinaryFile* bf, void* dst, size_t count);
+int read_bin_f32(BinaryFile* bf, float* dst, size_t count);
+// Narrows (or copies) rows of fp32 into dtype at row_pitch, zeroing the pad.
+void pack_bin_rows(const float* src, uint32_t rows, uint32_t w, uint32_t dtype, size_t row_pitch, void* dst);
+// Rewrites a .bin in the given header version; row_pitch 0 picks the
+// narrowest aligned pitch for v2. Returns 0 on success.
+int convert_bin_version(char* src_fp, char* dst_fp, uint32_t version, size_t row_pitch);
+
+TextFile open_txt_matrix_input(char* filepath);
+int read_txt_rows(TextFile* tf, float* dst, uint32_t rows);
+void close_txt_matrix_input(TextFile* tf);
+
+int open_row_stream(const char* path, int text, RowStream* rs);
+int read_stream_row(RowStream* rs, float* dst);
+void close_row_stream(RowStream* rs);
 
 void apply_padding_bin(char* src_fp,char* dst_fp, MatrixPadding* padding, size_t chunk_size);
 void apply_imap_bin(char* padded_bin_fp, char* im2col_bin_fp, uint32_t kH, uint32_t kW, uint32_t sH, uint32_t sW, MatrixPadding* padding, size_t chunk_size);
 
 void convert_txt_to_bin(char* txt_fp, char* bin_fp, size_t chunk_size);
 void convert_bin_to_txt(char* bin_fp, char* txt_fp, size_t chunk_size);
+// Two passes: a range scan picks scale/zero point (asymmetric for i8,
+// symmetric for i16), then the rows are quantized. Returns 0 on success.
+int quantize_bin_matrix(char* src_fp, char* dst_fp, uint32_t dtype);
+
+size_t format_txt_header(char* text, size_t capacity, uint32_t h, uint32_t w);
+size_t txt_rows_capacity(uint32_t rows, uint32_t w);
+size_t format_txt_rows(const float* data, uint32_t rows, uint32_t w, int ends_matrix, char* text);
 
 #endif // FILE_H
@@ -2,5 +2,13 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <time.h>
+#include <mpi.h>
 
-void generate_matrix_bin(char* bin_fp, uint32_t h, uint32_t w, uint32_t seed);
\ No newline at end of file
+// Element (i, j) is a pure function of (seed, i, j), so any row range can be
+// produced independently and the bytes do not depend on thread or rank count.
+float generate_value(uint64_t key, uint32_t i, uint32_t j);
+uint64_t generate_key(uint32_t seed);
+void generate_rows(uint32_t seed, uint32_t row_start, uint32_t rows, uint32_t w, float* dst);
+
+void generate_matrix_bin(char* bin_fp, uint32_t h, uint32_t w, uint32_t seed);
+void generate_matrix_bin_mpi(char* bin_fp, uint32_t h, uint32_t w, uint32_t seed, MPI_Comm comm);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <limits.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <mpi.h>
 
@@ -25,3 +27,29 @@ int mpi_write_subarray_f32(const char* filepath,
                            MPI_Comm comm);
 
 
+
+// MPI-IO with size_t element counts. Before MPI-4 the count of a call is an
+// int; past MPI_IO_COUNT_MAX elements the buffer is described by one derived
+// type of MPI_IO_COUNT_MAX-element blocks plus a tail, released as soon as the
+// call is started. MPI-4 libraries take the large-count (_c) calls instead.
+// Return the MPI error code.
+#ifndef MPI_IO_COUNT_MAX
+#define MPI_IO_COUNT_MAX INT_MAX
+#endif
+
+int mpi_file_read_at_big(MPI_File fh, MPI_Offset offset, void* buf, size_t count, MPI_Datatype type,
+                         MPI_Status* status);
+int mpi_file_iread_at_big(MPI_File fh, MPI_Offset offset, void* buf, size_t count, MPI_Datatype type,
+                          MPI_Request* req);
+int mpi_file_write_at_big(MPI_File fh, MPI_Offset offset, const void* buf, size_t count, MPI_Datatype type,
+                          MPI_Status* status);
+int mpi_file_iwrite_at_big(MPI_File fh, MPI_Offset offset, const void* buf, size_t count, MPI_Datatype type,
+                           MPI_Request* req);
+// Collective forms: every rank of the file's group makes the same calls in
+// the same order, with count 0 for nothing. Libraries older than MPI-3.1
+// have no nonblocking collective I/O; there the call completes before it
+// returns and *req is MPI_REQUEST_NULL.
+int mpi_file_iread_at_all_big(MPI_File fh, MPI_Offset offset, void* buf, size_t count, MPI_Datatype type,
+                              MPI_Request* req);
+int mpi_file_iwrite_at_all_big(MPI_File fh, MPI_Offset offset, const void* buf, size_t count, MPI_Datatype type,
+                               MPI_Request* req);
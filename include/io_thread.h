@@ -0,0 +1,39 @@
+#ifndef IO_THREAD_H
+#define IO_THREAD_H
+
+#include <pthread.h>
+
+// A helper thread that runs the file I/O of a rank. Jobs are queued by the
+// compute thread and run one after another in order; a job starts its reads
+// or writes and waits for them, so the progress MPI-IO makes inside the wait
+// happens while the OpenMP team computes. Jobs calling MPI need
+// MPI_THREAD_MULTIPLE.
+typedef struct IoJob {
+    int (*run)(void* arg);      // 0 on success
+    void* arg;
+    int queued;                 // submitted and not waited for yet
+    int done;
+    int rc;
+    double seconds;             // time run took on the helper
+    struct IoJob* next;
+} IoJob;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        // jobs queued, a job done or stop
+    IoJob* head;
+    IoJob* tail;
+    int stop;
+} IoThread;
+
+int io_thread_start(IoThread* io);
+// Queues run(arg) as job, which must stay alive until io_thread_wait.
+void io_thread_submit(IoThread* io, IoJob* job, int (*run)(void*), void* arg);
+// Blocks until job has run and returns its rc; 0 at once for a job that is
+// not queued.
+int io_thread_wait(IoThread* io, IoJob* job);
+// Runs the jobs still queued, then joins the thread.
+void io_thread_stop(IoThread* io);
+
+#endif // IO_THREAD_H
@@ -0,0 +1,32 @@
+#ifndef ISA_H
+#define ISA_H
+
+// The hot kernels (conv_openmp, conv_quant and the dtype conversions) are
+// built once per x86-64 ISA level next to the baseline build, which every
+// x86-64 node runs; the first call picks the highest level the CPU has.
+// CONV_ISA=generic|sse4.2|avx2|avx512 caps the choice.
+//
+// A kernel file built as a variant has CONV_ISA_SUFFIX set to the level
+// (sse42, avx2, avx512) and defines its dispatched entry points under
+// ISA_VARIANT(name); the rest of the file belongs to the baseline build only.
+typedef enum {
+    ISA_GENERIC = 0,
+    ISA_SSE42,
+    ISA_AVX2,
+    ISA_AVX512,
+    ISA_LEVELS
+} IsaLevel;
+
+#define ISA_CAT_(a, b) a##_##b
+#define ISA_CAT(a, b) ISA_CAT_(a, b)
+#ifdef CONV_ISA_SUFFIX
+#define ISA_VARIANT(name) ISA_CAT(name, CONV_ISA_SUFFIX)
+#else
+#define ISA_VARIANT(name) ISA_CAT(name, generic)
+#endif
+
+// Level the kernels run at, resolved once per process (thread-safe).
+IsaLevel isa_level(void);
+const char* isa_name(IsaLevel level);
+
+#endif // ISA_H
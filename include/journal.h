@@ -0,0 +1,53 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Completion journal of a checkpointed run, one file per rank:
+//
+//   "<output>.journal.<rank>" = JournalHeader | JournalRecord ...
+//
+// A record names output rows (over the N * out_H rows of all images) and is
+// appended only once they are durably in the output file. The header ties
+// the journal to one output shape; ranks is the rank count of the run that
+// wrote it.
+#define JOURNAL_MAGIC 0x4a564e43u   // "CNVJ"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t ranks;
+    uint32_t total_rows;
+    uint32_t K;
+    uint32_t out_W;
+    uint32_t out_dtype;
+    uint32_t bin_version;
+    uint32_t reserved;
+    uint64_t out_bytes;     // size of the finished output file
+} JournalHeader;
+
+typedef struct {
+    uint32_t row_start;
+    uint32_t row_end;
+} JournalRecord;
+
+typedef struct {
+    int fd;
+    int data_fd;            // the output file, synced before each record
+} RowJournal;
+
+// Writes a fresh journal for rank holding the carried records and leaves it
+// open for appending; it replaces any old journal of that rank atomically.
+int journal_open(RowJournal* journal, const char* output_path, int rank, const JournalHeader* header,
+                 const JournalRecord* carried, uint32_t carried_count);
+// Syncs the output file, then appends and syncs the record of rows
+// [row_start, row_end).
+int journal_commit(RowJournal* journal, uint32_t row_start, uint32_t row_end);
+void journal_close(RowJournal* journal);
+// Completed rows recorded by every journal of output_path, merged into
+// sorted disjoint ranges. Returns -1 if a journal does not match header.
+int journal_load(const char* output_path, const JournalHeader* header, JournalRecord** ranges, uint32_t* count);
+// Removes the journals of ranks first and up.
+void journal_remove(const char* output_path, int first);
+
+#endif // JOURNAL_H
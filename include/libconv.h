@@ -0,0 +1,115 @@
+#ifndef LIBCONV_H
+#define LIBCONV_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mpi.h>
+#include "matrix.h"
+#include "source.h"
+#include "conv_options.h"
+
+typedef struct RowStream RowStream;
+
+// Plan-based entry point for callers that hold matrices in memory. A plan
+// fixes the input shape, kernel, stride and thread count once; the kernel
+// copy, engine choice and any scratch buffers live with the plan and are
+// reused by every execute call.
+typedef struct ConvPlan ConvPlan;
+
+ConvPlan* conv_plan_create(uint32_t H, uint32_t W,
+                           const float* kernel, uint32_t kH, uint32_t kW,
+                           uint32_t sH, uint32_t sW,
+                           int threads);
+// Batched multi-channel plan: input is N x C x H x W, kernel K x C x kH x kW
+// and output N x K x out_H x out_W, all dense row-major. Every output plane
+// sums its kernel's C channels; conv_plan_create is the N = C = K = 1 case.
+ConvPlan* conv_plan_create_tensor(uint32_t N, uint32_t C, uint32_t H, uint32_t W,
+                                  const float* kernel, uint32_t K, uint32_t kH, uint32_t kW,
+                                  uint32_t sH, uint32_t sW,
+                                  int threads);
+void conv_plan_destroy(ConvPlan* plan);
+
+// Appends a stage run on the output of the stages before it, with zero
+// padding at every stage's borders as if each ran on its own. All stages
+// are fused into one pass over row chunks: each chunk is read with the halo
+// of the whole chain and only the last stage's rows are written. Output
+// dims become the last stage's. Single-channel fp32 plans only.
+int conv_plan_add_stage(ConvPlan* plan, const float* kernel, uint32_t kH, uint32_t kW,
+                        uint32_t sH, uint32_t sW);
+
+// Points the plan at inputs of H x W planes. The kernel copy, engine and
+// scratch buffers are kept, so one plan serves a batch of differently sized
+// matrices.
+int conv_plan_reshape(ConvPlan* plan, uint32_t H, uint32_t W);
+
+// Edge handling (see BoundaryMode); zero padding by default. VALID shrinks
+// the output to the windows that fit and runs every window on the interior
+// path. Padded modes are read from the chunk the rows are loaded into, no
+// padded copy of the input is made. Quantized plans take ZERO or VALID and
+// fused chains anything but CIRCULAR; streaming text and pipe input cannot
+// wrap around and reject CIRCULAR.
+int conv_plan_set_boundary(ConvPlan* plan, BoundaryMode mode);
+
+// Compiles the kernel into its taps with |weight| > threshold; 0 keeps every
+// non-zero tap and gives the same results as the dense path, a larger value
+// trades accuracy for speed. The fp32 engine then visits only those taps,
+// one at a time across whole output rows. kept/total may be NULL. Fused
+// stages and the integer engine keep using their dense kernels.
+int conv_plan_compile_taps(ConvPlan* plan, float threshold, uint32_t* kept, uint32_t* total);
+
+// Constant kernels (box and mean filters) of 25 taps or more run on window
+// sums by default: column sums carried down each chunk and prefix sums along
+// its rows, kept in double, so the cost per output does not grow with the
+// kernel. Results differ from the dense path only by its fp32 rounding.
+// enable = 0 keeps the dense path, 1 takes window sums for any constant
+// kernel and < 0 restores the default. Returns 1 if the plan runs window
+// sums; compiled taps take precedence.
+int conv_plan_set_box(ConvPlan* plan, int enable);
+
+void conv_plan_output_dims(const ConvPlan* plan, uint32_t* out_H, uint32_t* out_W);
+void conv_plan_tensor_dims(const ConvPlan* plan, uint32_t* N, uint32_t* C, uint32_t* K);
+
+// input is H x W and output out_H x out_W, both row-major (stacked planes for
+// a tensor plan). Neither needs MPI.
+int conv_plan_execute(ConvPlan* plan, const float* input, float* output);
+
+// Output rows are split across comm. input and output are only read/written
+// on root; every rank receives just the input rows (halo included) it needs.
+int conv_plan_execute_mpi(ConvPlan* plan, MPI_Comm comm, int root, const float* input, float* output);
+
+// Out-of-core runs: rows come from src and go to a .bin or text file. A comm
+// with more than one rank uses the MPI pipeline, otherwise the local one.
+// Tensor plans read src as N*C*H stacked rows and write N*K*out_H rows; text
+// output is limited to K = 1. opts->checkpoint runs the MPI pipeline even on
+// one rank, journaling output rows as their writes complete; 2 resumes from
+// the journals of an earlier run of the same output, on any rank count.
+int conv_plan_run(ConvPlan* plan, MPI_Comm comm, MatrixSource* src,
+                  const char* output_path, const ConvRunOptions* opts);
+int conv_plan_run_txt(ConvPlan* plan, const char* txt_path,
+                      const char* output_path, const ConvRunOptions* opts);
+// Reads in front to back (see open_row_stream) holding only a ring of kH
+// input rows, and writes each output row, to a file, FIFO or stdout ("-"),
+// as soon as its window is complete. Local, single-channel fp32 plans only.
+int conv_plan_run_pipe(ConvPlan* plan, RowStream* in,
+                       const char* output_path, const ConvRunOptions* opts);
+
+// Switches conv_plan_run to the integer engine for sources stored as in_dtype
+// (DTYPE_I8 or DTYPE_I16); single-channel plans only. The kernel is quantized here to 16 bits; window
+// sums stay in int32 while they cannot overflow it and use int64 otherwise. In-memory execute calls
+// keep using the fp32 engine.
+int conv_plan_quantize(ConvPlan* plan, uint32_t in_dtype);
+
+typedef struct {
+    uint32_t rows;          // output rows compared
+    double max_abs_err;
+    double rms_err;
+    double ref_rms;         // rms of the fp32 result
+    double snr_db;
+} ConvQuantReport;
+
+// Compares the integer engine on quant_src against the fp32 engine on ref
+// over up to sample_rows evenly spaced output rows. Local, no MPI.
+int conv_plan_quant_report(ConvPlan* plan, MatrixSource* ref, MatrixSource* quant_src,
+                           uint32_t sample_rows, ConvQuantReport* report);
+
+#endif // LIBCONV_H
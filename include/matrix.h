@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#define ALIGN_BYTES 64
+
 typedef struct {
     uint32_t height;
     uint32_t width;
@@ -17,11 +19,52 @@ typedef struct {
     uint16_t pad_w_a;
 } MatrixPadding;
 
+// How windows read past the matrix edge. ZERO, REFLECT (edge not repeated),
+// REPLICATE and CIRCULAR keep one output per stride step; VALID only keeps
+// outputs whose window lies fully inside the matrix.
+typedef enum {
+    BOUNDARY_ZERO = 0,
+    BOUNDARY_REFLECT,
+    BOUNDARY_REPLICATE,
+    BOUNDARY_CIRCULAR,
+    BOUNDARY_VALID,
+} BoundaryMode;
+
 MatrixPadding dim_to_padding(uint32_t kH, uint32_t kW);
 
-int calc_output_height(int H, int kH, int sH);
-int calc_output_width(int W, int kW, int sW);
-int calc_steps_total(int H, int W, int kH, int kW, int sH, int sW);
+const char* boundary_name(BoundaryMode mode);
+int boundary_from_name(const char* name);
+
+// Offset of a window's first row (column) from its output position times the
+// stride: the kernel is centred, except in VALID mode.
+static inline int calc_window_origin(uint32_t k, BoundaryMode mode) {
+    return mode == BOUNDARY_VALID ? 0 : (int)(k - 1) / 2;
+}
+
+// Index in [0, n) that position i of an axis reads, or -1 for a zero.
+static inline int boundary_index(int i, int n, BoundaryMode mode) {
+    if (i >= 0 && i < n) return i;
+    switch (mode) {
+        case BOUNDARY_REPLICATE:
+            return i < 0 ? 0 : n - 1;
+        case BOUNDARY_CIRCULAR:
+            i %= n;
+            return i < 0 ? i + n : i;
+        case BOUNDARY_REFLECT: {
+            if (n == 1) return 0;
+            int period = 2 * n - 2;
+            i %= period;
+            if (i < 0) i += period;
+            return i < n ? i : period - i;
+        }
+        default:
+            return -1;
+    }
+}
+
+int calc_output_height(int H, int kH, int sH, BoundaryMode mode);
+int calc_output_width(int W, int kW, int sW, BoundaryMode mode);
+int64_t calc_steps_total(int H, int W, int kH, int kW, int sH, int sW);
 int calc_steps_dim(int X, int kX, int sX);
 
 #endif
@@ -0,0 +1,57 @@
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "source.h"
+
+// Block-occupancy index of a matrix file, kept next to it as "<file>.occ":
+//
+//   OccupancyHeader | bitmap of tiles_y x tiles_x bits, row-major
+//
+// A set bit marks a tile_rows x tile_cols tile holding a non-zero element
+// (after dequantization). Sources that carry an index fill all-zero tile
+// rows without reading them, and conv_openmp writes zeros for output tiles
+// whose whole input footprint is unset. The header records the size, inode
+// and modification time (to the nanosecond) of the file it was built from; an
+// index whose file no longer matches them is stale and ignored.
+#define OCC_MAGIC 0x324f4e43u   // "CNO2"
+#define OCC_DEFAULT_TILE_ROWS 16
+#define OCC_DEFAULT_TILE_COLS 64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t height;
+    uint32_t width;
+    uint32_t tile_rows;
+    uint32_t tile_cols;
+    uint32_t tiles_y;
+    uint32_t tiles_x;
+    uint32_t occupied;      // tiles with a set bit
+    uint32_t data_mtime_nsec;
+    int64_t data_mtime_sec;
+    uint64_t data_size;
+    uint64_t data_inode;
+} OccupancyHeader;
+
+struct OccupancyIndex {
+    OccupancyHeader header;
+    uint8_t* bits;
+    uint8_t* row_occupied;  // per tile row: any bit set
+};
+
+// Scans every row of src, the matrix at path, once and writes its index to
+// "<path>.occ". Returns 0 on success.
+int build_occupancy_index(MatrixSource* src, const char* path, uint32_t tile_rows, uint32_t tile_cols);
+// The index of the matrix at path if "<path>.occ" exists, matches h x w and
+// is up to date; NULL otherwise.
+OccupancyIndex* load_occupancy_index(const char* path, uint32_t h, uint32_t w);
+void free_occupancy_index(OccupancyIndex* occ);
+
+// 1 if no tile overlapping rows [row0, row1) x columns [col0, col1) is set.
+int occupancy_zero(const OccupancyIndex* occ, uint32_t row0, uint32_t row1, uint32_t col0, uint32_t col1);
+// End of the run of rows from row (before end) whose tile rows are all
+// empty, or all not; *zero tells which.
+uint32_t occupancy_row_run(const OccupancyIndex* occ, uint32_t row, uint32_t end, int* zero);
+
+#endif // OCCUPANCY_H
@@ -0,0 +1,89 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mpi.h>
+
+typedef struct MatrixSource MatrixSource;
+typedef struct OccupancyIndex OccupancyIndex;
+
+// Row provider for the convolution pipelines. start_rows may complete
+// asynchronously (MPI-IO) and hand back a request for source_wait_rows;
+// synchronous sources finish the read and return MPI_REQUEST_NULL. Sources
+// whose rows already live in memory also implement peek_rows so callers can
+// convolve straight out of them without a copy. Rows arrive as fp32, as
+// zero-point-free int16 when load_dtype is DTYPE_I16 (quantized engine, integer
+// storage only), or as stored when load_dtype is the storage type (f16 and
+// bf16 chunks, widened band by band); sources convert before the read completes, and those that
+// defer that to wait_rows implement it. start_gather, if present, reads a list
+// of rows in one request (see source_start_gather); start_cols, if present,
+// reads a column strip of rows (see source_start_cols). Sources opened on a
+// communicator may offer collective reads over it (see source_collective).
+typedef struct {
+    int (*start_rows)(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req);
+    const float* (*peek_rows)(MatrixSource* src, uint32_t row_start, uint32_t rows);
+    void (*close)(MatrixSource* src);
+    int (*wait_rows)(MatrixSource* src, MPI_Request* req);
+    int (*start_gather)(MatrixSource* src, const uint32_t* rows, uint32_t count, void* dst, MPI_Request* req);
+    int (*start_cols)(MatrixSource* src, uint32_t row_start, uint32_t rows, uint32_t col_start, uint32_t cols,
+                      void* dst, MPI_Request* req);
+    int (*collective)(MatrixSource* src, MPI_Comm comm, MPI_Info hints);
+    int (*start_rows_all)(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req);
+} MatrixSourceOps;
+
+// stands in for a row of zeros in a gather list
+#define SOURCE_ZERO_ROW UINT32_MAX
+
+struct MatrixSource {
+    const MatrixSourceOps* ops;
+    const char* kind;
+    uint32_t height;
+    uint32_t width;
+    uint32_t dtype;     // storage type of the rows, MatrixDType
+    uint32_t load_dtype;    // DTYPE_F32, DTYPE_I16 or dtype, what reads deliver
+    float scale;            // quantization of integer storage
+    int32_t zero_point;
+    uint64_t bytes_stored;  // compressed sources: bytes fetched from storage
+    uint64_t bytes_raw;     // and their decoded size
+    OccupancyIndex* occupancy;  // optional zero-tile index, owned (see occupancy.h)
+    uint64_t rows_skipped;  // rows the index let reads fill with zeros
+    void* scratch;          // conversion staging, grown by reads and kept until close
+    size_t scratch_bytes;
+    void* state;
+};
+
+MatrixSource* source_open_file(const char* path);
+MatrixSource* source_open_mmap(const char* path);
+MatrixSource* source_open_memory(const float* data, uint32_t h, uint32_t w);
+MatrixSource* source_open_synthetic(uint32_t h, uint32_t w, uint32_t seed);
+MatrixSource* source_open_mpi(const char* path, MPI_Comm comm);
+MatrixSource* source_open_compressed(const char* path);
+
+int source_start_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req);
+int source_wait_rows(MatrixSource* src, MPI_Request* req);
+int source_read_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst);
+// Reads rows[0..count) (ascending, apart from SOURCE_ZERO_ROW entries) into
+// dst back to back. Without a start_gather op each run of adjacent rows is
+// read on its own and all but the last complete before this returns.
+int source_start_gather(MatrixSource* src, const uint32_t* rows, uint32_t count, void* dst, MPI_Request* req);
+// Reads columns [col_start, +cols) of rows [row_start, +rows) into dst as
+// rows of cols elements. Without a start_cols op whole rows pass through a
+// scratch buffer of at most SOURCE_STRIP_SCRATCH_BYTES (or one row).
+#define SOURCE_STRIP_SCRATCH_BYTES ((size_t)8 << 20)
+int source_start_cols(MatrixSource* src, uint32_t row_start, uint32_t rows, uint32_t col_start, uint32_t cols,
+                      void* dst, MPI_Request* req);
+// Prepares collective reads over comm, which must span the ranks the source
+// was opened on: applies hints and sets the byte file view every
+// source_start_rows_all call then reads through. Collective over comm;
+// returns -1 where the source has no collective reads, including sources
+// with an occupancy index, whose reads differ per rank.
+int source_collective(MatrixSource* src, MPI_Comm comm, MPI_Info hints);
+// source_start_rows as a collective: every rank of comm makes the same calls
+// in the same order, with rows 0 for nothing.
+int source_start_rows_all(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req);
+size_t source_load_size(const MatrixSource* src);
+const float* source_peek_rows(MatrixSource* src, uint32_t row_start, uint32_t rows);
+void source_close(MatrixSource* src);
+
+#endif // SOURCE_H
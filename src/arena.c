@@ -0,0 +1,168 @@
+#define _DEFAULT_SOURCE     // MAP_ANONYMOUS, MAP_HUGETLB, madvise and syscall
+#include "arena.h"
+#include "matrix.h"
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+static const char* const page_names[] = {"heap", "base", "thp", "hugetlb"};
+
+// dTLB read misses of the calling thread in user space, -1 where the kernel
+// offers no such counter
+static int open_tlb_counter(void) {
+#if defined(__linux__) && defined(SYS_perf_event_open)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static char* reserve(size_t bytes, ArenaPages* pages) {
+    const char* env = getenv("CONV_HUGE_PAGES");
+    const int huge = !env || strcmp(env, "0") != 0;
+    void* p = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+    // only succeeds when the administrator reserved enough huge pages
+    if (huge) p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        *pages = ARENA_PAGES_HUGETLB;
+        return (char*)p;
+    }
+#endif
+    p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    *pages = ARENA_PAGES_BASE;
+#if defined(MADV_HUGEPAGE)
+    if (huge && madvise(p, bytes, MADV_HUGEPAGE) == 0) *pages = ARENA_PAGES_THP;
+#endif
+    return (char*)p;
+}
+
+void arena_init(BufferArena* arena, size_t bytes, int threads) {
+    memset(arena, 0, sizeof(*arena));
+    arena->pages = ARENA_PAGES_HEAP;
+    if (bytes) {
+        size_t size = (bytes + ARENA_HUGE_PAGE_BYTES - 1) / ARENA_HUGE_PAGE_BYTES * ARENA_HUGE_PAGE_BYTES;
+        arena->base = reserve(size, &arena->pages);
+        if (arena->base) arena->size = size;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    arena->minflt = usage.ru_minflt;
+    arena->majflt = usage.ru_majflt;
+
+    if (threads < 1) threads = 1;
+    arena->tlb_fds = (int*)malloc((size_t)threads * sizeof(int));
+    if (!arena->tlb_fds) return;
+    arena->tlb_count = threads;
+    for (int t = 0; t < threads; ++t) arena->tlb_fds[t] = -1;
+    // counters are per thread, so each member of the team opens its own
+    #pragma omp parallel num_threads(threads)
+    {
+        int t = omp_get_thread_num();
+        if (t < threads) arena->tlb_fds[t] = open_tlb_counter();
+    }
+}
+
+void* arena_alloc(BufferArena* arena, size_t bytes) {
+    if (!bytes) bytes = 1;
+    size_t at = (arena->used + ALIGN_BYTES - 1) & ~(size_t)(ALIGN_BYTES - 1);
+    if (arena->base && at + bytes <= arena->size) {
+        arena->used = at + bytes;
+        arena->buffers++;
+        return arena->base + at;
+    }
+
+    if (arena->heap_count == arena->heap_capacity) {
+        uint32_t capacity = arena->heap_capacity ? arena->heap_capacity * 2 : 8;
+        void** grown = (void**)realloc(arena->heap, capacity * sizeof(void*));
+        if (!grown) return NULL;
+        arena->heap = grown;
+        arena->heap_capacity = capacity;
+    }
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, ALIGN_BYTES, bytes) != 0) return NULL;
+    arena->heap[arena->heap_count++] = ptr;
+    return ptr;
+}
+
+void arena_report(const BufferArena* arena, const char* label) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    unsigned long long misses = 0;
+    int counted = 0;
+    for (int t = 0; t < arena->tlb_count; ++t) {
+        uint64_t value = 0;
+        if (arena->tlb_fds[t] != -1 && read(arena->tlb_fds[t], &value, sizeof(value)) == (ssize_t)sizeof(value)) {
+            misses += value;
+            counted = 1;
+        }
+    }
+    char tlb[32] = "n/a";
+    if (counted) snprintf(tlb, sizeof(tlb), "%llu", misses);
+
+    char runs[32] = "";
+    if (arena->runs) snprintf(runs, sizeof(runs), " runs=%u", arena->runs);
+    printf("[ARENA] %sreserved=%.1fMB pages=%s used=%.1fMB buffers=%u heap=%u minflt=%ld majflt=%ld dtlb_misses=%s%s\n",
+           label, arena->size / 1e6, page_names[arena->pages], arena->used / 1e6, arena->buffers,
+           arena->heap_count, usage.ru_minflt - arena->minflt, usage.ru_majflt - arena->majflt, tlb, runs);
+}
+
+BufferArena* arena_begin_run(BufferArena* shared, BufferArena* own, size_t bytes, int threads) {
+    if (!shared) {
+        arena_init(own, bytes, threads);
+        return own;
+    }
+    for (uint32_t i = 0; i < shared->heap_count; ++i) free(shared->heap[i]);
+    shared->heap_count = 0;
+    shared->used = 0;
+    shared->runs++;
+    size_t size = (bytes + ARENA_HUGE_PAGE_BYTES - 1) / ARENA_HUGE_PAGE_BYTES * ARENA_HUGE_PAGE_BYTES;
+    if (size > shared->size) {
+        if (shared->base) munmap(shared->base, shared->size);
+        shared->size = 0;
+        shared->pages = ARENA_PAGES_HEAP;
+        shared->base = reserve(size, &shared->pages);
+        if (shared->base) shared->size = size;
+    }
+    return shared;
+}
+
+void arena_end_run(BufferArena* arena, const char* label) {
+    if (arena->runs) return;
+    if (label) arena_report(arena, label);
+    arena_destroy(arena);
+}
+
+void arena_destroy(BufferArena* arena) {
+    if (arena->base) munmap(arena->base, arena->size);
+    for (uint32_t i = 0; i < arena->heap_count; ++i) free(arena->heap[i]);
+    for (int t = 0; t < arena->tlb_count; ++t) {
+        if (arena->tlb_fds[t] != -1) close(arena->tlb_fds[t]);
+    }
+    free(arena->heap);
+    free(arena->tlb_fds);
+    memset(arena, 0, sizeof(*arena));
+}
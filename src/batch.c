@@ -0,0 +1,335 @@
+#include "batch.h"
+#include "compress.h"
+#include "file.h"
+#include "occupancy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define BATCH_SPLIT_MB_DEFAULT 64.0
+#define BATCH_JOB_SPLIT -1      // owner of jobs run by every rank together
+#define BATCH_JOB_INVALID -2    // input could not be opened on rank 0
+
+typedef struct {
+    char input[256];
+    char output[256];
+    uint32_t height;        // stored rows and columns of the input
+    uint32_t width;
+    uint64_t bytes;         // fp32 size, the scheduling cost
+    int owner;
+} BatchJob;
+
+static int ends_with(const char* s, const char* suf) {
+    size_t n = strlen(s), m = strlen(suf);
+    return n>=m && strcmp(s+n-m, suf)==0;
+}
+
+MatrixSource* open_input_source(const char* in_path, uint32_t H, uint32_t W, int use_mpi, const char* kind) {
+    if (!in_path) return source_open_synthetic(H, W, 1234);
+    MatrixSource* src = NULL;
+    if (ends_with(in_path, ".cbin")) src = source_open_compressed(in_path);
+    else if (kind && strcmp(kind, "mmap") == 0) src = source_open_mmap(in_path);
+    else if (kind && strcmp(kind, "file") == 0) src = source_open_file(in_path);
+    else src = use_mpi ? source_open_mpi(in_path, MPI_COMM_WORLD) : source_open_file(in_path);
+    if (src) src->occupancy = load_occupancy_index(in_path, src->height, src->width);
+    return src;
+}
+
+static int probe_input(const char* path, uint32_t* h, uint32_t* w) {
+    if (ends_with(path, ".txt")) {
+        TextFile tf = open_txt_matrix_input((char*)path);
+        if (!tf.file) return -1;
+        *h = tf.height;
+        *w = tf.width;
+        close_txt_matrix_input(&tf);
+        return 0;
+    }
+    if (ends_with(path, ".cbin")) {
+        CompressedHeader ch;
+        if (read_compressed_header(path, &ch) != 0) return -1;
+        *h = ch.height;
+        *w = ch.width;
+        return 0;
+    }
+    BinaryFile bf = open_bin_matrix_input((char*)path);
+    if (!bf.file) return -1;
+    *h = bf.height;
+    *w = bf.width;
+    fclose(bf.file);
+    return 0;
+}
+
+static BatchJob* read_manifest(const char* path, uint32_t* count) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Failed to open manifest %s\n", path);
+        return NULL;
+    }
+
+    uint32_t capacity = 64, n = 0;
+    BatchJob* jobs = (BatchJob*)malloc(capacity * sizeof(BatchJob));
+    char line[1024];
+    unsigned line_no = 0;
+    while (jobs && fgets(line, sizeof(line), f)) {
+        line_no++;
+        char* p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+        if (n == capacity) {
+            capacity *= 2;
+            BatchJob* grown = (BatchJob*)realloc(jobs, capacity * sizeof(BatchJob));
+            if (!grown) {
+                free(jobs);
+                jobs = NULL;
+                break;
+            }
+            jobs = grown;
+        }
+        BatchJob* job = &jobs[n];
+        memset(job, 0, sizeof(*job));
+        char extra[2];
+        if (sscanf(p, "%255s %255s %1s", job->input, job->output, extra) != 2) {
+            fprintf(stderr, "%s:%u: expected \"input output\"\n", path, line_no);
+            free(jobs);
+            jobs = NULL;
+            break;
+        }
+        n++;
+    }
+    fclose(f);
+    *count = n;
+    return jobs;
+}
+
+// Splits the jobs above split_bytes across every rank and deals the rest
+// out whole, largest first, to whichever rank has the least work so far.
+static void schedule_jobs(BatchJob* jobs, uint32_t count, int world, uint64_t split_bytes) {
+    uint64_t* load = (uint64_t*)calloc((size_t)world, sizeof(uint64_t));
+    uint32_t* order = (uint32_t*)malloc((size_t)count * sizeof(uint32_t));
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (jobs[i].owner == BATCH_JOB_INVALID) continue;
+        if (world > 1 && jobs[i].bytes > split_bytes) {
+            jobs[i].owner = BATCH_JOB_SPLIT;
+        } else if (order) {
+            order[n++] = i;
+        } else {
+            jobs[i].owner = (int)(i % (uint32_t)world);
+        }
+    }
+
+    // insertion sort keeps equal sizes in manifest order
+    for (uint32_t i = 1; i < n; ++i) {
+        uint32_t j = i, v = order[i];
+        while (j > 0 && jobs[order[j - 1]].bytes < jobs[v].bytes) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = v;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        int best = 0;
+        for (int r = 1; load && r < world; ++r) {
+            if (load[r] < load[best]) best = r;
+        }
+        jobs[order[i]].owner = best;
+        if (load) load[best] += jobs[order[i]].bytes + 1;
+    }
+    free(load);
+    free(order);
+}
+
+// Runs one job on comm, which is MPI_COMM_SELF for jobs a rank owns alone.
+// tmp_tag makes the names of temporary files unique to the job and runner.
+static int run_job(ConvPlan* plan, const BatchJob* job, MPI_Comm comm, const ConvRunOptions* opts,
+                   const char* tmp_dir, const char* tmp_tag) {
+    int rank = 0, size = 1;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    uint32_t N = 1, C = 1, K = 1;
+    conv_plan_tensor_dims(plan, &N, &C, &K);
+    if (job->height % (N * C) != 0) {
+        if (rank == 0) {
+            fprintf(stderr, "[BATCH] %s: %u rows do not hold %u images x %u channels\n",
+                    job->input, job->height, N, C);
+        }
+        return 1;
+    }
+    if (conv_plan_reshape(plan, job->height / (N * C), job->width) != 0) {
+        if (rank == 0) fprintf(stderr, "[BATCH] %s: %ux%u has no outputs for this kernel\n", job->input, job->height, job->width);
+        return 1;
+    }
+
+    const char* in_path = job->input;
+    char tmp_in[512] = {0};
+    char tmp_out[512] = {0};
+    char out_path[512];
+    snprintf(out_path, sizeof(out_path), "%s", job->output);
+
+    int compress_output = !opts->text_output && ends_with(job->output, ".cbin");
+    if (compress_output) {
+        snprintf(tmp_out, sizeof(tmp_out), "%s/conv_batch_%s_out.bin", tmp_dir, tmp_tag);
+        snprintf(out_path, sizeof(out_path), "%s", tmp_out);
+    } else if (!opts->text_output && !ends_with(job->output, ".bin")) {
+        snprintf(out_path, sizeof(out_path), "%s.bin", job->output);
+    }
+
+    int rc = 0;
+    if (ends_with(in_path, ".txt") && size == 1 && N * C * K == 1) {
+        rc = conv_plan_run_txt(plan, in_path, out_path, opts);
+    } else {
+        if (ends_with(in_path, ".txt")) {
+            snprintf(tmp_in, sizeof(tmp_in), "%s/conv_batch_%s_in.bin", tmp_dir, tmp_tag);
+            if (rank == 0) convert_txt_to_bin((char*)in_path, tmp_in, 8192);
+            MPI_Barrier(comm);
+            in_path = tmp_in;
+        }
+        MatrixSource* src = open_input_source(in_path, job->height, job->width, size > 1, getenv("CONV_SOURCE"));
+        if (!src) {
+            fprintf(stderr, "[BATCH] Failed to open input %s\n", job->input);
+            rc = 1;
+        } else {
+            rc = conv_plan_run(plan, comm, src, out_path, opts);
+            source_close(src);
+        }
+    }
+
+    if (compress_output) {
+        MPI_Barrier(comm);
+        if (rank == 0 && !rc) rc = compress_bin_matrix(tmp_out, (char*)job->output, 0) ? 1 : 0;
+        if (rank == 0) remove(tmp_out);
+        MPI_Bcast(&rc, 1, MPI_INT, 0, comm);
+    }
+    if (tmp_in[0]) {
+        MPI_Barrier(comm);
+        if (rank == 0) remove(tmp_in);
+    }
+    return rc;
+}
+
+int run_manifest(ConvPlan* plan, const char* manifest_path, MPI_Comm comm,
+                 const ConvRunOptions* opts, const char* tmp_dir) {
+    int rank = 0, world = 1;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &world);
+
+    uint32_t count = 0;
+    BatchJob* jobs = NULL;
+    int pid = (int)getpid();
+    if (rank == 0) {
+        jobs = read_manifest(manifest_path, &count);
+        if (!jobs) count = UINT32_MAX;
+        for (uint32_t i = 0; jobs && i < count; ++i) {
+            if (probe_input(jobs[i].input, &jobs[i].height, &jobs[i].width) != 0) {
+                fprintf(stderr, "[BATCH] Skipping %s: not a readable matrix\n", jobs[i].input);
+                jobs[i].owner = BATCH_JOB_INVALID;
+                continue;
+            }
+            jobs[i].bytes = (uint64_t)jobs[i].height * jobs[i].width * sizeof(float);
+        }
+
+        double split_mb = BATCH_SPLIT_MB_DEFAULT;
+        const char* split_env = getenv("CONV_BATCH_SPLIT_MB");
+        if (split_env && atof(split_env) > 0.0) split_mb = atof(split_env);
+        if (jobs) schedule_jobs(jobs, count, world, (uint64_t)(split_mb * 1048576.0));
+        mkdir(tmp_dir, 0777);
+    }
+    MPI_Bcast(&count, 1, MPI_UINT32_T, 0, comm);
+    MPI_Bcast(&pid, 1, MPI_INT, 0, comm);
+    if (count == UINT32_MAX) return 1;
+
+    if (rank != 0) jobs = (BatchJob*)malloc((size_t)count * sizeof(BatchJob) + 1);
+    if (!jobs) {
+        fprintf(stderr, "[Rank %d] Failed to allocate the batch job table\n", rank);
+        MPI_Abort(comm, 1);
+    }
+    MPI_Bcast(jobs, (int)(count * sizeof(BatchJob)), MPI_BYTE, 0, comm);
+
+    uint32_t split = 0, mine = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (jobs[i].owner == BATCH_JOB_SPLIT) split++;
+        if (jobs[i].owner == rank) mine++;
+    }
+    if (rank == 0) printf("[BATCH] manifest=%s jobs=%u split=%u ranks=%d\n", manifest_path, count, split, world);
+
+    // the chunk buffers of every job come from one arena kept for the batch;
+    // taking the jobs largest first reserves it for the largest job up front,
+    // and a later job only regrows it if its rows are wider
+    uint32_t* order = (uint32_t*)malloc((size_t)(count ? count : 1) * sizeof(uint32_t));
+    if (!order) {
+        fprintf(stderr, "[Rank %d] Failed to allocate the batch job order\n", rank);
+        MPI_Abort(comm, 1);
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t j = i;
+        while (j > 0 && jobs[order[j - 1]].bytes < jobs[i].bytes) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    BufferArena arena;
+    arena_init(&arena, 0, omp_get_max_threads());
+    ConvRunOptions job_opts = *opts;
+    job_opts.arena = &arena;
+
+    // split jobs first, in the same order everywhere, so every rank reaches
+    // them together
+    double t_start = MPI_Wtime();
+    int split_failed = 0, failed = 0;
+    for (uint32_t n = 0; n < count; ++n) {
+        const uint32_t i = order[n];
+        if (jobs[i].owner != BATCH_JOB_SPLIT) continue;
+        char tag[64];
+        snprintf(tag, sizeof(tag), "%d_%u", pid, i);
+        double t0 = MPI_Wtime();
+        int rc = run_job(plan, &jobs[i], comm, &job_opts, tmp_dir, tag);
+        split_failed += rc ? 1 : 0;
+        if (rank == 0) {
+            printf("[BATCH] job=%u in=%s out=%s size=%ux%u ranks=%d time=%.3fs%s\n", i, jobs[i].input, jobs[i].output,
+                   jobs[i].height, jobs[i].width, world, MPI_Wtime() - t0, rc ? " FAILED" : "");
+        }
+    }
+
+    double t_split = MPI_Wtime() - t_start;
+    uint32_t done = 0;
+    for (uint32_t n = 0; n < count; ++n) {
+        const uint32_t i = order[n];
+        if (jobs[i].owner != rank) continue;
+        char tag[64];
+        snprintf(tag, sizeof(tag), "%d_%d_%u", (int)getpid(), rank, i);
+        double t0 = MPI_Wtime();
+        int rc = run_job(plan, &jobs[i], MPI_COMM_SELF, &job_opts, tmp_dir, tag);
+        failed += rc ? 1 : 0;
+        printf("[BATCH] rank=%d job=%u (%u/%u) in=%s out=%s size=%ux%u time=%.3fs%s\n", rank, i, ++done, mine,
+               jobs[i].input, jobs[i].output, jobs[i].height, jobs[i].width, MPI_Wtime() - t0, rc ? " FAILED" : "");
+    }
+
+    int invalid = 0;
+    for (uint32_t i = 0; i < count; ++i) invalid += jobs[i].owner == BATCH_JOB_INVALID;
+    // split job failures are seen by every rank, whole ones only by their owner
+    int total_failed = 0;
+    MPI_Allreduce(&failed, &total_failed, 1, MPI_INT, MPI_SUM, comm);
+    total_failed += split_failed;
+
+    double t_total = MPI_Wtime() - t_start;
+    double t_max = 0.0;
+    MPI_Reduce(&t_total, &t_max, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    if (rank == 0) {
+        printf("mode=batch ranks=%d jobs=%u split=%u failed=%d skipped=%d split_time=%.3fs total=%.3fs\n",
+               world, count, split, total_failed, invalid, t_split, t_max);
+    }
+
+    char label[32];
+    snprintf(label, sizeof(label), "rank=%d batch ", rank);
+    if (arena.runs) arena_report(&arena, label);
+    arena_destroy(&arena);
+    free(order);
+    free(jobs);
+    return (total_failed || invalid) ? 1 : 0;
+}
@@ -1,4 +1,7 @@
 #include "cli_parse.h"
+#include "dtype.h"
+#include "matrix.h"
+#include "occupancy.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,19 +12,49 @@ void print_cli_usage(const char* program_name) {
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  -H, --height=N        Input matrix height (required if no -f)\n");
     fprintf(stderr, "  -W, --width=N         Input matrix width (required if no -f)\n");
-    fprintf(stderr, "  -kH,                  Kernel height (required if no -g)\n");
-    fprintf(stderr, "  -kW,                  Kernel width (required if no -g)\n");
+    fprintf(stderr, "  -kH,                  Kernel height (required if no -g, must match -g if given)\n");
+    fprintf(stderr, "  -kW,                  Kernel width (required if no -g, must match -g if given)\n");
     fprintf(stderr, "  -sH,                  Vertical stride (default: 1)\n");
     fprintf(stderr, "  -sW,                  Horizontal stride (default: 1)\n");
-    fprintf(stderr, "  -f, --input=FILE      Input matrix file (.txt or .bin)\n");
+    fprintf(stderr, "  -f, --input=FILE      Input matrix file (.txt, .bin or compressed .cbin)\n");
     fprintf(stderr, "  -g, --kernel=FILE     Kernel file (.txt or .bin)\n");
-    fprintf(stderr, "  -o, --output=FILE     Output file (required)\n");
+    fprintf(stderr, "  -o, --output=FILE     Output file (required; .cbin is block-compressed)\n");
     fprintf(stderr, "  -M, --memory=GB       Memory budget in GB (default: 32.0)\n");
+    fprintf(stderr, "  -t, --dtype=TYPE      Binary output storage: f32, f16 or bf16 (default: f32)\n");
+    fprintf(stderr, "  -q, --quantize=TYPE   Integer engine on i8 or i16 input (quantized first if needed)\n");
+    fprintf(stderr, "      --bin-version=N   .bin output header: 1 (packed), 2 (4 KiB header, aligned rows)\n");
+    fprintf(stderr, "                        or 3 (as 2, with 64-bit dimensions)\n");
+    fprintf(stderr, "      --row-pitch=N     Bytes between v2/v3 .bin rows, a multiple of %d (default: narrowest)\n", ALIGN_BYTES);
+    fprintf(stderr, "      --convert         Rewrite the -f .bin as -o in --bin-version layout and exit\n");
+    fprintf(stderr, "      --batch=N         Input holds N images stacked by rows (default: 1)\n");
+    fprintf(stderr, "      --channels=C      Each image holds C channel planes (default: 1)\n");
+    fprintf(stderr, "      --kernels=K       Kernel holds K kernels of C planes; output has K planes per image\n");
+    fprintf(stderr, "      --manifest=FILE   Batch mode: convolve every \"input output\" line of FILE\n");
+    fprintf(stderr, "      --pipe[=txt|bin]  Read -f (a pipe, FIFO or - for stdin) front to back with a kH-row\n");
+    fprintf(stderr, "                        window; -o - writes to stdout (default: bin for .bin, else txt)\n");
+    fprintf(stderr, "      --boundary=MODE   Edges: zero, reflect, replicate, circular, or valid to keep only\n");
+    fprintf(stderr, "                        windows inside the input (default: zero)\n");
+    fprintf(stderr, "      --sparse[=T]      Visit only kernel taps with |weight| > T (default: 0, exact)\n");
+    fprintf(stderr, "      --occupancy[=R[xC]]\n");
+    fprintf(stderr, "                        Index the non-zero RxC tiles (default: 16x64) of the .bin/.cbin\n");
+    fprintf(stderr, "                        output, or of -f with --convert and no -o, as FILE.occ; runs on\n");
+    fprintf(stderr, "                        an indexed input skip reading and convolving all-zero tiles\n");
+    fprintf(stderr, "      --checkpoint      Journal finished output rows in -o.journal.* (.bin output only)\n");
+    fprintf(stderr, "      --resume          Continue a checkpointed run from its journals, on any rank count\n");
+    fprintf(stderr, "      --stage=FILE[,sH[,sW]]\n");
+    fprintf(stderr, "                        Convolve the result again with kernel FILE; repeatable, all\n");
+    fprintf(stderr, "                        stages run fused in one pass without intermediate files\n");
     fprintf(stderr, "  -h, --help            Display this help message\n");
     fprintf(stderr, "\nExamples:\n");
     fprintf(stderr, "  %s -H 1000 -W 1000 -kH 5 -kW 5 -o output.bin\n", program_name);
     fprintf(stderr, "  %s -f input.txt -g kernel.txt -sH 2 -sW 2 -o output.bin\n", program_name);
     fprintf(stderr, "  %s --input=input.bin --kernel=kernel.bin -kH 10 -kW 10 -M 16 -o out.bin\n", program_name);
+    fprintf(stderr, "  %s --convert --bin-version=2 -f input.bin -o aligned.bin\n", program_name);
+    fprintf(stderr, "  %s --convert --occupancy -f masked.bin\n", program_name);
+    fprintf(stderr, "  mpirun -np 8 %s --manifest=jobs.txt -g kernel.txt\n", program_name);
+    fprintf(stderr, "  producer | %s --pipe -f - -g kernel.txt -o - | consumer\n", program_name);
+    fprintf(stderr, "  %s -f input.bin -g blur.txt --stage=edge.txt --stage=pool.txt,2 -o out.bin\n", program_name);
+    fprintf(stderr, "  %s -f rgb.bin --batch=8 --channels=3 --kernels=16 -g filters.bin -o features.bin\n", program_name);
 }
 
 static int parse_int_arg(const char* s) {
@@ -41,6 +74,24 @@ static double parse_double_arg(const char* s) {
     return (value > 0.0) ? value : -1.0;
 }
 
+int parse_stage_spec(const char* spec, char* path, size_t path_cap, int* sH, int* sW) {
+    size_t len = strcspn(spec, ",");
+    if (len == 0 || len >= path_cap) return 1;
+    memcpy(path, spec, len);
+    path[len] = '\0';
+    *sH = *sW = 1;
+    if (!spec[len]) return 0;
+
+    char* end = NULL;
+    long h = strtol(spec + len + 1, &end, 10);
+    long w = h;
+    if (*end == ',') w = strtol(end + 1, &end, 10);
+    if (*end || h <= 0 || w <= 0 || h > 0x7fffffffL || w > 0x7fffffffL) return 1;
+    *sH = (int)h;
+    *sW = (int)w;
+    return 0;
+}
+
 static char** expand_short_flags(int argc, char** argv, int* fixed_argc) {
     char** list = (char**)malloc((size_t)argc * sizeof(char*));
     if (!list) return NULL;
@@ -89,6 +140,19 @@ int parse_cli_args(int argc, char** argv, CLIArgs* args) {
     args->kernel_file = NULL;
     args->output_file = NULL;
     args->memory_gb = 8.0;
+    args->out_dtype = DTYPE_F32;
+    args->quant_dtype = 0;
+    args->bin_version = 1;
+    args->row_pitch = 0;
+    args->convert_only = 0;
+    args->batch = args->channels = args->kernels = 1;
+    args->manifest_file = NULL;
+    args->pipe_format = 0;
+    args->num_stages = 0;
+    args->boundary = BOUNDARY_ZERO;
+    args->sparse_threshold = -1.0;
+    args->occupancy_rows = args->occupancy_cols = 0;
+    args->checkpoint = 0;
     args->show_help = 0;
 
     int fixed_argc = 0;
@@ -109,6 +173,22 @@ int parse_cli_args(int argc, char** argv, CLIArgs* args) {
         {"kernel",  required_argument, 0, 'g'},
         {"output",  required_argument, 0, 'o'},
         {"memory",  required_argument, 0, 'M'},
+        {"dtype",   required_argument, 0, 't'},
+        {"quantize", required_argument, 0, 'q'},
+        {"bin-version", required_argument, 0, 'V'},
+        {"row-pitch", required_argument, 0, 'p'},
+        {"convert", no_argument,       0, 'C'},
+        {"batch",   required_argument, 0, 'N'},
+        {"channels", required_argument, 0, 'L'},
+        {"kernels", required_argument, 0, 'K'},
+        {"manifest", required_argument, 0, 'm'},
+        {"pipe",    optional_argument, 0, 'P'},
+        {"stage",   required_argument, 0, 'S'},
+        {"boundary", required_argument, 0, 'B'},
+        {"sparse",  optional_argument, 0, 'Z'},
+        {"occupancy", optional_argument, 0, 'O'},
+        {"checkpoint", no_argument,    0, 'J'},
+        {"resume",  no_argument,       0, 'R'},
         {"help",    no_argument,       0, 'h'},
         {0, 0, 0, 0}
     };
@@ -116,7 +196,7 @@ int parse_cli_args(int argc, char** argv, CLIArgs* args) {
     int option_index = 0;
     int flag = 0;
 
-    while ((flag = getopt_long(fixed_argc, fixed_argv, "H:W:f:g:o:M:h", long_options, &option_index)) != -1) {
+    while ((flag = getopt_long(fixed_argc, fixed_argv, "H:W:f:g:o:M:t:q:h", long_options, &option_index)) != -1) {
         switch (flag) {
             case 'H':
                 args->H = parse_int_arg(optarg);
@@ -183,6 +263,125 @@ int parse_cli_args(int argc, char** argv, CLIArgs* args) {
                     return 1;
                 }
                 break;
+            case 't':
+                args->out_dtype = dtype_from_name(optarg);
+                if (args->out_dtype < 0 || dtype_is_quantized((uint32_t)args->out_dtype)) {
+                    fprintf(stderr, "Error: Invalid output dtype: %s (expected f32, f16 or bf16)\n", optarg);
+                    free_expanded_args(fixed_argc, fixed_argv, argv);
+                    return 1;
+                }
+                break;
+            case 'q':
+                args->quant_dtype = dtype_from_name(optarg);
+                if (!dtype_is_quantized((uint32_t)args->quant_dtype)) {
+                    fprintf(stderr, "Error: Invalid quantized dtype: %s (expected i8 or i16)\n", optarg);
+                    free_expanded_args(fixed_argc, fixed_argv, argv);
+                    return 1;
+                }
+                break;
+            case 'V':
+                args->bin_version = parse_int_arg(optarg);
+                if (args->bin_version < 1 || args->bin_version > 3) {
+                    fprintf(stderr, "Error: Invalid .bin version: %s (expected 1, 2 or 3)\n", optarg);
+                    free_expanded_args(fixed_argc, fixed_argv, argv);
+                    return 1;
+                }
+                break;
+            case 'p': {
+                char* end = NULL;
+                args->row_pitch = strtoll(optarg, &end, 10);
+                if (!*optarg || *end || args->row_pitch <= 0 || args->row_pitch % ALIGN_BYTES) {
+                    fprintf(stderr, "Error: Invalid --row-pitch: %s (expected a positive multiple of %d)\n", optarg, ALIGN_BYTES);
+                    free_expanded_args(fixed_argc, fixed_argv, argv);
+                    return 1;
+                }
+                break;
+            }
+            case 'C':
+                args->convert_only = 1;
+                break;
+            case 'N':
+            case 'L':
+            case 'K': {
+                int value = parse_int_arg(optarg);
+                if (value <= 0) {
+                    fprintf(stderr, "Error: Invalid --%s value: %s\n", long_options[option_index].name, optarg);
+                    free_expanded_args(fixed_argc, fixed_argv, argv);
+                    return 1;
+                }
+                if (flag == 'N') args->batch = value;
+                else if (flag == 'L') args->channels = value;
+                else args->kernels = value;
+                break;
+            }
+            case 'm':
+                args->manifest_file = optarg;
+                break;
+            case 'P':
+                if (!optarg) {
+                    args->pipe_format = -1;     // from the -f extension
+                } else if (strcmp(optarg, "txt") == 0 || strcmp(optarg, "bin") == 0) {
+                    args->pipe_format = optarg[0] == 't' ? 1 : 2;
+                } else {
+                    fprintf(stderr, "Error: Invalid --pipe format: %s (expected txt or bin)\n", optarg);
+                    free_expanded_args(fixed_argc, fixed_argv, argv);
+                    return 1;
+                }
+                break;
+            case 'S': {
+                char path[256];
+                int stage_sH = 0, stage_sW = 0;
+                if (args->num_stages == CLI_MAX_STAGES) {
+                    fprintf(stderr, "Error: At most %d --stage options are supported\n", CLI_MAX_STAGES);
+                    free_expanded_args(fixed_argc, fixed_argv, argv);
+                    return 1;
+                }
+                if (parse_stage_spec(optarg, path, sizeof(path), &stage_sH, &stage_sW) != 0) {
+                    fprintf(stderr, "Error: Invalid --stage value: %s (expected FILE[,sH[,sW]])\n", optarg);
+                    free_expanded_args(fixed_argc, fixed_argv, argv);
+                    return 1;
+                }
+                args->stages[args->num_stages++] = optarg;
+                break;
+            }
+            case 'B':
+                args->boundary = boundary_from_name(optarg);
+                if (args->boundary < 0) {
+                    fprintf(stderr, "Error: Invalid boundary mode: %s (expected zero, reflect, replicate, circular or valid)\n", optarg);
+                    free_expanded_args(fixed_argc, fixed_argv, argv);
+                    return 1;
+                }
+                break;
+            case 'Z': {
+                char* end = NULL;
+                args->sparse_threshold = optarg ? strtod(optarg, &end) : 0.0;
+                if (optarg && (!*optarg || *end || !(args->sparse_threshold >= 0.0))) {
+                    fprintf(stderr, "Error: Invalid --sparse threshold: %s\n", optarg);
+                    free_expanded_args(fixed_argc, fixed_argv, argv);
+                    return 1;
+                }
+                break;
+            }
+            case 'O': {
+                char* end = NULL;
+                long rows = optarg ? strtol(optarg, &end, 10) : OCC_DEFAULT_TILE_ROWS;
+                long cols = OCC_DEFAULT_TILE_COLS;
+                if (optarg && end != optarg && (*end == 'x' || *end == 'X')) cols = strtol(end + 1, &end, 10);
+                if (optarg && (!*optarg || *end || rows <= 0 || cols <= 0 || rows > 65536 || cols > 65536)) {
+                    fprintf(stderr, "Error: Invalid --occupancy tile: %s (expected R or RxC)\n", optarg);
+                    free_expanded_args(fixed_argc, fixed_argv, argv);
+                    return 1;
+                }
+                args->occupancy_rows = (int)rows;
+                args->occupancy_cols = (int)cols;
+                break;
+            }
+            case 'J':
+                if (!args->checkpoint) args->checkpoint = 1;
+                break;
+            case 'R':
+                args->checkpoint = 2;
+                break;
             case 'h':
                 args->show_help = 1;
                 free_expanded_args(fixed_argc, fixed_argv, argv);
@@ -200,19 +399,64 @@ int parse_cli_args(int argc, char** argv, CLIArgs* args) {
         return 1;
     }
 
-    if ((args->kH <= 0 || args->kW <= 0) && !args->kernel_file) {
+    if (args->row_pitch && args->bin_version < 2) {
+        fprintf(stderr, "Error: --row-pitch needs --bin-version=2 or 3\n");
+        free_expanded_args(fixed_argc, fixed_argv, argv);
+        return 1;
+    }
+
+    if (args->convert_only && !args->input_file) {
+        fprintf(stderr, "Error: --convert needs an input file (-f)\n");
+        free_expanded_args(fixed_argc, fixed_argv, argv);
+        return 1;
+    }
+
+    if ((args->kH <= 0 || args->kW <= 0) && !args->kernel_file && !args->convert_only) {
         fprintf(stderr, "Error: Kernel dimensions (-kH and -kW) are required unless kernel file (-g) is provided\n");
         free_expanded_args(fixed_argc, fixed_argv, argv);
         return 1;
     }
 
-    if (!args->output_file) {
+    if (args->manifest_file && (args->input_file || args->output_file || args->quant_dtype || args->convert_only)) {
+        fprintf(stderr, "Error: --manifest takes inputs and outputs from the manifest and cannot be combined with -f, -o, -q or --convert\n");
+        free_expanded_args(fixed_argc, fixed_argv, argv);
+        return 1;
+    }
+
+    if (args->pipe_format && (!args->input_file || args->manifest_file || args->quant_dtype || args->convert_only)) {
+        fprintf(stderr, "Error: --pipe reads the -f input and cannot be combined with --manifest, -q or --convert\n");
+        free_expanded_args(fixed_argc, fixed_argv, argv);
+        return 1;
+    }
+    if (args->num_stages && (args->pipe_format || args->quant_dtype || args->channels * args->kernels != 1)) {
+        fprintf(stderr, "Error: --stage needs a single-channel fp32 run without --pipe, -q, --channels or --kernels\n");
+        free_expanded_args(fixed_argc, fixed_argv, argv);
+        return 1;
+    }
+    if (args->pipe_format < 0) {
+        size_t len = strlen(args->input_file);
+        args->pipe_format = (len >= 4 && strcmp(args->input_file + len - 4, ".bin") == 0) ? 2 : 1;
+    }
+
+    if (args->checkpoint && (args->manifest_file || args->pipe_format || args->convert_only)) {
+        fprintf(stderr, "Error: --checkpoint and --resume cannot be combined with --manifest, --pipe or --convert\n");
+        free_expanded_args(fixed_argc, fixed_argv, argv);
+        return 1;
+    }
+
+    if (args->occupancy_rows && (args->manifest_file || args->pipe_format)) {
+        fprintf(stderr, "Error: --occupancy cannot be combined with --manifest or --pipe\n");
+        free_expanded_args(fixed_argc, fixed_argv, argv);
+        return 1;
+    }
+
+    if (!args->output_file && !args->manifest_file && !(args->convert_only && args->occupancy_rows)) {
         fprintf(stderr, "Error: Output file (-o/--output) is required\n");
         free_expanded_args(fixed_argc, fixed_argv, argv);
         return 1;
     }
 
-    if (!args->input_file && (args->H <= 0 || args->W <= 0)) {
+    if (!args->input_file && !args->manifest_file && (args->H <= 0 || args->W <= 0)) {
         fprintf(stderr, "Error: Either input file (-f) or dimensions (-H and -W) must be specified\n");
         free_expanded_args(fixed_argc, fixed_argv, argv);
         return 1;
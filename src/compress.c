@@ -0,0 +1,216 @@
+#include "compress.h"
+#include "dtype.h"
+#include "file.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <omp.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define ZBLOCK_TARGET_BYTES (256u << 10)
+#define ZRUN_MIN 3
+#define ZRUN_MAX (ZRUN_MIN + 127)
+#define ZLIT_MAX 128
+
+static inline uint32_t load_elem(const unsigned char* p, size_t elem_size) {
+    uint32_t v = 0;
+    memcpy(&v, p, elem_size);
+    return v;
+}
+
+// Signed deltas of neighbouring bit patterns, zigzagged so small steps in
+// either direction leave the high byte planes at zero.
+static inline uint32_t zigzag(uint32_t d, size_t elem_size) {
+    const unsigned bits = (unsigned)elem_size * 8;
+    const uint32_t mask = bits == 32 ? 0xffffffffu : (1u << bits) - 1;
+    d &= mask;
+    uint32_t sign = (d >> (bits - 1)) & 1u;
+    return ((d << 1) ^ (sign ? mask : 0)) & mask;
+}
+
+static inline uint32_t unzigzag(uint32_t z) {
+    return (z >> 1) ^ (0u - (z & 1u));
+}
+
+size_t zblock_bound(size_t n, size_t elem_size) {
+    size_t bytes = n * elem_size;
+    return bytes + bytes / ZLIT_MAX + 1;
+}
+
+static size_t rle_encode(const unsigned char* in, size_t len, unsigned char* out, size_t cap) {
+    size_t i = 0, o = 0;
+    while (i < len) {
+        size_t run = 1;
+        while (i + run < len && run < ZRUN_MAX && in[i + run] == in[i]) run++;
+        if (run >= ZRUN_MIN) {
+            if (o + 2 > cap) return 0;
+            out[o++] = (unsigned char)(0x80u | (run - ZRUN_MIN));
+            out[o++] = in[i];
+            i += run;
+            continue;
+        }
+
+        size_t j = i;
+        while (j < len && j - i < ZLIT_MAX) {
+            if (j + 2 < len && in[j] == in[j + 1] && in[j] == in[j + 2]) break;
+            j++;
+        }
+        size_t lit = j - i;
+        if (o + 1 + lit > cap) return 0;
+        out[o++] = (unsigned char)(lit - 1);
+        memcpy(out + o, in + i, lit);
+        o += lit;
+        i = j;
+    }
+    return o;
+}
+
+static int rle_decode(const unsigned char* in, size_t len, unsigned char* out, size_t out_len) {
+    size_t i = 0, o = 0;
+    while (i < len) {
+        unsigned char t = in[i++];
+        if (t & 0x80u) {
+            size_t run = (size_t)(t & 0x7fu) + ZRUN_MIN;
+            if (i >= len || o + run > out_len) return -1;
+            memset(out + o, in[i++], run);
+            o += run;
+        } else {
+            size_t lit = (size_t)t + 1;
+            if (i + lit > len || o + lit > out_len) return -1;
+            memcpy(out + o, in + i, lit);
+            i += lit;
+            o += lit;
+        }
+    }
+    return o == out_len ? 0 : -1;
+}
+
+size_t zblock_encode(const void* src, size_t n, size_t elem_size, unsigned char* dst, size_t cap, unsigned char* scratch) {
+    const unsigned char* in = (const unsigned char*)src;
+    uint32_t prev = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t v = load_elem(in + i * elem_size, elem_size);
+        uint32_t z = zigzag(v - prev, elem_size);
+        prev = v;
+        for (size_t p = 0; p < elem_size; ++p) scratch[p * n + i] = (unsigned char)(z >> (8 * p));
+    }
+    return rle_encode(scratch, n * elem_size, dst, cap);
+}
+
+int zblock_decode(const unsigned char* src, size_t src_len, void* dst, size_t n, size_t elem_size, unsigned char* scratch) {
+    if (rle_decode(src, src_len, scratch, n * elem_size) != 0) return -1;
+    unsigned char* out = (unsigned char*)dst;
+    uint32_t prev = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t z = 0;
+        for (size_t p = 0; p < elem_size; ++p) z |= (uint32_t)scratch[p * n + i] << (8 * p);
+        prev += unzigzag(z);
+        memcpy(out + i * elem_size, &prev, elem_size);
+    }
+    return 0;
+}
+
+int read_compressed_header(const char* path, CompressedHeader* header) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Failed to open file for reading: %s (%s)\n", path, strerror(errno));
+        return -1;
+    }
+    int ok = fread(header, sizeof(*header), 1, f) == 1 &&
+             header->magic == BIN_COMPRESSED_MAGIC &&
+             dtype_size(header->dtype) && header->block_rows &&
+             header->num_blocks == (header->height + header->block_rows - 1) / header->block_rows;
+    fclose(f);
+    if (!ok) fprintf(stderr, "%s is not a valid compressed matrix\n", path);
+    return ok ? 0 : -1;
+}
+
+int compress_bin_matrix(char* src_fp, char* dst_fp, uint32_t block_rows) {
+    BinaryFile in = open_bin_matrix_input(src_fp);
+    if (!in.file) return -1;
+    if (in.height == 0 || in.width == 0) {
+        fprintf(stderr, "Cannot compress empty matrix %s\n", src_fp);
+        fclose(in.file);
+        return -1;
+    }
+
+    const size_t elem_size = dtype_size(in.dtype);
+    const size_t row_bytes = (size_t)in.width * elem_size;
+    if (!block_rows) {
+        block_rows = (uint32_t)(ZBLOCK_TARGET_BYTES / row_bytes);
+        if (!block_rows) block_rows = 1;
+    }
+    if (block_rows > in.height) block_rows = in.height;
+
+    CompressedHeader header = {BIN_COMPRESSED_MAGIC, in.dtype, in.height, in.width, block_rows,
+                               (in.height + block_rows - 1) / block_rows, in.scale, in.zero_point};
+    const uint32_t num_blocks = header.num_blocks;
+    const size_t block_elems = (size_t)block_rows * in.width;
+    const size_t bound = zblock_bound(block_elems, elem_size);
+
+    // blocks are compressed a group at a time, one per thread, and appended
+    // in order
+    const uint32_t group = (uint32_t)omp_get_max_threads() * 2;
+    uint64_t* offsets = (uint64_t*)malloc(((size_t)num_blocks + 1) * sizeof(uint64_t));
+    unsigned char* raw = (unsigned char*)malloc((size_t)group * block_elems * elem_size);
+    unsigned char* packed = (unsigned char*)malloc((size_t)group * bound);
+    size_t* packed_len = (size_t*)malloc((size_t)group * sizeof(size_t));
+    int fd = open(dst_fp, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+    int rc = (!offsets || !raw || !packed || !packed_len || fd == -1) ? -1 : 0;
+
+    off_t pos = (off_t)sizeof(header) + ((off_t)num_blocks + 1) * (off_t)sizeof(uint64_t);
+    for (uint32_t b0 = 0; !rc && b0 < num_blocks; b0 += group) {
+        uint32_t nb = num_blocks - b0 < group ? num_blocks - b0 : group;
+        uint32_t row0 = b0 * block_rows;
+        uint32_t rows = (row0 + nb * block_rows > in.height) ? in.height - row0 : nb * block_rows;
+        if (read_bin_elems(&in, raw, (size_t)rows * in.width) != 0) {
+            rc = -1;
+            break;
+        }
+
+        int failed = 0;
+        #pragma omp parallel for schedule(dynamic, 1) reduction(|:failed)
+        for (uint32_t i = 0; i < nb; ++i) {
+            uint32_t first = i * block_rows;
+            uint32_t count = rows - first < block_rows ? rows - first : block_rows;
+            size_t n = (size_t)count * in.width;
+            unsigned char* scratch = (unsigned char*)malloc(n * elem_size);
+            packed_len[i] = scratch ? zblock_encode(raw + (size_t)first * row_bytes, n, elem_size,
+                                                    packed + (size_t)i * bound, bound, scratch) : 0;
+            free(scratch);
+            failed |= !packed_len[i];
+        }
+        if (failed) {
+            rc = -1;
+            break;
+        }
+
+        for (uint32_t i = 0; i < nb && !rc; ++i) {
+            offsets[b0 + i] = (uint64_t)pos;
+            if (write_at_pos(fd, packed + (size_t)i * bound, packed_len[i], pos) != (ssize_t)packed_len[i]) rc = -1;
+            pos += (off_t)packed_len[i];
+        }
+    }
+
+    if (!rc) {
+        offsets[num_blocks] = (uint64_t)pos;
+        size_t index_bytes = ((size_t)num_blocks + 1) * sizeof(uint64_t);
+        if (write_at_pos(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+            write_at_pos(fd, offsets, index_bytes, (off_t)sizeof(header)) != (ssize_t)index_bytes) {
+            rc = -1;
+        }
+    }
+
+    if (rc) fprintf(stderr, "Failed to compress %s to %s (%s)\n", src_fp, dst_fp, strerror(errno));
+    if (fd != -1) {
+        close(fd);
+        if (rc) remove(dst_fp);
+    }
+    fclose(in.file);
+    free(offsets);
+    free(raw);
+    free(packed);
+    free(packed_len);
+    return rc;
+}
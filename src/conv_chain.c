@@ -0,0 +1,121 @@
+#include "conv.h"
+#include <stdio.h>
+
+// Intermediate rows of one block of final output rows are kept to about this
+// size so they stay in cache from the stage that writes them to the next.
+#define CHAIN_BLOCK_BYTES (1u << 20)
+// Every block recomputes the halo rows it shares with its neighbours, so a
+// block spans at least this many halos even when its rows exceed the cache.
+#define CHAIN_MIN_BLOCK_HALOS 4
+
+uint32_t conv_chain_min_block(const ConvParams* params) {
+    uint32_t span_kH = params->kH, span_sH = params->sH;
+    calc_row_span(params, &span_kH, &span_sH);
+    return CHAIN_MIN_BLOCK_HALOS * ((span_kH + span_sH - 1) / span_sH);
+}
+
+// Runs a chunk through every stage of params->chain. params describes the
+// first stage on its input chunk, with out_H/out_W and output_offset_row in
+// final output rows. The chunk is processed in blocks of final rows; each
+// block works out the rows it needs from every stage backwards, then pushes
+// them forwards through the stages in small scratch buffers.
+int conv_chain(ConvParams* params) {
+    const ConvChain* chain = params->chain;
+    const uint32_t S = chain->count;
+    const uint32_t out_H = params->out_H;
+    const uint32_t out_W = params->out_W;
+
+    // rows of stage s output per final row, and the widest stage
+    size_t row_cost = 0;
+    uint32_t max_W = 0;
+    for (uint32_t s = 0; s < S; ++s) {
+        uint32_t stride = 1;
+        for (uint32_t t = s; t < S; ++t) stride *= chain->stages[t].sH;
+        row_cost += (size_t)chain->stages[s].W * stride * sizeof(float);
+        if (chain->stages[s].W > max_W) max_W = chain->stages[s].W;
+    }
+    const uint32_t min_block = conv_chain_min_block(params);
+    uint32_t block = (uint32_t)(CHAIN_BLOCK_BYTES / (row_cost ? row_cost : 1));
+    if (block < min_block) block = min_block;
+    if (block > out_H) block = out_H;
+
+    uint32_t* starts = (uint32_t*)malloc(((size_t)S + 1) * sizeof(uint32_t));
+    uint32_t* rows = (uint32_t*)malloc(((size_t)S + 1) * sizeof(uint32_t));
+    float* scratch[2] = {NULL, NULL};
+    size_t scratch_elems = 0;
+    if (!starts || !rows) {
+        fprintf(stderr, "Failed to allocate chain state\n");
+        free(starts);
+        free(rows);
+        return 1;
+    }
+
+    int rc = 0;
+    for (uint32_t b0 = 0; b0 < out_H; b0 += block) {
+        uint32_t b1 = b0 + block < out_H ? b0 + block : out_H;
+
+        // starts/rows[s]: the output rows of stage s (stage S is the last)
+        starts[S] = params->output_offset_row + b0;
+        rows[S] = b1 - b0;
+        for (uint32_t s = S; s > 0; --s) {
+            const ConvStage* st = &chain->stages[s - 1];
+            calc_window_rows(starts[s], starts[s] + rows[s], st->sH, st->kH, st->H, params->boundary,
+                             &starts[s - 1], &rows[s - 1]);
+        }
+
+        size_t need = 0;
+        for (uint32_t s = 0; s < S; ++s) {
+            size_t elems = (size_t)rows[s] * chain->stages[s].W;
+            if (elems > need) need = elems;
+        }
+        if (need > scratch_elems) {
+            free(scratch[0]);
+            free(scratch[1]);
+            scratch[0] = alloc_aligned(need);
+            scratch[1] = alloc_aligned(need);
+            scratch_elems = need;
+            if (!scratch[0] || !scratch[1]) {
+                fprintf(stderr, "Failed to allocate %zu chain scratch rows\n", need / (max_W ? max_W : 1));
+                rc = 1;
+                break;
+            }
+        }
+
+        ConvParams stage = *params;
+        stage.chain = NULL;
+        stage.out_H = rows[0];
+        stage.out_W = chain->stages[0].W;
+        stage.output_offset_row = starts[0];
+        stage.output = scratch[0];
+        conv_openmp(&stage);
+
+        for (uint32_t s = 1; s <= S; ++s) {
+            const ConvStage* st = &chain->stages[s - 1];
+            stage.data = scratch[(s - 1) & 1];
+            stage.kernel = st->kernel;
+            stage.taps = NULL;
+            stage.box = NULL;
+            stage.occupancy = NULL;
+            stage.thread_state = st->thread_state;
+            stage.H = rows[s - 1];
+            stage.W = st->W;
+            stage.plane_H = st->H;
+            stage.kH = st->kH;
+            stage.kW = st->kW;
+            stage.sH = st->sH;
+            stage.sW = st->sW;
+            stage.input_offset_row = starts[s - 1];
+            stage.output_offset_row = starts[s];
+            stage.out_H = rows[s];
+            stage.out_W = s < S ? chain->stages[s].W : out_W;
+            stage.output = s < S ? scratch[s & 1] : params->output + (size_t)b0 * out_W;
+            conv_openmp(&stage);
+        }
+    }
+
+    free(scratch[0]);
+    free(scratch[1]);
+    free(starts);
+    free(rows);
+    return rc;
+}
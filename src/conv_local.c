@@ -0,0 +1,380 @@
+#include "conv.h"
+#include "file.h"
+#include "isa.h"
+#include <omp.h>
+#include <stdio.h>
+#include <unistd.h>
+
+typedef struct {
+    float* data;
+    float* input;
+    float* output;              // packed output rows when banded
+    uint32_t out_row_start;     // over the N * out_H rows of all images
+    uint32_t out_row_end;
+    uint32_t out_col_start;     // column tile, all of out_W when untiled
+    uint32_t out_col_end;
+    uint32_t input_row_start;
+    uint32_t num_input_rows;
+    uint32_t input_col_start;
+    uint32_t num_input_cols;
+    int gathered;
+    int loaded;
+    int processed;
+} ChunkBuffer;
+
+static FILE* open_output(const char* output_path, BinaryLayout* layout, const ConvRunOptions* opts) {
+    if (!opts->text_output) return create_bin_matrix_layout((char*)output_path, layout);
+
+    FILE* out = fopen(output_path, "w");
+    if (out) {
+        char header[64];
+        size_t header_len = format_txt_header(header, sizeof(header), layout->height, layout->width);
+        fwrite(header, 1, header_len, out);
+    }
+    return out;
+}
+
+// Single-rank out-of-core pipeline: chunks of output rows are loaded from the
+// source, convolved and appended to the output file within the budget. Each
+// chunk carries all C input and K output planes of its rows. Binary outputs
+// whose rows do not fit the budget whole are chunked in two dimensions: a
+// chunk is then a tile of output rows x columns, read as a strip of input
+// columns with a kW halo.
+int conv_local(ConvParams* params,
+               MatrixSource* src,
+               const char* output_path,
+               const ConvRunOptions* opts) {
+    const uint32_t H = params->H;
+    const uint32_t W = params->W;
+    const uint32_t kH = params->kH;
+    const uint32_t kW = params->kW;
+    const uint32_t sH = params->sH;
+    const uint32_t sW = params->sW;
+    const uint32_t out_H = params->out_H;
+    const uint32_t out_W = params->out_W;
+    const uint32_t N = params->N ? params->N : 1;
+    const uint32_t C = params->C ? params->C : 1;
+    const uint32_t K = params->K ? params->K : 1;
+    const uint32_t total_rows = N * out_H;
+    const size_t budget_bytes = opts->budget_bytes;
+    const int text_output = opts->text_output;
+    const uint32_t out_dtype = text_output ? DTYPE_F32 : opts->out_dtype;
+    const uint32_t bin_version = text_output ? 1 : opts->bin_version;
+    const size_t out_pitch = bin_row_pitch(bin_version, out_W, out_dtype, opts->row_pitch);
+    BinaryLayout out_layout = {N * K * out_H, out_W, out_dtype, 0, 1.0f, 0, bin_version, out_pitch};
+    const int packed_output = !text_output && (out_dtype != DTYPE_F32 || out_pitch != (size_t)out_W * sizeof(float));
+
+    double t0 = omp_get_wtime();
+
+    // quantized plans hold int16 input rows; size chunks in float units
+    const size_t in_elem = source_load_size(src);
+    const size_t out_elem = dtype_size(out_dtype);
+    // chunks of narrow input or packed output hold their rows as stored and
+    // are convolved through fp32 bands, a quarter of the budget at most
+    const int banded = packed_output || (in_elem < sizeof(float) && !params->quant);
+    int threads = params->threads > 0 ? params->threads : omp_get_max_threads();
+    size_t band_budget = banded ? budget_bytes / 4 : 0;
+    if (band_budget > (size_t)threads * CONV_BAND_THREAD_BYTES) band_budget = (size_t)threads * CONV_BAND_THREAD_BYTES;
+    // text rows are formatted whole, so only binary output is tiled; a
+    // banded tile also fits a band of one fp32 row
+    uint32_t tile_cols = out_W;
+    if (!text_output && tile_columns(params)) {
+        tile_cols = opts->tile_cols ? opts->tile_cols
+                  : calc_tile_cols(out_W, (size_t)C * (in_elem + (banded ? sizeof(float) : 0)),
+                                   (size_t)K * (banded ? out_elem + sizeof(float) : sizeof(float)),
+                                   kH, kW, sH, sW, budget_bytes);
+        if (tile_cols > out_W) tile_cols = out_W;
+    }
+    const int tiled = tile_cols < out_W;
+    const uint32_t num_tiles = (out_W + tile_cols - 1) / tile_cols;
+    // input columns a chunk holds at most, and its staged output row
+    uint32_t tile_W = W;
+    if (tiled && (uint64_t)(tile_cols - 1) * sW + kW < W) tile_W = (tile_cols - 1) * sW + kW;
+    const size_t stage_pitch = tiled ? (size_t)tile_cols * out_elem : out_pitch;
+    ConvBand band = {NULL, NULL, 0, 0};
+    const size_t band_bytes = banded ? conv_band_size(params, tile_W, tile_cols, band_budget, &band) : 0;
+    const size_t chunk_budget = budget_bytes > 2 * band_bytes ? budget_bytes - band_bytes : budget_bytes / 2;
+
+    // chunk rows are counted in the bytes they are held in
+    const size_t out_row_bytes = banded ? K * stage_pitch : (size_t)K * tile_cols * sizeof(float);
+    uint32_t budget_out_W = (uint32_t)((out_row_bytes + sizeof(float) - 1) / sizeof(float));
+    uint32_t budget_W = (uint32_t)(((size_t)C * tile_W * in_elem + sizeof(float) - 1) / sizeof(float));
+    // a fused chain reads rows for its whole receptive field
+    uint32_t span_kH = kH, span_sH = sH;
+    calc_row_span(params, &span_kH, &span_sH);
+    uint32_t chunk_out_rows = calc_chunk_size(budget_W, budget_out_W, span_kH, kW, span_sH, chunk_budget);
+    const char* whole_rows = whole_row_reason(params, text_output);
+    char why[96];
+    if (whole_rows) snprintf(why, sizeof(why), "%s", whole_rows);
+    else snprintf(why, sizeof(why), "even column tiles of %u output columns do not fit", tile_cols);
+    check_row_budget(budget_W, budget_out_W, span_kH, kW, span_sH, chunk_budget, why);
+    uint32_t num_chunks = count_chunks(0, total_rows, chunk_out_rows, out_H) * num_tiles;
+
+    size_t chunk_mem_size = (size_t)chunk_out_rows * (span_sH + span_kH) * C * tile_W * in_elem +
+                            (size_t)chunk_out_rows * out_row_bytes;
+    uint32_t max_chunks_in_mem = (uint32_t)(chunk_budget / chunk_mem_size);
+    if (max_chunks_in_mem < 1) max_chunks_in_mem = 1;
+
+    fprintf(stdout, "[CHUNK] mode=%s source=%s threads=%d mem=%.3fGB chunk_rows=%u total_chunks=%u max_in_mem=%u out_size=%ux%u\n",
+            "omp", src->kind, threads,
+            budget_bytes / 1e9, chunk_out_rows, num_chunks, max_chunks_in_mem, out_H, out_W);
+    if (tiled) {
+        fprintf(stdout, "[TILE] %u column tiles of %u output columns, %u input columns each\n",
+                num_tiles, tile_cols, tile_W);
+    }
+    if (banded) {
+        fprintf(stdout, "[BAND] %s chunks convolved %u output rows at a time, scratch=%.1fMB\n",
+                dtype_name(in_elem < sizeof(float) && !params->quant ? src->load_dtype : out_dtype),
+                band.rows, band_bytes / 1e6);
+    }
+
+    FILE* output_file = open_output(output_path, &out_layout, opts);
+    if (!output_file) {
+        fprintf(stderr, "Failed to open output file %s\n", output_path);
+        return 1;
+    }
+
+    double t_read_done = omp_get_wtime();
+    double t_comp_total = 0.0;
+    uint32_t chunk_counter = 0;
+    int rc = 0;
+
+    ChunkBuffer* buffers = (ChunkBuffer*)calloc(max_chunks_in_mem, sizeof(ChunkBuffer));
+    if (!buffers) {
+        fclose(output_file);
+        return 1;
+    }
+
+    // the chunk slots, the bands and the staging of formatted rows are carved
+    // from one reservation for the run (chunks never cross into the next image)
+    const uint32_t slot_rows = chunk_out_rows < out_H ? chunk_out_rows : out_H;
+    uint32_t max_input_rows = slot_rows * span_sH + span_kH;
+    if (max_input_rows > H) max_input_rows = H;
+    // gathered chunks hold kH window rows per output row, which can exceed H
+    if (gather_input_rows(params) && max_input_rows < slot_rows * kH) max_input_rows = slot_rows * kH;
+    const size_t slot_input = (size_t)C * max_input_rows * tile_W * in_elem;
+    const size_t slot_output = (size_t)slot_rows * out_row_bytes;
+    const size_t staging_bytes = text_output ? txt_rows_capacity(slot_rows, out_W) : 0;
+    BufferArena own_arena;
+    BufferArena* arena = arena_begin_run(opts->arena, &own_arena, (size_t)max_chunks_in_mem *
+                                         (slot_input + slot_output + 2 * ALIGN_BYTES) + band_bytes + staging_bytes +
+                                         ALIGN_BYTES, threads);
+    int arena_ok = 1;
+    for (uint32_t i = 0; i < max_chunks_in_mem && arena_ok; ++i) {
+        buffers[i].input = (float*)arena_alloc(arena, slot_input);
+        buffers[i].output = (float*)arena_alloc(arena, slot_output);
+        arena_ok = buffers[i].input && buffers[i].output;
+    }
+    if (banded && arena_ok) {
+        band.input = (float*)arena_alloc(arena, (size_t)C * band.in_rows * tile_W * sizeof(float));
+        band.output = (float*)arena_alloc(arena, (size_t)K * band.rows * tile_cols * sizeof(float));
+        arena_ok = band.input && band.output;
+    }
+    char* staging = staging_bytes ? (char*)arena_alloc(arena, staging_bytes) : NULL;
+    // a plan's kernel copies serve all its runs; otherwise the run makes its own
+    ConvThreadState* own_state = params->thread_state ? NULL : conv_thread_state_create(params);
+    const ConvThreadState* thread_state = params->thread_state ? params->thread_state : own_state;
+
+    MPI_Request* plane_reqs = (MPI_Request*)malloc((size_t)2 * C * sizeof(MPI_Request));
+    if (!plane_reqs || !arena_ok || (staging_bytes && !staging)) {
+        fprintf(stderr, "Failed to allocate chunk buffers\n");
+        free(plane_reqs);
+        conv_thread_state_free(own_state);
+        arena_end_run(arena, NULL);
+        free(buffers);
+        fclose(output_file);
+        remove(output_path);
+        return 1;
+    }
+
+    uint32_t next_chunk_to_load = 0;
+    uint32_t next_chunk_to_process = 0;
+    uint32_t chunks_in_memory = 0;
+    uint32_t next_load_row = 0;
+    uint32_t next_load_tile = 0;
+
+    while (!rc && next_chunk_to_process < num_chunks) {
+        while (chunks_in_memory < max_chunks_in_mem && next_chunk_to_load < num_chunks) {
+            uint32_t out_row_start = next_load_row;
+            uint32_t out_row_end = calc_chunk_end(out_row_start, chunk_out_rows, total_rows, out_H);
+            uint32_t image = out_row_start / out_H;
+            // the tiles of a row chunk are taken left to right
+            uint32_t out_col_start = next_load_tile * tile_cols;
+            uint32_t out_col_end = out_col_start + tile_cols < out_W ? out_col_start + tile_cols : out_W;
+            if (++next_load_tile == num_tiles) {
+                next_load_tile = 0;
+                next_load_row = out_row_end;
+            }
+
+            uint32_t input_row_start, num_input_rows;
+            calc_input_rows(params, out_row_start - image * out_H, out_row_end - image * out_H,
+                            &input_row_start, &num_input_rows);
+            uint32_t input_col_start = 0, num_input_cols = W;
+            if (tiled) {
+                calc_window_rows(out_col_start, out_col_end, sW, kW, W, params->boundary,
+                                 &input_col_start, &num_input_cols);
+            }
+
+            uint32_t chunk_out_H = out_row_end - out_row_start;
+            uint32_t buf_idx = next_chunk_to_load % max_chunks_in_mem;
+
+            // a single plane is contiguous in the source and can be used in
+            // place, unless a circular range wraps around it
+            const int contiguous = C == 1 && input_row_start + num_input_rows <= H && !tiled;
+            const float* mapped = contiguous ? source_peek_rows(src, image * H + input_row_start, num_input_rows) : NULL;
+            const int gathered = !mapped && !tiled && gather_input_rows(params);
+            if (gathered) num_input_rows = chunk_out_H * kH;
+            if (gathered && !next_chunk_to_load) {
+                fprintf(stdout, "[STRIDE] reading %u of every %u input rows\n", kH, sH);
+            }
+            buffers[buf_idx].data = mapped ? (float*)mapped : buffers[buf_idx].input;
+
+            buffers[buf_idx].out_row_start = out_row_start;
+            buffers[buf_idx].out_row_end = out_row_end;
+            buffers[buf_idx].out_col_start = out_col_start;
+            buffers[buf_idx].out_col_end = out_col_end;
+            buffers[buf_idx].input_row_start = input_row_start;
+            buffers[buf_idx].num_input_rows = num_input_rows;
+            buffers[buf_idx].input_col_start = input_col_start;
+            buffers[buf_idx].num_input_cols = num_input_cols;
+            buffers[buf_idx].gathered = gathered;
+            buffers[buf_idx].loaded = 1;
+            buffers[buf_idx].processed = 0;
+
+            next_chunk_to_load++;
+            chunks_in_memory++;
+
+            if (!mapped && num_input_rows > max_input_rows) {
+                fprintf(stderr, "Input rows %u-%u exceed the chunk buffer\n", input_row_start, input_row_start + num_input_rows);
+                rc = 1;
+                break;
+            }
+            int started = mapped ? 0
+                        : tiled ? start_input_tile(src, params, image, input_row_start, num_input_rows,
+                                                   input_col_start, num_input_cols, buffers[buf_idx].input, plane_reqs)
+                        : gathered ? start_input_gather(src, params, image, out_row_start - image * out_H, chunk_out_H,
+                                                        buffers[buf_idx].input, plane_reqs)
+                                   : start_input_planes(src, params, image, input_row_start, num_input_rows,
+                                                        buffers[buf_idx].input, plane_reqs);
+            if (!mapped && (started != 0 || wait_input_planes(src, C, plane_reqs) != 0)) {
+                fprintf(stderr, "Failed to read input rows %u-%u\n", input_row_start, input_row_start + num_input_rows);
+                rc = 1;
+                break;
+            }
+        }
+        if (rc) break;
+
+        uint32_t buf_idx = next_chunk_to_process % max_chunks_in_mem;
+        if (!buffers[buf_idx].loaded) break;
+
+        chunk_counter++;
+        double t_chunk_start = omp_get_wtime();
+
+        uint32_t chunk_out_H = buffers[buf_idx].out_row_end - buffers[buf_idx].out_row_start;
+        uint32_t chunk_out_W = buffers[buf_idx].out_col_end - buffers[buf_idx].out_col_start;
+        uint32_t image = buffers[buf_idx].out_row_start / out_H;
+
+        ConvParams chunk_params = *params;
+        chunk_params.data = buffers[buf_idx].data;
+        chunk_params.output = buffers[buf_idx].output;
+        chunk_params.H = buffers[buf_idx].num_input_rows;
+        chunk_params.W = buffers[buf_idx].num_input_cols;
+        chunk_params.out_H = chunk_out_H;
+        chunk_params.out_W = chunk_out_W;
+        chunk_params.input_offset_col = buffers[buf_idx].input_col_start;
+        chunk_params.output_offset_col = buffers[buf_idx].out_col_start;
+        chunk_params.input_offset_row = buffers[buf_idx].gathered ? 0 : buffers[buf_idx].input_row_start;
+        chunk_params.gathered = buffers[buf_idx].gathered;
+        chunk_params.output_offset_row = buffers[buf_idx].out_row_start - image * out_H;
+        chunk_params.occupancy = src->occupancy;
+        chunk_params.image = image;
+        chunk_params.thread_state = thread_state;
+
+        // packed rows of a tile are strips of its own width
+        const size_t packed_pitch = tiled ? (size_t)chunk_out_W * out_elem : out_pitch;
+        double t_conv_start = omp_get_wtime();
+        rc = banded ? conv_compute_bands(&chunk_params, src->load_dtype, out_dtype, packed_pitch, &band)
+                    : conv_compute(&chunk_params);
+        double t_conv = omp_get_wtime() - t_conv_start;
+        t_comp_total += t_conv;
+
+        if (rc) {
+            fprintf(stderr, "Failed to convolve output rows %u-%u\n", buffers[buf_idx].out_row_start, buffers[buf_idx].out_row_end);
+        } else if (text_output) {
+            // text output is only offered for K == 1, where chunks come in file order
+            size_t text_len = format_txt_rows(buffers[buf_idx].output, chunk_out_H, out_W,
+                                              buffers[buf_idx].out_row_end == total_rows, staging);
+            if (text_len == (size_t)-1 || fwrite(staging, 1, text_len, output_file) != text_len) {
+                fprintf(stderr, "Failed to write output rows %u-%u\n", buffers[buf_idx].out_row_start, buffers[buf_idx].out_row_end);
+                rc = 1;
+            }
+        } else if (tiled) {
+            // every row of the tile is a strip of one output row
+            const size_t strip = packed_pitch;
+            const void* packed = buffers[buf_idx].output;
+            uint32_t local_start = buffers[buf_idx].out_row_start - image * out_H;
+            for (uint32_t i = 0; i < K * chunk_out_H && !rc; ++i) {
+                uint64_t out_row = ((uint64_t)image * K + i / chunk_out_H) * out_H + local_start + i % chunk_out_H;
+                off_t at = (off_t)out_layout.data_offset + (off_t)out_row * (off_t)out_pitch +
+                           (off_t)buffers[buf_idx].out_col_start * (off_t)out_elem;
+                if (fseeko(output_file, at, SEEK_SET) != 0 ||
+                    fwrite((const char*)packed + i * strip, 1, strip, output_file) != strip) {
+                    fprintf(stderr, "Failed to write output rows %u-%u\n", buffers[buf_idx].out_row_start, buffers[buf_idx].out_row_end);
+                    rc = 1;
+                }
+            }
+        } else {
+            size_t bytes = (size_t)chunk_out_H * out_pitch;
+            const void* packed = buffers[buf_idx].output;
+            uint32_t local_start = buffers[buf_idx].out_row_start - image * out_H;
+            for (uint32_t k = 0; k < K && !rc; ++k) {
+                uint64_t out_row = ((uint64_t)image * K + k) * out_H + local_start;
+                if (fseeko(output_file, (off_t)out_layout.data_offset + (off_t)out_row * (off_t)out_pitch, SEEK_SET) != 0 ||
+                    fwrite((const char*)packed + k * bytes, 1, bytes, output_file) != bytes) {
+                    fprintf(stderr, "Failed to write output rows %u-%u\n", buffers[buf_idx].out_row_start, buffers[buf_idx].out_row_end);
+                    rc = 1;
+                }
+            }
+        }
+
+        double t_chunk_total = omp_get_wtime() - t_chunk_start;
+        fprintf(stdout, "[CHUNK] %u/%u out_rows=%u-%u in_rows=%u mem=%.1fMB chunks_loaded=%u time=%.4fs (io=%.4fs conv=%.4fs)\n",
+                chunk_counter, num_chunks, buffers[buf_idx].out_row_start, buffers[buf_idx].out_row_end,
+                buffers[buf_idx].num_input_rows,
+                ((double)buffers[buf_idx].num_input_rows * C * buffers[buf_idx].num_input_cols * in_elem +
+                 (double)chunk_out_H * K * (banded ? packed_pitch : chunk_out_W * sizeof(float))) / 1e6,
+                chunks_in_memory, t_chunk_total, t_chunk_total - t_conv, t_conv);
+
+        buffers[buf_idx].loaded = 0;
+        buffers[buf_idx].processed = 1;
+
+        chunks_in_memory--;
+        next_chunk_to_process++;
+    }
+
+    free(buffers);
+    free(plane_reqs);
+    conv_thread_state_free(own_state);
+    // tiles leave the pad after the last pitched row unwritten
+    if (!rc && tiled && (fflush(output_file) != 0 ||
+                         ftruncate(fileno(output_file), (off_t)out_layout.data_offset +
+                                                        (off_t)out_layout.height * (off_t)out_pitch) != 0)) {
+        fprintf(stderr, "Failed to write output file %s\n", output_path);
+        rc = 1;
+    }
+    fclose(output_file);
+    if (rc) {
+        arena_end_run(arena, NULL);
+        remove(output_path);
+        return rc;
+    }
+
+    double t_all_done = omp_get_wtime();
+    double t_read = t_read_done - t0;
+    double t_comp = t_comp_total;
+    double t_write = t_all_done - t_read_done - t_comp_total;
+    fprintf(stdout, "mode=%s ranks=%d threads=%d isa=%s H=%u W=%u k=%ux%u s=%ux%u read=%.3fs comp=%.3fs write=%.3fs\n",
+            "omp", 1, threads, isa_name(isa_level()), H, W, kH, kW, sH, sW, t_read, t_comp, t_write);
+    arena_end_run(arena, "");
+    return 0;
+}
@@ -1,56 +1,293 @@
 #include "conv.h"
 #include "file.h"
+#include "source.h"
+#include "journal.h"
+#include "io_mpi.h"
+#include "io_thread.h"
 #include <mpi.h>
+#include <omp.h>
 #include <math.h>
 #include <stdio.h>
 
+// file domain alignment of collective runs that set none, a stripe-sized
+// stand-in on filesystems without striping
+#define CONV_STRIPING_UNIT_DEFAULT ((uint32_t)1 << 20)
+
 typedef struct {
     uint32_t chunk_start;
     uint32_t chunk_end;
     uint32_t chunk_out_H;
-    uint32_t input_row_start;
+    uint32_t image;
+    uint32_t input_row_start;   // within the image
     uint32_t num_input_rows;
-    MPI_Offset input_offset;
-    MPI_Offset output_offset;
+    uint32_t out_col_start;     // column tile of the rows, all of them untiled
+    uint32_t out_col_end;
+    uint32_t input_col_start;
+    uint32_t num_input_cols;
+    int gathered;               // input holds just each output row's window rows
+    MPI_Offset output_offset;   // of the chunk's rows in output plane (image, 0)
 } Chunk;
 
 static void build_chunk(Chunk* chunk,
                         uint32_t chunk_start,
                         uint32_t chunk_rows,
                         uint32_t row_end,
-                        uint32_t sH,
-                        uint32_t kH,
-                        uint32_t input_H,
-                        uint32_t W,
-                        uint32_t out_W) {
-    uint32_t chunk_end = chunk_start + chunk_rows;
-    if (chunk_end > row_end) chunk_end = row_end;
+                        uint32_t col_start,
+                        uint32_t col_end,
+                        const ConvParams* params,
+                        uint32_t out_H,
+                        uint32_t K,
+                        MPI_Offset data_offset,
+                        size_t out_pitch,
+                        size_t out_elem) {
+    uint32_t chunk_end = calc_chunk_end(chunk_start, chunk_rows, row_end, out_H);
+    uint32_t image = chunk_start / out_H;
+    uint32_t local_start = chunk_start - image * out_H;
 
     chunk->chunk_start = chunk_start;
     chunk->chunk_end = chunk_end;
     chunk->chunk_out_H = chunk_end - chunk_start;
+    chunk->image = image;
+
+    calc_input_rows(params,
+                    local_start,
+                    local_start + chunk->chunk_out_H,
+                    &chunk->input_row_start,
+                    &chunk->num_input_rows);
+
+    chunk->out_col_start = col_start;
+    chunk->out_col_end = col_end;
+    chunk->input_col_start = 0;
+    chunk->num_input_cols = params->W;
+    if (col_end - col_start < params->out_W) {
+        calc_window_rows(col_start, col_end, params->sW, params->kW, params->W, params->boundary,
+                         &chunk->input_col_start, &chunk->num_input_cols);
+    }
+
+    uint64_t out_row = (uint64_t)image * K * out_H + local_start;
+    chunk->output_offset = data_offset + (MPI_Offset)out_row * (MPI_Offset)out_pitch +
+                           (MPI_Offset)col_start * (MPI_Offset)out_elem;
+}
+
+// Splits the output rows not covered by done (sorted and disjoint) evenly
+// across the ranks. Returns this rank's share as ranges, *count of them.
+static JournalRecord* rank_segments(const JournalRecord* done, uint32_t done_count, uint32_t total_rows,
+                                    int rank, int size, uint32_t* count) {
+    uint32_t remaining = total_rows;
+    for (uint32_t i = 0; i < done_count; ++i) remaining -= done[i].row_end - done[i].row_start;
+    uint32_t per_rank = (remaining + size - 1) / size;
+    uint64_t lo = (uint64_t)rank * per_rank, hi = lo + per_rank;
+    if (hi > remaining) hi = remaining;
+
+    JournalRecord* segments = (JournalRecord*)malloc(((size_t)done_count + 1) * sizeof(JournalRecord));
+    *count = 0;
+    if (!segments) return NULL;
+    // pos counts the remaining rows before each gap between done ranges
+    uint64_t pos = 0;
+    for (uint32_t i = 0; i <= done_count && pos < hi; ++i) {
+        uint32_t gap_start = i ? done[i - 1].row_end : 0;
+        uint32_t gap_end = i < done_count ? done[i].row_start : total_rows;
+        uint64_t a = lo > pos ? lo : pos;
+        uint64_t b = hi < pos + (gap_end - gap_start) ? hi : pos + (gap_end - gap_start);
+        if (a < b) {
+            segments[*count].row_start = gap_start + (uint32_t)(a - pos);
+            segments[*count].row_end = gap_start + (uint32_t)(b - pos);
+            (*count)++;
+        }
+        pos += gap_end - gap_start;
+    }
+    return segments;
+}
+
+// Deals the chunks of the output rows not covered by done out cyclically:
+// chunk i of the run goes to rank i % size, so each round of a collective run
+// writes size adjacent chunks. Returns this rank's chunks as ranges, *count
+// of them, and the chunk count of the run in *global.
+static JournalRecord* rank_chunks(const JournalRecord* done, uint32_t done_count, uint32_t total_rows,
+                                  uint32_t chunk_rows, uint32_t out_H, int rank, int size,
+                                  uint32_t* count, uint32_t* global) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i <= done_count; ++i) {
+        uint32_t gap_start = i ? done[i - 1].row_end : 0;
+        uint32_t gap_end = i < done_count ? done[i].row_start : total_rows;
+        n += count_chunks(gap_start, gap_end, chunk_rows, out_H);
+    }
+    *global = n;
+    *count = 0;
+    uint32_t mine = n > (uint32_t)rank ? (n - (uint32_t)rank + (uint32_t)size - 1) / (uint32_t)size : 0;
+    JournalRecord* chunks = (JournalRecord*)malloc((size_t)(mine ? mine : 1) * sizeof(JournalRecord));
+    if (!chunks) return NULL;
+    uint32_t c = 0;
+    for (uint32_t i = 0; i <= done_count; ++i) {
+        uint32_t gap_start = i ? done[i - 1].row_end : 0;
+        uint32_t gap_end = i < done_count ? done[i].row_start : total_rows;
+        for (uint32_t row = gap_start; row < gap_end; ++c) {
+            uint32_t end = calc_chunk_end(row, chunk_rows, gap_end, out_H);
+            if (c % (uint32_t)size == (uint32_t)rank) chunks[(*count)++] = (JournalRecord){row, end};
+            row = end;
+        }
+    }
+    return chunks;
+}
+
+// Hints of a collective run: collective buffering for reads and writes, file
+// domains aligned to striping_unit and spread over cb_nodes aggregators.
+static MPI_Info collective_hints(const ConvRunOptions* opts) {
+    char value[32];
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "collective_buffering", "true");
+    MPI_Info_set(info, "romio_cb_read", "enable");
+    MPI_Info_set(info, "romio_cb_write", "enable");
+    snprintf(value, sizeof(value), "%u", opts->striping_unit ? opts->striping_unit : CONV_STRIPING_UNIT_DEFAULT);
+    MPI_Info_set(info, "striping_unit", value);
+    if (opts->cb_nodes) {
+        snprintf(value, sizeof(value), "%u", opts->cb_nodes);
+        MPI_Info_set(info, "cb_nodes", value);
+    }
+    return info;
+}
+
+// Prints the collective hints the library took for a file.
+static void report_hints(MPI_File fh, const char* label) {
+    static const char* keys[] = {"cb_nodes", "striping_unit", "cb_buffer_size"};
+    MPI_Info info;
+    if (MPI_File_get_info(fh, &info) != MPI_SUCCESS) return;
+    printf("[COLLECTIVE] %s", label);
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+        char value[64];
+        int found = 0;
+        MPI_Info_get(info, keys[i], (int)sizeof(value) - 1, value, &found);
+        printf(" %s=%s", keys[i], found ? value : "default");
+    }
+    printf("\n");
+    MPI_Info_free(&info);
+}
+
+// Records a chunk whose writes have completed in the journal.
+static void commit_chunk(RowJournal* journal, const Chunk* chunk, int* written, MPI_Comm comm) {
+    if (!*written) return;
+    *written = 0;
+    if (journal->fd != -1 && journal_commit(journal, chunk->chunk_start, chunk->chunk_end) != 0) MPI_Abort(comm, 1);
+}
+
+// The input reads of one chunk, started on the caller or run as an I/O job.
+typedef struct {
+    MatrixSource* src;
+    const ConvParams* params;
+    const Chunk* chunk;
+    uint32_t out_H;
+    void* dst;
+    MPI_Request* reqs;
+    int collective;         // 2 * C collective reads, empty without a chunk
+} ChunkRead;
+
+// The collective form of start_input_planes: each plane is read as its rows
+// and their wrapped tail, so every rank makes the same calls each round.
+static int start_round_read(ChunkRead* r) {
+    const ConvParams* p = r->params;
+    const Chunk* c = r->chunk;
+    const uint32_t C = p->C ? p->C : 1;
+    const size_t row_bytes = (size_t)p->W * source_load_size(r->src);
+    const uint32_t rows = c ? c->num_input_rows : 0, start = c ? c->input_row_start : 0;
+    const uint32_t head = start + rows > p->H ? p->H - start : rows;
+    int rc = 0;
+    for (uint32_t k = 0; k < C; ++k) {
+        uint32_t src_row = c ? (c->image * C + k) * p->H : 0;
+        char* plane = c ? (char*)r->dst + (size_t)k * rows * row_bytes : NULL;
+        if (source_start_rows_all(r->src, src_row + start, head, plane, &r->reqs[2 * k]) != 0) rc = -1;
+        if (source_start_rows_all(r->src, src_row, rows - head, plane ? plane + head * row_bytes : NULL,
+                                  &r->reqs[2 * k + 1]) != 0) rc = -1;
+    }
+    return rc;
+}
+
+static int start_chunk_read(ChunkRead* r) {
+    const Chunk* c = r->chunk;
+    if (r->collective) return start_round_read(r);
+    if (c->num_input_cols < r->params->W) {
+        return start_input_tile(r->src, r->params, c->image, c->input_row_start, c->num_input_rows,
+                                c->input_col_start, c->num_input_cols, r->dst, r->reqs);
+    }
+    if (c->gathered) {
+        return start_input_gather(r->src, r->params, c->image, c->chunk_start - c->image * r->out_H, c->chunk_out_H,
+                                  r->dst, r->reqs);
+    }
+    return start_input_planes(r->src, r->params, c->image, c->input_row_start, c->num_input_rows, r->dst, r->reqs);
+}
 
-    calc_input_rows_for_output_range_clamped(chunk_start,
-                                             chunk_end,
-                                             sH,
-                                             kH,
-                                             input_H,
-                                             &chunk->input_row_start,
-                                             &chunk->num_input_rows);
-
-    chunk->input_offset = (MPI_Offset)sizeof(BinaryHeader)
-                        + (MPI_Offset)chunk->input_row_start 
-                        * (MPI_Offset)W * (MPI_Offset)sizeof(float);
-    chunk->output_offset = (MPI_Offset)sizeof(BinaryHeader)
-                         + (MPI_Offset)chunk_start * (MPI_Offset)out_W 
-                         * (MPI_Offset)sizeof(float);
+static int run_chunk_read(void* arg) {
+    ChunkRead* r = (ChunkRead*)arg;
+    if (start_chunk_read(r) != 0) return -1;
+    return wait_input_planes(r->src, r->params->C ? r->params->C : 1, r->reqs);
+}
+
+// The output writes of one chunk: planes x rows runs of count elements of
+// type, back to back in buf and plane_stride and row_stride bytes apart in
+// the file from offset. An I/O job also journals the chunk once they complete.
+typedef struct {
+    MPI_File file;
+    MPI_Offset offset;
+    MPI_Offset plane_stride;
+    const char* buf;
+    size_t count;
+    MPI_Datatype type;
+    uint32_t planes;
+    uint32_t rows;          // a tile's strips of output rows, or 1
+    MPI_Offset row_stride;
+    MPI_Request* reqs;
+    RowJournal* journal;
+    const Chunk* chunk;
+    int* written;
+    MPI_Comm comm;
+    int collective;         // one collective write per plane, count 0 without a chunk
+} ChunkWrite;
+
+static void start_chunk_write(ChunkWrite* w) {
+    int (*iwrite)(MPI_File, MPI_Offset, const void*, size_t, MPI_Datatype, MPI_Request*) =
+        w->collective ? mpi_file_iwrite_at_all_big : mpi_file_iwrite_at_big;
+    int type_bytes = 0;
+    MPI_Type_size(w->type, &type_bytes);
+    for (uint32_t p = 0; p < w->planes; ++p) {
+        for (uint32_t r = 0; r < w->rows; ++r) {
+            size_t i = (size_t)p * w->rows + r;
+            iwrite(w->file, w->offset + (MPI_Offset)p * w->plane_stride + (MPI_Offset)r * w->row_stride,
+                   w->buf ? w->buf + i * w->count * (size_t)type_bytes : NULL, w->count, w->type, &w->reqs[i]);
+        }
+    }
+}
+
+static int run_chunk_write(void* arg) {
+    ChunkWrite* w = (ChunkWrite*)arg;
+    start_chunk_write(w);
+    MPI_Waitall((int)(w->planes * w->rows), w->reqs, MPI_STATUSES_IGNORE);
+    commit_chunk(w->journal, w->chunk, w->written, w->comm);
+    return 0;
+}
+
+// Waits for an I/O job, adding the wait to *stall and its run time to *busy.
+static int wait_io(IoThread* io, IoJob* job, double* stall, double* busy) {
+    if (!job->queued) return 0;
+    double t0 = MPI_Wtime();
+    int rc = io_thread_wait(io, job);
+    *stall += MPI_Wtime() - t0;
+    *busy += job->seconds;
+    return rc;
+}
+
+static void fail_open(int rank, const char* what, const char* path, int mpi_err, MPI_Comm comm) {
+    char err_string[MPI_MAX_ERROR_STRING];
+    int err_len = 0;
+    MPI_Error_string(mpi_err, err_string, &err_len);
+    fprintf(stderr, "[Rank %d] Failed to open %s file '%s': %.*s\n", rank, what, path, err_len, err_string);
+    MPI_Abort(comm, mpi_err);
 }
 
 void conv_mpi(ConvParams* params,
               MPI_Comm comm,
-              const char* input_path,
+              MatrixSource* src,
               const char* output_path,
-              size_t budget_bytes) {
+              const ConvRunOptions* opts) {
     int rank = 0, size = 0;
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
@@ -62,203 +299,568 @@ void conv_mpi(ConvParams* params,
     const uint32_t sW = params->sW;
     const uint32_t out_H = params->out_H;
     const uint32_t out_W = params->out_W;
+    const uint32_t N = params->N ? params->N : 1;
+    const uint32_t C = params->C ? params->C : 1;
+    const uint32_t K = params->K ? params->K : 1;
+    const uint32_t total_rows = N * out_H;
+    const size_t budget_bytes = opts->budget_bytes;
+    const int text_output = opts->text_output;
+    const uint32_t out_dtype = text_output ? DTYPE_F32 : opts->out_dtype;
+    const uint32_t bin_version = text_output ? 1 : opts->bin_version;
+    const size_t out_pitch = bin_row_pitch(bin_version, out_W, out_dtype, opts->row_pitch);
+    const int packed_output = !text_output && (out_dtype != DTYPE_F32 || out_pitch != (size_t)out_W * sizeof(float));
+    // quantized plans hold int16 input rows; size chunks in float units
+    const size_t in_elem = source_load_size(src);
+    const size_t out_elem = dtype_size(out_dtype);
+    // chunks of narrow input or packed output hold their rows as stored and
+    // are convolved through fp32 bands, a quarter of the rank's budget at most
+    const int banded = packed_output || (in_elem < sizeof(float) && !params->quant);
+    const int threads = params->threads > 0 ? params->threads : omp_get_max_threads();
 
     size_t rank_budget = budget_bytes / (size_t)size;
-
-    uint32_t rows_per_rank = (out_H + size - 1) / size;
-    uint32_t row_start = rank * rows_per_rank;
-    uint32_t row_end = row_start + rows_per_rank;
-    if (row_end > out_H) row_end = out_H;
-    uint32_t row_count = row_end - row_start;
-
-    if (!row_count) return;
-
-    uint32_t chunk_rows = calc_chunk_size(W, out_W, kH, kW, sH, rank_budget);
-    uint32_t chunk_total = (row_count + chunk_rows - 1) / chunk_rows;
+    size_t band_budget = banded ? rank_budget / 4 : 0;
+    if (band_budget > (size_t)threads * CONV_BAND_THREAD_BYTES) band_budget = (size_t)threads * CONV_BAND_THREAD_BYTES;
+    // rows too wide for the rank's share are split into column tiles, as in
+    // conv_local; text rows are formatted whole
+    uint32_t tile_cols = out_W;
+    if (!text_output && tile_columns(params)) {
+        tile_cols = opts->tile_cols ? opts->tile_cols
+                  : calc_tile_cols(out_W, (size_t)C * (in_elem + (banded ? sizeof(float) : 0)),
+                                   (size_t)K * (banded ? out_elem + sizeof(float) : sizeof(float)),
+                                   kH, kW, sH, sW, rank_budget);
+        if (tile_cols > out_W) tile_cols = out_W;
+    }
+    const int tiled = tile_cols < out_W;
+    const uint32_t num_tiles = (out_W + tile_cols - 1) / tile_cols;
+    // input columns a chunk holds at most, and its staged output row
+    uint32_t tile_W = W;
+    if (tiled && (uint64_t)(tile_cols - 1) * sW + kW < W) tile_W = (tile_cols - 1) * sW + kW;
+    const size_t stage_pitch = tiled ? (size_t)tile_cols * out_elem : out_pitch;
+    // collective runs read and write whole rows in rounds every rank takes
+    // part in; tiled runs keep independent I/O
+    const int collective = opts->collective_io && !tiled;
+    if (rank == 0 && opts->collective_io && tiled) {
+        fprintf(stderr, "Collective I/O writes whole rows; column tiles use independent I/O\n");
+    }
+    ConvBand band = {NULL, NULL, 0, 0};
+    const size_t band_bytes = banded ? conv_band_size(params, tile_W, tile_cols, band_budget, &band) : 0;
+    const size_t chunk_budget = rank_budget > 2 * band_bytes ? rank_budget - band_bytes : rank_budget / 2;
+    // a fused chain reads rows for its whole receptive field
+    uint32_t span_kH = kH, span_sH = sH;
+    calc_row_span(params, &span_kH, &span_sH);
+    // text rows are counted as formatted, packed rows in the bytes they are
+    // held in
+    const uint32_t budget_W = (uint32_t)(((size_t)C * tile_W * in_elem + sizeof(float) - 1) / sizeof(float));
+    const uint32_t budget_out_W = text_output ? out_W + out_W * (TXT_VALUE_MAX_CHARS + 1) / sizeof(float)
+                                : banded ? (uint32_t)(((size_t)K * stage_pitch + sizeof(float) - 1) / sizeof(float))
+                                : K * tile_cols;
+    // every rank sizes the same chunks, so rank 0 speaks for all of them
+    const char* whole_rows = whole_row_reason(params, text_output);
+    char why[96];
+    if (whole_rows) snprintf(why, sizeof(why), "%s", whole_rows);
+    else snprintf(why, sizeof(why), "even column tiles of %u output columns do not fit", tile_cols);
+    check_row_budget(budget_W, budget_out_W, span_kH, kW, span_sH, chunk_budget, rank == 0 ? why : NULL);
+
+    char text_header[64];
+    MPI_Offset text_base = (MPI_Offset)format_txt_header(text_header, sizeof(text_header), total_rows, out_W);
+    unsigned char bin_header[BIN_HEADER_MAX_BYTES];
+    BinaryLayout out_layout = {N * K * out_H, out_W, out_dtype, 0, 1.0f, 0, bin_version, out_pitch};
+    int header_bytes = (int)format_bin_header(bin_header, &out_layout);
+    MPI_Offset data_offset = (MPI_Offset)out_layout.data_offset;
+
+    // binary output can be checkpointed: rows whose writes have completed
+    // are journaled, and a resumed run only decomposes the rest
+    const int journaled = opts->checkpoint && !text_output;
+    JournalHeader journal_header = {JOURNAL_MAGIC, (uint32_t)size, total_rows, K, out_W, out_dtype, bin_version, 0,
+                                    (uint64_t)data_offset + (uint64_t)out_layout.height * out_pitch};
+    JournalRecord* done = NULL;
+    uint32_t done_count = 0;
+    if (journaled && opts->checkpoint > 1) {
+        int load_rc = rank == 0 ? journal_load(output_path, &journal_header, &done, &done_count) : 0;
+        MPI_Bcast(&load_rc, 1, MPI_INT, 0, comm);
+        if (load_rc) MPI_Abort(comm, 1);
+        MPI_Bcast(&done_count, 1, MPI_UINT32_T, 0, comm);
+        if (rank && done_count) done = (JournalRecord*)malloc((size_t)done_count * sizeof(JournalRecord));
+        if (done_count && !done) MPI_Abort(comm, 1);
+        if (done_count) MPI_Bcast(done, 2 * (int)done_count, MPI_UINT32_T, 0, comm);
+        if (rank == 0) {
+            uint64_t done_rows = 0;
+            for (uint32_t i = 0; i < done_count; ++i) done_rows += done[i].row_end - done[i].row_start;
+            printf("[MPI] resume: %llu/%u output rows journaled as done\n", (unsigned long long)done_rows, total_rows);
+        }
+    }
+    JournalRecord* segments = NULL;
+    uint32_t num_segments = 0;
+
+    uint32_t rows_per_rank = (total_rows + size - 1) / size;
+    uint32_t row_start = 0;
+    uint32_t row_end = total_rows;
+    uint32_t chunks_per_image = 0;
+    uint32_t chunk_rows = 0;
+    uint32_t chunk_total = 0;
+    uint32_t iterations = 0;
+
+    // Text rows have data-dependent lengths, so a rank cannot know where its
+    // block starts until every earlier rank has formatted everything. Text
+    // output instead deals chunks out cyclically: in each round every rank
+    // formats one chunk and an exclusive scan over the byte counts places it.
+    // Text output is single-kernel, so the chunks are in file order.
+    if (text_output) {
+        chunk_rows = calc_chunk_size(budget_W, budget_out_W, span_kH, kW, span_sH, chunk_budget);
+        if (chunk_rows > rows_per_rank) chunk_rows = rows_per_rank ? rows_per_rank : 1;
+        if (chunk_rows > out_H) chunk_rows = out_H;
+        chunks_per_image = (out_H + chunk_rows - 1) / chunk_rows;
+        uint32_t global_chunks = N * chunks_per_image;
+        iterations = (global_chunks + size - 1) / size;
+        chunk_total = (global_chunks > (uint32_t)rank) ? (global_chunks - rank + size - 1) / size : 0;
+    } else {
+        chunk_rows = calc_chunk_size(budget_W, budget_out_W, span_kH, kW, span_sH, chunk_budget);
+        // chunks end at the image, so no buffer needs more rows
+        if (chunk_rows > out_H) chunk_rows = out_H;
+        if (collective) {
+            // rounds of one chunk per rank, each round a contiguous run of
+            // rows in every output plane for the aggregators to merge
+            if (chunk_rows > rows_per_rank) chunk_rows = rows_per_rank ? rows_per_rank : 1;
+            segments = rank_chunks(done, done_count, total_rows, chunk_rows, out_H, rank, size, &num_segments, &iterations);
+            iterations = (iterations + size - 1) / size;
+        } else {
+            segments = rank_segments(done, done_count, total_rows, rank, size, &num_segments);
+        }
+        if (!segments) {
+            fprintf(stderr, "[Rank %d] Failed to allocate row ranges\n", rank);
+            MPI_Abort(comm, 1);
+        }
+        row_start = row_end = 0;
+        if (num_segments) {
+            row_start = segments[0].row_start;
+            row_end = segments[0].row_end;
+        }
+        for (uint32_t i = 0; i < num_segments; ++i) {
+            chunk_total += count_chunks(segments[i].row_start, segments[i].row_end, chunk_rows, out_H) * num_tiles;
+        }
+        if (!collective) iterations = chunk_total;
+    }
 
     if (rank == 0) {
-        printf("[MPI] ranks=%d mem_total=%.3fGB mem_per_rank=%.3fGB chunk_rows=%u out_size=%ux%u\n",
-               size, budget_bytes / 1e9, rank_budget / 1e9, chunk_rows, out_H, out_W);
+        printf("[MPI] ranks=%d mem_total=%.3fGB mem_per_rank=%.3fGB chunk_rows=%u out_size=%ux%ux%ux%u output=%s\n",
+               size, budget_bytes / 1e9, rank_budget / 1e9, chunk_rows, N, K, out_H, out_W,
+               text_output ? "txt" : out_dtype == DTYPE_F32 ? "bin" : dtype_name(out_dtype));
+        if (tiled) {
+            printf("[TILE] %u column tiles of %u output columns, %u input columns each\n", num_tiles, tile_cols, tile_W);
+        }
     }
-    printf("[MPI] rank=%d rows=%u-%u chunks=%u\n", rank, row_start, row_end, chunk_total);
-
-    MPI_File input_file, output_file;
-    MPI_Info info_in, info_out;
-    MPI_Info_create(&info_in);
-    MPI_Info_set(info_in, "romio_cb_read", "enable");
-    MPI_Info_set(info_in, "access_style", "read_once,sequential");
-
-    MPI_Info_create(&info_out);
-    MPI_Info_set(info_out, "romio_cb_write", "enable");
-    MPI_Info_set(info_out, "access_style", "write_once,sequential");
-
-    int mpi_err = MPI_File_open(comm, (char*)input_path, MPI_MODE_RDONLY, info_in, &input_file);
-    if (mpi_err != MPI_SUCCESS) {
-        char err_string[MPI_MAX_ERROR_STRING];
-        int err_len = 0;
-        MPI_Error_string(mpi_err, err_string, &err_len);
-        fprintf(stderr, "[Rank %d] Failed to open input file '%s': %.*s\n", rank, input_path, err_len, err_string);
-        MPI_Abort(comm, mpi_err);
+    if (text_output || collective) {
+        printf("[MPI] rank=%d rows=cyclic chunks=%u\n", rank, chunk_total);
+    } else if (num_segments > 1) {
+        printf("[MPI] rank=%d rows=%u-%u ranges=%u chunks=%u\n", rank, row_start,
+               segments[num_segments - 1].row_end, num_segments, chunk_total);
+    } else {
+        printf("[MPI] rank=%d rows=%u-%u chunks=%u\n", rank, row_start, row_end, chunk_total);
     }
 
-    mpi_err = MPI_File_open(comm, (char*)output_path, MPI_MODE_CREATE | MPI_MODE_WRONLY, info_out, &output_file);
-    MPI_Info_free(&info_in);
-    MPI_Info_free(&info_out);
-    if (mpi_err != MPI_SUCCESS) {
-        char err_string[MPI_MAX_ERROR_STRING];
-        int err_len = 0;
-        MPI_Error_string(mpi_err, err_string, &err_len);
-        fprintf(stderr, "[Rank %d] Failed to open output file '%s': %.*s\n", rank, output_path, err_len, err_string);
-        MPI_Abort(comm, mpi_err);
+    MPI_File output_file;
+    MPI_Info info_out;
+    if (collective) {
+        info_out = collective_hints(opts);
+    } else {
+        MPI_Info_create(&info_out);
+        MPI_Info_set(info_out, "romio_cb_write", "enable");
     }
+    MPI_Info_set(info_out, "access_style", "write_once,sequential");
+
+    int mpi_err = MPI_File_open(comm, (char*)output_path, MPI_MODE_CREATE | MPI_MODE_WRONLY, info_out, &output_file);
+    if (mpi_err != MPI_SUCCESS) fail_open(rank, "output", output_path, mpi_err, comm);
 
     if (rank == 0) {
-        BinaryHeader header = {out_H, out_W};
-        MPI_File_write_at(output_file, 0, &header, sizeof(BinaryHeader), MPI_BYTE, MPI_STATUS_IGNORE);
+        if (text_output) {
+            MPI_File_write_at(output_file, 0, text_header, (int)text_base, MPI_BYTE, MPI_STATUS_IGNORE);
+        } else {
+            MPI_File_write_at(output_file, 0, bin_header, header_bytes, MPI_BYTE, MPI_STATUS_IGNORE);
+        }
     }
 
     MPI_Barrier(comm);
-    uint32_t max_input_rows = chunk_rows * sH + kH;
-    if (max_input_rows > params->H) max_input_rows = params->H;
-
-    size_t max_input_elems = (size_t)max_input_rows * (size_t)W;
-    size_t max_output_elems = (size_t)chunk_rows * (size_t)out_W;
-    if (!max_output_elems) max_output_elems = (size_t)out_W;
 
-    float* input_buf[2] = {alloc_aligned(max_input_elems), alloc_aligned(max_input_elems)};
-    float* output_buf[2] = {alloc_aligned(max_output_elems), alloc_aligned(max_output_elems)};
+    // rank 0 carries the rows done so far into its new journal before any
+    // other rank replaces its own, so no record is lost in between
+    RowJournal journal = {-1, -1};
+    if (journaled) {
+        int journal_rc = rank == 0 ? journal_open(&journal, output_path, 0, &journal_header, done, done_count) : 0;
+        MPI_Bcast(&journal_rc, 1, MPI_INT, 0, comm);
+        if (!journal_rc && rank) journal_rc = journal_open(&journal, output_path, rank, &journal_header, NULL, 0);
+        MPI_Allreduce(MPI_IN_PLACE, &journal_rc, 1, MPI_INT, MPI_MIN, comm);
+        if (journal_rc) MPI_Abort(comm, 1);
+        if (rank == 0) journal_remove(output_path, size);
+    }
+    free(done);
 
-    if (!input_buf[0] || !input_buf[1] || !output_buf[0] || !output_buf[1]) {
-        fprintf(stderr, "[Rank %d] Failed to allocate double buffers\n", rank);
-        if (input_buf[0]) free(input_buf[0]);
-        if (input_buf[1]) free(input_buf[1]);
-        if (output_buf[0]) free(output_buf[0]);
-        if (output_buf[1]) free(output_buf[1]);
-        MPI_Abort(comm, 1);
+    uint32_t max_input_rows = chunk_rows * span_sH + span_kH;
+    if (max_input_rows > params->H) max_input_rows = params->H;
+    // gathered chunks hold kH window rows per output row, which can exceed H
+    if (!tiled && gather_input_rows(params) && max_input_rows < chunk_rows * kH) max_input_rows = chunk_rows * kH;
+
+    size_t max_input_elems = (size_t)max_input_rows * (size_t)tile_W;
+    size_t max_output_elems = (size_t)chunk_rows * (size_t)tile_cols;
+    if (!max_output_elems) max_output_elems = (size_t)tile_cols;
+    const size_t plane_output_elems = max_output_elems;
+    max_input_elems *= C;
+    max_output_elems *= K;
+    size_t text_capacity = text_output ? txt_rows_capacity(chunk_rows, out_W) : 0;
+
+    // sources that already hold their rows in memory are convolved in place;
+    // the planes of a multi-channel chunk are not adjacent, so they are copied,
+    // and so are circular chunks, whose rows wrap around the plane, and tiles
+    const int in_place = src->ops->peek_rows != NULL && src->load_dtype == DTYPE_F32 && C == 1 &&
+                         params->boundary != BOUNDARY_CIRCULAR && !tiled;
+    const int gathered = !in_place && !tiled && gather_input_rows(params);
+    if (rank == 0 && gathered) printf("[STRIDE] reading %u of every %u input rows\n", kH, sH);
+    if (rank == 0 && banded) {
+        printf("[BAND] %s chunks convolved %u output rows at a time, scratch=%.1fMB\n",
+               dtype_name(packed_output ? out_dtype : src->load_dtype), band.rows, band_bytes / 1e6);
     }
 
-    MPI_Request read_req[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
-    MPI_Request write_req[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
-    Chunk block[2] = {{0}};
+    // the views are set once, as plain bytes: each round's offsets pick its
+    // rows, so no round pays for a collective set_view. Gathered rows and
+    // sources without collective reads keep independent reads.
+    int collective_read = 0;
+    if (collective) {
+        MPI_File_set_view(output_file, 0, MPI_BYTE, MPI_BYTE, "native", info_out);
+        collective_read = !in_place && !gathered && source_collective(src, comm, info_out) == 0;
+        if (rank == 0) {
+            report_hints(output_file, "output");
+            printf("[COLLECTIVE] rounds=%u reads=%s writes=collective\n", iterations,
+                   collective_read ? "collective" : "independent");
+        }
+    }
+    MPI_Info_free(&info_out);
 
-    uint32_t scheduled = 0;
-    uint32_t completed = 0;
-    uint32_t next_start = row_start;
-    int slot = 0;
+    float* input_buf[2] = {NULL, NULL};
+    float* input_ptr[2] = {NULL, NULL};
+    // fp32 rows, or the packed rows of a banded run
+    float* output_buf[2] = {NULL, NULL};
+    const size_t output_bytes = banded ? (size_t)(chunk_rows ? chunk_rows : 1) * K * stage_pitch
+                                       : max_output_elems * sizeof(float);
+    char* text_buf[2] = {NULL, NULL};
+    MPI_Request* read_req[2] = {NULL, NULL};
+    MPI_Request* write_req[2] = {NULL, NULL};
+    // one write per output plane, or per row of every plane of a tile
+    const uint32_t num_writes = K * (tiled && chunk_rows ? chunk_rows : 1);
+    for (int i = 0; i < 2; ++i) {
+        read_req[i] = (MPI_Request*)malloc((size_t)2 * C * sizeof(MPI_Request));
+        write_req[i] = (MPI_Request*)malloc((size_t)num_writes * sizeof(MPI_Request));
+        if (!read_req[i] || !write_req[i]) {
+            fprintf(stderr, "[Rank %d] Failed to allocate request arrays\n", rank);
+            MPI_Abort(comm, 1);
+        }
+        for (uint32_t c = 0; c < 2 * C; ++c) read_req[i][c] = MPI_REQUEST_NULL;
+        for (uint32_t k = 0; k < num_writes; ++k) write_req[i][k] = MPI_REQUEST_NULL;
+    }
+    // with an I/O thread every read and write of the rank runs on it while
+    // one thread fewer computes; its jobs call MPI next to this thread
+    int io_mode = 0;
+    IoThread io;
+    if (opts->io_thread && collective) {
+        if (rank == 0) fprintf(stderr, "Collective I/O runs in rounds on the compute thread; CONV_IO_THREAD ignored\n");
+    } else if (opts->io_thread && chunk_total) {
+        int level = MPI_THREAD_SINGLE;
+        MPI_Query_thread(&level);
+        if (level < MPI_THREAD_MULTIPLE) {
+            if (rank == 0) fprintf(stderr, "MPI is not initialized with MPI_THREAD_MULTIPLE; I/O stays on the compute thread\n");
+        } else {
+            io_mode = io_thread_start(&io) == 0;
+        }
+    }
+    const int saved_threads = omp_get_max_threads();
+    const int compute_threads = io_mode && threads > 1 ? threads - 1 : threads;
+    if (io_mode) {
+        omp_set_num_threads(compute_threads);
+        printf("[IO] rank=%d io_thread=1 compute_threads=%d\n", rank, compute_threads);
+    }
+    ChunkRead reads[2];
+    ChunkWrite writes[2];
+    IoJob read_job[2] = {{0}}, write_job[2] = {{0}};
+    double io_stall = 0.0, io_busy = 0.0;
+    const size_t input_bytes = in_place ? 0 : max_input_elems * in_elem;
+    // the double buffers and bands of the rank come out of one reservation for the run
+    BufferArena own_arena;
+    BufferArena* arena = arena_begin_run(opts->arena, &own_arena, chunk_total ? 2 * (input_bytes + output_bytes +
+                                         text_capacity + 3 * ALIGN_BYTES) + band_bytes : 0, threads);
+    ConvThreadState* own_state = NULL;
+    const ConvThreadState* thread_state = params->thread_state;
+    if (chunk_total) {
+        for (int i = 0; i < 2; ++i) {
+            if (!in_place) input_buf[i] = (float*)arena_alloc(arena, input_bytes);
+            output_buf[i] = (float*)arena_alloc(arena, output_bytes);
+            if (text_capacity) text_buf[i] = (char*)arena_alloc(arena, text_capacity);
+        }
+        if (banded) {
+            band.input = (float*)arena_alloc(arena, (size_t)C * band.in_rows * tile_W * sizeof(float));
+            band.output = (float*)arena_alloc(arena, (size_t)K * band.rows * tile_cols * sizeof(float));
+        }
 
-    if (next_start < row_end) {
-        build_chunk(&block[slot], next_start, chunk_rows, row_end, sH, kH, params->H, W, out_W);
-        size_t need_input = (size_t)block[slot].num_input_rows * (size_t)W;
-        if (need_input > max_input_elems) {
-            fprintf(stderr, "[Rank %d] Input buffer too small (%zu > %zu)\n", rank, need_input, max_input_elems);
+        if ((!in_place && (!input_buf[0] || !input_buf[1])) || !output_buf[0] || !output_buf[1] ||
+            (text_capacity && (!text_buf[0] || !text_buf[1])) || (banded && (!band.input || !band.output))) {
+            fprintf(stderr, "[Rank %d] Failed to allocate double buffers\n", rank);
             MPI_Abort(comm, 1);
         }
-        int count = (int)need_input;
-        MPI_File_iread_at(input_file,
-                          block[slot].input_offset,
-                          input_buf[slot],
-                          count,
-                          MPI_FLOAT,
-                          &read_req[slot]);
-        scheduled++;
-        next_start = block[slot].chunk_end;
+        // a plan's kernel copies serve all its runs; otherwise the compute team gets its own
+        if (!thread_state) {
+            ConvParams team = *params;
+            team.threads = compute_threads;
+            thread_state = own_state = conv_thread_state_create(&team);
+        }
     }
 
-    while (completed < chunk_total) {
-        MPI_Wait(&read_req[slot], MPI_STATUS_IGNORE);
+    Chunk block[2] = {{0}};
+    int written[2] = {0, 0};    // slot holds a chunk with writes in flight
+
+    int slot = 0;
+    uint32_t next_row = row_start;
+    uint32_t next_tile = 0;
+    uint32_t segment = 0;
+
+    for (uint32_t iter = 0; iter <= iterations; ++iter) {
+        // iteration i computes chunk i and prefetches chunk i + 1
+        uint32_t next = iter;
+        int next_idx = (iter == 0) ? slot : slot ^ 1;
+        io_stall = io_busy = 0.0;
+        // a collective round writes on every rank, with or without a chunk
+        if (next < chunk_total || (collective && next < iterations)) {
+            if (io_mode) {
+                wait_io(&io, &write_job[next_idx], &io_stall, &io_busy);
+            } else {
+                MPI_Waitall((int)num_writes, write_req[next_idx], MPI_STATUSES_IGNORE);
+                commit_chunk(&journal, &block[next_idx], &written[next_idx], comm);
+            }
+        }
+        if (next < chunk_total) {
+            if (!text_output && next_row == row_end) {
+                segment++;
+                next_row = segments[segment].row_start;
+                row_end = segments[segment].row_end;
+            }
+            uint32_t next_start = next_row;
+            if (text_output) {
+                uint32_t global = next * (uint32_t)size + (uint32_t)rank;
+                next_start = (global / chunks_per_image) * out_H + (global % chunks_per_image) * chunk_rows;
+            }
+            // the tiles of a row chunk are taken left to right
+            uint32_t col_start = next_tile * tile_cols;
+            uint32_t col_end = col_start + tile_cols < out_W ? col_start + tile_cols : out_W;
+            build_chunk(&block[next_idx], next_start, chunk_rows, row_end, col_start, col_end, params,
+                        out_H, K, data_offset, out_pitch, out_elem);
+            if (++next_tile == num_tiles) {
+                next_tile = 0;
+                next_row = block[next_idx].chunk_end;
+            }
+            block[next_idx].gathered = gathered;
+            if (gathered) block[next_idx].num_input_rows = block[next_idx].chunk_out_H * kH;
+            size_t need_input = (size_t)block[next_idx].num_input_rows * (size_t)block[next_idx].num_input_cols;
+            if (need_input > max_input_elems) {
+                fprintf(stderr, "[Rank %d] Input buffer too small (%zu > %zu)\n", rank, need_input, max_input_elems);
+                MPI_Abort(comm, 1);
+            }
+            if (in_place) {
+                input_ptr[next_idx] = (float*)source_peek_rows(src, block[next_idx].image * params->H + block[next_idx].input_row_start,
+                                                               block[next_idx].num_input_rows);
+            } else {
+                reads[next_idx] = (ChunkRead){src, params, &block[next_idx], out_H, input_buf[next_idx], read_req[next_idx],
+                                              collective_read};
+                if (io_mode) {
+                    io_thread_submit(&io, &read_job[next_idx], run_chunk_read, &reads[next_idx]);
+                    input_ptr[next_idx] = input_buf[next_idx];
+                } else if (start_chunk_read(&reads[next_idx]) == 0) {
+                    input_ptr[next_idx] = input_buf[next_idx];
+                }
+            }
+            if (!input_ptr[next_idx]) {
+                fprintf(stderr, "[Rank %d] Failed to read input rows %u-%u from %s source\n", rank,
+                        block[next_idx].input_row_start, block[next_idx].input_row_start + block[next_idx].num_input_rows, src->kind);
+                MPI_Abort(comm, 1);
+            }
+        } else if (collective_read && next < iterations) {
+            reads[next_idx] = (ChunkRead){src, params, NULL, out_H, NULL, read_req[next_idx], 1};
+            if (start_chunk_read(&reads[next_idx]) != 0) {
+                fprintf(stderr, "[Rank %d] Failed to join collective read round %u\n", rank, next);
+                MPI_Abort(comm, 1);
+            }
+        }
+        if (iter == 0) continue;
 
+        uint32_t current = iter - 1;
+        int has_chunk = current < chunk_total;
         double t_chunk_start = MPI_Wtime();
+        double t_conv = 0.0;
         Chunk* info = &block[slot];
+        size_t need_output = 0;
+        const uint32_t chunk_out_W = info->out_col_end - info->out_col_start;
+        // packed rows of a tile are strips of its own width
+        const size_t packed_pitch = tiled ? (size_t)chunk_out_W * out_elem : out_pitch;
+
+        if (has_chunk) {
+            int read_rc = io_mode ? wait_io(&io, &read_job[slot], &io_stall, &io_busy)
+                                  : wait_input_planes(src, C, read_req[slot]);
+            if (read_rc != 0) {
+                fprintf(stderr, "[Rank %d] Failed to complete read of input rows %u-%u\n", rank,
+                        info->input_row_start, info->input_row_start + info->num_input_rows);
+                MPI_Abort(comm, 1);
+            }
 
-        size_t need_output = (size_t)info->chunk_out_H * (size_t)out_W;
-        if (need_output > max_output_elems) {
-            fprintf(stderr, "[Rank %d] Output buffer too small (%zu > %zu)\n", rank, need_output, max_output_elems);
+            need_output = (size_t)info->chunk_out_H * (size_t)chunk_out_W;
+            if (need_output > plane_output_elems) {
+                fprintf(stderr, "[Rank %d] Output buffer too small (%zu > %zu)\n", rank, need_output, max_output_elems);
+                MPI_Abort(comm, 1);
+            }
+
+            ConvParams chunk_params = {
+                .data = input_ptr[slot],
+                .kernel = params->kernel,
+                .output = output_buf[slot],
+                .H = info->num_input_rows,
+                .W = info->num_input_cols,
+                .kH = kH,
+                .kW = kW,
+                .sH = sH,
+                .sW = sW,
+                .out_H = info->chunk_out_H,
+                .out_W = chunk_out_W,
+                .input_offset_row = info->gathered ? 0 : info->input_row_start,
+                .output_offset_row = info->chunk_start - info->image * out_H,
+                .input_offset_col = info->input_col_start,
+                .output_offset_col = info->out_col_start,
+                .threads = io_mode ? compute_threads : params->threads,
+                .quant = params->quant,
+                .N = 1,
+                .C = C,
+                .K = K,
+                .chain = params->chain,
+                .boundary = params->boundary,
+                .plane_H = params->H,
+                .taps = params->taps,
+                .box = params->box,
+                .occupancy = src->occupancy,
+                .image = info->image,
+                .gathered = info->gathered,
+                .thread_state = thread_state
+            };
+
+            double t_conv_start = MPI_Wtime();
+            if (banded ? conv_compute_bands(&chunk_params, src->load_dtype, out_dtype, packed_pitch, &band)
+                       : conv_compute(&chunk_params)) {
+                fprintf(stderr, "[Rank %d] Failed to convolve output rows %u-%u\n", rank, info->chunk_start, info->chunk_end);
+                MPI_Abort(comm, 1);
+            }
+            t_conv = MPI_Wtime() - t_conv_start;
+        } else if (collective_read && wait_input_planes(src, C, read_req[slot]) != 0) {
+            fprintf(stderr, "[Rank %d] Failed to complete collective read round %u\n", rank, current);
             MPI_Abort(comm, 1);
         }
 
-        ConvParams chunk_params = {
-            .data = input_buf[slot],
-            .kernel = params->kernel,
-            .output = output_buf[slot],
-            .H = info->num_input_rows,
-            .W = W,
-            .kH = kH,
-            .kW = kW,
-            .sH = sH,
-            .sW = sW,
-            .out_H = info->chunk_out_H,
-            .out_W = out_W,
-            .input_offset_row = info->input_row_start,
-            .output_offset_row = info->chunk_start
-        };
-
-        double t_conv_start = MPI_Wtime();
-        conv_openmp(&chunk_params);
-        double t_conv = MPI_Wtime() - t_conv_start;
-
-        int write_count = (int)need_output;
-        MPI_File_iwrite_at(output_file,
-                           info->output_offset,
-                           output_buf[slot],
-                           write_count,
-                           MPI_FLOAT,
-                           &write_req[slot]);
-
-        completed++;
-
-        if (scheduled < chunk_total && next_start < row_end) {
-            int next_idx = slot ^ 1;
-            if (write_req[next_idx] != MPI_REQUEST_NULL) {
-                MPI_Wait(&write_req[next_idx], MPI_STATUS_IGNORE);
-                write_req[next_idx] = MPI_REQUEST_NULL;
+        if (text_output) {
+            unsigned long long text_len = 0, text_prefix = 0, round_len = 0;
+            if (has_chunk) {
+                size_t n = format_txt_rows(output_buf[slot], info->chunk_out_H, out_W,
+                                           info->chunk_end == total_rows, text_buf[slot]);
+                if (n == (size_t)-1) {
+                    fprintf(stderr, "[Rank %d] Failed to format output rows %u-%u\n", rank, info->chunk_start, info->chunk_end);
+                    MPI_Abort(comm, 1);
+                }
+                text_len = n;
             }
-
-            build_chunk(&block[next_idx], next_start, chunk_rows, row_end, sH, kH, params->H, W, out_W);
-            size_t need_input_next = (size_t)block[next_idx].num_input_rows * (size_t)W;
-            if (need_input_next > max_input_elems) {
-                fprintf(stderr, "[Rank %d] Input buffer too small (%zu > %zu)\n", rank, need_input_next, max_input_elems);
-                MPI_Abort(comm, 1);
+            MPI_Exscan(&text_len, &text_prefix, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm);
+            MPI_Allreduce(&text_len, &round_len, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm);
+            if (rank == 0) text_prefix = 0;
+
+            if (text_len || collective) {
+                writes[slot] = (ChunkWrite){output_file, text_base + (MPI_Offset)text_prefix, 0, text_buf[slot],
+                                            text_len, MPI_BYTE, 1, 1, 0, write_req[slot], &journal, info,
+                                            &written[slot], comm, collective};
+                if (io_mode) io_thread_submit(&io, &write_job[slot], run_chunk_write, &writes[slot]);
+                else start_chunk_write(&writes[slot]);
             }
-            int next_count = (int)need_input_next;
-            MPI_File_iread_at(input_file,
-                              block[next_idx].input_offset,
-                              input_buf[next_idx],
-                              next_count,
-                              MPI_FLOAT,
-                              &read_req[next_idx]);
-            scheduled++;
-            next_start = block[next_idx].chunk_end;
+            text_base += (MPI_Offset)round_len;
+        } else if (has_chunk) {
+            // one write per output plane, or per row strip of a tile; planes
+            // of an image are out_H rows apart
+            const uint32_t runs = tiled ? info->chunk_out_H : 1;
+            size_t run_bytes = (size_t)info->chunk_out_H / runs * packed_pitch;
+            MPI_Offset plane_stride = (MPI_Offset)out_H * (MPI_Offset)out_pitch;
+            writes[slot] = (ChunkWrite){output_file, info->output_offset, plane_stride, (const char*)output_buf[slot],
+                                        packed_output ? run_bytes : need_output / runs,
+                                        packed_output ? MPI_BYTE : MPI_FLOAT, K, runs, (MPI_Offset)out_pitch,
+                                        write_req[slot], &journal, info, &written[slot], comm, collective};
+            // rows are journaled with their last tile
+            written[slot] = info->out_col_end == out_W;
+            if (io_mode) io_thread_submit(&io, &write_job[slot], run_chunk_write, &writes[slot]);
+            else start_chunk_write(&writes[slot]);
+        } else if (collective) {
+            writes[slot] = (ChunkWrite){output_file, 0, 0, NULL, 0, MPI_BYTE, K, 1, 0, write_req[slot], &journal, info,
+                                        &written[slot], comm, 1};
+            start_chunk_write(&writes[slot]);
         }
 
-        double t_chunk_total = MPI_Wtime() - t_chunk_start;
-        printf("[MPI] rank=%d chunk=%u/%u out_rows=%u-%u in_rows=%u mem=%.1fMB time=%.4fs (io=%.4fs conv=%.4fs)\n",
-               rank,
-               completed,
-               chunk_total,
-               info->chunk_start,
-               info->chunk_end,
-               info->num_input_rows,
-               ((double)info->num_input_rows * W + info->chunk_out_H * out_W) * sizeof(float) / 1e6,
-               t_chunk_total,
-               t_chunk_total - t_conv,
-               t_conv);
-
-        if (completed < chunk_total) {
-            slot ^= 1;
+        if (has_chunk) {
+            double t_chunk_total = MPI_Wtime() - t_chunk_start;
+            // the share of the I/O thread's time the compute thread did not wait for
+            char overlap[64] = "";
+            if (io_mode) {
+                double hidden = io_busy > 0.0 ? 100.0 * (io_busy - io_stall) / io_busy : 100.0;
+                snprintf(overlap, sizeof(overlap), " io_thread=%.4fs overlap=%.0f%%", io_busy, hidden > 0.0 ? hidden : 0.0);
+            }
+            printf("[MPI] rank=%d chunk=%u/%u out_rows=%u-%u in_rows=%u mem=%.1fMB time=%.4fs (io=%.4fs conv=%.4fs%s)\n",
+                   rank,
+                   iter,
+                   chunk_total,
+                   info->chunk_start,
+                   info->chunk_end,
+                   info->num_input_rows,
+                   ((double)info->num_input_rows * C * info->num_input_cols * in_elem +
+                    (double)info->chunk_out_H * K * (banded ? packed_pitch : chunk_out_W * sizeof(float))) / 1e6,
+                   t_chunk_total,
+                   t_chunk_total - t_conv,
+                   t_conv,
+                   overlap);
         }
+
+        slot ^= 1;
     }
 
+    // the last tile of a row chunk may finish before the one ahead of it, so
+    // both slots' writes complete before either is journaled
+    for (int i = 0; i < 2 && !io_mode; ++i) MPI_Waitall((int)num_writes, write_req[i], MPI_STATUSES_IGNORE);
     for (int i = 0; i < 2; ++i) {
-        if (write_req[i] != MPI_REQUEST_NULL) {
-            MPI_Wait(&write_req[i], MPI_STATUS_IGNORE);
+        if (io_mode) {
+            io_thread_wait(&io, &write_job[i]);
+            io_thread_wait(&io, &read_job[i]);
+        } else {
+            commit_chunk(&journal, &block[i], &written[i], comm);
+            wait_input_planes(src, C, read_req[i]);
         }
-        if (read_req[i] != MPI_REQUEST_NULL) {
-            MPI_Wait(&read_req[i], MPI_STATUS_IGNORE);
-        }
-        free(input_buf[i]);
-        free(output_buf[i]);
+        free(read_req[i]);
+        free(write_req[i]);
+    }
+    if (io_mode) {
+        io_thread_stop(&io);
+        omp_set_num_threads(saved_threads);
+    }
+    conv_thread_state_free(own_state);
+
+    if (text_output) {
+        MPI_File_set_size(output_file, text_base);
+    } else {
+        // an older, wider file at the same path must not leave a stale tail
+        MPI_File_set_size(output_file, data_offset + (MPI_Offset)out_layout.height * (MPI_Offset)out_pitch);
     }
 
-    MPI_File_close(&input_file);
     MPI_File_close(&output_file);
+    free(segments);
+    char label[32];
+    snprintf(label, sizeof(label), "rank=%d ", rank);
+    arena_end_run(arena, label);
+    if (journaled) {
+        // the output is complete; its journals are no longer needed
+        journal_close(&journal);
+        MPI_Barrier(comm);
+        if (rank == 0) journal_remove(output_path, 0);
+    }
 }
@@ -1,36 +1,469 @@
 #include "conv.h"
+#include "isa.h"
+#include "occupancy.h"
 #include <omp.h>
 #include <string.h>
 #include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
 
+// Window fully inside the chunk: no per-tap checks.
 static inline float apply_window(const float* __restrict__ input_data,
                                  const float* __restrict__ kernel_data,
-                                 uint32_t H, uint32_t W,
-                                 uint32_t center_row, uint32_t center_col,
+                                 uint32_t W, uint32_t top, uint32_t left,
                                  uint32_t kH, uint32_t kW) {
     float sum = 0.0f;
+    const float* row = input_data + (size_t)top * W + left;
     
-    int half_h = (int)(kH - 1) / 2;
-    int half_w = (int)(kW - 1) / 2;
+    for (uint32_t k_i = 0; k_i < kH; k_i++, row += W) {
+        for (uint32_t k_j = 0; k_j < kW; k_j++) {
+            sum += row[k_j] * kernel_data[k_i * kW + k_j];
+        }
+    }
+    
+    return sum;
+}
+
+// Chunk row holding row g of the plane, or -1 if it reads as zero. The
+// chunk holds plane rows from input_offset on, modulo plane_H when circular.
+static inline int chunk_row(int g, const ConvParams* params) {
+    if (params->boundary == BOUNDARY_ZERO) {
+        int i = g - (int)params->input_offset_row;
+        return i >= 0 && i < (int)params->H ? i : -1;
+    }
+    int i = boundary_index(g, (int)params->plane_H, params->boundary) - (int)params->input_offset_row;
+    if (i < 0) i += (int)params->plane_H;
+    return i < (int)params->H ? i : -1;
+}
+
+// Window crossing an edge, its top row at plane row top. Each tap row is
+// mapped with chunk_row (-1 reads zeros), columns per boundary mode.
+static inline float apply_border_window(const float* __restrict__ input_data,
+                                        const float* __restrict__ kernel_data,
+                                        uint32_t W, const ConvParams* params, int top, int left,
+                                        uint32_t kH, uint32_t kW, BoundaryMode mode) {
+    float sum = 0.0f;
     
     for (uint32_t k_i = 0; k_i < kH; k_i++) {
+        const int r = chunk_row(top + (int)k_i, params);
+        if (r < 0) continue;
+        const float* row = input_data + (size_t)r * W;
         for (uint32_t k_j = 0; k_j < kW; k_j++) {
-            int i = (int)center_row + (int)k_i - half_h;
-            int j = (int)center_col + (int)k_j - half_w;
-            
-            float sample = 0.0f;
-            if (i >= 0 && i < (int)H && j >= 0 && j < (int)W) {
-                sample = input_data[i * W + j];
-            }
-            
-            sum += sample * kernel_data[k_i * kW + k_j];
+            int j = boundary_index(left + (int)k_j, (int)W, mode);
+            if (j >= 0) sum += row[j] * kernel_data[k_i * kW + k_j];
         }
     }
     
     return sum;
 }
 
-void conv_openmp(ConvParams* params) {
+// output tiles checked against the occupancy index as a whole
+#define SKIP_TILE_ROWS 16
+#define SKIP_TILE_COLS 64
+
+// Clamps the window span [lo, hi) to a plane of n, widened by the edge rows
+// or columns padding maps it to. 0 if a circular span wraps around.
+static int clamp_span(int64_t* lo, int64_t* hi, int64_t n, BoundaryMode mode) {
+    const int64_t a = *lo, b = *hi;
+    const int padded = mode == BOUNDARY_REFLECT || mode == BOUNDARY_REPLICATE;
+    if ((a < 0 || b > n) && mode == BOUNDARY_CIRCULAR) return 0;
+    if (a < 0) {
+        *lo = 0;
+        if (padded && *hi < (mode == BOUNDARY_REFLECT ? 1 - a : 1)) *hi = mode == BOUNDARY_REFLECT ? 1 - a : 1;
+    }
+    if (b > n) {
+        *hi = n;
+        if (padded && *lo > (mode == BOUNDARY_REFLECT ? 2 * n - 1 - b : n - 1)) *lo = mode == BOUNDARY_REFLECT ? 2 * n - 1 - b : n - 1;
+    }
+    if (*lo < 0) *lo = 0;
+    if (*hi > n) *hi = n;
+    return 1;
+}
+
+// 1 if the source's occupancy index shows every input the output rows
+// [r0, r1) x columns [c0, c1) read is zero, in all channels.
+static int footprint_zero(const ConvParams* params, uint32_t r0, uint32_t r1, uint32_t c0, uint32_t c1) {
+    const BoundaryMode mode = params->boundary;
+    const int64_t plane_H = params->plane_H;
+    int64_t y0 = (int64_t)(r0 + params->output_offset_row) * params->sH - calc_window_origin(params->kH, mode);
+    int64_t y1 = (int64_t)(r1 - 1 + params->output_offset_row) * params->sH - calc_window_origin(params->kH, mode) + params->kH;
+    // columns relative to the chunk's data, which column tiles only offset
+    const int64_t col_shift = (int64_t)params->output_offset_col * params->sW - params->input_offset_col;
+    int64_t x0 = (int64_t)c0 * params->sW - calc_window_origin(params->kW, mode) + col_shift;
+    int64_t x1 = (int64_t)(c1 - 1) * params->sW - calc_window_origin(params->kW, mode) + params->kW + col_shift;
+    if (!clamp_span(&y0, &y1, plane_H, mode) || !clamp_span(&x0, &x1, params->W, mode)) return 0;
+    x0 += params->input_offset_col;
+    x1 += params->input_offset_col;
+
+    const uint32_t C = params->C ? params->C : 1;
+    for (uint32_t c = 0; c < C; c++) {
+        const uint64_t base = ((uint64_t)params->image * C + c) * (uint64_t)plane_H;
+        if (!occupancy_zero(params->occupancy, (uint32_t)(base + y0), (uint32_t)(base + y1), (uint32_t)x0, (uint32_t)x1)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// kernel preparation is built once, not per ISA variant
+#ifndef CONV_ISA_SUFFIX
+int compile_kernel_taps(const float* kernel, uint32_t planes, uint32_t kH, uint32_t kW, float threshold,
+                        ConvTaps* taps) {
+    const size_t total = (size_t)planes * kH * kW;
+    memset(taps, 0, sizeof(*taps));
+    taps->offsets = (uint32_t*)malloc(((size_t)planes + 1) * sizeof(uint32_t));
+    taps->dy = (int32_t*)malloc((total ? total : 1) * sizeof(int32_t));
+    taps->dx = (int32_t*)malloc((total ? total : 1) * sizeof(int32_t));
+    taps->weight = (float*)malloc((total ? total : 1) * sizeof(float));
+    if (!taps->offsets || !taps->dy || !taps->dx || !taps->weight) {
+        free_kernel_taps(taps);
+        return -1;
+    }
+
+    for (uint32_t p = 0; p < planes; ++p) {
+        taps->offsets[p] = taps->count;
+        for (uint32_t i = 0; i < kH; ++i) {
+            for (uint32_t j = 0; j < kW; ++j) {
+                float w = kernel[((size_t)p * kH + i) * kW + j];
+                if (!(fabsf(w) > threshold)) continue;
+                taps->dy[taps->count] = (int32_t)i;
+                taps->dx[taps->count] = (int32_t)j;
+                taps->weight[taps->count] = w;
+                taps->count++;
+            }
+        }
+    }
+    taps->offsets[planes] = taps->count;
+    return 0;
+}
+
+void free_kernel_taps(ConvTaps* taps) {
+    if (!taps) return;
+    free(taps->offsets);
+    free(taps->dy);
+    free(taps->dx);
+    free(taps->weight);
+    memset(taps, 0, sizeof(*taps));
+}
+
+int compile_kernel_box(const float* kernel, uint32_t planes, uint32_t kH, uint32_t kW, float* weight) {
+    const size_t taps = (size_t)kH * kW;
+    for (uint32_t p = 0; p < planes; ++p) {
+        const float* plane = kernel + (size_t)p * taps;
+        for (size_t i = 1; i < taps; ++i) {
+            if (plane[i] != plane[0]) return 0;
+        }
+        weight[p] = plane[0];
+    }
+    return 1;
+}
+#endif
+
+// Adds weight * input over one output row for a single tap. Columns whose
+// input lies inside the row form one contiguous run that vectorizes; the
+// few outside it are mapped per boundary mode.
+static inline void accumulate_tap(float* __restrict__ acc, const float* __restrict__ row,
+                                  uint32_t W, uint32_t out_W, uint32_t sW, int shift,
+                                  float weight, BoundaryMode mode) {
+    // output column c reads input column c*sW + shift
+    int64_t first = shift < 0 ? ((int64_t)-shift + sW - 1) / sW : 0;
+    int64_t last = (int64_t)W - 1 - shift < 0 ? 0 : ((int64_t)W - 1 - shift) / sW + 1;
+    if (first > out_W) first = out_W;
+    if (last > out_W) last = out_W;
+    if (last < first) last = first;
+
+    if (sW == 1) {
+        const float* src = row + shift;
+        for (int64_t c = first; c < last; ++c) acc[c] += weight * src[c];
+    } else {
+        for (int64_t c = first; c < last; ++c) acc[c] += weight * row[c * sW + shift];
+    }
+    if (mode == BOUNDARY_ZERO || mode == BOUNDARY_VALID) return;
+    for (int64_t c = 0; c < first; ++c) acc[c] += weight * row[boundary_index((int)(c * sW) + shift, (int)W, mode)];
+    for (int64_t c = last; c < out_W; ++c) acc[c] += weight * row[boundary_index((int)(c * sW) + shift, (int)W, mode)];
+}
+
+// Sparse path: every output row takes the compiled taps one at a time across
+// all of its columns. Channels are summed into a row of their own first, so
+// results match the dense path.
+static void conv_openmp_taps(ConvParams* params) {
+    const uint32_t H = params->H;
+    const uint32_t W = params->W;
+    const uint32_t kH = params->kH;
+    const uint32_t kW = params->kW;
+    const uint32_t sH = params->sH;
+    const uint32_t sW = params->sW;
+    const uint32_t out_H = params->out_H;
+    const uint32_t out_W = params->out_W;
+    const uint32_t output_offset = params->output_offset_row;
+    const uint32_t C = params->C ? params->C : 1;
+    const uint32_t K = params->K ? params->K : 1;
+    const BoundaryMode mode = params->boundary;
+    const int origin_h = calc_window_origin(kH, mode);
+    // column tiles read data columns from input_offset_col on
+    const int origin_w = calc_window_origin(kW, mode) + (int)params->input_offset_col -
+                         (int)(params->output_offset_col * sW);
+    const ConvTaps* taps = params->taps;
+    const size_t plane = (size_t)H * W;
+    const int threads = params->threads > 0 ? params->threads : omp_get_max_threads();
+
+    #pragma omp parallel num_threads(threads)
+    {
+        float* partial = C > 1 ? alloc_aligned(out_W) : NULL;
+
+        #pragma omp for schedule(static) collapse(2)
+        for (uint32_t k = 0; k < K; k++) {
+            for (uint32_t r = 0; r < out_H; r++) {
+                float* out = params->output + ((size_t)k * out_H + r) * out_W;
+                const int top = params->gathered ? (int)(r * kH)
+                                                 : (int)((int64_t)(r + output_offset) * sH - origin_h);
+                memset(out, 0, (size_t)out_W * sizeof(float));
+                if (params->occupancy && footprint_zero(params, r, r + 1, 0, out_W)) continue;
+
+                for (uint32_t c = 0; c < C; c++) {
+                    float* acc = partial ? partial : out;
+                    if (partial) memset(partial, 0, (size_t)out_W * sizeof(float));
+                    const uint32_t p = k * C + c;
+                    for (uint32_t t = taps->offsets[p]; t < taps->offsets[p + 1]; t++) {
+                        int row = chunk_row(top + taps->dy[t], params);
+                        if (row < 0) continue;
+                        accumulate_tap(acc, params->data + c * plane + (size_t)row * W, W, out_W, sW,
+                                       taps->dx[t] - origin_w, taps->weight[t], mode);
+                    }
+                    if (partial) {
+                        for (uint32_t col = 0; col < out_W; col++) out[col] += partial[col];
+                    }
+                }
+            }
+        }
+
+        free(partial);
+    }
+}
+
+// Chunk row of window row g, or -1 if it reads as zero.
+static inline int box_row(const ConvParams* params, int64_t g) {
+    return params->gathered ? (int)(g - params->input_offset_row) : chunk_row((int)g, params);
+}
+
+// Columns [x0, x1) of a data row with row pitch W into sums[0, x1 - x0).
+static inline void add_box_row(double* __restrict__ sums, const float* __restrict__ data, uint32_t W,
+                               uint32_t x0, uint32_t x1, int row) {
+    if (row < 0) return;
+    const float* src = data + (size_t)row * W + x0;
+    for (uint32_t x = 0; x < x1 - x0; ++x) sums[x] += src[x];
+}
+
+static inline void sub_box_row(double* __restrict__ sums, const float* __restrict__ data, uint32_t W,
+                               uint32_t x0, uint32_t x1, int row) {
+    if (row < 0) return;
+    const float* src = data + (size_t)row * W + x0;
+    for (uint32_t x = 0; x < x1 - x0; ++x) sums[x] -= src[x];
+}
+
+// Sum down one column of the window rows from top, for a border window that
+// maps a column outside its strip's sums.
+static inline double box_column(const ConvParams* params, const float* data, uint32_t W, int64_t top, uint32_t x) {
+    double s = 0.0;
+    for (uint32_t i = 0; i < params->kH; i++) {
+        const int row = box_row(params, top + i);
+        if (row >= 0) s += data[(size_t)row * W + x];
+    }
+    return s;
+}
+
+// Chunks with fewer output rows than threads also split their columns, into
+// strips of at least this many output columns.
+#define BOX_MIN_STRIP_COLS 256
+
+// Box path: every kernel plane is one constant, so an output is the weights
+// times the sums of its windows. Each thread takes a block of output rows and
+// keeps per channel the sums down every column of the window rows; the next
+// output row adds the sH rows entering the window and subtracts the sH
+// leaving it. A prefix sum along the row (one row of the summed-area table)
+// then gives every window as one difference, whatever kH x kW is. Sums are
+// double, so neither the running sums nor the differences of long prefixes
+// lose the precision of the fp32 inputs. When the chunk has fewer output rows
+// than threads, the team splits into row blocks times column strips, and a
+// strip keeps sums only for the input columns its windows read.
+static void conv_openmp_box(ConvParams* params) {
+    const uint32_t H = params->H;
+    const uint32_t W = params->W;
+    const uint32_t kH = params->kH;
+    const uint32_t kW = params->kW;
+    const uint32_t sH = params->sH;
+    const uint32_t sW = params->sW;
+    const uint32_t out_H = params->out_H;
+    const uint32_t out_W = params->out_W;
+    const uint32_t output_offset = params->output_offset_row;
+    const uint32_t C = params->C ? params->C : 1;
+    const uint32_t K = params->K ? params->K : 1;
+    const BoundaryMode mode = params->boundary;
+    const int origin_h = calc_window_origin(kH, mode);
+    const int origin_w = calc_window_origin(kW, mode) + (int)params->input_offset_col -
+                         (int)(params->output_offset_col * sW);
+    // gathered rows are never shared by two windows
+    const int slide = !params->gathered && sH < kH;
+    const size_t plane = (size_t)H * W;
+    const int threads = params->threads > 0 ? params->threads : omp_get_max_threads();
+
+    // per thread: column sums of every channel, the row's prefix sums, its
+    // window sums and, with channels to add up, the K output rows in double
+    const size_t per_thread = (size_t)C * W + W + 1 + out_W + (C > 1 ? (size_t)K * out_W : 0);
+    double* scratch = (double*)malloc((size_t)threads * per_thread * sizeof(double));
+    if (!scratch) {
+        ConvParams dense = *params;
+        dense.box = NULL;
+        conv_openmp(&dense);
+        return;
+    }
+
+    #pragma omp parallel num_threads(threads)
+    {
+        const int tid = omp_get_thread_num();
+        const uint32_t team = (uint32_t)omp_get_num_threads();
+        uint32_t strips = 1;
+        if (out_H < team) {
+            const uint32_t widest = out_W / BOX_MIN_STRIP_COLS;
+            strips = (team + out_H - 1) / (out_H ? out_H : 1);
+            if (strips > widest) strips = widest ? widest : 1;
+        }
+        const uint32_t blocks = team / strips;
+        const uint32_t block = (uint32_t)tid / strips, strip = (uint32_t)tid % strips;
+        const uint32_t r0 = block < blocks ? (uint32_t)((uint64_t)out_H * block / blocks) : out_H;
+        const uint32_t r1 = block < blocks ? (uint32_t)((uint64_t)out_H * (block + 1) / blocks) : out_H;
+        const uint32_t oc0 = (uint32_t)((uint64_t)out_W * strip / strips);
+        const uint32_t oc1 = (uint32_t)((uint64_t)out_W * (strip + 1) / strips);
+        // input columns [x0, x1) hold every in-row column of the strip's
+        // windows; one strip keeps them all
+        int64_t lo_min = (int64_t)oc0 * sW - origin_w, hi_max = (int64_t)(oc1 ? oc1 - 1 : 0) * sW - origin_w + kW;
+        const uint32_t x0 = strips == 1 || lo_min < 0 ? 0 : lo_min > (int64_t)W ? W : (uint32_t)lo_min;
+        const uint32_t x1 = strips == 1 || hi_max > (int64_t)W ? W : hi_max < (int64_t)x0 ? x0 : (uint32_t)hi_max;
+        double* sums = scratch + (size_t)tid * per_thread;
+        double* prefix = sums + (size_t)C * W;
+        double* win = prefix + W + 1;
+        double* acc = win + out_W;
+
+        for (uint32_t r = r0; r < r1; r++) {
+            const int64_t top = params->gathered ? (int64_t)r * kH + params->input_offset_row
+                                                 : (int64_t)(r + output_offset) * sH - origin_h;
+            for (uint32_t c = 0; c < C; c++) {
+                double* col = sums + (size_t)c * W;
+                const float* data = params->data + c * plane;
+                if (slide && r > r0) {
+                    for (uint32_t i = 0; i < sH; i++) {
+                        sub_box_row(col, data, W, x0, x1, box_row(params, top - sH + i));
+                        add_box_row(col, data, W, x0, x1, box_row(params, top + kH - sH + i));
+                    }
+                } else {
+                    memset(col, 0, (size_t)(x1 - x0) * sizeof(double));
+                    for (uint32_t i = 0; i < kH; i++) add_box_row(col, data, W, x0, x1, box_row(params, top + i));
+                }
+
+                // prefix[x - x0] sums col over input columns [x0, x)
+                prefix[0] = 0.0;
+                for (uint32_t x = 0; x < x1 - x0; x++) prefix[x + 1] = prefix[x] + col[x];
+                for (uint32_t oc = oc0; oc < oc1; oc++) {
+                    int64_t lo = (int64_t)oc * sW - origin_w;
+                    int64_t hi = lo + kW;
+                    if (lo >= 0 && hi <= (int64_t)W) {
+                        win[oc] = prefix[hi - x0] - prefix[lo - x0];
+                    } else if (mode == BOUNDARY_ZERO || mode == BOUNDARY_VALID) {
+                        if (lo < 0) lo = 0;
+                        if (hi > (int64_t)W) hi = W;
+                        win[oc] = hi > lo ? prefix[hi - x0] - prefix[lo - x0] : 0.0;
+                    } else {
+                        double s = 0.0;
+                        for (int64_t j = lo; j < hi; j++) {
+                            const uint32_t x = (uint32_t)boundary_index((int)j, (int)W, mode);
+                            s += x >= x0 && x < x1 ? col[x - x0] : box_column(params, data, W, top, x);
+                        }
+                        win[oc] = s;
+                    }
+                }
+
+                for (uint32_t k = 0; k < K; k++) {
+                    const double w = params->box[k * C + c];
+                    if (C == 1) {
+                        float* out = params->output + ((size_t)k * out_H + r) * out_W;
+                        for (uint32_t oc = oc0; oc < oc1; oc++) out[oc] = (float)(w * win[oc]);
+                    } else {
+                        double* a = acc + (size_t)k * out_W;
+                        if (c == 0) {
+                            for (uint32_t oc = oc0; oc < oc1; oc++) a[oc] = w * win[oc];
+                        } else {
+                            for (uint32_t oc = oc0; oc < oc1; oc++) a[oc] += w * win[oc];
+                        }
+                    }
+                }
+            }
+            if (C > 1) {
+                for (uint32_t k = 0; k < K; k++) {
+                    float* out = params->output + ((size_t)k * out_H + r) * out_W;
+                    for (uint32_t oc = oc0; oc < oc1; oc++) out[oc] = (float)acc[(size_t)k * out_W + oc];
+                }
+            }
+        }
+    }
+    free(scratch);
+}
+
+#ifndef CONV_ISA_SUFFIX
+ConvThreadState* conv_thread_state_create(const ConvParams* params) {
+    if (params->quant || params->taps || params->box) return NULL;
+    const int threads = params->threads > 0 ? params->threads : omp_get_max_threads();
+    const size_t kernel_bytes = (size_t)(params->K ? params->K : 1) * (params->C ? params->C : 1) *
+                                params->kH * params->kW * sizeof(float);
+    // whole pages per copy, so no two threads' copies share one
+    const long page = sysconf(_SC_PAGESIZE) > 0 ? sysconf(_SC_PAGESIZE) : 4096;
+    const size_t copy_bytes = (kernel_bytes + (size_t)page - 1) / (size_t)page * (size_t)page;
+    ConvThreadState* state = (ConvThreadState*)malloc(sizeof(ConvThreadState));
+    float** kernel = (float**)calloc((size_t)threads, sizeof(float*));
+    if (!state || !kernel) {
+        free(state);
+        free(kernel);
+        return NULL;
+    }
+    state->threads = threads;
+    state->kernel = kernel;
+    // each thread allocates and fills its own copy, so under first-touch
+    // placement its pages land on the thread's node
+    int failed = 0;
+    #pragma omp parallel num_threads(threads) reduction(|:failed)
+    {
+        void* copy = NULL;
+        if (posix_memalign(&copy, (size_t)page, copy_bytes) == 0) {
+            memcpy(copy, params->kernel, kernel_bytes);
+            kernel[omp_get_thread_num()] = (float*)copy;
+        } else {
+            failed = 1;
+        }
+    }
+    if (failed) {
+        conv_thread_state_free(state);
+        return NULL;
+    }
+    return state;
+}
+
+void conv_thread_state_free(ConvThreadState* state) {
+    if (!state) return;
+    for (int t = 0; t < state->threads; ++t) free(state->kernel[t]);
+    free(state->kernel);
+    free(state);
+}
+#endif
+
+void ISA_VARIANT(conv_openmp)(ConvParams* params) {
+    if (params->taps) {
+        conv_openmp_taps(params);
+        return;
+    }
+    if (params->box) {
+        conv_openmp_box(params);
+        return;
+    }
+
     const uint32_t H = params->H;
     const uint32_t W = params->W;
     const uint32_t kH = params->kH;
@@ -41,35 +474,83 @@ void conv_openmp(ConvParams* params) {
     const uint32_t out_W = params->out_W;
     const uint32_t input_offset = params->input_offset_row;
     const uint32_t output_offset = params->output_offset_row;
+    const uint32_t C = params->C ? params->C : 1;
+    const uint32_t K = params->K ? params->K : 1;
+    const BoundaryMode mode = params->boundary;
+    const int origin_h = calc_window_origin(kH, mode);
+    // column tiles read data columns from input_offset_col on
+    const int origin_w = calc_window_origin(kW, mode) + (int)params->input_offset_col -
+                         (int)(params->output_offset_col * sW);
+    // rows of the chunk that hold whole windows; zero padding ends at the
+    // chunk, the other modes at the plane (gathered chunks hold only windows)
+    const int chunk_bounds = mode == BOUNDARY_ZERO || params->gathered;
+    const int64_t row_lo = chunk_bounds ? (int64_t)input_offset : 0;
+    const int64_t row_hi = chunk_bounds ? (int64_t)input_offset + H : (int64_t)params->plane_H;
     
-    const uint32_t slots = out_H * out_W;
+    const size_t plane = (size_t)H * W;
+    const size_t taps = (size_t)kH * kW;
+    const size_t slots = (size_t)out_H * out_W;
+    const int threads = params->threads > 0 ? params->threads : omp_get_max_threads();
+
+    // output tiles whose footprint the occupancy index shows empty
+    const uint32_t tiles_x = (out_W + SKIP_TILE_COLS - 1) / SKIP_TILE_COLS;
+    const uint32_t tiles_y = (out_H + SKIP_TILE_ROWS - 1) / SKIP_TILE_ROWS;
+    uint8_t* skip = params->occupancy ? (uint8_t*)malloc((size_t)tiles_y * tiles_x) : NULL;
+    if (skip) {
+        #pragma omp parallel for schedule(static) collapse(2) num_threads(threads)
+        for (uint32_t ty = 0; ty < tiles_y; ty++) {
+            for (uint32_t tx = 0; tx < tiles_x; tx++) {
+                uint32_t r1 = (ty + 1) * SKIP_TILE_ROWS < out_H ? (ty + 1) * SKIP_TILE_ROWS : out_H;
+                uint32_t c1 = (tx + 1) * SKIP_TILE_COLS < out_W ? (tx + 1) * SKIP_TILE_COLS : out_W;
+                skip[(size_t)ty * tiles_x + tx] = (uint8_t)footprint_zero(params, ty * SKIP_TILE_ROWS, r1,
+                                                                          tx * SKIP_TILE_COLS, c1);
+            }
+        }
+    }
     
-    #pragma omp parallel
+    #pragma omp parallel num_threads(threads)
     {
-        float* local_kernel = (float*)malloc(kH * kW * sizeof(float));
-        if (local_kernel) {
-            memcpy(local_kernel, params->kernel, kH * kW * sizeof(float));
-        }
-        
-        #pragma omp for schedule(static)
-        for (uint32_t slot = 0; slot < slots; slot++) {
-            const uint32_t out_row = slot / out_W;
-            const uint32_t out_col = slot % out_W;
-            
-            const uint32_t row_center = (out_row + output_offset) * sH - input_offset;
-            const uint32_t col_center = out_col * sW;
-            
-            float* kernel_data = local_kernel ? local_kernel : params->kernel;
-            float value = apply_window(
-                params->data, kernel_data,
-                H, W, row_center, col_center, kH, kW
-            );
-            
-            params->output[slot] = value;
-        }
-        
-        if (local_kernel) {
-            free(local_kernel);
+        // the run's copy of this thread if the runner keeps one; without it
+        // every thread reads the shared kernel rather than copying it per call
+        const ConvThreadState* state = params->thread_state;
+        const int tid = omp_get_thread_num();
+        const float* local_kernel = state && tid < state->threads && state->kernel[tid] ? state->kernel[tid]
+                                                                                       : params->kernel;
+
+        #pragma omp for schedule(static) collapse(2)
+        for (uint32_t k = 0; k < K; k++) {
+            for (size_t slot = 0; slot < slots; slot++) {
+                const uint32_t out_row = (uint32_t)(slot / out_W);
+                const uint32_t out_col = (uint32_t)(slot % out_W);
+                if (skip && skip[(size_t)(out_row / SKIP_TILE_ROWS) * tiles_x + out_col / SKIP_TILE_COLS]) {
+                    params->output[(size_t)k * slots + slot] = 0.0f;
+                    continue;
+                }
+                
+                const int64_t top = params->gathered ? (int64_t)out_row * kH + input_offset
+                                                     : (int64_t)(out_row + output_offset) * sH - origin_h;
+                const int left = (int)(out_col * sW) - origin_w;
+                // VALID windows always take the interior path
+                const int interior = top >= row_lo && top + kH <= row_hi && left >= 0 && left + (int)kW <= (int)W;
+                int local_top = (int)(top - (int64_t)input_offset);
+                if (interior && local_top < 0) local_top += (int)params->plane_H;   // circular chunk past the seam
+                
+                // the channel reduction stays inside the window loop
+                const float* kernel_data = local_kernel + (size_t)k * C * taps;
+                float value = 0.0f;
+                for (uint32_t c = 0; c < C; c++) {
+                    if (interior) {
+                        value += apply_window(params->data + c * plane, kernel_data + c * taps,
+                                              W, (uint32_t)local_top, (uint32_t)left, kH, kW);
+                    } else {
+                        value += apply_border_window(params->data + c * plane, kernel_data + c * taps,
+                                                     W, params, (int)top, left, kH, kW, mode);
+                    }
+                }
+                
+                params->output[(size_t)k * slots + slot] = value;
+            }
         }
     }
+    free(skip);
 }
@@ -0,0 +1,113 @@
+#include "conv.h"
+#include "file.h"
+#include "isa.h"
+#include <omp.h>
+#include <stdio.h>
+#include <string.h>
+
+// Row-at-a-time pipeline for unseekable inputs. Input rows land in a ring of
+// kH rows that is written twice, at slot and slot + kH, so the window of any
+// output row is contiguous in the ring. An output row is convolved and
+// written as soon as the last input row of its window has arrived.
+int conv_pipe(ConvParams* params, RowStream* in, const char* output_path, const ConvRunOptions* opts) {
+    const uint32_t H = params->H;
+    const uint32_t W = params->W;
+    const uint32_t kH = params->kH;
+    const uint32_t sH = params->sH;
+    const uint32_t out_H = params->out_H;
+    const uint32_t out_W = params->out_W;
+    const int text_output = opts->text_output;
+    const uint32_t bin_version = text_output ? 1 : opts->bin_version;
+    const size_t out_pitch = bin_row_pitch(bin_version, out_W, opts->out_dtype, opts->row_pitch);
+
+    if (in->height != H || in->width != W) {
+        fprintf(stderr, "Input stream is %ux%u, expected %ux%u\n", in->height, in->width, H, W);
+        return 1;
+    }
+
+    const uint32_t ring_rows = kH < H ? kH : H;
+    float* ring = alloc_aligned((size_t)2 * ring_rows * W);
+    float* row = alloc_aligned(out_W);
+    char* text = (char*)malloc(text_output ? txt_rows_capacity(1, out_W) : out_pitch);
+    FILE* out = strcmp(output_path, "-") == 0 ? stdout : fopen(output_path, text_output ? "w" : "wb");
+    int rc = (!ring || !row || !text || !out) ? 1 : 0;
+    if (!out) fprintf(stderr, "Failed to open output %s\n", output_path);
+
+    // headers are written up front; nothing after them is ever revisited
+    if (!rc && text_output) {
+        char header[64];
+        size_t len = format_txt_header(header, sizeof(header), out_H, out_W);
+        rc = fwrite(header, 1, len, out) != len;
+    } else if (!rc) {
+        unsigned char header[BIN_HEADER_MAX_BYTES];
+        BinaryLayout layout = {out_H, out_W, opts->out_dtype, 0, 1.0f, 0, bin_version, out_pitch};
+        size_t len = format_bin_header(header, &layout);
+        rc = fwrite(header, 1, len, out) != len;
+        for (size_t pad = len; !rc && pad < layout.data_offset; ++pad) rc = fputc(0, out) == EOF;
+    }
+
+    fprintf(stderr, "[PIPE] in=%ux%u out=%ux%u ring_rows=%u ring=%.1fKB output=%s\n", H, W, out_H, out_W,
+            ring_rows, 2.0 * ring_rows * W * sizeof(float) / 1024.0, output_path);
+
+    double t_start = omp_get_wtime(), t_read = 0.0, t_comp = 0.0;
+    uint32_t next_out = 0;
+    for (uint32_t r = 0; !rc && r < H; ++r) {
+        float* slot = ring + (size_t)(r % ring_rows) * W;
+        double t0 = omp_get_wtime();
+        if (read_stream_row(in, slot) != 0) {
+            fprintf(stderr, "Failed to read input row %u\n", r);
+            rc = 1;
+            break;
+        }
+        memcpy(slot + (size_t)ring_rows * W, slot, (size_t)W * sizeof(float));
+        t_read += omp_get_wtime() - t0;
+
+        while (!rc && next_out < out_H) {
+            // reflected and replicated edge rows are at most kH rows back too
+            uint32_t in_start = 0, in_rows = 0;
+            calc_input_rows(params, next_out, next_out + 1, &in_start, &in_rows);
+            if (in_start + in_rows - 1 > r) break;
+
+            ConvParams row_params = *params;
+            row_params.data = ring + (size_t)(in_start % ring_rows) * W;
+            row_params.output = row;
+            row_params.H = in_rows;
+            row_params.out_H = 1;
+            row_params.input_offset_row = in_start;
+            row_params.output_offset_row = next_out;
+
+            t0 = omp_get_wtime();
+            if (conv_compute(&row_params) != 0) {
+                fprintf(stderr, "Failed to convolve output row %u\n", next_out);
+                rc = 1;
+                break;
+            }
+            t_comp += omp_get_wtime() - t0;
+
+            size_t len = 0;
+            if (text_output) {
+                len = format_txt_rows(row, 1, out_W, next_out + 1 == out_H, text);
+            } else {
+                pack_bin_rows(row, 1, out_W, opts->out_dtype, out_pitch, text);
+                len = out_pitch;
+            }
+            // flushed per row so a consumer downstream sees it right away
+            if (len == (size_t)-1 || fwrite(text, 1, len, out) != len || fflush(out) != 0) {
+                fprintf(stderr, "Failed to write output row %u to %s\n", next_out, output_path);
+                rc = 1;
+            }
+            next_out++;
+        }
+    }
+
+    if (!rc) {
+        fprintf(stderr, "mode=pipe ranks=1 isa=%s H=%u W=%u k=%ux%u s=%ux%u read=%.3fs comp=%.3fs total=%.3fs\n",
+                isa_name(isa_level()), H, W, kH, params->kW, sH, params->sW, t_read, t_comp, omp_get_wtime() - t_start);
+    }
+
+    if (out && out != stdout) fclose(out);
+    free(ring);
+    free(row);
+    free(text);
+    return rc;
+}
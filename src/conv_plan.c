@@ -0,0 +1,571 @@
+#include "libconv.h"
+#include "conv.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef enum {
+    CONV_ENGINE_DIRECT = 0,
+    CONV_ENGINE_QUANT,
+} ConvEngine;
+
+struct ConvPlan {
+    ConvParams params;      // kernel points at the plan's aligned copy
+    ConvEngine engine;
+    ConvChain chain;        // fused stages after the first, kernels owned
+    ConvTaps taps;          // compiled non-zero taps of the first stage
+    float* box;             // per-plane weights if the first kernel is constant
+    int16_t* qkernel;       // CONV_ENGINE_QUANT only
+    float qkernel_scale;
+    int qkernel_wide;       // quantized window sums need int64
+    uint32_t quant_dtype;
+    ConvThreadState* thread_state;  // per-thread kernel copies, kept for every run of the plan
+    float* scratch_in;      // per-rank rows for conv_plan_execute_mpi
+    float* scratch_out;
+    size_t scratch_in_elems;
+    size_t scratch_out_elems;
+};
+
+ConvPlan* conv_plan_create_tensor(uint32_t N, uint32_t C, uint32_t H, uint32_t W,
+                                  const float* kernel, uint32_t K, uint32_t kH, uint32_t kW,
+                                  uint32_t sH, uint32_t sW,
+                                  int threads) {
+    if (!kernel || !N || !C || !K || !H || !W || !kH || !kW || !sH || !sW) return NULL;
+    if ((uint64_t)N * C * H > UINT32_MAX || (uint64_t)N * K * H > UINT32_MAX) return NULL;
+
+    ConvPlan* plan = (ConvPlan*)calloc(1, sizeof(ConvPlan));
+    if (!plan) return NULL;
+
+    const size_t kernel_elems = (size_t)K * C * kH * kW;
+    plan->params.kernel = alloc_aligned(kernel_elems);
+    if (!plan->params.kernel) {
+        free(plan);
+        return NULL;
+    }
+    memcpy(plan->params.kernel, kernel, kernel_elems * sizeof(float));
+    plan->box = (float*)malloc((size_t)K * C * sizeof(float));
+    if (plan->box && !compile_kernel_box(kernel, K * C, kH, kW, plan->box)) {
+        free(plan->box);
+        plan->box = NULL;
+    }
+
+    plan->params.H = H;
+    plan->params.plane_H = H;
+    plan->params.W = W;
+    plan->params.kH = kH;
+    plan->params.kW = kW;
+    plan->params.sH = sH;
+    plan->params.sW = sW;
+    plan->params.threads = threads;
+    plan->params.N = N;
+    plan->params.C = C;
+    plan->params.K = K;
+    calc_output_dims(&plan->params);
+    plan->engine = CONV_ENGINE_DIRECT;
+    conv_plan_set_box(plan, -1);
+    return plan;
+}
+
+ConvPlan* conv_plan_create(uint32_t H, uint32_t W,
+                           const float* kernel, uint32_t kH, uint32_t kW,
+                           uint32_t sH, uint32_t sW,
+                           int threads) {
+    return conv_plan_create_tensor(1, 1, H, W, kernel, 1, kH, kW, sH, sW, threads);
+}
+
+void conv_plan_destroy(ConvPlan* plan) {
+    if (!plan) return;
+    free(plan->params.kernel);
+    for (uint32_t s = 0; s < plan->chain.count; ++s) {
+        free(plan->chain.stages[s].kernel);
+        conv_thread_state_free(plan->chain.stages[s].thread_state);
+    }
+    free(plan->chain.stages);
+    free_kernel_taps(&plan->taps);
+    free(plan->box);
+    free(plan->qkernel);
+    conv_thread_state_free(plan->thread_state);
+    free(plan->scratch_in);
+    free(plan->scratch_out);
+    free(plan);
+}
+
+// Stage 0 dims come from params; each fused stage takes the previous output.
+static void update_chain_dims(ConvPlan* plan) {
+    calc_output_dims(&plan->params);
+    uint32_t H = plan->params.out_H, W = plan->params.out_W;
+    for (uint32_t s = 0; s < plan->chain.count; ++s) {
+        ConvStage* st = &plan->chain.stages[s];
+        st->H = H;
+        st->W = W;
+        H = (uint32_t)calc_output_height((int)H, (int)st->kH, (int)st->sH, plan->params.boundary);
+        W = (uint32_t)calc_output_width((int)W, (int)st->kW, (int)st->sW, plan->params.boundary);
+    }
+    plan->params.out_H = H;
+    plan->params.out_W = W;
+}
+
+int conv_plan_add_stage(ConvPlan* plan, const float* kernel, uint32_t kH, uint32_t kW,
+                        uint32_t sH, uint32_t sW) {
+    if (!plan || !kernel || !kH || !kW || !sH || !sW) return 1;
+    if (plan->engine == CONV_ENGINE_QUANT || plan->params.C * plan->params.K != 1 ||
+        plan->params.boundary == BOUNDARY_CIRCULAR) {
+        fprintf(stderr, "Fused stages need a single-channel fp32 plan without circular boundaries\n");
+        return 1;
+    }
+    ConvStage* stages = (ConvStage*)realloc(plan->chain.stages, ((size_t)plan->chain.count + 1) * sizeof(ConvStage));
+    if (!stages) return 1;
+    plan->chain.stages = stages;
+
+    ConvStage* st = &stages[plan->chain.count];
+    st->kernel = alloc_aligned((size_t)kH * kW);
+    if (!st->kernel) return 1;
+    memcpy(st->kernel, kernel, (size_t)kH * kW * sizeof(float));
+    st->kH = kH;
+    st->kW = kW;
+    st->sH = sH;
+    st->sW = sW;
+    st->thread_state = NULL;
+    plan->chain.count++;
+    plan->params.chain = &plan->chain;
+    update_chain_dims(plan);
+    return 0;
+}
+
+int conv_plan_reshape(ConvPlan* plan, uint32_t H, uint32_t W) {
+    if (!plan || !H || !W) return 1;
+    if ((uint64_t)plan->params.N * plan->params.C * H > UINT32_MAX ||
+        (uint64_t)plan->params.N * plan->params.K * H > UINT32_MAX) return 1;
+    plan->params.H = H;
+    plan->params.plane_H = H;
+    plan->params.W = W;
+    update_chain_dims(plan);
+    return plan->params.out_H && plan->params.out_W ? 0 : 1;
+}
+
+int conv_plan_set_boundary(ConvPlan* plan, BoundaryMode mode) {
+    if (!plan || (int)mode < BOUNDARY_ZERO || mode > BOUNDARY_VALID) return 1;
+    int padded = mode != BOUNDARY_ZERO && mode != BOUNDARY_VALID;
+    if ((padded && plan->engine == CONV_ENGINE_QUANT) || (mode == BOUNDARY_CIRCULAR && plan->chain.count)) {
+        fprintf(stderr, "%s boundaries are not supported by %s plans\n", boundary_name(mode),
+                plan->chain.count ? "fused" : "quantized");
+        return 1;
+    }
+    plan->params.boundary = mode;
+    update_chain_dims(plan);
+    return 0;
+}
+
+int conv_plan_compile_taps(ConvPlan* plan, float threshold, uint32_t* kept, uint32_t* total) {
+    if (!plan || !(threshold >= 0.0f)) return 1;
+    const ConvParams* p = &plan->params;
+    ConvTaps taps;
+    if (compile_kernel_taps(p->kernel, p->K * p->C, p->kH, p->kW, threshold, &taps) != 0) return 1;
+    free_kernel_taps(&plan->taps);
+    plan->taps = taps;
+    plan->params.taps = &plan->taps;
+    plan->params.box = NULL;
+    if (kept) *kept = taps.count;
+    if (total) *total = p->K * p->C * p->kH * p->kW;
+    return 0;
+}
+
+int conv_plan_set_box(ConvPlan* plan, int enable) {
+    if (!plan) return 0;
+    const int large = (size_t)plan->params.kH * plan->params.kW >= CONV_BOX_MIN_TAPS;
+    const int use = plan->box && !plan->params.taps && (enable > 0 || (enable < 0 && large));
+    plan->params.box = use ? plan->box : NULL;
+    return use;
+}
+
+void conv_plan_output_dims(const ConvPlan* plan, uint32_t* out_H, uint32_t* out_W) {
+    if (out_H) *out_H = plan->params.out_H;
+    if (out_W) *out_W = plan->params.out_W;
+}
+
+void conv_plan_tensor_dims(const ConvPlan* plan, uint32_t* N, uint32_t* C, uint32_t* K) {
+    if (N) *N = plan->params.N;
+    if (C) *C = plan->params.C;
+    if (K) *K = plan->params.K;
+}
+
+// The kernel copies are made on the first run and shared by all later ones;
+// the kernels themselves never change after they are added to the plan.
+static void keep_thread_state(ConvPlan* plan) {
+    if (plan->engine == CONV_ENGINE_QUANT) return;
+    if (!plan->thread_state) {
+        plan->thread_state = conv_thread_state_create(&plan->params);
+        plan->params.thread_state = plan->thread_state;
+    }
+    for (uint32_t s = 0; s < plan->chain.count; ++s) {
+        ConvStage* st = &plan->chain.stages[s];
+        if (st->thread_state) continue;
+        ConvParams stage = {0};
+        stage.kernel = st->kernel;
+        stage.kH = st->kH;
+        stage.kW = st->kW;
+        stage.threads = plan->params.threads;
+        st->thread_state = conv_thread_state_create(&stage);
+    }
+}
+
+static int run_rows(ConvPlan* plan, const float* input, uint32_t input_row_start, uint32_t num_input_rows,
+                     float* output, uint32_t out_row_start, uint32_t out_rows) {
+    ConvParams chunk = plan->params;
+    chunk.data = (float*)input;
+    chunk.output = output;
+    chunk.H = num_input_rows;
+    chunk.out_H = out_rows;
+    chunk.input_offset_row = input_row_start;
+    chunk.output_offset_row = out_row_start;
+    chunk.N = 1;
+    return conv_compute(&chunk);
+}
+
+int conv_plan_execute(ConvPlan* plan, const float* input, float* output) {
+    if (!plan || !input || !output) return 1;
+    const ConvParams* p = &plan->params;
+    const size_t in_image = (size_t)p->C * p->H * p->W;
+    const size_t out_image = (size_t)p->K * p->out_H * p->out_W;
+    keep_thread_state(plan);
+    for (uint32_t n = 0; n < p->N; ++n) {
+        if (run_rows(plan, input + n * in_image, 0, p->H, output + n * out_image, 0, p->out_H) != 0) return 1;
+    }
+    return 0;
+}
+
+static int reserve(float** buf, size_t* have, size_t need) {
+    if (need <= *have) return 0;
+    float* tmp = alloc_aligned(need);
+    if (!tmp) return 1;
+    free(*buf);
+    *buf = tmp;
+    *have = need;
+    return 0;
+}
+
+int conv_plan_execute_mpi(ConvPlan* plan, MPI_Comm comm, int root, const float* input, float* output) {
+    if (!plan) return 1;
+    keep_thread_state(plan);
+
+    int rank = 0, size = 1;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    const uint32_t H = plan->params.H;
+    const uint32_t W = plan->params.W;
+    const uint32_t out_H = plan->params.out_H;
+    const uint32_t out_W = plan->params.out_W;
+    const uint32_t N = plan->params.N;
+    const uint32_t C = plan->params.C;
+    const uint32_t K = plan->params.K;
+    const uint32_t rows_per_rank = (out_H + size - 1) / size;
+
+    int* out_counts = (int*)malloc((size_t)size * sizeof(int));
+    int* out_displs = (int*)malloc((size_t)size * sizeof(int));
+    MPI_Request* reqs = (MPI_Request*)malloc((size_t)2 * size * C * sizeof(MPI_Request));
+    if (!out_counts || !out_displs || !reqs) {
+        free(out_counts);
+        free(out_displs);
+        free(reqs);
+        return 1;
+    }
+
+    MPI_Datatype in_row, out_row;
+    MPI_Type_contiguous((int)W, MPI_FLOAT, &in_row);
+    MPI_Type_contiguous((int)out_W, MPI_FLOAT, &out_row);
+    MPI_Type_commit(&in_row);
+    MPI_Type_commit(&out_row);
+
+    uint32_t my_in_start = 0, my_in_rows = 0;
+    uint32_t my_out_start = 0, my_out_rows = 0;
+    for (int r = 0; r < size; ++r) {
+        uint32_t start = (uint32_t)r * rows_per_rank;
+        uint32_t end = start + rows_per_rank;
+        if (end > out_H) end = out_H;
+        if (start > end) start = end;
+        out_counts[r] = (int)(end - start);
+        out_displs[r] = (int)start;
+        if (r == rank) {
+            my_out_start = start;
+            my_out_rows = end - start;
+            if (end > start) calc_input_rows(&plan->params, start, end, &my_in_start, &my_in_rows);
+        }
+    }
+    // a single plane is used in place on root; channel planes, and circular
+    // rows that wrap around the plane, are gathered into contiguous scratch
+    // like on every other rank
+    const int root_direct = C == 1 && K == 1 && my_in_start + my_in_rows <= H;
+    const uint32_t my_head = my_in_start + my_in_rows > H ? H - my_in_start : my_in_rows;
+
+    int rc = 0;
+    if (my_out_rows && !(rank == root && root_direct)) {
+        rc = reserve(&plan->scratch_in, &plan->scratch_in_elems, (size_t)C * my_in_rows * W) ||
+             reserve(&plan->scratch_out, &plan->scratch_out_elems, (size_t)K * my_out_rows * out_W);
+        if (rc) {
+            fprintf(stderr, "[Rank %d] Failed to allocate plan scratch buffers\n", rank);
+            MPI_Abort(comm, 1);
+        }
+    }
+
+    for (uint32_t n = 0; n < N; ++n) {
+        const float* image_in = (rank == root) ? input + (size_t)n * C * H * W : NULL;
+        float* image_out = (rank == root) ? output + (size_t)n * K * out_H * out_W : NULL;
+
+        int nreqs = 0;
+        if (rank == root) {
+            for (int r = 0; r < size; ++r) {
+                if (r == rank || !out_counts[r]) continue;
+                uint32_t in_start = 0, in_rows = 0;
+                calc_input_rows(&plan->params, (uint32_t)out_displs[r], (uint32_t)(out_displs[r] + out_counts[r]),
+                                &in_start, &in_rows);
+                uint32_t head = in_start + in_rows > H ? H - in_start : in_rows;
+                // halos overlap between ranks, which Scatterv does not allow
+                for (uint32_t c = 0; c < C; ++c) {
+                    MPI_Isend(image_in + ((size_t)c * H + in_start) * W, (int)head, in_row, r, (int)c, comm, &reqs[nreqs++]);
+                    if (head < in_rows) {
+                        MPI_Isend(image_in + (size_t)c * H * W, (int)(in_rows - head), in_row, r, (int)(C + c), comm,
+                                  &reqs[nreqs++]);
+                    }
+                }
+            }
+        }
+
+        const float* local_in = NULL;
+        float* local_out = NULL;
+        if (rank == root && root_direct) {
+            local_in = image_in + (size_t)my_in_start * W;
+            local_out = image_out + (size_t)my_out_start * out_W;
+        } else if (my_out_rows) {
+            for (uint32_t c = 0; c < C; ++c) {
+                float* dst = plan->scratch_in + (size_t)c * my_in_rows * W;
+                if (rank == root) {
+                    memcpy(dst, image_in + ((size_t)c * H + my_in_start) * W, (size_t)my_head * W * sizeof(float));
+                    memcpy(dst + (size_t)my_head * W, image_in + (size_t)c * H * W,
+                           (size_t)(my_in_rows - my_head) * W * sizeof(float));
+                } else {
+                    MPI_Recv(dst, (int)my_head, in_row, root, (int)c, comm, MPI_STATUS_IGNORE);
+                    if (my_head < my_in_rows) {
+                        MPI_Recv(dst + (size_t)my_head * W, (int)(my_in_rows - my_head), in_row, root, (int)(C + c),
+                                 comm, MPI_STATUS_IGNORE);
+                    }
+                }
+            }
+            local_in = plan->scratch_in;
+            local_out = plan->scratch_out;
+        }
+
+        if (my_out_rows && run_rows(plan, local_in, my_in_start, my_in_rows, local_out, my_out_start, my_out_rows) != 0) {
+            fprintf(stderr, "[Rank %d] Failed to convolve output rows %u-%u\n", rank, my_out_start, my_out_start + my_out_rows);
+            MPI_Abort(comm, 1);
+        }
+        if (rank == root && !root_direct && my_out_rows) {
+            for (uint32_t k = 0; k < K; ++k) {
+                memcpy(image_out + ((size_t)k * out_H + my_out_start) * out_W,
+                       local_out + (size_t)k * my_out_rows * out_W, (size_t)my_out_rows * out_W * sizeof(float));
+            }
+        }
+
+        MPI_Waitall(nreqs, reqs, MPI_STATUSES_IGNORE);
+        for (uint32_t k = 0; k < K; ++k) {
+            if (rank == root) {
+                MPI_Gatherv(MPI_IN_PLACE, 0, out_row, image_out + (size_t)k * out_H * out_W,
+                            out_counts, out_displs, out_row, root, comm);
+            } else {
+                MPI_Gatherv(local_out ? local_out + (size_t)k * my_out_rows * out_W : NULL, (int)my_out_rows, out_row,
+                            NULL, NULL, NULL, out_row, root, comm);
+            }
+        }
+    }
+
+    MPI_Type_free(&in_row);
+    MPI_Type_free(&out_row);
+    free(out_counts);
+    free(out_displs);
+    free(reqs);
+    return rc;
+}
+
+// An explicit pitch must be aligned and hold a whole output row of a v2/v3 file.
+static int check_row_pitch(const ConvPlan* plan, const ConvRunOptions* opts) {
+    if (!opts->row_pitch || opts->text_output) return 0;
+    const size_t row_bytes = (size_t)plan->params.out_W * dtype_size(opts->out_dtype);
+    if (opts->bin_version >= 2 && opts->row_pitch >= row_bytes && opts->row_pitch % ALIGN_BYTES == 0) return 0;
+    fprintf(stderr, "Row pitch %zu needs .bin v2 or v3 output and a multiple of %d of at least %zu bytes\n",
+            opts->row_pitch, ALIGN_BYTES, row_bytes);
+    return 1;
+}
+
+int conv_plan_run(ConvPlan* plan, MPI_Comm comm, MatrixSource* src,
+                  const char* output_path, const ConvRunOptions* opts) {
+    if (!plan || !src || !opts) return 1;
+    const uint32_t rows = plan->params.N * plan->params.C * plan->params.H;
+    if (src->height != rows || src->width != plan->params.W) {
+        fprintf(stderr, "Input source is %ux%u, plan expects %ux%u\n",
+                src->height, src->width, rows, plan->params.W);
+        return 1;
+    }
+    if (opts->text_output && plan->params.K > 1) {
+        fprintf(stderr, "Text output holds a single matrix, not %u output planes\n", plan->params.K);
+        return 1;
+    }
+    if (opts->checkpoint && (opts->text_output || comm == MPI_COMM_NULL)) {
+        fprintf(stderr, "Checkpointed runs need .bin output and a communicator\n");
+        return 1;
+    }
+    if (check_row_pitch(plan, opts)) return 1;
+
+    keep_thread_state(plan);
+    ConvParams params = plan->params;
+    ConvQuant quant;
+    if (plan->engine == CONV_ENGINE_QUANT) {
+        if (src->dtype != plan->quant_dtype) {
+            fprintf(stderr, "Quantized plan expects %s input, source stores %s\n",
+                    dtype_name(plan->quant_dtype), dtype_name(src->dtype));
+            return 1;
+        }
+        quant.kernel = plan->qkernel;
+        quant.kernel_scale = plan->qkernel_scale;
+        quant.scale = src->scale * plan->qkernel_scale;
+        quant.wide = plan->qkernel_wide;
+        params.quant = &quant;
+        src->load_dtype = DTYPE_I16;
+    } else if (src->dtype == DTYPE_F16 || src->dtype == DTYPE_BF16) {
+        // 16-bit float chunks stay narrow and are widened as they are convolved
+        src->load_dtype = src->dtype;
+    }
+
+    int rc = 0;
+    int size = 1;
+    if (comm != MPI_COMM_NULL) MPI_Comm_size(comm, &size);
+    // only conv_mpi journals its output and runs an I/O thread, so such runs
+    // take it on one rank too
+    if (size > 1 || opts->checkpoint || opts->io_thread) {
+        conv_mpi(&params, comm, src, output_path, opts);
+    } else {
+        rc = conv_local(&params, src, output_path, opts);
+    }
+    src->load_dtype = DTYPE_F32;
+    return rc;
+}
+
+int conv_plan_run_txt(ConvPlan* plan, const char* txt_path,
+                      const char* output_path, const ConvRunOptions* opts) {
+    if (!plan || !opts) return 1;
+    if (plan->engine == CONV_ENGINE_QUANT) {
+        fprintf(stderr, "Quantized plans need a binary integer input, not %s\n", txt_path);
+        return 1;
+    }
+    if (plan->params.boundary == BOUNDARY_CIRCULAR) {
+        fprintf(stderr, "Circular boundaries need a seekable binary input, not %s\n", txt_path);
+        return 1;
+    }
+    if (plan->params.N * plan->params.C * plan->params.K != 1) {
+        fprintf(stderr, "Streaming text input supports a single-channel matrix only\n");
+        return 1;
+    }
+    if (check_row_pitch(plan, opts)) return 1;
+    return conv_txt_stream(&plan->params, txt_path, output_path, opts);
+}
+
+int conv_plan_run_pipe(ConvPlan* plan, RowStream* in,
+                       const char* output_path, const ConvRunOptions* opts) {
+    if (!plan || !in || !opts) return 1;
+    if (plan->engine == CONV_ENGINE_QUANT || plan->chain.count || plan->params.boundary == BOUNDARY_CIRCULAR ||
+        plan->params.N * plan->params.C * plan->params.K != 1) {
+        fprintf(stderr, "Pipe input supports single-stage, single-channel fp32 plans without circular boundaries only\n");
+        return 1;
+    }
+    if (check_row_pitch(plan, opts)) return 1;
+    return conv_pipe(&plan->params, in, output_path, opts);
+}
+
+int conv_plan_quantize(ConvPlan* plan, uint32_t in_dtype) {
+    if (!plan || !dtype_is_quantized(in_dtype)) return 1;
+    if (plan->params.C * plan->params.K != 1 || plan->chain.count ||
+        (plan->params.boundary != BOUNDARY_ZERO && plan->params.boundary != BOUNDARY_VALID)) {
+        fprintf(stderr, "Quantized plans support a single channel and kernel with zero or valid boundaries, without fused stages\n");
+        return 1;
+    }
+    const size_t taps = (size_t)plan->params.kH * plan->params.kW;
+    int16_t* qkernel = (int16_t*)malloc(taps * sizeof(int16_t));
+    if (!qkernel) return 1;
+    if (quantize_kernel(plan->params.kernel, plan->params.kH, plan->params.kW, in_dtype,
+                        qkernel, &plan->qkernel_scale, &plan->qkernel_wide) != 0) {
+        free(qkernel);
+        return 1;
+    }
+    free(plan->qkernel);
+    plan->qkernel = qkernel;
+    plan->quant_dtype = in_dtype;
+    plan->engine = CONV_ENGINE_QUANT;
+    return 0;
+}
+
+int conv_plan_quant_report(ConvPlan* plan, MatrixSource* ref, MatrixSource* quant_src,
+                           uint32_t sample_rows, ConvQuantReport* report) {
+    if (!plan || !ref || !quant_src || !report || plan->engine != CONV_ENGINE_QUANT) return 1;
+    if (quant_src->dtype != plan->quant_dtype) return 1;
+    memset(report, 0, sizeof(*report));
+
+    const uint32_t H = plan->params.H;
+    const uint32_t W = plan->params.W;
+    const uint32_t out_H = plan->params.out_H;
+    const uint32_t out_W = plan->params.out_W;
+    if (sample_rows > out_H) sample_rows = out_H;
+    if (!sample_rows) sample_rows = 1;
+
+    uint32_t max_in_rows = plan->params.kH < H ? plan->params.kH : H;
+    float* in_f32 = alloc_aligned((size_t)max_in_rows * W);
+    int16_t* in_i16 = (int16_t*)malloc((size_t)max_in_rows * W * sizeof(int16_t));
+    float* out_ref = alloc_aligned(out_W);
+    float* out_q = alloc_aligned(out_W);
+    int rc = (!in_f32 || !in_i16 || !out_ref || !out_q);
+
+    ConvQuant quant = {plan->qkernel, plan->qkernel_scale, quant_src->scale * plan->qkernel_scale, plan->qkernel_wide};
+    double err_sq = 0.0, ref_sq = 0.0;
+    for (uint32_t s = 0; !rc && s < sample_rows; ++s) {
+        uint32_t r = sample_rows > 1 ? (uint32_t)((uint64_t)s * (out_H - 1) / (sample_rows - 1)) : 0;
+        uint32_t in_start = 0, in_rows = 0;
+        calc_input_rows(&plan->params, r, r + 1, &in_start, &in_rows);
+
+        rc = source_read_rows(ref, in_start, in_rows, in_f32);
+        quant_src->load_dtype = DTYPE_I16;
+        rc = rc || source_read_rows(quant_src, in_start, in_rows, in_i16);
+        quant_src->load_dtype = DTYPE_F32;
+        if (rc) break;
+
+        ConvParams chunk = plan->params;
+        chunk.H = in_rows;
+        chunk.out_H = 1;
+        chunk.input_offset_row = in_start;
+        chunk.output_offset_row = r;
+        chunk.data = in_f32;
+        chunk.output = out_ref;
+        conv_compute(&chunk);
+        chunk.data = (float*)in_i16;
+        chunk.output = out_q;
+        chunk.quant = &quant;
+        conv_compute(&chunk);
+
+        for (uint32_t c = 0; c < out_W; ++c) {
+            double e = fabs((double)out_q[c] - (double)out_ref[c]);
+            if (e > report->max_abs_err) report->max_abs_err = e;
+            err_sq += e * e;
+            ref_sq += (double)out_ref[c] * out_ref[c];
+        }
+        report->rows++;
+    }
+
+    if (!rc && report->rows) {
+        double n = (double)report->rows * out_W;
+        report->rms_err = sqrt(err_sq / n);
+        report->ref_rms = sqrt(ref_sq / n);
+        report->snr_db = err_sq > 0.0 ? 10.0 * log10(ref_sq / err_sq) : INFINITY;
+    }
+    free(in_f32);
+    free(in_i16);
+    free(out_ref);
+    free(out_q);
+    return rc;
+}
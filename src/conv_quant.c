@@ -0,0 +1,210 @@
+#include "conv.h"
+#include "dtype.h"
+#include "isa.h"
+#include <omp.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#ifndef CONV_ISA_SUFFIX
+// Largest |q - zero_point| each integer storage type can feed the engine.
+static int32_t input_abs_max(uint32_t in_dtype) {
+    return in_dtype == DTYPE_I8 ? 255 : INT16_MAX;
+}
+
+int quantize_kernel(const float* kernel, uint32_t kH, uint32_t kW, uint32_t in_dtype, int16_t* qkernel, float* scale,
+                    int* wide) {
+    const size_t taps = (size_t)kH * kW;
+    if (!taps) return -1;
+    float m = 0.0f;
+    for (size_t i = 0; i < taps; ++i) m = fmaxf(m, fabsf(kernel[i]));
+
+    // int32 window sums need taps * |x| * |k| < 2^31; past that they widen
+    // to int64 rather than giving up kernel bits
+    *wide = (int64_t)taps * input_abs_max(in_dtype) * INT16_MAX > INT32_MAX;
+    *scale = m > 0.0f ? m / (float)INT16_MAX : 1.0f;
+    for (size_t i = 0; i < taps; ++i) qkernel[i] = (int16_t)lrintf(kernel[i] / *scale);
+    return 0;
+}
+#endif
+
+#if defined(__AVX2__)
+// 16 output columns at stride 1. Taps are taken in pairs so one madd_epi16
+// does two multiply-adds per column; unpacklo/hi leave the columns in
+// [0-3, 8-11] / [4-7, 12-15] order, which the final permutes undo.
+static inline void quant_block16(const int16_t* const* rows, const int16_t* kernel,
+                                 uint32_t kH, uint32_t kW_even, uint32_t c,
+                                 float scale, float* out, uint32_t count) {
+    __m256i acc_lo = _mm256_setzero_si256();
+    __m256i acc_hi = _mm256_setzero_si256();
+    for (uint32_t ki = 0; ki < kH; ++ki) {
+        if (!rows[ki]) continue;
+        const int16_t* x = rows[ki] + c;
+        const int16_t* k = kernel + (size_t)ki * kW_even;
+        for (uint32_t kj = 0; kj < kW_even; kj += 2) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(x + kj));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(x + kj + 1));
+            __m256i w = _mm256_set1_epi32((int32_t)(uint16_t)k[kj] | ((int32_t)k[kj + 1] << 16));
+            acc_lo = _mm256_add_epi32(acc_lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+            acc_hi = _mm256_add_epi32(acc_hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+        }
+    }
+    const __m256 s = _mm256_set1_ps(scale);
+    __m256 v0 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_permute2x128_si256(acc_lo, acc_hi, 0x20)), s);
+    __m256 v1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_permute2x128_si256(acc_lo, acc_hi, 0x31)), s);
+    if (count == 16) {
+        _mm256_storeu_ps(out, v0);
+        _mm256_storeu_ps(out + 8, v1);
+    } else {
+        float tmp[16];
+        _mm256_storeu_ps(tmp, v0);
+        _mm256_storeu_ps(tmp + 8, v1);
+        memcpy(out, tmp, count * sizeof(float));
+    }
+}
+
+// quant_block16 for wide sums: each madd pair fits int32 (|x|, |k| <= 2^15),
+// so only its result is widened into int64 accumulators.
+static inline void quant_block16_wide(const int16_t* const* rows, const int16_t* kernel,
+                                      uint32_t kH, uint32_t kW_even, uint32_t c,
+                                      float scale, float* out, uint32_t count) {
+    // columns 0-3, 8-11, 4-7, 12-15
+    __m256i acc[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(),
+                      _mm256_setzero_si256()};
+    for (uint32_t ki = 0; ki < kH; ++ki) {
+        if (!rows[ki]) continue;
+        const int16_t* x = rows[ki] + c;
+        const int16_t* k = kernel + (size_t)ki * kW_even;
+        for (uint32_t kj = 0; kj < kW_even; kj += 2) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(x + kj));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(x + kj + 1));
+            __m256i w = _mm256_set1_epi32((int32_t)(uint16_t)k[kj] | ((int32_t)k[kj + 1] << 16));
+            __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w);
+            __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w);
+            acc[0] = _mm256_add_epi64(acc[0], _mm256_cvtepi32_epi64(_mm256_castsi256_si128(lo)));
+            acc[1] = _mm256_add_epi64(acc[1], _mm256_cvtepi32_epi64(_mm256_extracti128_si256(lo, 1)));
+            acc[2] = _mm256_add_epi64(acc[2], _mm256_cvtepi32_epi64(_mm256_castsi256_si128(hi)));
+            acc[3] = _mm256_add_epi64(acc[3], _mm256_cvtepi32_epi64(_mm256_extracti128_si256(hi, 1)));
+        }
+    }
+    int64_t sums[16];
+    _mm256_storeu_si256((__m256i*)sums, acc[0]);
+    _mm256_storeu_si256((__m256i*)(sums + 4), acc[2]);
+    _mm256_storeu_si256((__m256i*)(sums + 8), acc[1]);
+    _mm256_storeu_si256((__m256i*)(sums + 12), acc[3]);
+    for (uint32_t i = 0; i < count; ++i) out[i] = (float)sums[i] * scale;
+}
+#endif
+
+// Same chunk contract as conv_openmp, but data holds int16 rows with the zero
+// point already removed. Sums are exact in int32 (int64 when quant->wide) and
+// dequantized on store.
+void ISA_VARIANT(conv_quant)(ConvParams* params) {
+    const uint32_t H = params->H;
+    const uint32_t W = params->W;
+    const uint32_t kH = params->kH;
+    const uint32_t kW = params->kW;
+    const uint32_t sH = params->sH;
+    const uint32_t sW = params->sW;
+    const uint32_t out_H = params->out_H;
+    const uint32_t out_W = params->out_W;
+    const uint32_t input_offset = params->input_offset_row;
+    const uint32_t output_offset = params->output_offset_row;
+    const int16_t* input = (const int16_t*)params->data;
+    const ConvQuant* quant = params->quant;
+    const float scale = quant->scale;
+
+    // zero padding or VALID only; the plan rejects the padded modes
+    const int half_h = calc_window_origin(kH, params->boundary);
+    const uint32_t half_w = (uint32_t)calc_window_origin(kW, params->boundary);
+    // column tiles keep as much of the left padding as lies before their data
+    const uint32_t pad_w = half_w + params->input_offset_col - params->output_offset_col * sW;
+    const uint32_t kW_even = (kW + 1) & ~1u;
+    // zero-padded copy of one input row: pad_w zeros, W values, then zeros
+    // covering the last window (and the vector overrun at stride 1)
+    const size_t padded_W = (size_t)W + kW_even + 32;
+    const int wide = quant->wide;
+    const int threads = params->threads > 0 ? params->threads : omp_get_max_threads();
+
+    #pragma omp parallel num_threads(threads)
+    {
+        int16_t* kernel = (int16_t*)calloc((size_t)kH * kW_even, sizeof(int16_t));
+        // a ring of kH padded rows: input row i sits in slot i % kH, so the
+        // rows a window shares with the last one are not copied again
+        int16_t* padded = (int16_t*)calloc((size_t)kH * padded_W, sizeof(int16_t));
+        int* slot_row = (int*)malloc((size_t)kH * sizeof(int));
+        const int16_t** rows = (const int16_t**)malloc((size_t)kH * sizeof(int16_t*));
+        int ok = kernel && padded && slot_row && rows;
+        if (ok) {
+            for (uint32_t ki = 0; ki < kH; ++ki) {
+                memcpy(kernel + (size_t)ki * kW_even, quant->kernel + (size_t)ki * kW, kW * sizeof(int16_t));
+                slot_row[ki] = -1;
+            }
+        }
+
+        #pragma omp for schedule(static)
+        for (uint32_t r = 0; r < out_H; ++r) {
+            float* out = params->output + (size_t)r * out_W;
+            if (!ok) {
+                memset(out, 0, (size_t)out_W * sizeof(float));
+                continue;
+            }
+
+            const int center = params->gathered ? (int)(r * kH) + half_h
+                                                : (int)((r + output_offset) * sH) - (int)input_offset;
+            for (uint32_t ki = 0; ki < kH; ++ki) {
+                int i = center + (int)ki - half_h;
+                if (i < 0 || i >= (int)H) {
+                    rows[ki] = NULL;
+                    continue;
+                }
+                const uint32_t slot = (uint32_t)i % kH;
+                int16_t* dst = padded + (size_t)slot * padded_W;
+                if (slot_row[slot] != i) {
+                    memcpy(dst + pad_w, input + (size_t)i * W, (size_t)W * sizeof(int16_t));
+                    slot_row[slot] = i;
+                }
+                rows[ki] = dst;
+            }
+
+            uint32_t c = 0;
+#if defined(__AVX2__)
+            if (sW == 1) {
+                for (; c < out_W; c += 16) {
+                    uint32_t count = out_W - c < 16 ? out_W - c : 16;
+                    if (wide) quant_block16_wide(rows, kernel, kH, kW_even, c, scale, out + c, count);
+                    else quant_block16(rows, kernel, kH, kW_even, c, scale, out + c, count);
+                }
+            }
+#endif
+            for (; wide && c < out_W; ++c) {
+                int64_t acc = 0;
+                for (uint32_t ki = 0; ki < kH; ++ki) {
+                    if (!rows[ki]) continue;
+                    const int16_t* x = rows[ki] + (size_t)c * sW;
+                    const int16_t* k = kernel + (size_t)ki * kW_even;
+                    for (uint32_t kj = 0; kj < kW; ++kj) acc += (int32_t)x[kj] * k[kj];
+                }
+                out[c] = (float)acc * scale;
+            }
+            for (; c < out_W; ++c) {
+                int32_t acc = 0;
+                for (uint32_t ki = 0; ki < kH; ++ki) {
+                    if (!rows[ki]) continue;
+                    const int16_t* x = rows[ki] + (size_t)c * sW;
+                    const int16_t* k = kernel + (size_t)ki * kW_even;
+                    for (uint32_t kj = 0; kj < kW; ++kj) acc += (int32_t)x[kj] * k[kj];
+                }
+                out[c] = (float)acc * scale;
+            }
+        }
+
+        free(kernel);
+        free(padded);
+        free(slot_row);
+        free(rows);
+    }
+}
@@ -0,0 +1,248 @@
+#include "conv.h"
+#include "file.h"
+#include "isa.h"
+#include <omp.h>
+#include <stdio.h>
+#include <string.h>
+
+// Streaming chunks are kept small so parsing and convolution overlap even on
+// inputs that would fit the budget in a single chunk.
+#define STREAM_CHUNK_BYTES (4u << 20)
+
+typedef struct {
+    float* input;
+    float* output;              // packed output rows when banded
+    uint32_t out_row_start;
+    uint32_t out_row_end;
+    uint32_t input_row_start;
+    uint32_t num_input_rows;
+} StreamChunk;
+
+// Fills chunk->input with its input rows. Rows shared with the previous chunk
+// are copied from prev (which is only read, so it may still be convolving);
+// the rest are parsed from the text file, skipping rows no output touches.
+static int load_stream_chunk(TextFile* tf, StreamChunk* chunk, const StreamChunk* prev, uint32_t W) {
+    uint32_t row = chunk->input_row_start;
+    uint32_t end = chunk->input_row_start + chunk->num_input_rows;
+
+    if (prev && prev->num_input_rows) {
+        uint32_t prev_end = prev->input_row_start + prev->num_input_rows;
+        if (row < prev_end) {
+            uint32_t shared = (end < prev_end ? end : prev_end) - row;
+            memcpy(chunk->input,
+                   prev->input + (size_t)(row - prev->input_row_start) * W,
+                   (size_t)shared * W * sizeof(float));
+            row += shared;
+        }
+    }
+
+    if (row < end && tf->next_row < row) {
+        if (read_txt_rows(tf, NULL, row - tf->next_row) != 0) return -1;
+    }
+    if (row < end) {
+        return read_txt_rows(tf, chunk->input + (size_t)(row - chunk->input_row_start) * W, end - row);
+    }
+    return 0;
+}
+
+// text holds the formatted rows for text output; binary rows are written as
+// the chunk holds them.
+static int write_stream_chunk(FILE* out, const StreamChunk* chunk, uint32_t out_H, uint32_t out_W,
+                              const ConvRunOptions* opts, size_t out_pitch, char* text) {
+    uint32_t rows = chunk->out_row_end - chunk->out_row_start;
+    if (opts->text_output) {
+        size_t len = format_txt_rows(chunk->output, rows, out_W, chunk->out_row_end == out_H, text);
+        if (len == (size_t)-1) return -1;
+        return fwrite(text, 1, len, out) == len ? 0 : -1;
+    }
+    size_t bytes = (size_t)rows * out_pitch;
+    return fwrite(chunk->output, 1, bytes, out) == bytes ? 0 : -1;
+}
+
+int conv_txt_stream(ConvParams* params,
+                    const char* txt_path,
+                    const char* output_path,
+                    const ConvRunOptions* opts) {
+    const uint32_t H = params->H;
+    const uint32_t W = params->W;
+    const uint32_t kH = params->kH;
+    const uint32_t kW = params->kW;
+    const uint32_t sH = params->sH;
+    const uint32_t out_H = params->out_H;
+    const uint32_t out_W = params->out_W;
+    const int text_output = opts->text_output;
+    const uint32_t bin_version = text_output ? 1 : opts->bin_version;
+    const size_t out_pitch = bin_row_pitch(bin_version, out_W, opts->out_dtype, opts->row_pitch);
+    const int packed_output = !text_output && (opts->out_dtype != DTYPE_F32 || out_pitch != (size_t)out_W * sizeof(float));
+
+    TextFile tf = open_txt_matrix_input((char*)txt_path);
+    if (!tf.file) return 1;
+    if (tf.height != H || tf.width != W) {
+        fprintf(stderr, "Text matrix %s is %ux%u, expected %ux%u\n", txt_path, tf.height, tf.width, H, W);
+        close_txt_matrix_input(&tf);
+        return 1;
+    }
+
+    // packed output is held as stored and convolved through fp32 bands, an
+    // eighth of the budget at most
+    int threads = params->threads > 0 ? params->threads : omp_get_max_threads();
+    size_t band_budget = packed_output ? opts->budget_bytes / 8 : 0;
+    if (band_budget > (size_t)threads * CONV_BAND_THREAD_BYTES) band_budget = (size_t)threads * CONV_BAND_THREAD_BYTES;
+    ConvBand band = {NULL, NULL, 0, 0};
+    const size_t band_bytes = packed_output ? conv_band_size(params, W, out_W, band_budget, &band) : 0;
+    const size_t chunk_budget = opts->budget_bytes / 2 > 2 * band_bytes ? opts->budget_bytes / 2 - band_bytes
+                                                                        : opts->budget_bytes / 4;
+
+    uint32_t budget_out_W = text_output ? out_W + out_W * (TXT_VALUE_MAX_CHARS + 1) / sizeof(float)
+                          : packed_output ? (uint32_t)((out_pitch + sizeof(float) - 1) / sizeof(float)) : out_W;
+    uint32_t span_kH = kH, span_sH = sH;
+    calc_row_span(params, &span_kH, &span_sH);
+    uint32_t chunk_rows = calc_chunk_size(W, budget_out_W, span_kH, kW, span_sH, chunk_budget);
+    const char* whole_rows = whole_row_reason(params, text_output);
+    check_row_budget(W, budget_out_W, span_kH, kW, span_sH, chunk_budget,
+                     whole_rows ? whole_rows : "text input is parsed in whole rows");
+    uint32_t stream_rows = (uint32_t)(STREAM_CHUNK_BYTES / ((size_t)W * sizeof(float)) / span_sH);
+    if (!stream_rows) stream_rows = 1;
+    if (chunk_rows > stream_rows) chunk_rows = stream_rows;
+    uint32_t num_chunks = (out_H + chunk_rows - 1) / chunk_rows;
+
+    uint32_t max_input_rows = chunk_rows * span_sH + span_kH;
+    if (max_input_rows > H) max_input_rows = H;
+
+    StreamChunk chunks[2];
+    memset(chunks, 0, sizeof(chunks));
+    char* text = NULL;
+    int rc = 0;
+    const size_t input_bytes = (size_t)max_input_rows * W * sizeof(float);
+    const size_t output_bytes = packed_output ? (size_t)chunk_rows * out_pitch : (size_t)chunk_rows * out_W * sizeof(float);
+    const size_t text_bytes = text_output ? txt_rows_capacity(chunk_rows, out_W) : 0;
+    BufferArena own_arena;
+    BufferArena* arena = arena_begin_run(opts->arena, &own_arena, 2 * (input_bytes + output_bytes + 2 * ALIGN_BYTES) +
+                                         band_bytes + text_bytes, threads);
+    for (int i = 0; i < 2; ++i) {
+        chunks[i].input = (float*)arena_alloc(arena, input_bytes);
+        chunks[i].output = (float*)arena_alloc(arena, output_bytes);
+        if (!chunks[i].input || !chunks[i].output) rc = 1;
+    }
+    if (packed_output) {
+        band.input = (float*)arena_alloc(arena, (size_t)band.in_rows * W * sizeof(float));
+        band.output = (float*)arena_alloc(arena, (size_t)band.rows * out_W * sizeof(float));
+        if (!band.input || !band.output) rc = 1;
+    }
+    if (text_bytes) {
+        text = (char*)arena_alloc(arena, text_bytes);
+        if (!text) rc = 1;
+    }
+
+    FILE* out = NULL;
+    if (!rc) {
+        if (text_output) {
+            out = fopen(output_path, "w");
+            if (out) {
+                char header[64];
+                size_t header_len = format_txt_header(header, sizeof(header), out_H, out_W);
+                fwrite(header, 1, header_len, out);
+            }
+        } else {
+            BinaryLayout layout = {out_H, out_W, opts->out_dtype, 0, 1.0f, 0, bin_version, out_pitch};
+            out = create_bin_matrix_layout((char*)output_path, &layout);
+        }
+        if (!out) {
+            fprintf(stderr, "Failed to open output file %s\n", output_path);
+            rc = 1;
+        }
+    } else {
+        fprintf(stderr, "Failed to allocate streaming buffers\n");
+    }
+
+    int parse_threads = threads / 2 ? threads / 2 : 1;
+    int conv_threads = threads - parse_threads ? threads - parse_threads : 1;
+    int saved_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(2);
+
+    printf("[STREAM] threads=%d (conv=%d parse=%d) chunk_rows=%u total_chunks=%u out_size=%ux%u\n",
+           threads, conv_threads, parse_threads, chunk_rows, num_chunks, out_H, out_W);
+
+    double t_parse_total = 0.0, t_comp_total = 0.0, t_start = omp_get_wtime();
+
+    for (uint32_t c = 0; !rc && c <= num_chunks; ++c) {
+        // iteration c parses chunk c while chunk c - 1 is convolved and written
+        StreamChunk* load = (c < num_chunks) ? &chunks[c & 1] : NULL;
+        StreamChunk* work = c ? &chunks[(c - 1) & 1] : NULL;
+        int load_rc = 0, conv_rc = 0, work_rc = 0;
+        double t_parse = 0.0, t_conv = 0.0;
+
+        if (load) {
+            load->out_row_start = c * chunk_rows;
+            load->out_row_end = load->out_row_start + chunk_rows;
+            if (load->out_row_end > out_H) load->out_row_end = out_H;
+            calc_input_rows(params, load->out_row_start, load->out_row_end,
+                            &load->input_row_start, &load->num_input_rows);
+        }
+
+        #pragma omp parallel sections num_threads(2)
+        {
+            #pragma omp section
+            {
+                if (work) {
+                    omp_set_num_threads(conv_threads);
+                    ConvParams chunk_params = *params;
+                    chunk_params.threads = conv_threads;
+                    chunk_params.data = work->input;
+                    chunk_params.output = work->output;
+                    chunk_params.H = work->num_input_rows;
+                    chunk_params.out_H = work->out_row_end - work->out_row_start;
+                    chunk_params.input_offset_row = work->input_row_start;
+                    chunk_params.output_offset_row = work->out_row_start;
+
+                    double t0 = omp_get_wtime();
+                    conv_rc = packed_output ? conv_compute_bands(&chunk_params, DTYPE_F32, opts->out_dtype, out_pitch, &band)
+                                            : conv_compute(&chunk_params);
+                    t_conv = omp_get_wtime() - t0;
+                    if (!conv_rc) work_rc = write_stream_chunk(out, work, out_H, out_W, opts, out_pitch, text);
+                }
+            }
+            #pragma omp section
+            {
+                if (load) {
+                    omp_set_num_threads(parse_threads);
+                    double t0 = omp_get_wtime();
+                    load_rc = load_stream_chunk(&tf, load, work, W);
+                    t_parse = omp_get_wtime() - t0;
+                }
+            }
+        }
+
+        if (load_rc) {
+            fprintf(stderr, "Failed to parse input rows for chunk %u of %s\n", c + 1, txt_path);
+            rc = 1;
+        }
+        if (conv_rc) {
+            fprintf(stderr, "Failed to convolve output rows %u-%u of %s\n", work->out_row_start, work->out_row_end, output_path);
+            rc = 1;
+        }
+        if (work_rc) {
+            fprintf(stderr, "Failed to write output rows %u-%u to %s\n", work->out_row_start, work->out_row_end, output_path);
+            rc = 1;
+        }
+        t_parse_total += t_parse;
+        t_comp_total += t_conv;
+        if (work) {
+            printf("[STREAM] %u/%u out_rows=%u-%u in_rows=%u parse_next=%.4fs conv=%.4fs\n",
+                   c, num_chunks, work->out_row_start, work->out_row_end, work->num_input_rows, t_parse, t_conv);
+        }
+    }
+
+    omp_set_max_active_levels(saved_levels);
+
+    if (!rc) {
+        printf("mode=stream ranks=1 threads=%d isa=%s H=%u W=%u k=%ux%u s=%ux%u parse=%.3fs comp=%.3fs total=%.3fs\n",
+               threads, isa_name(isa_level()), H, W, kH, kW, sH, params->sW, t_parse_total, t_comp_total, omp_get_wtime() - t_start);
+    }
+
+    if (out) fclose(out);
+    if (rc && out) remove(output_path);
+    arena_end_run(arena, rc ? NULL : "");
+    close_txt_matrix_input(&tf);
+    return rc;
+}
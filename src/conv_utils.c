@@ -9,8 +9,8 @@ float* alloc_aligned(size_t count) {
 }
 
 void calc_output_dims(ConvParams* params) {
-    params->out_H = (uint32_t)calc_output_height((int)params->H, (int)params->kH, (int)params->sH);
-    params->out_W = (uint32_t)calc_output_width((int)params->W, (int)params->kW, (int)params->sW);
+    params->out_H = (uint32_t)calc_output_height((int)params->H, (int)params->kH, (int)params->sH, params->boundary);
+    params->out_W = (uint32_t)calc_output_width((int)params->W, (int)params->kW, (int)params->sW, params->boundary);
 }
 
 void calc_input_rows_for_output_range_clamped(uint32_t out_row_start,
@@ -34,22 +34,281 @@ void calc_input_rows_for_output_range_clamped(uint32_t out_row_start,
     *num_input_rows = (uint32_t)((in_end > in_start) ? (in_end - in_start) : 0);
 }
 
+void calc_window_rows(uint32_t out_row_start, uint32_t out_row_end, uint32_t sH, uint32_t kH,
+                      uint32_t H, BoundaryMode mode, uint32_t* input_row_start, uint32_t* num_input_rows) {
+    if (mode == BOUNDARY_ZERO) {
+        calc_input_rows_for_output_range_clamped(out_row_start, out_row_end, sH, kH, H,
+                                                 input_row_start, num_input_rows);
+        return;
+    }
+
+    int64_t first = (int64_t)out_row_start * sH - calc_window_origin(kH, mode);
+    int64_t end = (int64_t)(out_row_end ? out_row_end - 1 : out_row_start) * sH -
+                  calc_window_origin(kH, mode) + kH;
+    if (mode == BOUNDARY_CIRCULAR) {
+        if (end - first >= (int64_t)H) {
+            first = 0;
+            end = H;
+        }
+        *input_row_start = (uint32_t)boundary_index((int)first, (int)H, mode);
+        *num_input_rows = (uint32_t)(end - first);
+        return;
+    }
+
+    // VALID windows never leave the plane; reflected and replicated halo rows
+    // map to edge rows just inside it
+    int64_t lo = first < 0 ? 0 : first;
+    int64_t hi = end > (int64_t)H ? (int64_t)H : end;
+    for (int64_t i = first < 0 ? first : (int64_t)H; i < end; ++i) {
+        if (i == 0) i = H;      // on to the bottom halo
+        if (i >= end) break;
+        int64_t row = boundary_index((int)i, (int)H, mode);
+        if (row < lo) lo = row;
+        if (row + 1 > hi) hi = row + 1;
+    }
+    *input_row_start = (uint32_t)lo;
+    *num_input_rows = (uint32_t)(hi - lo);
+}
+
+void calc_input_rows(const ConvParams* params, uint32_t out_row_start, uint32_t out_row_end,
+                     uint32_t* input_row_start, uint32_t* num_input_rows) {
+    uint32_t start = out_row_start, end = out_row_end;
+    const ConvChain* chain = params->chain;
+    for (uint32_t s = chain ? chain->count : 0; s > 0; --s) {
+        const ConvStage* st = &chain->stages[s - 1];
+        uint32_t rows = 0;
+        calc_window_rows(start, end, st->sH, st->kH, st->H, params->boundary, &start, &rows);
+        end = start + rows;
+    }
+    calc_window_rows(start, end, params->sH, params->kH, params->H, params->boundary,
+                     input_row_start, num_input_rows);
+}
+
+void calc_row_span(const ConvParams* params, uint32_t* kH, uint32_t* sH) {
+    // a reflected bottom halo of an even kernel reaches one row above the window
+    const uint32_t extra = params->boundary == BOUNDARY_REFLECT ? 1 : 0;
+    uint32_t span = params->kH + extra, stride = params->sH;
+    const ConvChain* chain = params->chain;
+    for (uint32_t s = 0; chain && s < chain->count; ++s) {
+        span += (chain->stages[s].kH - 1 + extra) * stride;
+        stride *= chain->stages[s].sH;
+    }
+    *kH = span;
+    *sH = stride;
+}
+
+uint32_t calc_chunk_end(uint32_t row, uint32_t chunk_rows, uint32_t row_end, uint32_t out_H) {
+    // 64-bit so the sums cannot wrap near UINT32_MAX rows
+    uint64_t end = (uint64_t)row + chunk_rows;
+    uint64_t image_end = ((uint64_t)row / out_H + 1) * out_H;
+    if (end > image_end) end = image_end;
+    if (end > row_end) end = row_end;
+    return (uint32_t)end;
+}
+
+uint32_t count_chunks(uint32_t row_start, uint32_t row_end, uint32_t chunk_rows, uint32_t out_H) {
+    uint32_t chunks = 0;
+    for (uint32_t row = row_start; row < row_end; row = calc_chunk_end(row, chunk_rows, row_end, out_H)) chunks++;
+    return chunks;
+}
+
+int start_input_planes(MatrixSource* src, const ConvParams* params, uint32_t image,
+                       uint32_t row_start, uint32_t rows, void* dst, MPI_Request* reqs) {
+    const uint32_t C = params->C ? params->C : 1;
+    const size_t row_bytes = (size_t)params->W * source_load_size(src);
+    const size_t plane_bytes = (size_t)rows * row_bytes;
+    // a circular range wraps to the top of the plane at most once
+    const uint32_t head = row_start + rows > params->H ? params->H - row_start : rows;
+    for (uint32_t i = 0; i < 2 * C; ++i) reqs[i] = MPI_REQUEST_NULL;
+    for (uint32_t c = 0; c < C; ++c) {
+        uint32_t src_row = ((image * C) + c) * params->H;
+        char* plane = (char*)dst + c * plane_bytes;
+        if (source_start_rows(src, src_row + row_start, head, plane, &reqs[2 * c]) != 0 ||
+            (head < rows && source_start_rows(src, src_row, rows - head, plane + head * row_bytes, &reqs[2 * c + 1]) != 0)) {
+            wait_input_planes(src, c + 1, reqs);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int gather_input_rows(const ConvParams* params) {
+    return params->sH > params->kH && !(params->chain && params->chain->count) &&
+           (params->boundary == BOUNDARY_ZERO || params->boundary == BOUNDARY_VALID);
+}
+
+int start_input_gather(MatrixSource* src, const ConvParams* params, uint32_t image,
+                       uint32_t out_row_start, uint32_t out_rows, void* dst, MPI_Request* reqs) {
+    const uint32_t C = params->C ? params->C : 1;
+    const uint32_t kH = params->kH;
+    const int origin = calc_window_origin(kH, params->boundary);
+    const uint32_t count = C * out_rows * kH;
+    for (uint32_t i = 0; i < 2 * C; ++i) reqs[i] = MPI_REQUEST_NULL;
+
+    uint32_t* rows = (uint32_t*)malloc((size_t)(count ? count : 1) * sizeof(uint32_t));
+    if (!rows) return -1;
+    uint32_t n = 0;
+    for (uint32_t c = 0; c < C; ++c) {
+        const uint32_t src_row = ((image * C) + c) * params->H;
+        for (uint32_t r = out_row_start; r < out_row_start + out_rows; ++r) {
+            for (uint32_t ki = 0; ki < kH; ++ki) {
+                int64_t g = (int64_t)r * params->sH - origin + ki;
+                rows[n++] = g >= 0 && g < (int64_t)params->H ? src_row + (uint32_t)g : SOURCE_ZERO_ROW;
+            }
+        }
+    }
+    int rc = source_start_gather(src, rows, count, dst, &reqs[0]);
+    free(rows);
+    return rc;
+}
+
+int wait_input_planes(MatrixSource* src, uint32_t C, MPI_Request* reqs) {
+    int rc = 0;
+    for (uint32_t i = 0; i < 2 * (C ? C : 1); ++i) {
+        if (source_wait_rows(src, &reqs[i]) != 0) rc = -1;
+    }
+    return rc;
+}
+
+// The part of a budget left for chunk rows once the kernel is held.
+static size_t chunk_margin(uint32_t kH, uint32_t kW, size_t budget_bytes) {
+    size_t kernel_bytes = (size_t)kH * kW * sizeof(float);
+    size_t margin = budget_bytes > kernel_bytes ? budget_bytes - kernel_bytes : budget_bytes / 2;
+    return margin ? margin : budget_bytes;
+}
+
+static size_t chunk_row_bytes(uint32_t W, uint32_t out_W, uint32_t kH, uint32_t sH) {
+    return ((size_t)(sH + kH) * W + out_W) * sizeof(float);
+}
+
 uint32_t calc_chunk_size(uint32_t W,
                          uint32_t out_W,
                          uint32_t kH,
                          uint32_t kW,
                          uint32_t sH,
                          size_t budget_bytes) {
-    uint32_t rows_per_out = sH + kH;
-    size_t kernel_bytes = (size_t)kH * kW * sizeof(float);
-    size_t margin = budget_bytes > kernel_bytes ? budget_bytes - kernel_bytes : budget_bytes / 2;
-    if (!margin) margin = budget_bytes;
-    size_t row_bytes = (size_t)(rows_per_out * W + out_W) * sizeof(float);
+    size_t margin = chunk_margin(kH, kW, budget_bytes);
+    size_t row_bytes = chunk_row_bytes(W, out_W, kH, sH);
     if (!row_bytes) return 1;
     uint32_t chunk = (uint32_t)(margin / row_bytes);
     return chunk ? chunk : 1;
 }
 
+void check_row_budget(uint32_t W, uint32_t out_W, uint32_t kH, uint32_t kW, uint32_t sH, size_t budget_bytes,
+                      const char* why) {
+    const size_t row_bytes = chunk_row_bytes(W, out_W, kH, sH);
+    if (!why || row_bytes <= chunk_margin(kH, kW, budget_bytes)) return;
+    fprintf(stderr, "Warning: one output row and its input rows need %.3f MB, over the %.3f MB they may use, and %s; "
+            "running one row per chunk (raise -M to stay within it)\n", row_bytes / 1e6, budget_bytes / 1e6, why);
+}
+
+const char* whole_row_reason(const ConvParams* params, int text_output) {
+    if (params->chain && params->chain->count) return "fused stages read whole rows";
+    if (!tile_columns(params)) {
+        static char reason[64];
+        snprintf(reason, sizeof(reason), "%s boundaries read whole rows", boundary_name(params->boundary));
+        return reason;
+    }
+    if (text_output) return "text output is written in whole rows (CONVERT_BIN=0 writes tiled .bin)";
+    return NULL;
+}
+
+int tile_columns(const ConvParams* params) {
+    return !(params->chain && params->chain->count) &&
+           (params->boundary == BOUNDARY_ZERO || params->boundary == BOUNDARY_VALID);
+}
+
+uint32_t calc_tile_cols(uint32_t out_W, size_t in_bytes, size_t out_bytes, uint32_t kH, uint32_t kW,
+                        uint32_t sH, uint32_t sW, size_t budget_bytes) {
+    // same margin and rows per output row as calc_chunk_size
+    const int64_t rows_per_out = (int64_t)sH + kH;
+    const size_t margin = chunk_margin(kH, kW, budget_bytes);
+    // rows_per_out * ((cols - 1) * sW + kW) * in_bytes + cols * out_bytes <= margin
+    const int64_t fixed = rows_per_out * ((int64_t)kW - sW) * (int64_t)in_bytes;
+    const int64_t per_col = rows_per_out * sW * (int64_t)in_bytes + (int64_t)out_bytes;
+    const int64_t cols = per_col ? ((int64_t)margin - fixed) / per_col : (int64_t)out_W;
+    if (cols >= (int64_t)out_W) return out_W;
+    return cols > 0 ? (uint32_t)cols : 1;
+}
+
+size_t conv_band_size(const ConvParams* params, uint32_t W, uint32_t out_W, size_t budget_bytes, ConvBand* band) {
+    const uint32_t C = params->C ? params->C : 1;
+    const uint32_t K = params->K ? params->K : 1;
+    uint32_t span_kH = params->kH, span_sH = params->sH;
+    calc_row_span(params, &span_kH, &span_sH);
+    band->rows = calc_chunk_size(C * W, K * out_W, span_kH, params->kW, span_sH, budget_bytes);
+    // a chain recomputes its halo in every band, as in every block
+    if (params->chain && params->chain->count && band->rows < conv_chain_min_block(params)) {
+        band->rows = conv_chain_min_block(params);
+    }
+    if (band->rows > params->out_H) band->rows = params->out_H ? params->out_H : 1;
+    // the same bound as a chunk's input rows
+    band->in_rows = band->rows * span_sH + span_kH;
+    if (band->in_rows > params->H) band->in_rows = params->H;
+    if (gather_input_rows(params) && band->in_rows < band->rows * params->kH) band->in_rows = band->rows * params->kH;
+    return ((size_t)C * band->in_rows * W + (size_t)K * band->rows * out_W) * sizeof(float) + 2 * ALIGN_BYTES;
+}
+
+int conv_compute_bands(const ConvParams* chunk, uint32_t in_dtype, uint32_t out_dtype, size_t row_pitch,
+                       const ConvBand* band) {
+    const uint32_t C = chunk->C ? chunk->C : 1;
+    const uint32_t K = chunk->K ? chunk->K : 1;
+    const size_t in_row = (size_t)chunk->W * (chunk->quant ? sizeof(int16_t) : dtype_size(in_dtype));
+    // band windows are mapped over the whole plane, as the chunk's were
+    ConvParams plane = *chunk;
+    plane.H = chunk->plane_H;
+    for (uint32_t r0 = 0; r0 < chunk->out_H; r0 += band->rows) {
+        const uint32_t rows = chunk->out_H - r0 < band->rows ? chunk->out_H - r0 : band->rows;
+        ConvParams b = *chunk;
+        uint32_t first = r0 * chunk->kH, n = rows * chunk->kH;
+        if (!chunk->gathered) {
+            calc_input_rows(&plane, chunk->output_offset_row + r0, chunk->output_offset_row + r0 + rows,
+                            &b.input_offset_row, &n);
+            first = (uint32_t)(((uint64_t)b.input_offset_row + chunk->plane_H - chunk->input_offset_row) % chunk->plane_H);
+        }
+        // a circular chunk holding the whole plane continues at its row 0
+        const uint32_t head = first + n > chunk->H ? chunk->H - first : n;
+        for (uint32_t c = 0; c < C; ++c) {
+            const char* from = (const char*)chunk->data + (size_t)c * chunk->H * in_row;
+            float* to = band->input + (size_t)c * n * chunk->W;
+            if (chunk->quant) {
+                memcpy(to, from + first * in_row, head * in_row);
+                memcpy((char*)to + head * in_row, from, (n - head) * in_row);
+            } else {
+                dtype_to_f32(in_dtype, from + first * in_row, to, (size_t)head * chunk->W);
+                dtype_to_f32(in_dtype, from, to + (size_t)head * chunk->W, (size_t)(n - head) * chunk->W);
+            }
+        }
+        b.data = band->input;
+        b.output = band->output;
+        b.H = n;
+        b.out_H = rows;
+        b.output_offset_row = chunk->output_offset_row + r0;
+        if (conv_compute(&b) != 0) return 1;
+        for (uint32_t k = 0; k < K; ++k) {
+            pack_bin_rows(band->output + (size_t)k * rows * chunk->out_W, rows, chunk->out_W, out_dtype, row_pitch,
+                          (char*)chunk->output + ((size_t)k * chunk->out_H + r0) * row_pitch);
+        }
+    }
+    return 0;
+}
+
+int start_input_tile(MatrixSource* src, const ConvParams* params, uint32_t image, uint32_t row_start, uint32_t rows,
+                     uint32_t col_start, uint32_t cols, void* dst, MPI_Request* reqs) {
+    const uint32_t C = params->C ? params->C : 1;
+    const size_t plane_bytes = (size_t)rows * cols * source_load_size(src);
+    for (uint32_t i = 0; i < 2 * C; ++i) reqs[i] = MPI_REQUEST_NULL;
+    for (uint32_t c = 0; c < C; ++c) {
+        uint32_t src_row = ((image * C) + c) * params->H;
+        if (source_start_cols(src, src_row + row_start, rows, col_start, cols, (char*)dst + c * plane_bytes,
+                              &reqs[2 * c]) != 0) {
+            wait_input_planes(src, c + 1, reqs);
+            return -1;
+        }
+    }
+    return 0;
+}
+
 ConvParams* init_conv_params(const char* input_file,
                              const char* kernel_file,
                              uint32_t sH,
@@ -72,6 +331,20 @@ ConvParams* init_conv_params(const char* input_file,
     params->kW = kernel.width;
     params->sH = sH;
     params->sW = sW;
+    params->threads = 0;
+    params->quant = NULL;
+    params->N = params->C = params->K = 1;
+    params->chain = NULL;
+    params->boundary = BOUNDARY_ZERO;
+    params->plane_H = params->H;
+    params->taps = NULL;
+    params->box = NULL;
+    params->occupancy = NULL;
+    params->image = 0;
+    params->gathered = 0;
+    params->thread_state = NULL;
+    params->input_offset_col = 0;
+    params->output_offset_col = 0;
     calc_output_dims(params);
 
     size_t input_elems = (size_t)params->H * (size_t)params->W;
@@ -92,8 +365,8 @@ ConvParams* init_conv_params(const char* input_file,
         return NULL;
     }
 
-    fread(params->data, sizeof(float), input_elems, input.file);
-    fread(params->kernel, sizeof(float), kernel_elems, kernel.file);
+    read_bin_f32(&input, params->data, input_elems);
+    read_bin_f32(&kernel, params->kernel, kernel_elems);
 
     fclose(input.file);
     fclose(kernel.file);
@@ -107,3 +380,10 @@ void free_conv_params(ConvParams* params) {
     free(params->output);
     free(params);
 }
+
+int conv_compute(ConvParams* params) {
+    if (params->chain && params->chain->count) return conv_chain(params);
+    if (params->quant) conv_quant(params);
+    else conv_openmp(params);
+    return 0;
+}
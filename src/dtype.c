@@ -0,0 +1,207 @@
+#include "dtype.h"
+#include "isa.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+// below this many elements conversion stays on the calling thread
+#define DTYPE_PARALLEL_MIN (1u << 16)
+
+// the conversions below are built once per ISA variant, the rest only once
+#ifndef CONV_ISA_SUFFIX
+size_t dtype_size(uint32_t dtype) {
+    switch (dtype) {
+        case DTYPE_F32: return 4;
+        case DTYPE_F16:
+        case DTYPE_BF16:
+        case DTYPE_I16: return 2;
+        case DTYPE_I8: return 1;
+        default: return 0;
+    }
+}
+
+const char* dtype_name(uint32_t dtype) {
+    switch (dtype) {
+        case DTYPE_F32: return "f32";
+        case DTYPE_F16: return "f16";
+        case DTYPE_BF16: return "bf16";
+        case DTYPE_I8: return "i8";
+        case DTYPE_I16: return "i16";
+        default: return "unknown";
+    }
+}
+
+int dtype_from_name(const char* name) {
+    if (!name) return -1;
+    if (strcmp(name, "f32") == 0 || strcmp(name, "fp32") == 0) return DTYPE_F32;
+    if (strcmp(name, "f16") == 0 || strcmp(name, "fp16") == 0) return DTYPE_F16;
+    if (strcmp(name, "bf16") == 0) return DTYPE_BF16;
+    if (strcmp(name, "i8") == 0 || strcmp(name, "int8") == 0) return DTYPE_I8;
+    if (strcmp(name, "i16") == 0 || strcmp(name, "int16") == 0) return DTYPE_I16;
+    return -1;
+}
+
+int dtype_is_quantized(uint32_t dtype) {
+    return dtype == DTYPE_I8 || dtype == DTYPE_I16;
+}
+#endif
+
+static inline uint32_t f32_bits(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static inline float bits_f32(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static inline float half_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+    uint32_t exp = (h >> 10) & 0x1fu;
+    uint32_t mant = h & 0x3ffu;
+    if (exp == 0x1f) return bits_f32(sign | 0x7f800000u | (mant << 13));
+    if (exp == 0) {
+        // subnormal halves are exact multiples of 2^-24
+        float v = (float)mant * 5.9604644775390625e-8f;
+        return sign ? -v : v;
+    }
+    return bits_f32(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+static inline uint16_t float_to_half(float f) {
+    uint32_t u = f32_bits(f);
+    uint16_t sign = (uint16_t)((u >> 16) & 0x8000u);
+    uint32_t abs = u & 0x7fffffffu;
+    if (abs >= 0x7f800000u) return sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0);
+    if (abs >= 0x477ff000u) return sign | 0x7c00u;          // rounds past the largest half
+    if (abs < 0x38800000u) {
+        // subnormal or zero: round to nearest multiple of 2^-24
+        float v = bits_f32(abs) * 16777216.0f;
+        uint32_t m = (uint32_t)v;
+        float rem = v - (float)m;
+        if (rem > 0.5f || (rem == 0.5f && (m & 1u))) m++;
+        return sign | (uint16_t)m;
+    }
+    uint32_t mant = abs + 0xfffu + ((abs >> 13) & 1u);     // round to nearest even
+    return sign | (uint16_t)((mant - 0x38000000u) >> 13);
+}
+
+static void f16_block_to_f32(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+#endif
+    for (; i < n; ++i) dst[i] = half_to_float(src[i]);
+}
+
+static void f32_block_to_f16(const float* src, uint16_t* dst, size_t n) {
+    size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(dst + i), h);
+    }
+#endif
+    for (; i < n; ++i) dst[i] = float_to_half(src[i]);
+}
+
+static void bf16_block_to_f32(const uint16_t* src, float* dst, size_t n) {
+    uint32_t* out = (uint32_t*)dst;
+    #pragma omp simd
+    for (size_t i = 0; i < n; ++i) out[i] = (uint32_t)src[i] << 16;
+}
+
+static void f32_block_to_bf16(const float* src, uint16_t* dst, size_t n) {
+    const uint32_t* in = (const uint32_t*)src;
+    #pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t u = in[i];
+        uint32_t rounded = (u + 0x7fffu + ((u >> 16) & 1u)) >> 16;
+        int nan = (u & 0x7fffffffu) > 0x7f800000u;
+        dst[i] = (uint16_t)(nan ? ((u >> 16) | 0x40u) : rounded);
+    }
+}
+
+void ISA_VARIANT(dtype_to_f32)(uint32_t dtype, const void* src, float* dst, size_t n) {
+    if (dtype == DTYPE_F32) {
+        if ((const void*)dst != src) memcpy(dst, src, n * sizeof(float));
+        return;
+    }
+    if (dtype_is_quantized(dtype)) {
+        // raw integer values; callers holding a scale use dequantize_to_f32
+        dequantize_to_f32(dtype, src, dst, n, 1.0f, 0);
+        return;
+    }
+    const uint16_t* in = (const uint16_t*)src;
+    const size_t block = DTYPE_PARALLEL_MIN;
+    const size_t blocks = (n + block - 1) / block;
+    #pragma omp parallel for schedule(static) if (blocks > 1)
+    for (size_t b = 0; b < blocks; ++b) {
+        size_t start = b * block;
+        size_t count = (n - start < block) ? n - start : block;
+        if (dtype == DTYPE_F16) f16_block_to_f32(in + start, dst + start, count);
+        else bf16_block_to_f32(in + start, dst + start, count);
+    }
+}
+
+void ISA_VARIANT(f32_to_dtype)(uint32_t dtype, const float* src, void* dst, size_t n) {
+    if (dtype == DTYPE_F32) {
+        if (dst != (const void*)src) memcpy(dst, src, n * sizeof(float));
+        return;
+    }
+    if (dtype_is_quantized(dtype)) {
+        quantize_from_f32(dtype, src, dst, n, 1.0f, 0);
+        return;
+    }
+    uint16_t* out = (uint16_t*)dst;
+    const size_t block = DTYPE_PARALLEL_MIN;
+    const size_t blocks = (n + block - 1) / block;
+    #pragma omp parallel for schedule(static) if (blocks > 1)
+    for (size_t b = 0; b < blocks; ++b) {
+        size_t start = b * block;
+        size_t count = (n - start < block) ? n - start : block;
+        if (dtype == DTYPE_F16) f32_block_to_f16(src + start, out + start, count);
+        else f32_block_to_bf16(src + start, out + start, count);
+    }
+}
+
+static inline int32_t quantized_at(uint32_t dtype, const void* src, size_t i) {
+    return dtype == DTYPE_I8 ? (int32_t)((const int8_t*)src)[i] : (int32_t)((const int16_t*)src)[i];
+}
+
+void ISA_VARIANT(dequantize_to_f32)(uint32_t dtype, const void* src, float* dst, size_t n, float scale, int32_t zero_point) {
+    #pragma omp parallel for simd schedule(static) if (n > DTYPE_PARALLEL_MIN)
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = scale * (float)(quantized_at(dtype, src, i) - zero_point);
+    }
+}
+
+void ISA_VARIANT(dequantize_to_i16)(uint32_t dtype, const void* src, int16_t* dst, size_t n, int32_t zero_point) {
+    #pragma omp parallel for simd schedule(static) if (n > DTYPE_PARALLEL_MIN)
+    for (size_t i = 0; i < n; ++i) {
+        int32_t v = quantized_at(dtype, src, i) - zero_point;
+        dst[i] = (int16_t)(v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v);
+    }
+}
+
+void ISA_VARIANT(quantize_from_f32)(uint32_t dtype, const float* src, void* dst, size_t n, float scale, int32_t zero_point) {
+    const int32_t lo = dtype == DTYPE_I8 ? INT8_MIN : INT16_MIN;
+    const int32_t hi = dtype == DTYPE_I8 ? INT8_MAX : INT16_MAX;
+    const float inv = 1.0f / scale;
+    #pragma omp parallel for schedule(static) if (n > DTYPE_PARALLEL_MIN)
+    for (size_t i = 0; i < n; ++i) {
+        int32_t q = (int32_t)lrintf(src[i] * inv) + zero_point;
+        q = q < lo ? lo : q > hi ? hi : q;
+        if (dtype == DTYPE_I8) ((int8_t*)dst)[i] = (int8_t)q;
+        else ((int16_t*)dst)[i] = (int16_t)q;
+    }
+}
@@ -10,6 +10,7 @@
 #include <stdatomic.h>
 
 #if defined(__unix__) || defined(__APPLE__)
+ssize_t pread(int fd, void* buf, size_t nbyte, off_t offset);
 ssize_t pwrite(int fd, const void* buf, size_t nbyte, off_t offset);
 #endif
 
@@ -33,7 +34,7 @@ static ssize_t read_line(FILE* stream, char** buffer, size_t* capacity) {
     size_t pos = 0;
     int ch = 0;
 
-    while ((ch = fgetc(stream)) != EOF) {
+    while ((ch = getc_unlocked(stream)) != EOF) {
         if (pos + 1 >= *capacity) {
             size_t new_cap = (*capacity < SIZE_MAX / 2) ? (*capacity * 2) : SIZE_MAX;
             if (new_cap == *capacity) {
@@ -63,7 +64,7 @@ static ssize_t read_line(FILE* stream, char** buffer, size_t* capacity) {
     return (ssize_t)pos;
 }
 
-static ssize_t write_at_pos(int fd, const void* buffer, size_t bytes, off_t offset) {
+ssize_t write_at_pos(int fd, const void* buffer, size_t bytes, off_t offset) {
     ssize_t direct = -1;
 #if defined(__unix__) || defined(__APPLE__)
     errno = 0;
@@ -93,55 +94,164 @@ static ssize_t write_at_pos(int fd, const void* buffer, size_t bytes, off_t offs
     return written;
 }
 
-FILE* create_bin_matrix(char* filepath, uint32_t h, uint32_t w) {
-    BinaryHeader header = {h, w};
-    const uint64_t total_elements = (uint64_t)h * (uint64_t)w;
-    const size_t header_size = sizeof(header);
+size_t bin_aligned_pitch(uint32_t w, uint32_t dtype) {
+    size_t row_bytes = (size_t)w * dtype_size(dtype);
+    return (row_bytes + ALIGN_BYTES - 1) / ALIGN_BYTES * ALIGN_BYTES;
+}
+
+size_t bin_row_pitch(uint32_t version, uint32_t w, uint32_t dtype, size_t row_pitch) {
+    if (version < 2) return (size_t)w * dtype_size(dtype);
+    return row_pitch ? row_pitch : bin_aligned_pitch(w, dtype);
+}
+
+int parse_bin_header(const void* raw, size_t bytes, BinaryLayout* layout) {
+    uint32_t words[4] = {0, 0, 0, 0};
+    memcpy(words, raw, bytes < sizeof(words) ? bytes : sizeof(words));
+    layout->scale = 1.0f;
+    layout->zero_point = 0;
+    layout->version = 1;
+    if ((bytes >= sizeof(BinaryHeaderV2) && words[0] == BIN_V2_MAGIC) ||
+        (bytes >= sizeof(BinaryHeaderV3) && words[0] == BIN_V3_MAGIC)) {
+        // both versions widen to the v3 fields
+        BinaryHeaderV3 v3;
+        if (words[0] == BIN_V3_MAGIC) {
+            memcpy(&v3, raw, sizeof(v3));
+            if (v3.version != 3 || v3.data_offset < sizeof(v3)) return -1;
+            if (v3.height > UINT32_MAX || v3.width > UINT32_MAX) {
+                fprintf(stderr, "Matrix of %llux%llu exceeds %u rows or columns\n",
+                        (unsigned long long)v3.height, (unsigned long long)v3.width, UINT32_MAX);
+                return -1;
+            }
+        } else {
+            BinaryHeaderV2 v2;
+            memcpy(&v2, raw, sizeof(v2));
+            if (v2.version != 2 || v2.data_offset < sizeof(v2)) return -1;
+            v3 = (BinaryHeaderV3){BIN_V3_MAGIC, 2, v2.dtype, 0, v2.height, v2.width,
+                                  v2.row_pitch, v2.data_offset, v2.scale, v2.zero_point};
+        }
+        size_t row_bytes = (size_t)v3.width * dtype_size(v3.dtype);
+        if (!dtype_size(v3.dtype) || v3.row_pitch < row_bytes) return -1;
+        // aligned rows are what the layout promises its readers
+        if (v3.row_pitch % ALIGN_BYTES || v3.data_offset % ALIGN_BYTES) {
+            fprintf(stderr, "v%u header: row pitch %llu and data offset %llu must be multiples of %d bytes\n",
+                    v3.version, (unsigned long long)v3.row_pitch, (unsigned long long)v3.data_offset, ALIGN_BYTES);
+            return -1;
+        }
+        if (dtype_is_quantized(v3.dtype) && !(v3.scale > 0.0f)) return -1;
+        layout->version = v3.version;
+        layout->dtype = v3.dtype;
+        layout->height = (uint32_t)v3.height;
+        layout->width = (uint32_t)v3.width;
+        layout->data_offset = (size_t)v3.data_offset;
+        layout->row_pitch = (size_t)v3.row_pitch;
+        if (dtype_is_quantized(v3.dtype)) {
+            layout->scale = v3.scale;
+            layout->zero_point = v3.zero_point;
+        }
+        return 0;
+    }
+    if (bytes >= sizeof(BinaryTypedHeader) && words[0] == BIN_TYPED_MAGIC) {
+        if (!dtype_size(words[1])) return -1;
+        layout->dtype = words[1];
+        layout->height = words[2];
+        layout->width = words[3];
+        layout->data_offset = sizeof(BinaryTypedHeader);
+        if (dtype_is_quantized(words[1])) {
+            BinaryQuantHeader q;
+            if (bytes < sizeof(q)) return -1;
+            memcpy(&q, raw, sizeof(q));
+            if (!(q.scale > 0.0f)) return -1;
+            layout->scale = q.scale;
+            layout->zero_point = q.zero_point;
+            layout->data_offset = sizeof(q);
+        }
+        layout->row_pitch = (size_t)layout->width * dtype_size(layout->dtype);
+        return 0;
+    }
+    if (bytes < sizeof(BinaryHeader)) return -1;
+    layout->dtype = DTYPE_F32;
+    layout->height = words[0];
+    layout->width = words[1];
+    layout->data_offset = sizeof(BinaryHeader);
+    layout->row_pitch = (size_t)layout->width * sizeof(float);
+    return 0;
+}
+
+size_t format_bin_header(void* raw, BinaryLayout* layout) {
+    if (layout->version >= 2) {
+        if (!layout->row_pitch) layout->row_pitch = bin_aligned_pitch(layout->width, layout->dtype);
+        layout->data_offset = BIN_V2_HEADER_BYTES;
+        if (layout->version == 3) {
+            BinaryHeaderV3 header = {BIN_V3_MAGIC, 3, layout->dtype, 0, layout->height, layout->width,
+                                     layout->row_pitch, layout->data_offset, layout->scale, layout->zero_point};
+            memcpy(raw, &header, sizeof(header));
+            return sizeof(header);
+        }
+        layout->version = 2;
+        BinaryHeaderV2 header = {BIN_V2_MAGIC, 2, layout->dtype, layout->height, layout->width, 0,
+                                 layout->row_pitch, layout->data_offset, layout->scale, layout->zero_point};
+        memcpy(raw, &header, sizeof(header));
+        return sizeof(header);
+    }
+    layout->version = 1;
+    layout->row_pitch = (size_t)layout->width * dtype_size(layout->dtype);
+    if (layout->dtype == DTYPE_F32) {
+        BinaryHeader header = {layout->height, layout->width};
+        memcpy(raw, &header, sizeof(header));
+        layout->data_offset = sizeof(header);
+        return sizeof(header);
+    }
+    BinaryQuantHeader header = {{BIN_TYPED_MAGIC, layout->dtype, layout->height, layout->width},
+                                layout->scale, layout->zero_point};
+    size_t bytes = dtype_is_quantized(layout->dtype) ? sizeof(header) : sizeof(header.typed);
+    memcpy(raw, &header, bytes);
+    layout->data_offset = bytes;
+    return bytes;
+}
+
+FILE* create_bin_matrix_layout(char* filepath, BinaryLayout* layout) {
+    unsigned char header[BIN_HEADER_MAX_BYTES];
+    const size_t header_size = format_bin_header(header, layout);
 
     FILE* o_file = fopen(filepath, "wb+");
 
     if (!o_file) return NULL;
 
-    if (fwrite(&header, header_size, 1, o_file) != 1) goto fail;
+    if (fwrite(header, header_size, 1, o_file) != 1) goto fail;
     if (fflush(o_file) != 0) goto fail;
 
-    if (total_elements > 0) {
+    // pre-size the payload, pitch padding included, so writers can land anywhere
+    const uint64_t total_bytes = (uint64_t)layout->height * (uint64_t)layout->row_pitch;
+    if (total_bytes > 0) {
         int fd = fileno(o_file);
         if (fd == -1) goto fail;
 
-        const size_t block_elems = 32768; 
+        const size_t block_bytes = 32768 * sizeof(float);
         _Atomic int error_flag = 0;
 
         #pragma omp parallel
         {
-            float* zero_block = (float*)calloc(block_elems, sizeof(float));
+            unsigned char* zero_block = (unsigned char*)calloc(block_bytes, 1);
 
             #pragma omp for schedule(static)
-            for (uint64_t start = 0; start < total_elements; start += block_elems) {
+            for (uint64_t start = 0; start < total_bytes; start += block_bytes) {
                 if (atomic_load_explicit(&error_flag, memory_order_relaxed)) continue;
-                
-
-                size_t remaining = (size_t)(total_elements - start);
-                size_t count = remaining < block_elems ? remaining : block_elems;
 
-                const size_t bytes = count * sizeof(float);
-                off_t offset = (off_t)header_size + (off_t)(start * sizeof(float));
+                size_t remaining = (size_t)(total_bytes - start);
+                size_t bytes = remaining < block_bytes ? remaining : block_bytes;
+                off_t offset = (off_t)layout->data_offset + (off_t)start;
 
-                const float* buffer = zero_block;
-                float stack_block[1024] = {0};
+                const unsigned char* buffer = zero_block;
+                unsigned char stack_block[4096] = {0};
 
                 if (!buffer) {
-                    size_t local_count = count < 1024 ? count : 1024;
                     buffer = stack_block;
                     // write in slices to avoid overrunning the stack buffer
-                    size_t remaining_bytes = bytes;
                     size_t processed = 0;
-                    while (remaining_bytes > 0) {
-                        size_t slice_count = remaining_bytes / sizeof(float);
-                        if (slice_count > local_count) slice_count = local_count;
-                        size_t slice_bytes = slice_count * sizeof(float);
-                        off_t slice_offset = offset + (off_t)(processed * sizeof(float));
-                        ssize_t written = write_at_pos(fd, buffer, (size_t)slice_bytes, slice_offset);
+                    while (processed < bytes) {
+                        size_t slice_bytes = bytes - processed;
+                        if (slice_bytes > sizeof(stack_block)) slice_bytes = sizeof(stack_block);
+                        ssize_t written = write_at_pos(fd, buffer, slice_bytes, offset + (off_t)processed);
                         if (written != (ssize_t)slice_bytes) {
                             #pragma omp critical
                             {
@@ -152,8 +262,7 @@ FILE* create_bin_matrix(char* filepath, uint32_t h, uint32_t w) {
                             }
                             break;
                         }
-                        remaining_bytes -= slice_bytes;
-                        processed += slice_count;
+                        processed += slice_bytes;
                     }
                     continue;
                 }
@@ -178,7 +287,7 @@ FILE* create_bin_matrix(char* filepath, uint32_t h, uint32_t w) {
         }
     }
 
-    if (fseeko(o_file, (off_t)header_size, SEEK_SET) != 0) {
+    if (fseeko(o_file, (off_t)layout->data_offset, SEEK_SET) != 0) {
         fprintf(stderr, "Failed to rewind payload in %s (%s)\n", filepath, strerror(errno));
         goto fail;
     }
@@ -191,8 +300,17 @@ fail:
     return NULL;
 }
 
+FILE* create_bin_matrix_typed(char* filepath, uint32_t h, uint32_t w, uint32_t dtype) {
+    BinaryLayout layout = {h, w, dtype, 0, 1.0f, 0};
+    return create_bin_matrix_layout(filepath, &layout);
+}
+
+FILE* create_bin_matrix(char* filepath, uint32_t h, uint32_t w) {
+    return create_bin_matrix_typed(filepath, h, w, DTYPE_F32);
+}
+
 BinaryFile open_bin_matrix_input(char* filepath) {
-    BinaryFile out = {0, 0, NULL};
+    BinaryFile out = {0, 0, NULL, DTYPE_F32, 0, 1.0f, 0, 0, 0};
     if (!filepath) {
         return out;
     }
@@ -203,45 +321,310 @@ BinaryFile open_bin_matrix_input(char* filepath) {
         return out;
     }
 
-    BinaryHeader header;
-    if (fread(&header, sizeof(header), 1, file) != 1) {
-        fprintf(stderr, "Failed to read header from %s (%s)\n", filepath, strerror(errno));
+    unsigned char raw[BIN_HEADER_MAX_BYTES];
+    size_t got = fread(raw, 1, sizeof(raw), file);
+    BinaryLayout layout;
+    if (parse_bin_header(raw, got, &layout) != 0) {
+        fprintf(stderr, "Failed to read header from %s (%s)\n", filepath, ferror(file) ? strerror(errno) : "invalid header");
         fclose(file);
         return out;
     }
 
-    const uint64_t elements = (uint64_t)header.height * (uint64_t)header.width;
+    const uint64_t elements = (uint64_t)layout.height * (uint64_t)layout.width;
     if (elements == 0) {
         fclose(file);
         return out;
     }
 
-    off_t f_offset = (off_t)sizeof(header) + ((off_t)elements - 1) * (off_t)sizeof(float);
+    const size_t elem_size = dtype_size(layout.dtype);
+    off_t f_offset = (off_t)layout.data_offset + ((off_t)layout.height - 1) * (off_t)layout.row_pitch
+                   + ((off_t)layout.width - 1) * (off_t)elem_size;
     if (fseeko(file, f_offset, SEEK_SET) != 0) {
         fprintf(stderr, "Failed to seek to end of payload in %s (%s)\n", filepath, strerror(errno));
         fclose(file);
         return out;
     }
 
-    float last;
-    if (fread(&last, sizeof(last), 1, file) != 1) {
+    unsigned char last[sizeof(float)];
+    if (fread(last, elem_size, 1, file) != 1) {
         fprintf(stderr, "Failed to read payload from %s (%s)\n", filepath, strerror(errno));
         fclose(file);
         return out;
     }
 
-    if (fseeko(file, (off_t)sizeof(header), SEEK_SET) != 0) {
+    if (fseeko(file, (off_t)layout.data_offset, SEEK_SET) != 0) {
         fprintf(stderr, "Failed to rewind payload in %s (%s)\n", filepath, strerror(errno));
         fclose(file);
         return out;
     }
 
-    out.height = header.height;
-    out.width = header.width;
+    out.height = layout.height;
+    out.width = layout.width;
     out.file = file;
+    out.dtype = layout.dtype;
+    out.data_offset = layout.data_offset;
+    out.scale = layout.scale;
+    out.zero_point = layout.zero_point;
+    out.row_pitch = layout.row_pitch;
     return out;
 }
 
+// Reads the next count stored elements, stepping over the pad at the end of
+// each row of an aligned file.
+int read_bin_elems(BinaryFile* bf, void* dst, size_t count) {
+    const size_t elem_size = dtype_size(bf->dtype);
+    const size_t row_bytes = (size_t)bf->width * elem_size;
+    if (bf->row_pitch == row_bytes) {
+        return fread(dst, elem_size, count, bf->file) == count ? 0 : -1;
+    }
+    char* out = (char*)dst;
+    while (count) {
+        size_t n = bf->width - bf->row_pos;
+        if (n > count) n = count;
+        if (fread(out, elem_size, n, bf->file) != n) return -1;
+        out += n * elem_size;
+        count -= n;
+        bf->row_pos += n;
+        if (bf->row_pos == bf->width) {
+            bf->row_pos = 0;
+            if (fseeko(bf->file, (off_t)(bf->row_pitch - row_bytes), SEEK_CUR) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+// Reads count elements from the current position, widening them to fp32.
+int read_bin_f32(BinaryFile* bf, float* dst, size_t count) {
+    if (bf->dtype == DTYPE_F32) return read_bin_elems(bf, dst, count);
+    size_t elem_size = dtype_size(bf->dtype);
+    void* raw = malloc(count * elem_size);
+    if (!raw) return -1;
+    int rc = read_bin_elems(bf, raw, count);
+    if (!rc && dtype_is_quantized(bf->dtype)) dequantize_to_f32(bf->dtype, raw, dst, count, bf->scale, bf->zero_point);
+    else if (!rc) dtype_to_f32(bf->dtype, raw, dst, count);
+    free(raw);
+    return rc;
+}
+
+static TextFile txt_matrix_from_file(FILE* file, const char* name);
+
+TextFile open_txt_matrix_input(char* filepath) {
+    TextFile out;
+    memset(&out, 0, sizeof(out));
+    if (!filepath) return out;
+
+    FILE* file = fopen(filepath, "r");
+    if (!file) {
+        fprintf(stderr, "Failed to open text file %s (%s)\n", filepath, strerror(errno));
+        return out;
+    }
+    return txt_matrix_from_file(file, filepath);
+}
+
+// Reads the dimension header; the file is closed on failure.
+static TextFile txt_matrix_from_file(FILE* file, const char* name) {
+    TextFile out;
+    memset(&out, 0, sizeof(out));
+    int h = 0, w = 0;
+    if (fscanf(file, "%d %d", &h, &w) != 2 || h <= 0 || w <= 0) {
+        fprintf(stderr, "Input Matrix has an invalid dimension header in %s\n", name);
+        if (file != stdin) fclose(file);
+        return out;
+    }
+
+    int c;
+    while ((c = fgetc(file)) != '\n') {
+        if (c == EOF) break;
+    }
+
+    out.height = (uint32_t)h;
+    out.width = (uint32_t)w;
+    out.file = file;
+    return out;
+}
+
+static int parse_txt_row(const char* line, float* dst, uint32_t w) {
+    const char* cursor = line;
+    uint32_t count = 0;
+    while (count < w) {
+        while (*cursor && isspace((unsigned char)*cursor)) cursor++;
+        if (*cursor == '\0') break;
+
+        errno = 0;
+        char* endptr = NULL;
+        float value = strtof(cursor, &endptr);
+        if (errno != 0 || endptr == cursor) return -1;
+        dst[count++] = value;
+        cursor = endptr;
+    }
+    while (*cursor && isspace((unsigned char)*cursor)) cursor++;
+    return (count == w && *cursor == '\0') ? 0 : -1;
+}
+
+// Reads the next rows of a text matrix into dst (row-major, width floats per
+// row), or discards them when dst is NULL. Lines are read serially and then
+// parsed in parallel.
+int read_txt_rows(TextFile* tf, float* dst, uint32_t rows) {
+    if (!tf || !tf->file) return -1;
+    if (rows > tf->height - tf->next_row) {
+        fprintf(stderr, "Text matrix has only %u rows left, %u requested\n", tf->height - tf->next_row, rows);
+        return -1;
+    }
+    if (!rows) return 0;
+
+    if (rows + 1 > tf->line_capacity) {
+        size_t* tmp = (size_t*)realloc(tf->line_start, (size_t)(rows + 1) * sizeof(size_t));
+        if (!tmp) return -1;
+        tf->line_start = tmp;
+        tf->line_capacity = rows + 1;
+    }
+
+    char* line = NULL;
+    size_t linecap = 0;
+    size_t used = 0;
+    for (uint32_t r = 0; r < rows; ++r) {
+        ssize_t len = read_line(tf->file, &line, &linecap);
+        if (len == -1) {
+            fprintf(stderr, "Failed to read row %u of text matrix (%s)\n", tf->next_row + r, strerror(errno));
+            free(line);
+            return -1;
+        }
+        if (!dst) continue;
+
+        if (used + (size_t)len + 1 > tf->text_capacity) {
+            size_t new_cap = tf->text_capacity ? tf->text_capacity : 4096;
+            while (new_cap < used + (size_t)len + 1) new_cap *= 2;
+            char* tmp = (char*)realloc(tf->text, new_cap);
+            if (!tmp) {
+                free(line);
+                return -1;
+            }
+            tf->text = tmp;
+            tf->text_capacity = new_cap;
+        }
+        tf->line_start[r] = used;
+        memcpy(tf->text + used, line, (size_t)len + 1);
+        used += (size_t)len + 1;
+    }
+    free(line);
+
+    uint32_t first_row = tf->next_row;
+    tf->next_row += rows;
+    if (!dst) return 0;
+
+    _Atomic int error_flag = 0;
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (uint32_t r = 0; r < rows; ++r) {
+        if (parse_txt_row(tf->text + tf->line_start[r], dst + (size_t)r * tf->width, tf->width) != 0) {
+            #pragma omp critical
+            {
+                if (!atomic_load_explicit(&error_flag, memory_order_relaxed)) {
+                    fprintf(stderr, "Row %u of text matrix does not hold %u parseable values\n", first_row + r, tf->width);
+                    atomic_store_explicit(&error_flag, 1, memory_order_relaxed);
+                }
+            }
+        }
+    }
+    return atomic_load_explicit(&error_flag, memory_order_relaxed) ? -1 : 0;
+}
+
+void close_txt_matrix_input(TextFile* tf) {
+    if (!tf) return;
+    if (tf->file) fclose(tf->file);
+    free(tf->text);
+    free(tf->line_start);
+    memset(tf, 0, sizeof(*tf));
+}
+
+int open_row_stream(const char* path, int text, RowStream* rs) {
+    memset(rs, 0, sizeof(*rs));
+    rs->text = text;
+    int use_stdin = strcmp(path, "-") == 0;
+    FILE* file = use_stdin ? stdin : fopen(path, text ? "r" : "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to open input stream %s (%s)\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (text) {
+        rs->tf = txt_matrix_from_file(file, use_stdin ? "stdin" : path);
+        if (!rs->tf.file) return -1;
+        rs->file = file;
+        rs->height = rs->tf.height;
+        rs->width = rs->tf.width;
+        return 0;
+    }
+
+    // the header's size is only known from its first words, so it is read
+    // in steps instead of parsed from a fixed-size peek
+    unsigned char raw[BIN_HEADER_MAX_BYTES];
+    size_t got = fread(raw, 1, sizeof(BinaryHeader), file);
+    uint32_t magic = 0;
+    memcpy(&magic, raw, sizeof(magic));
+    size_t want = got;
+    if (got == sizeof(BinaryHeader) && magic == BIN_V2_MAGIC) {
+        want = sizeof(BinaryHeaderV2);
+    } else if (got == sizeof(BinaryHeader) && magic == BIN_V3_MAGIC) {
+        want = sizeof(BinaryHeaderV3);
+    } else if (got == sizeof(BinaryHeader) && magic == BIN_TYPED_MAGIC) {
+        want = sizeof(BinaryTypedHeader);
+        got += fread(raw + got, 1, want - got, file);
+        uint32_t dtype = 0;
+        memcpy(&dtype, raw + sizeof(uint32_t), sizeof(dtype));
+        if (got == want && dtype_is_quantized(dtype)) want = sizeof(BinaryQuantHeader);
+    }
+    if (want > got) got += fread(raw + got, 1, want - got, file);
+
+    int rc = parse_bin_header(raw, got, &rs->layout);
+    for (size_t skip = got; !rc && skip < rs->layout.data_offset; ++skip) {
+        if (fgetc(file) == EOF) rc = -1;
+    }
+    if (!rc) {
+        rs->raw = malloc(rs->layout.row_pitch ? rs->layout.row_pitch : 1);
+        if (!rs->raw) rc = -1;
+    }
+    if (rc) {
+        fprintf(stderr, "Failed to read a .bin header from input stream %s\n", path);
+        if (!use_stdin) fclose(file);
+        free(rs->raw);
+        memset(rs, 0, sizeof(*rs));
+        return -1;
+    }
+    rs->file = file;
+    rs->height = rs->layout.height;
+    rs->width = rs->layout.width;
+    return 0;
+}
+
+int read_stream_row(RowStream* rs, float* dst) {
+    if (!rs->file || rs->next_row >= rs->height) return -1;
+    if (rs->text) {
+        if (read_txt_rows(&rs->tf, dst, 1) != 0) return -1;
+    } else {
+        if (fread(rs->raw, 1, rs->layout.row_pitch, rs->file) != rs->layout.row_pitch) {
+            fprintf(stderr, "Input stream ended at row %u of %u\n", rs->next_row, rs->height);
+            return -1;
+        }
+        if (dtype_is_quantized(rs->layout.dtype)) {
+            dequantize_to_f32(rs->layout.dtype, rs->raw, dst, rs->width, rs->layout.scale, rs->layout.zero_point);
+        } else {
+            dtype_to_f32(rs->layout.dtype, rs->raw, dst, rs->width);
+        }
+    }
+    rs->next_row++;
+    return 0;
+}
+
+void close_row_stream(RowStream* rs) {
+    if (!rs) return;
+    // stdin stays open for whoever reads after us
+    if (rs->tf.file == stdin) rs->tf.file = NULL;
+    close_txt_matrix_input(&rs->tf);
+    if (!rs->text && rs->file && rs->file != stdin) fclose(rs->file);
+    free(rs->raw);
+    memset(rs, 0, sizeof(*rs));
+}
+
 void apply_padding_bin(char* bin_fp, char* dst_fp, MatrixPadding* padding, size_t chunk_size) {
     if (!bin_fp) return;
     if (!chunk_size) chunk_size = 5000;
@@ -294,7 +677,7 @@ void apply_padding_bin(char* bin_fp, char* dst_fp, MatrixPadding* padding, size_
         fwrite(pad_row,sizeof(float),Wp,bin_p);
         row_written++;
     }
-    while (fread(row_buffer,sizeof(float),w, bin) > 0) {
+    while (read_bin_f32(&b_in, row_buffer, w) == 0) {
         if (padding->pad_w_b && fwrite(pad_b,sizeof(float), padding->pad_w_b, bin_p) != padding->pad_w_b) break;
         if (fwrite(row_buffer,sizeof(float),w, bin_p) != w) break;
         if (padding->pad_w_a && fwrite(pad_a,sizeof(float), padding->pad_w_a, bin_p) != padding->pad_w_a) break;
@@ -609,8 +992,7 @@ void convert_bin_to_txt(char* bin_fp, char* txt_fp, size_t chunk_size) {
                     break;
                 }
 
-                size_t read = fread(chunk_buf, sizeof(float), current_chunk, bin);
-                if (read != current_chunk) {
+                if (read_bin_f32(&b_in, chunk_buf, current_chunk) != 0) {
                     #pragma omp critical
                     {
                         if (!atomic_load_explicit(&error_flag, memory_order_relaxed)) {
@@ -764,3 +1146,203 @@ void convert_bin_to_txt(char* bin_fp, char* txt_fp, size_t chunk_size) {
 void get_dimension_txt(FILE* matrix_file, uint32_t* h, uint32_t* w) {
     if (fscanf(matrix_file, "%d %d", h, w) != 2) {fprintf(stderr, "Input Matrix has an invalid dimension header"); return; }
 }
+
+size_t format_txt_header(char* text, size_t capacity, uint32_t h, uint32_t w) {
+    int n = snprintf(text, capacity, "%u %u\n", h, w);
+    return (n > 0 && (size_t)n < capacity) ? (size_t)n : 0;
+}
+
+size_t txt_rows_capacity(uint32_t rows, uint32_t w) {
+    return (size_t)rows * (size_t)w * (TXT_VALUE_MAX_CHARS + 1);
+}
+
+// Formats rows into text laid out like convert_bin_to_txt. Each row is
+// rendered in parallel into its own fixed-pitch slot and then compacted, so
+// text must hold txt_rows_capacity(rows, w) bytes. The newline after the
+// last row is dropped when the rows end the matrix.
+size_t format_txt_rows(const float* data, uint32_t rows, uint32_t w, int ends_matrix, char* text) {
+    if (!rows || !w) return 0;
+
+    const size_t pitch = (size_t)w * (TXT_VALUE_MAX_CHARS + 1);
+    size_t* lengths = (size_t*)malloc((size_t)rows * sizeof(size_t));
+    if (!lengths) return (size_t)-1;
+
+    #pragma omp parallel for schedule(static)
+    for (uint32_t r = 0; r < rows; ++r) {
+        const float* row = data + (size_t)r * w;
+        char* dst = text + (size_t)r * pitch;
+        size_t n = 0;
+        for (uint32_t c = 0; c < w; ++c) {
+            n += (size_t)snprintf(dst + n, TXT_VALUE_MAX_CHARS + 1, "%.3f", row[c]);
+            dst[n++] = (c + 1 < w) ? ' ' : '\n';
+        }
+        lengths[r] = n;
+    }
+
+    size_t total = lengths[0];
+    for (uint32_t r = 1; r < rows; ++r) {
+        memmove(text + total, text + (size_t)r * pitch, lengths[r]);
+        total += lengths[r];
+    }
+    free(lengths);
+
+    if (ends_matrix) total--;
+    return total;
+}
+
+int quantize_bin_matrix(char* src_fp, char* dst_fp, uint32_t dtype) {
+    if (!dtype_is_quantized(dtype)) return -1;
+    BinaryFile in = open_bin_matrix_input(src_fp);
+    if (!in.file) return -1;
+
+    const size_t w = in.width;
+    size_t block_rows = (4u << 20) / (w * sizeof(float));
+    if (!block_rows) block_rows = 1;
+    float* rows = (float*)malloc(block_rows * w * sizeof(float));
+    void* packed = malloc(block_rows * w * dtype_size(dtype));
+    if (!rows || !packed) {
+        free(rows);
+        free(packed);
+        fclose(in.file);
+        return -1;
+    }
+
+    int rc = 0;
+    float lo = 0.0f, hi = 0.0f;
+    for (uint32_t r = 0; !rc && r < in.height; r += (uint32_t)block_rows) {
+        size_t n = ((in.height - r) < block_rows ? (in.height - r) : block_rows) * w;
+        rc = read_bin_f32(&in, rows, n);
+        #pragma omp parallel for reduction(min:lo) reduction(max:hi) if (n > (1u << 16))
+        for (size_t i = 0; i < n; ++i) {
+            lo = rows[i] < lo ? rows[i] : lo;
+            hi = rows[i] > hi ? rows[i] : hi;
+        }
+    }
+
+    // the range always includes 0 so zero padding stays exact
+    BinaryLayout layout = {in.height, in.width, dtype, 0, 1.0f, 0};
+    if (dtype == DTYPE_I8) {
+        if (hi > lo) layout.scale = (hi - lo) / 255.0f;
+        layout.zero_point = (int32_t)lrintf(INT8_MIN - lo / layout.scale);
+    } else {
+        float m = fabsf(lo) > fabsf(hi) ? fabsf(lo) : fabsf(hi);
+        if (m > 0.0f) layout.scale = m / INT16_MAX;
+    }
+
+    FILE* out = rc ? NULL : create_bin_matrix_layout(dst_fp, &layout);
+    if (!rc && !out) rc = -1;
+    if (!rc && fseeko(in.file, (off_t)in.data_offset, SEEK_SET) != 0) rc = -1;
+    in.row_pos = 0;
+    for (uint32_t r = 0; !rc && r < in.height; r += (uint32_t)block_rows) {
+        size_t n = ((in.height - r) < block_rows ? (in.height - r) : block_rows) * w;
+        rc = read_bin_f32(&in, rows, n);
+        if (rc) break;
+        quantize_from_f32(dtype, rows, packed, n, layout.scale, layout.zero_point);
+        if (fwrite(packed, dtype_size(dtype), n, out) != n) rc = -1;
+    }
+
+    if (rc) fprintf(stderr, "Failed to quantize %s to %s\n", src_fp, dst_fp);
+    if (out) {
+        fclose(out);
+        if (rc) remove(dst_fp);
+    }
+    fclose(in.file);
+    free(rows);
+    free(packed);
+    return rc;
+}
+
+void pack_bin_rows(const float* src, uint32_t rows, uint32_t w, uint32_t dtype, size_t row_pitch, void* dst) {
+    const size_t row_bytes = (size_t)w * dtype_size(dtype);
+    if (row_pitch == row_bytes) {
+        f32_to_dtype(dtype, src, dst, (size_t)rows * w);
+        return;
+    }
+    #pragma omp parallel for schedule(static) if ((size_t)rows * w > (1u << 16))
+    for (uint32_t r = 0; r < rows; ++r) {
+        char* out = (char*)dst + (size_t)r * row_pitch;
+        f32_to_dtype(dtype, src + (size_t)r * w, out, w);
+        memset(out + row_bytes, 0, row_pitch - row_bytes);
+    }
+}
+
+static int read_full_at(int fd, void* dst, size_t bytes, off_t offset) {
+    char* out = (char*)dst;
+    while (bytes) {
+        ssize_t got = pread(fd, out, bytes, offset);
+        if (got <= 0) {
+            if (got == -1 && errno == EINTR) continue;
+            return -1;
+        }
+        out += got;
+        offset += got;
+        bytes -= (size_t)got;
+    }
+    return 0;
+}
+
+// Blocks of rows are re-pitched independently, so threads read, repack and
+// write them with positional I/O in any order.
+int convert_bin_version(char* src_fp, char* dst_fp, uint32_t version, size_t row_pitch) {
+    BinaryFile in = open_bin_matrix_input(src_fp);
+    if (!in.file) return -1;
+
+    const size_t row_bytes = (size_t)in.width * dtype_size(in.dtype);
+    BinaryLayout layout = {in.height, in.width, in.dtype, 0, in.scale, in.zero_point, version,
+                           version >= 2 ? row_pitch : 0};
+    if (version >= 2 && row_pitch && (row_pitch < row_bytes || row_pitch % ALIGN_BYTES)) {
+        fprintf(stderr, "Row pitch %zu must be a multiple of %d of at least %zu bytes\n", row_pitch, ALIGN_BYTES, row_bytes);
+        fclose(in.file);
+        return -1;
+    }
+    FILE* out = create_bin_matrix_layout(dst_fp, &layout);
+    if (!out) {
+        fprintf(stderr, "Failed to create %s (%s)\n", dst_fp, strerror(errno));
+        fclose(in.file);
+        return -1;
+    }
+
+    const size_t in_pitch = in.row_pitch, out_pitch = layout.row_pitch;
+    const int in_fd = fileno(in.file), out_fd = fileno(out);
+    uint32_t block_rows = (uint32_t)((8u << 20) / (in_pitch > out_pitch ? in_pitch : out_pitch));
+    if (!block_rows) block_rows = 1;
+    const uint32_t num_blocks = (in.height + block_rows - 1) / block_rows;
+
+    int failed = 0;
+    #pragma omp parallel reduction(|:failed)
+    {
+        char* src = (char*)malloc((size_t)block_rows * in_pitch);
+        char* dst = (char*)malloc((size_t)block_rows * out_pitch);
+        if (!src || !dst) failed = 1;
+
+        #pragma omp for schedule(dynamic, 1)
+        for (uint32_t b = 0; b < num_blocks; ++b) {
+            if (failed) continue;
+            uint32_t r0 = b * block_rows;
+            uint32_t rows = in.height - r0 < block_rows ? in.height - r0 : block_rows;
+            // the last row of a v2 file may omit its pad
+            size_t span = (size_t)(rows - 1) * in_pitch + row_bytes;
+            if (read_full_at(in_fd, src, span, (off_t)in.data_offset + (off_t)r0 * (off_t)in_pitch) != 0) {
+                failed = 1;
+                continue;
+            }
+            for (uint32_t r = 0; r < rows; ++r) {
+                memcpy(dst + (size_t)r * out_pitch, src + (size_t)r * in_pitch, row_bytes);
+                memset(dst + (size_t)r * out_pitch + row_bytes, 0, out_pitch - row_bytes);
+            }
+            size_t bytes = (size_t)rows * out_pitch;
+            if (write_at_pos(out_fd, dst, bytes, (off_t)layout.data_offset + (off_t)r0 * (off_t)out_pitch) != (ssize_t)bytes) {
+                failed = 1;
+            }
+        }
+        free(src);
+        free(dst);
+    }
+
+    if (!failed && ftruncate(out_fd, (off_t)layout.data_offset + (off_t)in.height * (off_t)out_pitch) != 0) failed = 1;
+    if (failed) fprintf(stderr, "Failed to convert %s to %s (%s)\n", src_fp, dst_fp, strerror(errno));
+    fclose(out);
+    if (failed) remove(dst_fp);
+    fclose(in.file);
+    return failed ? -1 : 0;
+}
@@ -1,29 +1,147 @@
 #include "generate.h"
 #include "file.h"
+#include "io_mpi.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#define GEN_BLOCK_BYTES (4u << 20)
+
+static inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+uint64_t generate_key(uint32_t seed) {
+    return splitmix64((uint64_t)seed);
+}
+
+float generate_value(uint64_t key, uint32_t i, uint32_t j) {
+    uint64_t bits = splitmix64(key ^ (((uint64_t)i << 32) | j));
+    return (float)(bits % 101) / 100.0f;
+}
+
+void generate_rows(uint32_t seed, uint32_t row_start, uint32_t rows, uint32_t w, float* dst) {
+    const uint64_t key = generate_key(seed);
+    #pragma omp parallel for schedule(static)
+    for (uint32_t r = 0; r < rows; ++r) {
+        float* row = dst + (size_t)r * w;
+        for (uint32_t j = 0; j < w; ++j) {
+            row[j] = generate_value(key, row_start + r, j);
+        }
+    }
+}
+
+static uint32_t rows_per_block(uint32_t w) {
+    uint32_t rows = (uint32_t)(GEN_BLOCK_BYTES / ((size_t)w * sizeof(float)));
+    return rows ? rows : 1;
+}
 
 void generate_matrix_bin(char* bin_fp, uint32_t h, uint32_t w, uint32_t seed) {
-    int chunk = 10000;
-    uint64_t written = 0;
-
-    seed ? (uint32_t)seed : (uint32_t)time(NULL);
-    srand(seed);
-
-    FILE* bin = create_bin_matrix(bin_fp, h, w);
-    fseek(bin, sizeof(BinaryHeader), SEEK_SET);
-
-    float* buf = (float*)malloc((size_t)chunk * sizeof(float));
-    
-    #pragma omp parallel for firstprivate(buf) reduction(+ : written)
-    for (int n = 0; n < (int)(h * w); n++) {
-        int made = 0;
-        for (int i = 0; (i < chunk) && (i < (int)(h * w) - (int)written); i++) {
-            buf[i] = (rand() % 101) / 100.0f;
-            made++;
+    if (!seed) seed = (uint32_t)time(NULL);
+    if (!h || !w) return;
+
+    int fd = open(bin_fp, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+    if (fd == -1) {
+        fprintf(stderr, "Failed to create %s (%s)\n", bin_fp, strerror(errno));
+        return;
+    }
+
+    BinaryHeader header = {h, w};
+    if (write_at_pos(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        fprintf(stderr, "Failed to write header to %s (%s)\n", bin_fp, strerror(errno));
+        close(fd);
+        remove(bin_fp);
+        return;
+    }
+
+    const uint64_t key = generate_key(seed);
+    const uint32_t block_rows = rows_per_block(w);
+    const uint32_t blocks = (h + block_rows - 1) / block_rows;
+    _Atomic int error_flag = 0;
+
+    #pragma omp parallel
+    {
+        float* buf = (float*)malloc((size_t)block_rows * w * sizeof(float));
+        if (!buf) atomic_store_explicit(&error_flag, 1, memory_order_relaxed);
+
+        #pragma omp for schedule(dynamic, 1)
+        for (uint32_t b = 0; b < blocks; ++b) {
+            if (!buf || atomic_load_explicit(&error_flag, memory_order_relaxed)) continue;
+
+            uint32_t row_start = b * block_rows;
+            uint32_t rows = (h - row_start < block_rows) ? h - row_start : block_rows;
+            for (uint32_t r = 0; r < rows; ++r) {
+                for (uint32_t j = 0; j < w; ++j) {
+                    buf[(size_t)r * w + j] = generate_value(key, row_start + r, j);
+                }
+            }
+
+            size_t bytes = (size_t)rows * w * sizeof(float);
+            off_t offset = (off_t)sizeof(BinaryHeader) + (off_t)row_start * (off_t)w * (off_t)sizeof(float);
+            if (write_at_pos(fd, buf, bytes, offset) != (ssize_t)bytes) {
+                atomic_store_explicit(&error_flag, 1, memory_order_relaxed);
+            }
         }
-        
-        fwrite(buf, sizeof(float), made, bin);
-        written += (uint64_t)made;
+        free(buf);
+    }
+
+    close(fd);
+    if (atomic_load_explicit(&error_flag, memory_order_relaxed)) {
+        fprintf(stderr, "Failed to generate %s (%s)\n", bin_fp, strerror(errno));
+        remove(bin_fp);
+    }
+}
+
+void generate_matrix_bin_mpi(char* bin_fp, uint32_t h, uint32_t w, uint32_t seed, MPI_Comm comm) {
+    int rank = 0, size = 1;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    if (!seed && rank == 0) seed = (uint32_t)time(NULL);
+    MPI_Bcast(&seed, 1, MPI_UINT32_T, 0, comm);
+    if (!h || !w) return;
+
+    MPI_File fh;
+    int mpi_err = MPI_File_open(comm, bin_fp, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+    if (mpi_err != MPI_SUCCESS) {
+        char err_string[MPI_MAX_ERROR_STRING];
+        int err_len = 0;
+        MPI_Error_string(mpi_err, err_string, &err_len);
+        fprintf(stderr, "[Rank %d] Failed to create '%s': %.*s\n", rank, bin_fp, err_len, err_string);
+        MPI_Abort(comm, mpi_err);
+    }
+
+    MPI_Offset total = (MPI_Offset)sizeof(BinaryHeader) + (MPI_Offset)h * (MPI_Offset)w * (MPI_Offset)sizeof(float);
+    MPI_File_set_size(fh, total);
+    if (rank == 0) {
+        BinaryHeader header = {h, w};
+        MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
     }
-    fclose(bin);
+
+    uint32_t rows_per_rank = (h + size - 1) / size;
+    uint32_t row_start = rank * rows_per_rank;
+    uint32_t row_end = row_start + rows_per_rank;
+    if (row_end > h) row_end = h;
+    if (row_start > row_end) row_start = row_end;
+
+    const uint32_t block_rows = rows_per_block(w);
+    float* buf = (row_start < row_end) ? (float*)malloc((size_t)block_rows * w * sizeof(float)) : NULL;
+    if (row_start < row_end && !buf) {
+        fprintf(stderr, "[Rank %d] Failed to allocate generator buffer\n", rank);
+        MPI_Abort(comm, 1);
+    }
+
+    for (uint32_t row = row_start; row < row_end; row += block_rows) {
+        uint32_t rows = (row_end - row < block_rows) ? row_end - row : block_rows;
+        generate_rows(seed, row, rows, w, buf);
+        MPI_Offset offset = (MPI_Offset)sizeof(BinaryHeader) + (MPI_Offset)row * (MPI_Offset)w * (MPI_Offset)sizeof(float);
+        mpi_file_write_at_big(fh, offset, buf, (size_t)rows * w, MPI_FLOAT, MPI_STATUS_IGNORE);
+    }
+
     free(buf);
+    MPI_File_close(&fh);
 }
@@ -0,0 +1,108 @@
+#include "io_mpi.h"
+
+typedef enum { BIG_READ, BIG_IREAD, BIG_WRITE, BIG_IWRITE, BIG_IREAD_ALL, BIG_IWRITE_ALL } BigIoOp;
+
+#define MPI_HAS_IO_ALL (MPI_VERSION > 3 || (MPI_VERSION == 3 && MPI_SUBVERSION >= 1))
+
+#if MPI_VERSION < 4
+// count elements of type as one committed type: MPI_IO_COUNT_MAX-element
+// blocks, then whatever is left.
+static int big_type(size_t count, MPI_Datatype type, MPI_Datatype* big) {
+    const size_t block = MPI_IO_COUNT_MAX;
+    const size_t blocks = count / block, tail = count % block;
+    MPI_Aint lb, extent;
+    MPI_Datatype body;
+    int rc = MPI_Type_get_extent(type, &lb, &extent);
+    if (rc == MPI_SUCCESS) rc = MPI_Type_vector((int)blocks, (int)block, (int)block, type, &body);
+    if (rc != MPI_SUCCESS) return rc;
+    if (!tail) {
+        *big = body;
+    } else {
+        int lengths[2] = {1, (int)tail};
+        MPI_Aint displs[2] = {0, (MPI_Aint)(blocks * block) * extent};
+        MPI_Datatype types[2] = {body, type};
+        rc = MPI_Type_create_struct(2, lengths, displs, types, big);
+        MPI_Type_free(&body);
+        if (rc != MPI_SUCCESS) return rc;
+    }
+    rc = MPI_Type_commit(big);
+    if (rc != MPI_SUCCESS) MPI_Type_free(big);
+    return rc;
+}
+#endif
+
+static int big_io(BigIoOp op, MPI_File fh, MPI_Offset offset, void* buf, size_t count, MPI_Datatype type,
+                  MPI_Status* status, MPI_Request* req) {
+#if MPI_VERSION >= 4
+    const MPI_Count n = (MPI_Count)count;
+    switch (op) {
+        case BIG_READ: return MPI_File_read_at_c(fh, offset, buf, n, type, status);
+        case BIG_IREAD: return MPI_File_iread_at_c(fh, offset, buf, n, type, req);
+        case BIG_WRITE: return MPI_File_write_at_c(fh, offset, buf, n, type, status);
+        case BIG_IREAD_ALL: return MPI_File_iread_at_all_c(fh, offset, buf, n, type, req);
+        case BIG_IWRITE_ALL: return MPI_File_iwrite_at_all_c(fh, offset, buf, n, type, req);
+        default: return MPI_File_iwrite_at_c(fh, offset, buf, n, type, req);
+    }
+#else
+    MPI_Datatype io_type = type;
+    int n = (int)count;
+    if (count > (size_t)MPI_IO_COUNT_MAX) {
+        int rc = big_type(count, type, &io_type);
+        if (rc != MPI_SUCCESS) return rc;
+        n = 1;
+    }
+    int rc;
+    switch (op) {
+        case BIG_READ: rc = MPI_File_read_at(fh, offset, buf, n, io_type, status); break;
+        case BIG_IREAD: rc = MPI_File_iread_at(fh, offset, buf, n, io_type, req); break;
+        case BIG_WRITE: rc = MPI_File_write_at(fh, offset, buf, n, io_type, status); break;
+#if MPI_HAS_IO_ALL
+        case BIG_IREAD_ALL: rc = MPI_File_iread_at_all(fh, offset, buf, n, io_type, req); break;
+        case BIG_IWRITE_ALL: rc = MPI_File_iwrite_at_all(fh, offset, buf, n, io_type, req); break;
+#else
+        case BIG_IREAD_ALL:
+            *req = MPI_REQUEST_NULL;
+            rc = MPI_File_read_at_all(fh, offset, buf, n, io_type, MPI_STATUS_IGNORE);
+            break;
+        case BIG_IWRITE_ALL:
+            *req = MPI_REQUEST_NULL;
+            rc = MPI_File_write_at_all(fh, offset, buf, n, io_type, MPI_STATUS_IGNORE);
+            break;
+#endif
+        default: rc = MPI_File_iwrite_at(fh, offset, buf, n, io_type, req); break;
+    }
+    // a started request keeps its own reference to the type
+    if (io_type != type) MPI_Type_free(&io_type);
+    return rc;
+#endif
+}
+
+int mpi_file_read_at_big(MPI_File fh, MPI_Offset offset, void* buf, size_t count, MPI_Datatype type,
+                         MPI_Status* status) {
+    return big_io(BIG_READ, fh, offset, buf, count, type, status, NULL);
+}
+
+int mpi_file_iread_at_big(MPI_File fh, MPI_Offset offset, void* buf, size_t count, MPI_Datatype type,
+                          MPI_Request* req) {
+    return big_io(BIG_IREAD, fh, offset, buf, count, type, NULL, req);
+}
+
+int mpi_file_write_at_big(MPI_File fh, MPI_Offset offset, const void* buf, size_t count, MPI_Datatype type,
+                          MPI_Status* status) {
+    return big_io(BIG_WRITE, fh, offset, (void*)buf, count, type, status, NULL);
+}
+
+int mpi_file_iwrite_at_big(MPI_File fh, MPI_Offset offset, const void* buf, size_t count, MPI_Datatype type,
+                           MPI_Request* req) {
+    return big_io(BIG_IWRITE, fh, offset, (void*)buf, count, type, NULL, req);
+}
+
+int mpi_file_iread_at_all_big(MPI_File fh, MPI_Offset offset, void* buf, size_t count, MPI_Datatype type,
+                              MPI_Request* req) {
+    return big_io(BIG_IREAD_ALL, fh, offset, buf, count, type, NULL, req);
+}
+
+int mpi_file_iwrite_at_all_big(MPI_File fh, MPI_Offset offset, const void* buf, size_t count, MPI_Datatype type,
+                               MPI_Request* req) {
+    return big_io(BIG_IWRITE_ALL, fh, offset, (void*)buf, count, type, NULL, req);
+}
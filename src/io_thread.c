@@ -0,0 +1,81 @@
+#include "io_thread.h"
+#include <omp.h>
+#include <stdio.h>
+#include <string.h>
+
+static void* io_main(void* arg) {
+    IoThread* io = (IoThread*)arg;
+    pthread_mutex_lock(&io->lock);
+    for (;;) {
+        while (!io->head && !io->stop) pthread_cond_wait(&io->cond, &io->lock);
+        IoJob* job = io->head;
+        if (!job) break;
+        io->head = job->next;
+        if (!io->head) io->tail = NULL;
+        pthread_mutex_unlock(&io->lock);
+
+        double t0 = omp_get_wtime();
+        int rc = job->run(job->arg);
+        double seconds = omp_get_wtime() - t0;
+
+        pthread_mutex_lock(&io->lock);
+        job->rc = rc;
+        job->seconds = seconds;
+        job->done = 1;
+        pthread_cond_broadcast(&io->cond);
+    }
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+}
+
+int io_thread_start(IoThread* io) {
+    memset(io, 0, sizeof(*io));
+    if (pthread_mutex_init(&io->lock, NULL) != 0) return -1;
+    if (pthread_cond_init(&io->cond, NULL) != 0) {
+        pthread_mutex_destroy(&io->lock);
+        return -1;
+    }
+    int err = pthread_create(&io->thread, NULL, io_main, io);
+    if (err) {
+        fprintf(stderr, "Failed to start the I/O thread (%s)\n", strerror(err));
+        pthread_cond_destroy(&io->cond);
+        pthread_mutex_destroy(&io->lock);
+        return -1;
+    }
+    return 0;
+}
+
+void io_thread_submit(IoThread* io, IoJob* job, int (*run)(void*), void* arg) {
+    job->run = run;
+    job->arg = arg;
+    job->queued = 1;
+    job->done = 0;
+    job->rc = 0;
+    job->seconds = 0.0;
+    job->next = NULL;
+    pthread_mutex_lock(&io->lock);
+    if (io->tail) io->tail->next = job;
+    else io->head = job;
+    io->tail = job;
+    pthread_cond_broadcast(&io->cond);
+    pthread_mutex_unlock(&io->lock);
+}
+
+int io_thread_wait(IoThread* io, IoJob* job) {
+    if (!job->queued) return 0;
+    pthread_mutex_lock(&io->lock);
+    while (!job->done) pthread_cond_wait(&io->cond, &io->lock);
+    pthread_mutex_unlock(&io->lock);
+    job->queued = 0;
+    return job->rc;
+}
+
+void io_thread_stop(IoThread* io) {
+    pthread_mutex_lock(&io->lock);
+    io->stop = 1;
+    pthread_cond_broadcast(&io->cond);
+    pthread_mutex_unlock(&io->lock);
+    pthread_join(io->thread, NULL);
+    pthread_cond_destroy(&io->cond);
+    pthread_mutex_destroy(&io->lock);
+}
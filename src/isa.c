@@ -0,0 +1,114 @@
+#include "isa.h"
+#include "conv.h"
+#include "dtype.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* const names[ISA_LEVELS] = {"generic", "sse4.2", "avx2", "avx512"};
+
+const char* isa_name(IsaLevel level) {
+    return (unsigned)level < ISA_LEVELS ? names[level] : "?";
+}
+
+// The variants are only built for x86-64 (CONV_ISA_DISPATCH); elsewhere the
+// baseline build is the host's own.
+#ifdef CONV_ISA_DISPATCH
+#define ISA_DECLARE(ret, name, args) \
+    ret name##_generic args; ret name##_sse42 args; ret name##_avx2 args; ret name##_avx512 args;
+#define ISA_TABLE(name) {name##_generic, name##_sse42, name##_avx2, name##_avx512}
+
+// Highest level whose instructions the CPU and OS both support.
+static IsaLevel detect_level(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("x86-64-v4")) return ISA_AVX512;
+    if (__builtin_cpu_supports("x86-64-v3")) return ISA_AVX2;
+    if (__builtin_cpu_supports("x86-64-v2")) return ISA_SSE42;
+    return ISA_GENERIC;
+}
+#else
+#define ISA_DECLARE(ret, name, args) ret name##_generic args;
+#define ISA_TABLE(name) {name##_generic, name##_generic, name##_generic, name##_generic}
+
+static IsaLevel detect_level(void) {
+    return ISA_GENERIC;
+}
+#endif
+
+static pthread_once_t level_once = PTHREAD_ONCE_INIT;
+static IsaLevel level;
+
+static void resolve_level(void) {
+    IsaLevel supported = detect_level();
+    IsaLevel chosen = supported;
+    const char* env = getenv("CONV_ISA");
+    if (env && *env) {
+        int want = -1;
+        for (int i = 0; i < ISA_LEVELS; ++i) {
+            if (strcmp(env, names[i]) == 0) want = i;
+        }
+        if (want < 0) {
+            fprintf(stderr, "Ignoring unknown CONV_ISA=%s (expected generic, sse4.2, avx2 or avx512)\n", env);
+        } else if (want > (int)supported) {
+            fprintf(stderr, "CONV_ISA=%s is not supported here, using %s\n", env, names[supported]);
+        } else {
+            chosen = (IsaLevel)want;
+        }
+    }
+    level = chosen;
+}
+
+IsaLevel isa_level(void) {
+    // the I/O thread and OpenMP workers may ask first; pthread_once settles it
+    pthread_once(&level_once, resolve_level);
+    return level;
+}
+
+ISA_DECLARE(void, conv_openmp, (ConvParams* params))
+ISA_DECLARE(void, conv_quant, (ConvParams* params))
+ISA_DECLARE(void, dtype_to_f32, (uint32_t dtype, const void* src, float* dst, size_t n))
+ISA_DECLARE(void, f32_to_dtype, (uint32_t dtype, const float* src, void* dst, size_t n))
+ISA_DECLARE(void, dequantize_to_f32, (uint32_t dtype, const void* src, float* dst, size_t n, float scale,
+                                      int32_t zero_point))
+ISA_DECLARE(void, dequantize_to_i16, (uint32_t dtype, const void* src, int16_t* dst, size_t n, int32_t zero_point))
+ISA_DECLARE(void, quantize_from_f32, (uint32_t dtype, const float* src, void* dst, size_t n, float scale,
+                                      int32_t zero_point))
+
+void conv_openmp(ConvParams* params) {
+    static void (*const variants[ISA_LEVELS])(ConvParams*) = ISA_TABLE(conv_openmp);
+    variants[isa_level()](params);
+}
+
+void conv_quant(ConvParams* params) {
+    static void (*const variants[ISA_LEVELS])(ConvParams*) = ISA_TABLE(conv_quant);
+    variants[isa_level()](params);
+}
+
+void dtype_to_f32(uint32_t dtype, const void* src, float* dst, size_t n) {
+    static void (*const variants[ISA_LEVELS])(uint32_t, const void*, float*, size_t) = ISA_TABLE(dtype_to_f32);
+    variants[isa_level()](dtype, src, dst, n);
+}
+
+void f32_to_dtype(uint32_t dtype, const float* src, void* dst, size_t n) {
+    static void (*const variants[ISA_LEVELS])(uint32_t, const float*, void*, size_t) = ISA_TABLE(f32_to_dtype);
+    variants[isa_level()](dtype, src, dst, n);
+}
+
+void dequantize_to_f32(uint32_t dtype, const void* src, float* dst, size_t n, float scale, int32_t zero_point) {
+    static void (*const variants[ISA_LEVELS])(uint32_t, const void*, float*, size_t, float, int32_t) =
+        ISA_TABLE(dequantize_to_f32);
+    variants[isa_level()](dtype, src, dst, n, scale, zero_point);
+}
+
+void dequantize_to_i16(uint32_t dtype, const void* src, int16_t* dst, size_t n, int32_t zero_point) {
+    static void (*const variants[ISA_LEVELS])(uint32_t, const void*, int16_t*, size_t, int32_t) =
+        ISA_TABLE(dequantize_to_i16);
+    variants[isa_level()](dtype, src, dst, n, zero_point);
+}
+
+void quantize_from_f32(uint32_t dtype, const float* src, void* dst, size_t n, float scale, int32_t zero_point) {
+    static void (*const variants[ISA_LEVELS])(uint32_t, const float*, void*, size_t, float, int32_t) =
+        ISA_TABLE(quantize_from_f32);
+    variants[isa_level()](dtype, src, dst, n, scale, zero_point);
+}
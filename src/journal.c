@@ -0,0 +1,139 @@
+#include "journal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static void journal_path(char* path, size_t cap, const char* output_path, int rank, const char* suffix) {
+    snprintf(path, cap, "%s.journal.%d%s", output_path, rank, suffix);
+}
+
+static int write_all(int fd, const void* data, size_t bytes) {
+    const char* p = (const char*)data;
+    while (bytes) {
+        ssize_t n = write(fd, p, bytes);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        bytes -= (size_t)n;
+    }
+    return 0;
+}
+
+int journal_open(RowJournal* journal, const char* output_path, int rank, const JournalHeader* header,
+                 const JournalRecord* carried, uint32_t carried_count) {
+    char path[4096], tmp[4096];
+    journal_path(path, sizeof(path), output_path, rank, "");
+    journal_path(tmp, sizeof(tmp), output_path, rank, ".tmp");
+    journal->fd = journal->data_fd = -1;
+
+    int fd = open(tmp, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+    int rc = fd == -1 || write_all(fd, header, sizeof(*header)) != 0 ||
+             write_all(fd, carried, (size_t)carried_count * sizeof(JournalRecord)) != 0 ||
+             fsync(fd) != 0 ? -1 : 0;
+    if (fd != -1) close(fd);
+    if (!rc && rename(tmp, path) != 0) rc = -1;
+    if (!rc) {
+        journal->fd = open(path, O_WRONLY | O_APPEND);
+        journal->data_fd = open(output_path, O_WRONLY);
+        if (journal->fd == -1 || journal->data_fd == -1) rc = -1;
+    }
+    if (rc) {
+        fprintf(stderr, "[Rank %d] Failed to open journal %s (%s)\n", rank, path, strerror(errno));
+        remove(tmp);
+        journal_close(journal);
+    }
+    return rc;
+}
+
+int journal_commit(RowJournal* journal, uint32_t row_start, uint32_t row_end) {
+    // the output rows must be on disk before the record claims them
+    JournalRecord record = {row_start, row_end};
+    if (fdatasync(journal->data_fd) != 0 || write_all(journal->fd, &record, sizeof(record)) != 0 ||
+        fdatasync(journal->fd) != 0) {
+        fprintf(stderr, "Failed to journal output rows %u-%u (%s)\n", row_start, row_end, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+void journal_close(RowJournal* journal) {
+    if (journal->fd != -1) close(journal->fd);
+    if (journal->data_fd != -1) close(journal->data_fd);
+    journal->fd = journal->data_fd = -1;
+}
+
+static int compare_records(const void* a, const void* b) {
+    const JournalRecord* x = (const JournalRecord*)a;
+    const JournalRecord* y = (const JournalRecord*)b;
+    return x->row_start < y->row_start ? -1 : x->row_start > y->row_start;
+}
+
+int journal_load(const char* output_path, const JournalHeader* header, JournalRecord** ranges, uint32_t* count) {
+    JournalRecord* all = NULL;
+    size_t n = 0, capacity = 0;
+    *ranges = NULL;
+    *count = 0;
+
+    // journals are numbered from 0 by rank; the first gap ends them
+    for (int r = 0;; ++r) {
+        char path[4096];
+        journal_path(path, sizeof(path), output_path, r, "");
+        FILE* f = fopen(path, "rb");
+        if (!f) break;
+
+        JournalHeader h;
+        int ok = fread(&h, sizeof(h), 1, f) == 1 && h.magic == JOURNAL_MAGIC &&
+                 h.total_rows == header->total_rows && h.K == header->K && h.out_W == header->out_W &&
+                 h.out_dtype == header->out_dtype && h.bin_version == header->bin_version &&
+                 h.out_bytes == header->out_bytes;
+        if (!ok) {
+            fprintf(stderr, "Journal %s does not belong to this output\n", path);
+            fclose(f);
+            free(all);
+            return -1;
+        }
+        JournalRecord record;
+        // a record cut short by a crash is ignored
+        while (fread(&record, sizeof(record), 1, f) == 1) {
+            if (record.row_start >= record.row_end || record.row_end > header->total_rows) continue;
+            if (n == capacity) {
+                capacity = capacity ? capacity * 2 : 256;
+                JournalRecord* grown = (JournalRecord*)realloc(all, capacity * sizeof(JournalRecord));
+                if (!grown) {
+                    fclose(f);
+                    free(all);
+                    return -1;
+                }
+                all = grown;
+            }
+            all[n++] = record;
+        }
+        fclose(f);
+    }
+
+    if (!n) return 0;
+    qsort(all, n, sizeof(JournalRecord), compare_records);
+    size_t merged = 0;
+    for (size_t i = 1; i < n; ++i) {
+        if (all[i].row_start <= all[merged].row_end) {
+            if (all[i].row_end > all[merged].row_end) all[merged].row_end = all[i].row_end;
+        } else {
+            all[++merged] = all[i];
+        }
+    }
+    *ranges = all;
+    *count = (uint32_t)(merged + 1);
+    return 0;
+}
+
+void journal_remove(const char* output_path, int first) {
+    for (int r = first;; ++r) {
+        char path[4096];
+        journal_path(path, sizeof(path), output_path, r, "");
+        if (remove(path) != 0) break;
+    }
+}
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
@@ -8,22 +9,136 @@
 #include <sys/types.h>
 #include <mpi.h>
 #include "file.h"
+#include "compress.h"
 #include "generate.h"
-#include "conv.h"
 #include "cli_parse.h"
+#include "libconv.h"
+#include "batch.h"
+#include "occupancy.h"
+#include "isa.h"
 
 static int ends_with(const char* s, const char* suf) {
     size_t n = strlen(s), m = strlen(suf);
     return n>=m && strcmp(s+n-m, suf)==0;
 }
 
+// Reads a .txt or .bin kernel on the calling rank.
+static float* load_kernel(const char* path, int* kH, int* kW) {
+    float* kernel = NULL;
+    if (ends_with(path, ".txt")) {
+        TextFile tf = open_txt_matrix_input((char*)path);
+        if (!tf.file) return NULL;
+        kernel = (float*)malloc((size_t)tf.height * tf.width * sizeof(float));
+        if (kernel && read_txt_rows(&tf, kernel, tf.height) == 0) {
+            *kH = (int)tf.height;
+            *kW = (int)tf.width;
+        } else {
+            free(kernel);
+            kernel = NULL;
+        }
+        close_txt_matrix_input(&tf);
+        return kernel;
+    }
+
+    BinaryFile kb = open_bin_matrix_input((char*)path);
+    if (!kb.file) return NULL;
+    size_t n = (size_t)kb.height * kb.width;
+    kernel = (float*)malloc(n * sizeof(float));
+    if (kernel && read_bin_f32(&kb, kernel, n) == 0) {
+        *kH = (int)kb.height;
+        *kW = (int)kb.width;
+    } else {
+        free(kernel);
+        kernel = NULL;
+    }
+    fclose(kb.file);
+    return kernel;
+}
+
+// Indexes the non-zero tiles of the .bin or .cbin at path as path.occ.
+static int write_occupancy(const char* path, const CLIArgs* args) {
+    char occ_path[4096];
+    if (snprintf(occ_path, sizeof(occ_path), "%s.occ", path) >= (int)sizeof(occ_path)) return 1;
+    MatrixSource* src = ends_with(path, ".cbin") ? source_open_compressed(path) : source_open_file(path);
+    if (!src) return 1;
+    int rc = build_occupancy_index(src, path, (uint32_t)args->occupancy_rows, (uint32_t)args->occupancy_cols);
+    OccupancyIndex* occ = rc ? NULL : load_occupancy_index(path, src->height, src->width);
+    if (occ) {
+        const OccupancyHeader* h = &occ->header;
+        printf("[OCCUPANCY] index=%s tile=%ux%u occupied=%u/%u tiles (%.1f%%)\n", occ_path, h->tile_rows, h->tile_cols,
+               h->occupied, h->tiles_y * h->tiles_x, 100.0 * h->occupied / ((double)h->tiles_y * h->tiles_x));
+    }
+    free_occupancy_index(occ);
+    source_close(src);
+    return rc ? 1 : 0;
+}
+
+// Applies the boundary mode, --sparse and CONV_BOX, then loads every --stage kernel on
+// rank 0 and appends it to plan on all ranks. Notes go to log.
+static int setup_plan(ConvPlan* plan, const CLIArgs* args, BoundaryMode boundary, double sparse, int rank, FILE* log) {
+    if (conv_plan_set_boundary(plan, boundary) != 0) return 1;
+    if (sparse >= 0.0) {
+        uint32_t kept = 0, total = 0;
+        if (conv_plan_compile_taps(plan, (float)sparse, &kept, &total) != 0) return 1;
+        if (rank == 0) fprintf(log, "[SPARSE] taps=%u/%u threshold=%g\n", kept, total, sparse);
+    }
+    // CONV_BOX=0 keeps constant kernels on the dense path, 1 sums windows at any size
+    const char* box_env = getenv("CONV_BOX");
+    if (conv_plan_set_box(plan, box_env ? atoi(box_env) : -1) && rank == 0) {
+        fprintf(log, "[BOX] constant kernel, window sums\n");
+    }
+
+    int count = args->num_stages;
+    MPI_Bcast(&count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    for (int s = 0; s < count; ++s) {
+        int dims[4] = {0, 0, 1, 1};     // kH, kW, sH, sW
+        float* kernel = NULL;
+        if (rank == 0) {
+            char path[256];
+            parse_stage_spec(args->stages[s], path, sizeof(path), &dims[2], &dims[3]);
+            kernel = load_kernel(path, &dims[0], &dims[1]);
+            if (!kernel) {
+                fprintf(stderr, "Failed to load stage kernel %s\n", path);
+                dims[0] = 0;
+            }
+        }
+        MPI_Bcast(dims, 4, MPI_INT, 0, MPI_COMM_WORLD);
+        if (!dims[0]) return 1;
+        if (!kernel) kernel = (float*)malloc((size_t)dims[0] * dims[1] * sizeof(float));
+        MPI_Bcast(kernel, dims[0] * dims[1], MPI_FLOAT, 0, MPI_COMM_WORLD);
+        int rc = conv_plan_add_stage(plan, kernel, (uint32_t)dims[0], (uint32_t)dims[1],
+                                     (uint32_t)dims[2], (uint32_t)dims[3]);
+        free(kernel);
+        if (rc) return 1;
+        if (rank == 0) {
+            fprintf(log, "[STAGE] %d: %s k=%dx%d s=%dx%d\n", s + 1, args->stages[s], dims[0], dims[1], dims[2], dims[3]);
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char** argv) {
-    MPI_Init(&argc, &argv);
+    // CONV_IO_THREAD=1 moves the file I/O of conv_mpi to a helper thread,
+    // which calls MPI alongside the compute thread
+    const char* io_env = getenv("CONV_IO_THREAD");
+    int io_thread = io_env && atoi(io_env) > 0;
+    if (io_thread) {
+        int provided = MPI_THREAD_SINGLE;
+        MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+        io_thread = provided >= MPI_THREAD_MULTIPLE;
+    } else {
+        MPI_Init(&argc, &argv);
+    }
     int world=1, rank=0;
     MPI_Comm_size(MPI_COMM_WORLD, &world);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (io_env && atoi(io_env) > 0 && !io_thread && rank == 0) {
+        fprintf(stderr, "MPI does not provide MPI_THREAD_MULTIPLE; CONV_IO_THREAD ignored\n");
+    }
+    // settle the kernel variants (and any CONV_ISA warning) before helper threads start
+    isa_level();
 
-    CLIArgs args = {-1, -1, -1, -1, 1, 1, NULL, NULL, NULL, 32.0, 0};
+    CLIArgs args = {-1, -1, -1, -1, 1, 1, NULL, NULL, NULL, 32.0, DTYPE_F32, 0, 1, 0, 0, 1, 1, 1, NULL, 0, {NULL}, 0, BOUNDARY_ZERO, -1.0, 0, 0, 0, 0};
     
     if (rank == 0) {
         int parse_rc = parse_cli_args(argc, argv, &args);
@@ -37,48 +152,110 @@ int main(int argc, char** argv) {
         }
     }
 
-    int cfg[6] = {args.H, args.W, args.kH, args.kW, args.sH, args.sW};
-    MPI_Bcast(cfg, 6, MPI_INT, 0, MPI_COMM_WORLD);
+    // --convert only rewrites the input file on rank 0
+    int convert_rc = -1;
+    if (rank == 0 && args.convert_only) {
+        convert_rc = 0;
+        if (args.output_file) {
+            convert_rc = convert_bin_version((char*)args.input_file, (char*)args.output_file, (uint32_t)args.bin_version,
+                                             (size_t)args.row_pitch) ? 1 : 0;
+            if (!convert_rc) printf("Converted %s to %s (.bin v%d)\n", args.input_file, args.output_file, args.bin_version);
+        }
+        if (!convert_rc && args.occupancy_rows) {
+            convert_rc = write_occupancy(args.output_file ? args.output_file : args.input_file, &args);
+        }
+    }
+    MPI_Bcast(&convert_rc, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (convert_rc >= 0) {
+        MPI_Finalize();
+        return convert_rc;
+    }
+
+    // dimensions travel as int64 so stacked .bin heights past INT_MAX survive
+    // until they are checked below
+    int64_t cfg[16] = {args.H, args.W, args.kH, args.kW, args.sH, args.sW, args.out_dtype, args.quant_dtype, args.bin_version,
+                   args.batch, args.channels, args.kernels, args.pipe_format, args.boundary, args.checkpoint, args.row_pitch};
+    MPI_Bcast(cfg, (int)(sizeof(cfg) / sizeof(cfg[0])), MPI_INT64_T, 0, MPI_COMM_WORLD);
     
-    int H = cfg[0];
-    int W = cfg[1];
-    int kH = cfg[2];
-    int kW = cfg[3];
-    int sH = cfg[4];
-    int sW = cfg[5];
+    int H = (int)cfg[0];
+    int W = (int)cfg[1];
+    int kH = (int)cfg[2];
+    int kW = (int)cfg[3];
+    int sH = (int)cfg[4];
+    int sW = (int)cfg[5];
+    int out_dtype = (int)cfg[6];
+    int quant_dtype = (int)cfg[7];
+    int bin_version = (int)cfg[8];
+    const size_t row_pitch = (size_t)cfg[15];
+    // tensor runs stack N images of C planes in the input rows; H is per plane
+    const int N = (int)cfg[9];
+    const int C = (int)cfg[10];
+    const int K = (int)cfg[11];
+    const int tensor = N * C * K != 1;
+    const int pipe_format = (int)cfg[12];
+    const BoundaryMode boundary = (BoundaryMode)cfg[13];
+    const int checkpoint = (int)cfg[14];
     
-    double mem_gb = args.memory_gb;
-    MPI_Bcast(&mem_gb, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    double dcfg[2] = {args.memory_gb, args.sparse_threshold};
+    MPI_Bcast(dcfg, 2, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    double mem_gb = dcfg[0];
+    const double sparse = dcfg[1];
     
     char in_path_buf[256] = {0};
     char ker_path_buf[256] = {0};
     char out_path_buf[256] = {0};
+    char manifest_buf[256] = {0};
     
     if (rank == 0) {
         if (args.input_file) strncpy(in_path_buf, args.input_file, 255);
         if (args.kernel_file) strncpy(ker_path_buf, args.kernel_file, 255);
         if (args.output_file) strncpy(out_path_buf, args.output_file, 255);
+        if (args.manifest_file) strncpy(manifest_buf, args.manifest_file, 255);
     }
     
     MPI_Bcast(in_path_buf, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
     MPI_Bcast(ker_path_buf, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
     MPI_Bcast(out_path_buf, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+    MPI_Bcast(manifest_buf, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
     
     const char* in_path = (in_path_buf[0] != '\0') ? in_path_buf : NULL;
     const char* ker_path = (ker_path_buf[0] != '\0') ? ker_path_buf : NULL;
     const char* out_path = out_path_buf;
+    // batch runs take their inputs and outputs from the manifest
+    const char* manifest = (manifest_buf[0] != '\0') ? manifest_buf : NULL;
 
     const char* tmp_dir = getenv("CONV_TEMP_DIR");
     if (!tmp_dir) tmp_dir = getenv("CONV_TMP_DIR");
     if (!tmp_dir) tmp_dir = "./tmp";
-    if (rank == 0) {
-        mkdir(tmp_dir, 0777);
-    }
     
+    // pipe input is read once, front to back, so its header is consumed here
+    // and nothing else may open it
+    RowStream pipe_in;
+    if (pipe_format) {
+        if (world > 1) {
+            if (rank==0) fprintf(stderr, "--pipe runs on a single rank\n");
+            MPI_Finalize();
+            return 2;
+        }
+        if (open_row_stream(in_path, pipe_format == 1, &pipe_in) != 0) {
+            MPI_Finalize();
+            return 1;
+        }
+        cfg[0] = pipe_in.height;
+        cfg[1] = pipe_in.width;
+        in_path = NULL;
+    }
+
     char tmp_input_bin[256] = {0};
     int cleanup_input = 0;
-    if (in_path && ends_with(in_path, ".txt")) {
+    int stream_input = 0;
+    if (in_path && ends_with(in_path, ".txt") && world == 1 && !quant_dtype && !tensor && boundary != BOUNDARY_CIRCULAR &&
+        !checkpoint) {
+        // a single rank parses text rows straight into its chunk buffers
+        stream_input = 1;
+    } else if (in_path && ends_with(in_path, ".txt")) {
         if (rank==0) {
+            mkdir(tmp_dir, 0777);
             snprintf(tmp_input_bin, sizeof(tmp_input_bin), "%s/conv_input_%d.bin", tmp_dir, (int)getpid());
             convert_txt_to_bin((char*)in_path, tmp_input_bin, 8192);
         }
@@ -88,77 +265,134 @@ int main(int argc, char** argv) {
     }
 
     if (in_path) {
-        if (rank==0) {
+        if (rank==0 && stream_input) {
+            TextFile tf = open_txt_matrix_input((char*)in_path);
+            cfg[0] = tf.height;
+            cfg[1] = tf.width;
+            close_txt_matrix_input(&tf);
+        } else if (rank==0 && ends_with(in_path, ".cbin")) {
+            CompressedHeader ch;
+            if (read_compressed_header(in_path, &ch) != 0) MPI_Abort(MPI_COMM_WORLD, 1);
+            if (quant_dtype) {
+                fprintf(stderr, "-q needs a .bin or .txt input, decompress %s first\n", in_path);
+                MPI_Abort(MPI_COMM_WORLD, 2);
+            }
+            cfg[0] = ch.height;
+            cfg[1] = ch.width;
+        } else if (rank==0) {
             BinaryFile bf = open_bin_matrix_input((char*)in_path);
-            H = (int)bf.height; W = (int)bf.width;
-            fclose(bf.file);
-            
-            cfg[0] = H;
-            cfg[1] = W;
+            cfg[0] = bf.height;
+            cfg[1] = bf.width;
+            if (bf.file) fclose(bf.file);
+        }
+        MPI_Bcast(cfg, (int)(sizeof(cfg) / sizeof(cfg[0])), MPI_INT64_T, 0, MPI_COMM_WORLD);
+        if (cfg[0] > 0 && cfg[0] % (N * C) != 0) {
+            if (rank==0) fprintf(stderr, "Input has %lld rows, not a multiple of %d images x %d channels\n",
+                                 (long long)cfg[0], N, C);
+            MPI_Finalize();
+            return 2;
         }
-        MPI_Bcast(cfg, 6, MPI_INT, 0, MPI_COMM_WORLD);
-        H = cfg[0];
-        W = cfg[1];
+        cfg[0] /= N * C;
     }
+    // element counts are 64-bit throughout, but a plane's rows and columns are
+    // int in the kernels and the stacked planes are uint32 source rows
+    if (cfg[0] > INT_MAX || cfg[1] > INT_MAX || cfg[0] * N * C > UINT32_MAX) {
+        if (rank==0) fprintf(stderr, "Input of %d x %lldx%lld planes exceeds %d rows or columns per plane or %u rows in all\n",
+                             N * C, (long long)cfg[0], (long long)cfg[1], INT_MAX, UINT32_MAX);
+        MPI_Finalize();
+        return 2;
+    }
+    H = (int)cfg[0];
+    W = (int)cfg[1];
+    // every source and temporary input holds all stacked planes
+    const uint32_t src_rows = (uint32_t)H * (uint32_t)(N * C);
     
-    if (H<=0 || W<=0) { if (rank==0) fprintf(stderr, "Input size invalid or missing (-H -W or -f).\n"); MPI_Finalize(); return 2; }
+    if (!manifest && (H<=0 || W<=0)) { if (rank==0) fprintf(stderr, "Input size invalid or missing (-H -W or -f).\n"); MPI_Finalize(); return 2; }
 
-    if (!in_path) {
+    const char* source_env = getenv("CONV_SOURCE");
+    int materialize_input = quant_dtype ||
+                            (source_env && (strcmp(source_env, "file") == 0 || strcmp(source_env, "mmap") == 0));
+    if (!in_path && !manifest && !pipe_format && materialize_input) {
         if (rank==0) {
+            mkdir(tmp_dir, 0777);
             snprintf(tmp_input_bin, sizeof(tmp_input_bin), "%s/conv_input_%d.bin", tmp_dir, (int)getpid());
-            generate_matrix_bin(tmp_input_bin, (uint32_t)H, (uint32_t)W, 1234);
         }
         MPI_Bcast(tmp_input_bin, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+        if (world > 1) {
+            generate_matrix_bin_mpi(tmp_input_bin, src_rows, (uint32_t)W, 1234, MPI_COMM_WORLD);
+        } else {
+            generate_matrix_bin(tmp_input_bin, src_rows, (uint32_t)W, 1234);
+        }
         in_path = tmp_input_bin;
         cleanup_input = 1;
     }
 
+    // the integer engine reads i8/i16 storage; other inputs are quantized
+    // into a temporary file first and kept as the fp32 reference
+    char tmp_quant_bin[256] = {0};
+    const char* run_path = in_path;
+    if (quant_dtype) {
+        if (rank==0) {
+            BinaryFile bf = open_bin_matrix_input((char*)in_path);
+            uint32_t in_dtype = bf.dtype;
+            if (bf.file) fclose(bf.file);
+            if (dtype_is_quantized(in_dtype)) {
+                quant_dtype = (int)in_dtype;
+            } else {
+                mkdir(tmp_dir, 0777);
+                snprintf(tmp_quant_bin, sizeof(tmp_quant_bin), "%s/conv_quant_%d.bin", tmp_dir, (int)getpid());
+                if (quantize_bin_matrix((char*)in_path, tmp_quant_bin, (uint32_t)quant_dtype) != 0) {
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+            }
+        }
+        MPI_Bcast(&quant_dtype, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Bcast(tmp_quant_bin, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+        if (tmp_quant_bin[0]) run_path = tmp_quant_bin;
+    }
+
     if (!ker_path && kH <= 0 && kW <= 0) {
         kH = 1;
         kW = 1;
-        cfg[2] = kH;
-        cfg[3] = kW;
         if (rank==0) {
             fprintf(stderr, "No kernel file or dimensions provided, assuming 1x1 identity kernel for matrix generation\n");
         }
     }
 
-    char tmp_kernel_bin[256] = {0};
-    int cleanup_kernel = 0;
     float* kernel_mem = NULL;
-    if (ker_path && ends_with(ker_path, ".txt")) {
-        if (rank==0) {
-            snprintf(tmp_kernel_bin, sizeof(tmp_kernel_bin), "%s/conv_kernel_%d.bin", tmp_dir, (int)getpid());
-            convert_txt_to_bin((char*)ker_path, tmp_kernel_bin, 8192);
-        }
-        MPI_Bcast(tmp_kernel_bin, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
-        ker_path = tmp_kernel_bin;
-        cleanup_kernel = 1;
-    }
-    
-    if (ker_path && (kH <= 0 || kW <= 0)) {
-        if (rank==0) {
-            BinaryFile kb = open_bin_matrix_input((char*)ker_path);
-            kH = (int)kb.height; kW = (int)kb.width;
-            fclose(kb.file);
-            
-            cfg[2] = kH;
-            cfg[3] = kW;
-        }
-        MPI_Bcast(cfg, 6, MPI_INT, 0, MPI_COMM_WORLD);
-        kH = cfg[2];
-        kW = cfg[3];
-    }
-    
-    if (!ker_path) {
-        if (rank==0) {
-            kernel_mem = (float*)malloc((size_t)kH*(size_t)kW*sizeof(float));
+    if (rank==0) {
+        if (ker_path) {
+            int file_kH = 0, file_kW = 0;
+            kernel_mem = load_kernel(ker_path, &file_kH, &file_kW);
+            if (!kernel_mem) {
+                fprintf(stderr, "Failed to load kernel %s\n", ker_path);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            // K kernels of C planes are stacked by rows like the input
+            if (file_kH % (K * C) != 0) {
+                fprintf(stderr, "Kernel %s has %d rows, not a multiple of %d kernels x %d channels\n", ker_path, file_kH, K, C);
+                MPI_Abort(MPI_COMM_WORLD, 2);
+            }
+            file_kH /= K * C;
+            if ((kH > 0 && kH != file_kH) || (kW > 0 && kW != file_kW)) {
+                fprintf(stderr, "Kernel %s is %dx%d, but -kH %d -kW %d were given\n", ker_path, file_kH, file_kW, kH, kW);
+                MPI_Abort(MPI_COMM_WORLD, 2);
+            }
+            kH = file_kH;
+            kW = file_kW;
+        } else {
+            kernel_mem = (float*)malloc((size_t)K*C*kH*kW*sizeof(float));
             unsigned seed = 2025u;
-            for (int i=0;i<kH*kW;++i) kernel_mem[i] = (float)(rand_r(&seed)%101)/100.0f;
+            for (int i=0;i<K*C*kH*kW;++i) kernel_mem[i] = (float)(rand_r(&seed)%101)/100.0f;
         }
-        if (!kernel_mem) kernel_mem = (float*)malloc((size_t)kH*(size_t)kW*sizeof(float));
-        MPI_Bcast(kernel_mem, kH*kW, MPI_FLOAT, 0, MPI_COMM_WORLD);
+        cfg[2] = kH;
+        cfg[3] = kW;
     }
+    MPI_Bcast(cfg, (int)(sizeof(cfg) / sizeof(cfg[0])), MPI_INT64_T, 0, MPI_COMM_WORLD);
+    kH = (int)cfg[2];
+    kW = (int)cfg[3];
+    if (!kernel_mem) kernel_mem = (float*)malloc((size_t)K*C*kH*kW*sizeof(float));
+    MPI_Bcast(kernel_mem, K*C*kH*kW, MPI_FLOAT, 0, MPI_COMM_WORLD);
 
     int use_mpi = (world > 1);
 
@@ -171,254 +405,195 @@ int main(int argc, char** argv) {
     if (convert_env && (strcmp(convert_env, "0") == 0 || strcmp(convert_env, "false") == 0 || strcmp(convert_env, "False") == 0)) {
         convert_to_txt = 0;
     }
-    
-    char tmp_output_bin[256] = {0};
-    char final_output_path[256] = {0};
-    int convert_output = 0;
-    const char* internal_out = NULL;
-    
-    if (rank==0) {
-        if (convert_to_txt) {
-            snprintf(tmp_output_bin, sizeof(tmp_output_bin), "%s/conv_output_%d.bin", tmp_dir, (int)getpid());
-            internal_out = tmp_output_bin;
-            convert_output = 1;
-        } else {
-            if (!ends_with(out_path, ".bin")) {
-                snprintf(final_output_path, sizeof(final_output_path), "%s.bin", out_path);
-                internal_out = final_output_path;
-            } else {
-                internal_out = out_path;
-            }
+    // the journal tracks rows of the file the pipeline writes, which must be the output itself
+    if (checkpoint && (convert_to_txt || ends_with(out_path, ".cbin"))) {
+        if (rank==0) fprintf(stderr, "--checkpoint and --resume need plain .bin output (CONVERT_BIN=0, not .cbin)\n");
+        if (rank==0 && cleanup_input) remove(tmp_input_bin);
+        MPI_Finalize();
+        return 2;
+    }
+
+    if (pipe_format) {
+        ConvPlan* plan = conv_plan_create((uint32_t)H, (uint32_t)W, kernel_mem, (uint32_t)kH, (uint32_t)kW,
+                                          (uint32_t)sH, (uint32_t)sW, 0);
+        ConvRunOptions run_opts = {(size_t)budget_bytes, convert_to_txt, (uint32_t)out_dtype, (uint32_t)bin_version,
+                                   row_pitch};
+        int rc = plan && !setup_plan(plan, &args, boundary, sparse, rank, stderr) ? conv_plan_run_pipe(plan, &pipe_in, out_path, &run_opts) : 1;
+        close_row_stream(&pipe_in);
+        conv_plan_destroy(plan);
+        free(kernel_mem);
+        MPI_Finalize();
+        return rc;
+    }
+
+    if (manifest) {
+        // one plan, and so one kernel copy, serves every job of the batch
+        ConvPlan* plan = conv_plan_create_tensor((uint32_t)N, (uint32_t)C, 1, 1,
+                                                 kernel_mem, (uint32_t)K, (uint32_t)kH, (uint32_t)kW,
+                                                 (uint32_t)sH, (uint32_t)sW, 0);
+        if (!plan || setup_plan(plan, &args, boundary, sparse, rank, stdout) != 0) {
+            fprintf(stderr, "[Rank %d] Failed to create convolution plan\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        ConvRunOptions run_opts = {(size_t)budget_bytes, convert_to_txt, (uint32_t)out_dtype, (uint32_t)bin_version,
+                                   row_pitch};
+        int rc = run_manifest(plan, manifest, MPI_COMM_WORLD, &run_opts, tmp_dir);
+        conv_plan_destroy(plan);
+        free(kernel_mem);
+        MPI_Finalize();
+        return rc;
     }
     
-    if (convert_to_txt) {
-        MPI_Bcast(tmp_output_bin, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
-        internal_out = tmp_output_bin;
-    } else {
-        if (rank == 0 && final_output_path[0] != '\0') {
-            strncpy(tmp_output_bin, final_output_path, 255);
-        } else if (rank == 0) {
-            strncpy(tmp_output_bin, out_path, 255);
-        }
-        MPI_Bcast(tmp_output_bin, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
-        internal_out = tmp_output_bin;
+    char bin_output_path[256] = {0};
+    const char* internal_out = out_path;
+    if (out_dtype != DTYPE_F32 && convert_to_txt && rank == 0) {
+        fprintf(stderr, "Ignoring -t %s for text output (set CONVERT_BIN=0 for .bin output)\n", dtype_name((uint32_t)out_dtype));
+    }
+    if (args.occupancy_rows && convert_to_txt && rank == 0) {
+        fprintf(stderr, "Ignoring --occupancy for text output (set CONVERT_BIN=0 for .bin output)\n");
+    }
+    // .cbin output is written as a plain .bin and compressed afterwards, and
+    // so is text output with several planes per image, which the pipelines
+    // do not produce in file order
+    int compress_output = !convert_to_txt && ends_with(out_path, ".cbin");
+    int text_via_bin = convert_to_txt && K > 1;
+    if (compress_output || text_via_bin) {
+        if (rank==0) mkdir(tmp_dir, 0777);
+        int pid = (int)getpid();
+        MPI_Bcast(&pid, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        snprintf(bin_output_path, sizeof(bin_output_path), "%s/conv_output_%d.bin", tmp_dir, pid);
+        internal_out = bin_output_path;
+        if (text_via_bin) out_dtype = DTYPE_F32;
+    } else if (!convert_to_txt && !ends_with(out_path, ".bin")) {
+        snprintf(bin_output_path, sizeof(bin_output_path), "%s.bin", out_path);
+        internal_out = bin_output_path;
+    }
+
+    ConvPlan* plan = conv_plan_create_tensor((uint32_t)N, (uint32_t)C, (uint32_t)H, (uint32_t)W,
+                                             kernel_mem, (uint32_t)K, (uint32_t)kH, (uint32_t)kW,
+                                             (uint32_t)sH, (uint32_t)sW, 0);
+    if (!plan || setup_plan(plan, &args, boundary, sparse, rank, stdout) != 0) {
+        fprintf(stderr, "[Rank %d] Failed to create convolution plan\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    uint32_t plan_out_H = 0, plan_out_W = 0;
+    conv_plan_output_dims(plan, &plan_out_H, &plan_out_W);
+    if (!plan_out_H || !plan_out_W) {
+        if (rank==0) fprintf(stderr, "Input %dx%d has no %s outputs for this kernel\n", H, W, boundary_name(boundary));
+        MPI_Finalize();
+        return 2;
+    }
+    if (quant_dtype && conv_plan_quantize(plan, (uint32_t)quant_dtype) != 0) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
 
     double t0 = MPI_Wtime();
 
+    // CONV_TILE_COLS forces column tiles of that many output columns
+    const char* tile_env = getenv("CONV_TILE_COLS");
+    // CONV_COLLECTIVE_IO=1 makes the MPI-IO of a multi-rank run collective;
+    // CONV_CB_NODES and CONV_STRIPING_UNIT tune its aggregators and domains
+    const char* collective_env = getenv("CONV_COLLECTIVE_IO");
+    const char* cb_nodes_env = getenv("CONV_CB_NODES");
+    const char* stripe_env = getenv("CONV_STRIPING_UNIT");
+    ConvRunOptions run_opts = {(size_t)budget_bytes, convert_to_txt && !text_via_bin, (uint32_t)out_dtype,
+                               text_via_bin ? 1u : (uint32_t)bin_version, text_via_bin ? 0 : row_pitch, checkpoint,
+                               tile_env && atoi(tile_env) > 0 ? (uint32_t)atoi(tile_env) : 0, io_thread,
+                               collective_env && atoi(collective_env) > 0,
+                               cb_nodes_env && atoi(cb_nodes_env) > 0 ? (uint32_t)atoi(cb_nodes_env) : 0,
+                               stripe_env && atoi(stripe_env) > 0 ? (uint32_t)atoi(stripe_env) : 0};
+
     int rc = 0;
-    if (use_mpi) {
-        float* kptr = NULL;
-        if (kernel_mem) kptr = kernel_mem;
-        else if (ker_path) {
+    if (stream_input) {
+        rc = conv_plan_run_txt(plan, in_path, internal_out, &run_opts);
+    } else {
+        MatrixSource* src = open_input_source(run_path, src_rows, (uint32_t)W, use_mpi, source_env);
+        if (!src) {
+            fprintf(stderr, "[Rank %d] Failed to open input source\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        rc = conv_plan_run(plan, MPI_COMM_WORLD, src, internal_out, &run_opts);
+
+        if (src->occupancy) {
+            unsigned long long skipped = src->rows_skipped, total_skipped = 0;
+            MPI_Reduce(&skipped, &total_skipped, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+            const OccupancyHeader* h = &src->occupancy->header;
             if (rank==0) {
-                BinaryFile kb = open_bin_matrix_input((char*)ker_path);
-                float* tmp = (float*)malloc((size_t)kH*(size_t)kW*sizeof(float));
-                fread(tmp, sizeof(float), (size_t)kH*(size_t)kW, kb.file);
-                fclose(kb.file);
-                if (!kernel_mem) kernel_mem = tmp; else free(tmp);
+                printf("[OCCUPANCY] input=%s occupied=%u/%u tiles rows_skipped=%llu\n", in_path,
+                       h->occupied, h->tiles_y * h->tiles_x, total_skipped);
             }
-            if (!kernel_mem) kernel_mem = (float*)malloc((size_t)kH*(size_t)kW*sizeof(float));
-            MPI_Bcast(kernel_mem, kH*kW, MPI_FLOAT, 0, MPI_COMM_WORLD);
-            kptr = kernel_mem;
         }
 
-        ConvParams* mpi_params = (ConvParams*)malloc(sizeof(ConvParams));
-        
-        mpi_params->H = (uint32_t)H;
-        mpi_params->W = (uint32_t)W;
-        mpi_params->kH = (uint32_t)kH;
-        mpi_params->kW = (uint32_t)kW;
-        mpi_params->sH = (uint32_t)sH;
-        mpi_params->sW = (uint32_t)sW;
-        mpi_params->kernel = kptr;
-        mpi_params->data = NULL;
-        mpi_params->output = NULL;  
-        mpi_params->input_offset_row = 0;
-        mpi_params->output_offset_row = 0;
-        calc_output_dims(mpi_params);
-        
-        conv_mpi(mpi_params, MPI_COMM_WORLD, in_path, internal_out, budget_bytes);
-        
-        free(mpi_params);
-        rc = 0;
-    } else {
-        float* kernel_full = NULL;
-
-        if (rank==0) {
-            if (kernel_mem) kernel_full = kernel_mem;
-            else if (ker_path) {
-                BinaryFile kb = open_bin_matrix_input((char*)ker_path);
-                kernel_full = (float*)malloc((size_t)kH*(size_t)kW*sizeof(float));
-                fread(kernel_full, sizeof(float), (size_t)kH*(size_t)kW, kb.file);
-                fclose(kb.file);
+        if (strcmp(src->kind, "compressed") == 0) {
+            unsigned long long local[2] = {src->bytes_stored, src->bytes_raw}, total[2] = {0, 0};
+            MPI_Reduce(local, total, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+            if (rank==0 && total[0]) {
+                printf("[COMPRESS] input=%s read=%.1fMB decoded=%.1fMB ratio=%.2f\n", in_path,
+                       total[0] / 1048576.0, total[1] / 1048576.0, (double)total[1] / (double)total[0]);
             }
-            
-            int out_H = calc_output_height(H, kH, sH);
-            int out_W = calc_output_width(W, kW, sW);
-            
-            uint32_t chunk_out_rows = calc_chunk_size((uint32_t)W, (uint32_t)out_W, 
-                                                       (uint32_t)kH, (uint32_t)kW, 
-                                                       (uint32_t)sH, (size_t)budget_bytes);
-            
-            uint32_t num_chunks = (out_H + chunk_out_rows - 1) / chunk_out_rows;
-            
-            size_t chunk_mem_size = (size_t)chunk_out_rows * (sH + kH) * W * sizeof(float) + 
-                                   (size_t)chunk_out_rows * out_W * sizeof(float);
-            uint32_t max_chunks_in_mem = (uint32_t)(budget_bytes / chunk_mem_size);
-            if (max_chunks_in_mem < 1) max_chunks_in_mem = 1;
-            
-            fprintf(stdout,"[CHUNK] mode=%s threads=%s mem=%.3fGB chunk_rows=%u total_chunks=%u max_in_mem=%u out_size=%dx%d\n",
-                   "omp",
-                   getenv("OMP_NUM_THREADS")?getenv("OMP_NUM_THREADS"):"1",
-                   budget_bytes/1e9, chunk_out_rows, num_chunks, max_chunks_in_mem, out_H, out_W);
-            
-            double t_read_done = MPI_Wtime();
-            double t_comp_total = 0.0;
-            uint32_t chunk_counter = 0;
-            
-            FILE* output_file = create_bin_matrix((char*)internal_out, (uint32_t)out_H, (uint32_t)out_W);
-            
-            typedef struct {
-                float* input;
-                float* output;
-                uint32_t out_row_start;
-                uint32_t out_row_end;
-                uint32_t input_row_start;
-                uint32_t num_input_rows;
-                int loaded;
-                int processed;
-            } ChunkBuffer;
-            
-            ChunkBuffer* buffers = (ChunkBuffer*)calloc(max_chunks_in_mem, sizeof(ChunkBuffer));
-            
-            uint32_t next_chunk_to_load = 0;
-            uint32_t next_chunk_to_process = 0;
-            uint32_t chunks_in_memory = 0;
-            
-            while (next_chunk_to_process < num_chunks) {
-                while (chunks_in_memory < max_chunks_in_mem && next_chunk_to_load < num_chunks) {
-                    uint32_t out_row_start = next_chunk_to_load * chunk_out_rows;
-                    uint32_t out_row_end = out_row_start + chunk_out_rows;
-                    if (out_row_end > (uint32_t)out_H) out_row_end = (uint32_t)out_H;
-                    
-                    uint32_t input_row_start, num_input_rows;
-                    calc_input_rows_for_output_range_clamped(out_row_start, out_row_end, (uint32_t)sH, (uint32_t)kH, (uint32_t)H,
-                                                              &input_row_start, &num_input_rows);
-                    
-                    uint32_t chunk_out_H = out_row_end - out_row_start;
-                    uint32_t buf_idx = next_chunk_to_load % max_chunks_in_mem;
-                    
-                    buffers[buf_idx].input = (float*)malloc((size_t)num_input_rows * W * sizeof(float));
-                    buffers[buf_idx].output = (float*)malloc((size_t)chunk_out_H * out_W * sizeof(float));
-                    BinaryFile input_file = open_bin_matrix_input((char*)in_path);
-                    fseek(input_file.file, sizeof(BinaryHeader) + (size_t)input_row_start * W * sizeof(float), SEEK_SET);
-                    fread(buffers[buf_idx].input, sizeof(float), (size_t)num_input_rows * W, input_file.file);
-                    fclose(input_file.file);
-                    
-                    buffers[buf_idx].out_row_start = out_row_start;
-                    buffers[buf_idx].out_row_end = out_row_end;
-                    buffers[buf_idx].input_row_start = input_row_start;
-                    buffers[buf_idx].num_input_rows = num_input_rows;
-                    buffers[buf_idx].loaded = 1;
-                    buffers[buf_idx].processed = 0;
-                    
-                    next_chunk_to_load++;
-                    chunks_in_memory++;
-                }
-                
-                uint32_t buf_idx = next_chunk_to_process % max_chunks_in_mem;
-                if (!buffers[buf_idx].loaded) break;
-                
-                chunk_counter++;
-                double t_chunk_start = MPI_Wtime();
-                
-                uint32_t chunk_out_H = buffers[buf_idx].out_row_end - buffers[buf_idx].out_row_start;
-                
-                ConvParams chunk_params = {
-                    .data = buffers[buf_idx].input,
-                    .kernel = kernel_full,
-                    .output = buffers[buf_idx].output,
-                    .H = buffers[buf_idx].num_input_rows,
-                    .W = (uint32_t)W,
-                    .kH = (uint32_t)kH,
-                    .kW = (uint32_t)kW,
-                    .sH = (uint32_t)sH,
-                    .sW = (uint32_t)sW,
-                    .out_H = chunk_out_H,
-                    .out_W = (uint32_t)out_W,
-                    .input_offset_row = buffers[buf_idx].input_row_start,
-                    .output_offset_row = buffers[buf_idx].out_row_start
-                };
-                
-                double t_conv_start = MPI_Wtime();
-                conv_openmp(&chunk_params);
-                double t_conv = MPI_Wtime() - t_conv_start;
-                t_comp_total += t_conv;
-                
-                fseek(output_file, sizeof(BinaryHeader) + (size_t)buffers[buf_idx].out_row_start * out_W * sizeof(float), SEEK_SET);
-                fwrite(buffers[buf_idx].output, sizeof(float), (size_t)chunk_out_H * out_W, output_file);
-                
-                double t_chunk_total = MPI_Wtime() - t_chunk_start;
-                fprintf(stdout,"[CHUNK] %u/%u out_rows=%u-%u in_rows=%u mem=%.1fMB chunks_loaded=%u time=%.4fs (io=%.4fs conv=%.4fs)\n",
-                       chunk_counter, num_chunks, buffers[buf_idx].out_row_start, buffers[buf_idx].out_row_end, 
-                       buffers[buf_idx].num_input_rows,
-                       ((double)buffers[buf_idx].num_input_rows * W + chunk_out_H * out_W) * sizeof(float) / 1e6,
-                       chunks_in_memory, t_chunk_total, t_chunk_total - t_conv, t_conv);
-                
-                free(buffers[buf_idx].input);
-                free(buffers[buf_idx].output);
-                buffers[buf_idx].loaded = 0;
-                buffers[buf_idx].processed = 1;
-                
-                chunks_in_memory--;
-                next_chunk_to_process++;
+        }
+        source_close(src);
+    }
+
+    if (text_via_bin) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (rank==0 && !rc) convert_bin_to_txt(bin_output_path, (char*)out_path, 8192);
+        if (rank==0) remove(bin_output_path);
+    }
+
+    if (compress_output) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (rank==0 && !rc) {
+            struct stat raw_st, packed_st;
+            rc = compress_bin_matrix(bin_output_path, (char*)out_path, 0);
+            if (!rc && stat(bin_output_path, &raw_st) == 0 && stat(out_path, &packed_st) == 0) {
+                printf("[COMPRESS] output=%s raw=%.1fMB stored=%.1fMB ratio=%.2f\n", out_path,
+                       raw_st.st_size / 1048576.0, packed_st.st_size / 1048576.0,
+                       (double)raw_st.st_size / (double)packed_st.st_size);
             }
-            
-            free(buffers);
-            fclose(output_file);
-
-            double t_all_done = MPI_Wtime();
-            double t_read = t_read_done - t0;
-            double t_comp = t_comp_total;
-            double t_write = t_all_done - t_read_done - t_comp_total;
-            fprintf(stdout,"mode=%s ranks=%d threads=%s H=%d W=%d k=%dx%d s=%dx%d read=%.3fs comp=%.3fs write=%.3fs\n",
-                   "omp", world, getenv("OMP_NUM_THREADS")?getenv("OMP_NUM_THREADS"):"1",
-                   H,W,kH,kW,sH,sW,t_read,t_comp,t_write);
-
-            if (!kernel_mem && kernel_full) free(kernel_full);
         }
+        if (rank==0) remove(bin_output_path);
+        MPI_Bcast(&rc, 1, MPI_INT, 0, MPI_COMM_WORLD);
     }
 
+    if (rank==0 && !rc && args.occupancy_rows && !convert_to_txt) rc = write_occupancy(out_path, &args);
+    MPI_Bcast(&rc, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
     if (use_mpi) {
         double t_done = MPI_Wtime();
         if (rank==0) {
-            printf("mode=mpi ranks=%d threads=%s H=%d W=%d k=%dx%d s=%dx%d total=%.3fs\n",
-                   world, getenv("OMP_NUM_THREADS")?getenv("OMP_NUM_THREADS"):"?",
-                   H,W,kH,kW,sH,sW, t_done - t0);
+            printf("mode=mpi ranks=%d threads=%s isa=%s N=%d C=%d K=%d H=%d W=%d k=%dx%d s=%dx%d total=%.3fs\n",
+                   world, getenv("OMP_NUM_THREADS")?getenv("OMP_NUM_THREADS"):"?", isa_name(isa_level()),
+                   N,C,K,H,W,kH,kW,sH,sW, t_done - t0);
         }
     }
 
-    if (rank==0 && convert_to_txt && convert_output) {
-        convert_bin_to_txt((char*)internal_out, (char*)out_path, 8192);
+    if (quant_dtype && rank==0 && !rc) {
+        MatrixSource* ref = source_open_file(in_path);
+        MatrixSource* qsrc = source_open_file(run_path);
+        ConvQuantReport report;
+        if (ref && qsrc && conv_plan_quant_report(plan, ref, qsrc, 64, &report) == 0) {
+            printf("[QUANT] input=%s scale=%g zero_point=%d rows=%u max_abs_err=%.3g rms_err=%.3g ref_rms=%.3g snr=%.1fdB\n",
+                   dtype_name(qsrc->dtype), qsrc->scale, qsrc->zero_point, report.rows,
+                   report.max_abs_err, report.rms_err, report.ref_rms, report.snr_db);
+        } else {
+            fprintf(stderr, "Failed to compute the quantization accuracy report\n");
+        }
+        source_close(ref);
+        source_close(qsrc);
     }
-    
+
     MPI_Barrier(MPI_COMM_WORLD);
     
     if (rank==0) {
         if (cleanup_input && tmp_input_bin[0]) {
             remove(tmp_input_bin);
         }
-        if (cleanup_kernel && tmp_kernel_bin[0]) {
-            remove(tmp_kernel_bin);
-        }
-        if (convert_output && tmp_output_bin[0]) {
-            remove(tmp_output_bin);
-        }
+        if (tmp_quant_bin[0]) remove(tmp_quant_bin);
     }
 
-    if (kernel_mem) free(kernel_mem);
+    conv_plan_destroy(plan);
+    free(kernel_mem);
     MPI_Finalize();
     return rc;
 }
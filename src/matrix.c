@@ -1,5 +1,6 @@
 #include "matrix.h"
 #include <stdlib.h>
+#include <string.h>
 
 MatrixPadding dim_to_padding(uint32_t kH, uint32_t kW) {
     MatrixPadding pad = (MatrixPadding){0, 0, 0, 0};
@@ -13,22 +14,42 @@ MatrixPadding dim_to_padding(uint32_t kH, uint32_t kW) {
     return pad;
 }
 
-int calc_output_height(int H, int kH, int sH) {
-    (void)kH;
+const char* boundary_name(BoundaryMode mode) {
+    switch (mode) {
+        case BOUNDARY_ZERO: return "zero";
+        case BOUNDARY_REFLECT: return "reflect";
+        case BOUNDARY_REPLICATE: return "replicate";
+        case BOUNDARY_CIRCULAR: return "circular";
+        case BOUNDARY_VALID: return "valid";
+        default: return "unknown";
+    }
+}
+
+int boundary_from_name(const char* name) {
+    if (!name) return -1;
+    if (strcmp(name, "zero") == 0 || strcmp(name, "same") == 0) return BOUNDARY_ZERO;
+    if (strcmp(name, "reflect") == 0) return BOUNDARY_REFLECT;
+    if (strcmp(name, "replicate") == 0 || strcmp(name, "edge") == 0) return BOUNDARY_REPLICATE;
+    if (strcmp(name, "circular") == 0 || strcmp(name, "wrap") == 0) return BOUNDARY_CIRCULAR;
+    if (strcmp(name, "valid") == 0) return BOUNDARY_VALID;
+    return -1;
+}
+
+int calc_output_height(int H, int kH, int sH, BoundaryMode mode) {
+    if (mode == BOUNDARY_VALID) return H >= kH ? ((H - kH) / sH) + 1 : 0;
     return ((H - 1) / sH) + 1;
 }
 
-int calc_output_width(int W, int kW, int sW) {
-    (void)kW;
-    return ((W - 1) / sW) + 1;
+int calc_output_width(int W, int kW, int sW, BoundaryMode mode) {
+    return calc_output_height(W, kW, sW, mode);
 }
 
-int calc_steps_total(int H, int W, int kH, int kW, int sH, int sW) {
-    int out_H = calc_output_height(H, kH, sH);
-    int out_W = calc_output_width(W, kW, sW);
-    return out_H * out_W;
+int64_t calc_steps_total(int H, int W, int kH, int kW, int sH, int sW) {
+    int out_H = calc_output_height(H, kH, sH, BOUNDARY_ZERO);
+    int out_W = calc_output_width(W, kW, sW, BOUNDARY_ZERO);
+    return (int64_t)out_H * out_W;
 }
 
 int calc_steps_dim(int X, int kX, int sX) {
-    return calc_output_height(X, kX, sX);
+    return calc_output_height(X, kX, sX, BOUNDARY_ZERO);
 }
@@ -0,0 +1,186 @@
+#define _DEFAULT_SOURCE     // st_mtim
+#include "occupancy.h"
+#include "dtype.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// rows scanned per read while building, rounded to whole tile rows
+#define OCC_SCAN_BYTES (8u << 20)
+
+static inline int tile_bit(const OccupancyIndex* occ, uint32_t ty, uint32_t tx) {
+    size_t i = (size_t)ty * occ->header.tiles_x + tx;
+    return (occ->bits[i >> 3] >> (i & 7)) & 1;
+}
+
+static size_t bitmap_bytes(const OccupancyHeader* h) {
+    return ((size_t)h->tiles_y * h->tiles_x + 7) / 8;
+}
+
+// Fills row_occupied from the bitmap.
+static void index_rows(OccupancyIndex* occ) {
+    for (uint32_t ty = 0; ty < occ->header.tiles_y; ++ty) {
+        occ->row_occupied[ty] = 0;
+        for (uint32_t tx = 0; tx < occ->header.tiles_x && !occ->row_occupied[ty]; ++tx) {
+            occ->row_occupied[ty] = (uint8_t)tile_bit(occ, ty, tx);
+        }
+    }
+}
+
+// The identity of the data file an index describes.
+static int stamp_data_file(const char* path, OccupancyHeader* h) {
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+    h->data_size = (uint64_t)st.st_size;
+    h->data_inode = (uint64_t)st.st_ino;
+    h->data_mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    h->data_mtime_nsec = (uint32_t)st.st_mtim.tv_nsec;
+    return 0;
+}
+
+int build_occupancy_index(MatrixSource* src, const char* path, uint32_t tile_rows, uint32_t tile_cols) {
+    const uint32_t H = src->height, W = src->width;
+    char occ_path[4096];
+    if (snprintf(occ_path, sizeof(occ_path), "%s.occ", path) >= (int)sizeof(occ_path)) return -1;
+    if (!tile_rows) tile_rows = OCC_DEFAULT_TILE_ROWS;
+    if (!tile_cols) tile_cols = OCC_DEFAULT_TILE_COLS;
+    OccupancyHeader header = {OCC_MAGIC, H, W, tile_rows, tile_cols,
+                              (H + tile_rows - 1) / tile_rows, (W + tile_cols - 1) / tile_cols, 0};
+    // stamped before the scan, so a write during it leaves the index stale
+    if (stamp_data_file(path, &header) != 0) {
+        fprintf(stderr, "Failed to stat %s (%s)\n", path, strerror(errno));
+        return -1;
+    }
+
+    uint32_t group = (uint32_t)(OCC_SCAN_BYTES / ((size_t)tile_rows * W * sizeof(float)));
+    if (!group) group = 1;
+    const uint32_t group_rows = group * tile_rows;
+    const uint32_t load_dtype = src->load_dtype;
+    src->load_dtype = DTYPE_F32;
+
+    uint8_t* bits = (uint8_t*)calloc(bitmap_bytes(&header) ? bitmap_bytes(&header) : 1, 1);
+    uint8_t* tiles = (uint8_t*)malloc((size_t)group * header.tiles_x);
+    float* rows = (float*)malloc((size_t)(group_rows < H ? group_rows : H) * W * sizeof(float));
+    int rc = (!bits || !tiles || !rows) ? -1 : 0;
+
+    for (uint32_t r0 = 0; !rc && r0 < H; r0 += group_rows) {
+        const uint32_t n = H - r0 < group_rows ? H - r0 : group_rows;
+        if (source_read_rows(src, r0, n, rows) != 0) {
+            rc = -1;
+            break;
+        }
+        const uint32_t ty0 = r0 / tile_rows;
+        const uint32_t nt = (n + tile_rows - 1) / tile_rows;
+
+        #pragma omp parallel for schedule(static) collapse(2)
+        for (uint32_t ty = 0; ty < nt; ++ty) {
+            for (uint32_t tx = 0; tx < header.tiles_x; ++tx) {
+                const uint32_t y1 = (ty + 1) * tile_rows < n ? (ty + 1) * tile_rows : n;
+                const uint32_t x0 = tx * tile_cols;
+                const uint32_t x1 = x0 + tile_cols < W ? x0 + tile_cols : W;
+                uint8_t any = 0;
+                for (uint32_t y = ty * tile_rows; y < y1 && !any; ++y) {
+                    const float* row = rows + (size_t)y * W;
+                    for (uint32_t x = x0; x < x1; ++x) any |= row[x] != 0.0f;
+                }
+                tiles[(size_t)ty * header.tiles_x + tx] = any;
+            }
+        }
+
+        for (uint32_t ty = 0; ty < nt; ++ty) {
+            for (uint32_t tx = 0; tx < header.tiles_x; ++tx) {
+                if (!tiles[(size_t)ty * header.tiles_x + tx]) continue;
+                size_t i = (size_t)(ty0 + ty) * header.tiles_x + tx;
+                bits[i >> 3] |= (uint8_t)(1u << (i & 7));
+                header.occupied++;
+            }
+        }
+    }
+    src->load_dtype = load_dtype;
+
+    FILE* out = rc ? NULL : fopen(occ_path, "wb");
+    if (!rc && (!out || fwrite(&header, sizeof(header), 1, out) != 1 ||
+                fwrite(bits, 1, bitmap_bytes(&header), out) != bitmap_bytes(&header))) {
+        rc = -1;
+    }
+    if (out && fclose(out) != 0) rc = -1;
+    if (rc) {
+        fprintf(stderr, "Failed to build occupancy index %s (%s)\n", occ_path, strerror(errno));
+        if (out) remove(occ_path);
+    }
+    free(bits);
+    free(tiles);
+    free(rows);
+    return rc;
+}
+
+OccupancyIndex* load_occupancy_index(const char* path, uint32_t h, uint32_t w) {
+    char occ_path[4096];
+    if (snprintf(occ_path, sizeof(occ_path), "%s.occ", path) >= (int)sizeof(occ_path)) return NULL;
+
+    struct stat occ_st;
+    if (stat(occ_path, &occ_st) != 0) return NULL;
+
+    FILE* f = fopen(occ_path, "rb");
+    OccupancyIndex* occ = (OccupancyIndex*)calloc(1, sizeof(OccupancyIndex));
+    OccupancyHeader* hd = occ ? &occ->header : NULL;
+    int ok = f && occ && fread(hd, sizeof(*hd), 1, f) == 1 &&
+             hd->magic == OCC_MAGIC && hd->height == h && hd->width == w && hd->tile_rows && hd->tile_cols &&
+             hd->tiles_y == (h + hd->tile_rows - 1) / hd->tile_rows &&
+             hd->tiles_x == (w + hd->tile_cols - 1) / hd->tile_cols;
+    if (ok) {
+        OccupancyHeader now;
+        if (stamp_data_file(path, &now) != 0 || now.data_size != hd->data_size || now.data_inode != hd->data_inode ||
+            now.data_mtime_sec != hd->data_mtime_sec || now.data_mtime_nsec != hd->data_mtime_nsec) {
+            fprintf(stderr, "Ignoring stale occupancy index %s\n", occ_path);
+            fclose(f);
+            free_occupancy_index(occ);
+            return NULL;
+        }
+        occ->bits = (uint8_t*)malloc(bitmap_bytes(hd) ? bitmap_bytes(hd) : 1);
+        occ->row_occupied = (uint8_t*)malloc(hd->tiles_y ? hd->tiles_y : 1);
+        ok = occ->bits && occ->row_occupied && fread(occ->bits, 1, bitmap_bytes(hd), f) == bitmap_bytes(hd);
+    }
+    if (f) fclose(f);
+    if (!ok) {
+        fprintf(stderr, "Ignoring invalid occupancy index %s\n", occ_path);
+        free_occupancy_index(occ);
+        return NULL;
+    }
+    index_rows(occ);
+    return occ;
+}
+
+void free_occupancy_index(OccupancyIndex* occ) {
+    if (!occ) return;
+    free(occ->bits);
+    free(occ->row_occupied);
+    free(occ);
+}
+
+int occupancy_zero(const OccupancyIndex* occ, uint32_t row0, uint32_t row1, uint32_t col0, uint32_t col1) {
+    const OccupancyHeader* h = &occ->header;
+    if (row1 > h->height) row1 = h->height;
+    if (col1 > h->width) col1 = h->width;
+    if (row0 >= row1 || col0 >= col1) return 1;
+    const uint32_t ty1 = (row1 - 1) / h->tile_rows;
+    const uint32_t tx0 = col0 / h->tile_cols, tx1 = (col1 - 1) / h->tile_cols;
+    for (uint32_t ty = row0 / h->tile_rows; ty <= ty1; ++ty) {
+        if (!occ->row_occupied[ty]) continue;
+        for (uint32_t tx = tx0; tx <= tx1; ++tx) {
+            if (tile_bit(occ, ty, tx)) return 0;
+        }
+    }
+    return 1;
+}
+
+uint32_t occupancy_row_run(const OccupancyIndex* occ, uint32_t row, uint32_t end, int* zero) {
+    const uint32_t tile_rows = occ->header.tile_rows;
+    uint32_t ty = row / tile_rows;
+    *zero = !occ->row_occupied[ty];
+    uint32_t next = (ty + 1) * tile_rows;
+    while (next < end && (!occ->row_occupied[next / tile_rows]) == *zero) next += tile_rows;
+    return next < end ? next : end;
+}
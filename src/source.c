@@ -0,0 +1,883 @@
+#include "source.h"
+#include "file.h"
+#include "generate.h"
+#include "compress.h"
+#include "occupancy.h"
+#include "io_mpi.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+ssize_t pread(int fd, void* buf, size_t nbyte, off_t offset);
+#endif
+
+static int check_rows(const MatrixSource* src, uint32_t row_start, uint32_t rows) {
+    if ((uint64_t)row_start + rows > src->height) {
+        fprintf(stderr, "%s source: rows %u-%u out of range (height %u)\n",
+                src->kind, row_start, row_start + rows, src->height);
+        return -1;
+    }
+    return 0;
+}
+
+static MatrixSource* new_source(const MatrixSourceOps* ops, const char* kind, uint32_t h, uint32_t w, void* state) {
+    MatrixSource* src = (MatrixSource*)malloc(sizeof(MatrixSource));
+    if (!src) return NULL;
+    src->ops = ops;
+    src->kind = kind;
+    src->height = h;
+    src->width = w;
+    src->dtype = DTYPE_F32;
+    src->load_dtype = DTYPE_F32;
+    src->scale = 1.0f;
+    src->zero_point = 0;
+    src->bytes_stored = 0;
+    src->bytes_raw = 0;
+    src->occupancy = NULL;
+    src->rows_skipped = 0;
+    src->scratch = NULL;
+    src->scratch_bytes = 0;
+    src->state = state;
+    return src;
+}
+
+// Reads land directly in dst when the storage already is what they deliver.
+static int rows_direct(const MatrixSource* src) {
+    if (src->load_dtype != src->dtype) return 0;
+    return !dtype_is_quantized(src->dtype) || (src->dtype == DTYPE_I16 && !src->zero_point);
+}
+
+// The source's conversion staging, at least bytes long.
+static void* source_scratch(MatrixSource* src, size_t bytes) {
+    if (bytes > src->scratch_bytes) {
+        free(src->scratch);
+        src->scratch = malloc(bytes);
+        src->scratch_bytes = src->scratch ? bytes : 0;
+    }
+    return src->scratch;
+}
+
+static void convert_rows(const MatrixSource* src, const void* raw, void* dst, size_t n) {
+    if (src->load_dtype == DTYPE_I16) {
+        dequantize_to_i16(src->dtype, raw, (int16_t*)dst, n, src->zero_point);
+    } else if (src->load_dtype == src->dtype) {
+        memcpy(dst, raw, n * dtype_size(src->dtype));
+    } else if (dtype_is_quantized(src->dtype)) {
+        dequantize_to_f32(src->dtype, raw, (float*)dst, n, src->scale, src->zero_point);
+    } else {
+        dtype_to_f32(src->dtype, raw, (float*)dst, n);
+    }
+}
+
+static size_t stored_row_bytes(const MatrixSource* src) {
+    return (size_t)src->width * dtype_size(src->dtype);
+}
+
+// Bytes a read of rows covers in a file with the given pitch; the pad after
+// the last row is not needed.
+static size_t pitched_span(const MatrixSource* src, uint32_t rows, size_t row_pitch) {
+    return (size_t)(rows - 1) * row_pitch + stored_row_bytes(src);
+}
+
+// Converts rows stored row_pitch bytes apart into packed rows of load_dtype.
+static void convert_pitched_rows(const MatrixSource* src, const void* raw, size_t row_pitch, void* dst, uint32_t rows) {
+    if (row_pitch == stored_row_bytes(src)) {
+        if (raw != dst) convert_rows(src, raw, dst, (size_t)rows * src->width);
+        return;
+    }
+    const size_t out_row = (size_t)src->width * dtype_size(src->load_dtype);
+    #pragma omp parallel for schedule(static) if ((size_t)rows * src->width > (1u << 16))
+    for (uint32_t r = 0; r < rows; ++r) {
+        convert_rows(src, (const char*)raw + (size_t)r * row_pitch, (char*)dst + (size_t)r * out_row, src->width);
+    }
+}
+
+// file: pread from a validated binary matrix
+
+static int pread_full(int fd, void* dst, size_t bytes, off_t offset) {
+    char* out = (char*)dst;
+    while (bytes) {
+        ssize_t got = pread(fd, out, bytes, offset);
+        if (got <= 0) {
+            if (got == -1 && errno == EINTR) continue;
+            if (!got) errno = 0;
+            return -1;
+        }
+        out += got;
+        offset += got;
+        bytes -= (size_t)got;
+    }
+    return 0;
+}
+
+static int file_start_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    BinaryFile* bf = (BinaryFile*)src->state;
+    size_t span = pitched_span(src, rows, bf->row_pitch);
+    off_t offset = (off_t)bf->data_offset + (off_t)row_start * (off_t)bf->row_pitch;
+
+    void* raw = rows_direct(src) && bf->row_pitch == stored_row_bytes(src) ? dst : source_scratch(src, span);
+    if (!raw) return -1;
+    int rc = pread_full(fileno(bf->file), raw, span, offset);
+    if (rc != 0) {
+        fprintf(stderr, "file source: failed to read rows %u-%u (%s)\n",
+                row_start, row_start + rows, errno ? strerror(errno) : "unexpected end of file");
+    } else {
+        convert_pitched_rows(src, raw, bf->row_pitch, dst, rows);
+    }
+    return rc;
+}
+
+// Column strips take one pread per row.
+static int file_start_cols(MatrixSource* src, uint32_t row_start, uint32_t rows, uint32_t col_start, uint32_t cols,
+                           void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    BinaryFile* bf = (BinaryFile*)src->state;
+    const size_t elem_size = dtype_size(src->dtype);
+    const size_t strip_bytes = (size_t)cols * elem_size;
+    const size_t out_row = (size_t)cols * source_load_size(src);
+    const int direct = rows_direct(src);
+    void* raw = direct ? NULL : source_scratch(src, strip_bytes);
+    if (!direct && !raw) return -1;
+    int rc = 0;
+    for (uint32_t r = 0; r < rows && !rc; ++r) {
+        char* out = (char*)dst + (size_t)r * out_row;
+        off_t offset = (off_t)bf->data_offset + (off_t)(row_start + r) * (off_t)bf->row_pitch +
+                       (off_t)col_start * (off_t)elem_size;
+        rc = pread_full(fileno(bf->file), direct ? out : raw, strip_bytes, offset);
+        if (!rc && !direct) convert_rows(src, raw, out, cols);
+    }
+    if (rc) {
+        fprintf(stderr, "file source: failed to read columns %u-%u of rows %u-%u (%s)\n", col_start, col_start + cols,
+                row_start, row_start + rows, errno ? strerror(errno) : "unexpected end of file");
+    }
+    return rc;
+}
+
+static void file_close(MatrixSource* src) {
+    BinaryFile* bf = (BinaryFile*)src->state;
+    fclose(bf->file);
+    free(bf);
+}
+
+static const MatrixSourceOps file_ops = {file_start_rows, NULL, file_close, NULL, NULL, file_start_cols};
+
+MatrixSource* source_open_file(const char* path) {
+    BinaryFile bf = open_bin_matrix_input((char*)path);
+    if (!bf.file) return NULL;
+    BinaryFile* st = (BinaryFile*)malloc(sizeof(BinaryFile));
+    MatrixSource* src = st ? new_source(&file_ops, "file", bf.height, bf.width, st) : NULL;
+    if (!src) {
+        free(st);
+        fclose(bf.file);
+        return NULL;
+    }
+    *st = bf;
+    src->dtype = bf.dtype;
+    src->scale = bf.scale;
+    src->zero_point = bf.zero_point;
+    return src;
+}
+
+// mmap: the whole file mapped read-only, rows served in place
+
+typedef struct {
+    void* base;
+    size_t length;
+    size_t data_offset;
+    size_t row_pitch;
+} MmapState;
+
+static const void* mmap_rows(MatrixSource* src, uint32_t row_start) {
+    MmapState* st = (MmapState*)src->state;
+    return (const char*)st->base + st->data_offset + (size_t)row_start * st->row_pitch;
+}
+
+static const float* mmap_peek_rows(MatrixSource* src, uint32_t row_start, uint32_t rows) {
+    (void)rows;
+    return (const float*)mmap_rows(src, row_start);
+}
+
+static int mmap_start_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    convert_pitched_rows(src, mmap_rows(src, row_start), ((MmapState*)src->state)->row_pitch, dst, rows);
+    return 0;
+}
+
+static int mmap_start_cols(MatrixSource* src, uint32_t row_start, uint32_t rows, uint32_t col_start, uint32_t cols,
+                           void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    const size_t offset = (size_t)col_start * dtype_size(src->dtype);
+    const size_t out_row = (size_t)cols * source_load_size(src);
+    #pragma omp parallel for schedule(static) if ((size_t)rows * cols > (1u << 16))
+    for (uint32_t r = 0; r < rows; ++r) {
+        convert_rows(src, (const char*)mmap_rows(src, row_start + r) + offset, (char*)dst + (size_t)r * out_row, cols);
+    }
+    return 0;
+}
+
+static void mmap_close(MatrixSource* src) {
+    MmapState* st = (MmapState*)src->state;
+    munmap(st->base, st->length);
+    free(st);
+}
+
+static const MatrixSourceOps mmap_ops = {mmap_start_rows, mmap_peek_rows, mmap_close, NULL, NULL, mmap_start_cols};
+// narrow or pitched storage cannot be handed out in place
+static const MatrixSourceOps mmap_typed_ops = {mmap_start_rows, NULL, mmap_close, NULL, NULL, mmap_start_cols};
+
+MatrixSource* source_open_mmap(const char* path) {
+    BinaryFile bf = open_bin_matrix_input((char*)path);
+    if (!bf.file) return NULL;
+
+    size_t length = bf.data_offset + (size_t)(bf.height - 1) * bf.row_pitch + (size_t)bf.width * dtype_size(bf.dtype);
+    void* base = mmap(NULL, length, PROT_READ, MAP_SHARED, fileno(bf.file), 0);
+    fclose(bf.file);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %s (%s)\n", path, strerror(errno));
+        return NULL;
+    }
+    posix_madvise(base, length, POSIX_MADV_SEQUENTIAL);
+
+    MmapState* st = (MmapState*)malloc(sizeof(MmapState));
+    int packed_f32 = bf.dtype == DTYPE_F32 && bf.row_pitch == (size_t)bf.width * sizeof(float);
+    const MatrixSourceOps* ops = packed_f32 ? &mmap_ops : &mmap_typed_ops;
+    MatrixSource* src = st ? new_source(ops, "mmap", bf.height, bf.width, st) : NULL;
+    if (!src) {
+        free(st);
+        munmap(base, length);
+        return NULL;
+    }
+    st->base = base;
+    st->length = length;
+    st->data_offset = bf.data_offset;
+    st->row_pitch = bf.row_pitch;
+    src->dtype = bf.dtype;
+    src->scale = bf.scale;
+    src->zero_point = bf.zero_point;
+    return src;
+}
+
+// memory: caller-owned row-major buffer
+
+static const float* memory_peek_rows(MatrixSource* src, uint32_t row_start, uint32_t rows) {
+    (void)rows;
+    return (const float*)src->state + (size_t)row_start * src->width;
+}
+
+static int memory_start_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    memcpy(dst, memory_peek_rows(src, row_start, rows), (size_t)rows * src->width * sizeof(float));
+    return 0;
+}
+
+static int memory_start_cols(MatrixSource* src, uint32_t row_start, uint32_t rows, uint32_t col_start, uint32_t cols,
+                             void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    for (uint32_t r = 0; r < rows; ++r) {
+        memcpy((float*)dst + (size_t)r * cols, memory_peek_rows(src, row_start + r, 1) + col_start, (size_t)cols * sizeof(float));
+    }
+    return 0;
+}
+
+static void memory_close(MatrixSource* src) {
+    (void)src;
+}
+
+static const MatrixSourceOps memory_ops = {memory_start_rows, memory_peek_rows, memory_close, NULL, NULL, memory_start_cols};
+
+MatrixSource* source_open_memory(const float* data, uint32_t h, uint32_t w) {
+    if (!data) return NULL;
+    return new_source(&memory_ops, "memory", h, w, (void*)data);
+}
+
+// synthetic: rows produced on demand by the counter-based generator
+
+static int synthetic_start_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    generate_rows((uint32_t)(uintptr_t)src->state, row_start, rows, src->width, dst);
+    return 0;
+}
+
+static int synthetic_start_cols(MatrixSource* src, uint32_t row_start, uint32_t rows, uint32_t col_start, uint32_t cols,
+                                void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    const uint64_t key = generate_key((uint32_t)(uintptr_t)src->state);
+    #pragma omp parallel for schedule(static)
+    for (uint32_t r = 0; r < rows; ++r) {
+        float* row = (float*)dst + (size_t)r * cols;
+        for (uint32_t j = 0; j < cols; ++j) row[j] = generate_value(key, row_start + r, col_start + j);
+    }
+    return 0;
+}
+
+static void synthetic_close(MatrixSource* src) {
+    (void)src;
+}
+
+static const MatrixSourceOps synthetic_ops = {synthetic_start_rows, NULL, synthetic_close, NULL, NULL, synthetic_start_cols};
+
+MatrixSource* source_open_synthetic(uint32_t h, uint32_t w, uint32_t seed) {
+    if (!seed) seed = (uint32_t)time(NULL);
+    return new_source(&synthetic_ops, "synthetic", h, w, (void*)(uintptr_t)seed);
+}
+
+// Reads each run of adjacent listed rows with its own request, waiting on
+// one before starting the next.
+static int gather_runs(MatrixSource* src, const uint32_t* rows, uint32_t count, void* dst, MPI_Request* req) {
+    const size_t row_bytes = (size_t)src->width * source_load_size(src);
+    *req = MPI_REQUEST_NULL;
+    for (uint32_t i = 0, j = 0; i < count; i = j) {
+        char* at = (char*)dst + (size_t)i * row_bytes;
+        if (rows[i] == SOURCE_ZERO_ROW) {
+            for (j = i + 1; j < count && rows[j] == SOURCE_ZERO_ROW; ++j) {}
+            memset(at, 0, (size_t)(j - i) * row_bytes);
+            continue;
+        }
+        for (j = i + 1; j < count && rows[j] == rows[j - 1] + 1; ++j) {}
+        if (source_wait_rows(src, req) != 0 || source_start_rows(src, rows[i], j - i, at, req) != 0) return -1;
+    }
+    return 0;
+}
+
+// Column strips without a start_cols op: groups of whole rows are read into
+// scratch and the strip is copied out of them.
+static int strip_by_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, uint32_t col_start, uint32_t cols,
+                         void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    const size_t load_size = source_load_size(src);
+    const size_t row_bytes = (size_t)src->width * load_size;
+    const size_t out_row = (size_t)cols * load_size;
+    uint32_t group = (uint32_t)(SOURCE_STRIP_SCRATCH_BYTES / row_bytes);
+    if (!group) group = 1;
+    if (group > rows) group = rows;
+    char* scratch = (char*)malloc((size_t)group * row_bytes);
+    if (!scratch) return -1;
+    int rc = 0;
+    for (uint32_t r0 = 0; !rc && r0 < rows; r0 += group) {
+        const uint32_t n = rows - r0 < group ? rows - r0 : group;
+        rc = source_read_rows(src, row_start + r0, n, scratch);
+        for (uint32_t r = 0; !rc && r < n; ++r) {
+            memcpy((char*)dst + (size_t)(r0 + r) * out_row, scratch + (size_t)r * row_bytes + (size_t)col_start * load_size,
+                   out_row);
+        }
+    }
+    free(scratch);
+    return rc;
+}
+
+// mpi: collective open, nonblocking MPI_File_iread_at per request, or
+// MPI_File_iread_at_all once collective. Rows that need converting land in the
+// staging of a pending slot, which wait_rows converts into dst; slots keep
+// their staging for later reads.
+// Gathers and column strips go through per-rank handles whose file view
+// selects just the bytes wanted, so one request reads them with no sieving of
+// the bytes in between.
+
+#define MPI_SOURCE_MAX_PENDING 4
+#define MPI_SOURCE_GATHER_HANDLES 2
+
+typedef struct {
+    MPI_Request req;
+    void* staging;
+    size_t capacity;
+    int busy;
+    void* dst;
+    uint32_t rows;
+} MpiPendingRead;
+
+typedef struct {
+    MPI_File fh;
+    MPI_Offset data_offset;
+    size_t row_pitch;
+    MpiPendingRead pending[MPI_SOURCE_MAX_PENDING];
+    char* path;
+    struct {
+        MPI_File fh;
+        MPI_Request req;
+        int open;
+        int busy;
+    } gather[MPI_SOURCE_GATHER_HANDLES];
+} MpiState;
+
+static int mpi_read_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req,
+                         int collective) {
+    MpiState* st = (MpiState*)src->state;
+    int (*iread)(MPI_File, MPI_Offset, void*, size_t, MPI_Datatype, MPI_Request*) =
+        collective ? mpi_file_iread_at_all_big : mpi_file_iread_at_big;
+    size_t elem_size = dtype_size(src->dtype);
+    MPI_Offset offset = st->data_offset + (MPI_Offset)row_start * (MPI_Offset)st->row_pitch;
+    if (!rows || (rows_direct(src) && st->row_pitch == stored_row_bytes(src))) {
+        MPI_Datatype type = elem_size == 4 ? MPI_FLOAT : elem_size == 2 ? MPI_UINT16_T : MPI_UINT8_T;
+        return iread(st->fh, offset, dst, (size_t)rows * src->width, type, req) == MPI_SUCCESS ? 0 : -1;
+    }
+
+    // everything else is fetched as one byte span and converted on completion
+    size_t count = pitched_span(src, rows, st->row_pitch);
+    MPI_Datatype type = MPI_BYTE;
+
+    MpiPendingRead* slot = NULL;
+    for (int i = 0; i < MPI_SOURCE_MAX_PENDING && !slot; ++i) {
+        if (!st->pending[i].busy) slot = &st->pending[i];
+    }
+    if (!slot) {
+        // every staging slot is busy: fall back to a blocking read, still
+        // the nonblocking call when it has to match the other ranks'
+        void* staging = source_scratch(src, count);
+        if (!staging) return -1;
+        *req = MPI_REQUEST_NULL;
+        int rc = collective ? iread(st->fh, offset, staging, count, type, req)
+                            : mpi_file_read_at_big(st->fh, offset, staging, count, type, MPI_STATUS_IGNORE);
+        if (collective && rc == MPI_SUCCESS) rc = MPI_Wait(req, MPI_STATUS_IGNORE);
+        if (rc == MPI_SUCCESS) convert_pitched_rows(src, staging, st->row_pitch, dst, rows);
+        return rc == MPI_SUCCESS ? 0 : -1;
+    }
+    if (count > slot->capacity) {
+        free(slot->staging);
+        slot->staging = malloc(count);
+        slot->capacity = slot->staging ? count : 0;
+        if (!slot->staging) return -1;
+    }
+    if (iread(st->fh, offset, slot->staging, count, type, req) != MPI_SUCCESS) return -1;
+    slot->req = *req;
+    slot->busy = 1;
+    slot->dst = dst;
+    slot->rows = rows;
+    return 0;
+}
+
+static int mpi_start_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req) {
+    return mpi_read_rows(src, row_start, rows, dst, req, 0);
+}
+
+static int mpi_start_rows_all(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req) {
+    return mpi_read_rows(src, row_start, rows, dst, req, 1);
+}
+
+// Collective reads go through the shared handle, so comm must hold the same
+// ranks as the communicator it was opened on.
+static int mpi_collective(MatrixSource* src, MPI_Comm comm, MPI_Info hints) {
+    MpiState* st = (MpiState*)src->state;
+    MPI_Group file_group, comm_group;
+    int same = MPI_UNEQUAL;
+    MPI_File_get_group(st->fh, &file_group);
+    MPI_Comm_group(comm, &comm_group);
+    MPI_Group_compare(file_group, comm_group, &same);
+    MPI_Group_free(&file_group);
+    MPI_Group_free(&comm_group);
+    if (same != MPI_IDENT) return -1;
+    return MPI_File_set_view(st->fh, 0, MPI_BYTE, MPI_BYTE, "native", hints) == MPI_SUCCESS ? 0 : -1;
+}
+
+// A free per-rank handle, opened on first use; -1 if all are busy or the
+// file cannot be opened.
+static int view_handle(MpiState* st) {
+    int h = -1;
+    for (int i = 0; i < MPI_SOURCE_GATHER_HANDLES && h < 0; ++i) {
+        if (!st->gather[i].busy) h = i;
+    }
+    if (h < 0 || st->gather[h].open) return h;
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "romio_ds_read", "disable");
+    int rc = MPI_File_open(MPI_COMM_SELF, st->path, MPI_MODE_RDONLY, info, &st->gather[h].fh);
+    MPI_Info_free(&info);
+    if (rc != MPI_SUCCESS) return -1;
+    st->gather[h].open = 1;
+    return h;
+}
+
+static int mpi_start_gather(MatrixSource* src, const uint32_t* rows, uint32_t count, void* dst, MPI_Request* req) {
+    MpiState* st = (MpiState*)src->state;
+    const size_t row_bytes = (size_t)src->width * dtype_size(src->dtype);
+    // run lengths of the hindexed types are int bytes
+    int h = rows_direct(src) && row_bytes <= (size_t)INT_MAX ? view_handle(st) : -1;
+    if (h < 0) return gather_runs(src, rows, count, dst, req);
+
+    int* lengths = (int*)malloc((size_t)count * sizeof(int));
+    MPI_Aint* file_at = (MPI_Aint*)malloc((size_t)count * sizeof(MPI_Aint));
+    MPI_Aint* mem_at = (MPI_Aint*)malloc((size_t)count * sizeof(MPI_Aint));
+    int runs = 0, rc = (!lengths || !file_at || !mem_at) ? -1 : 0;
+    for (uint32_t i = 0, j = 0; !rc && i < count; i = j) {
+        char* at = (char*)dst + (size_t)i * row_bytes;
+        if (rows[i] == SOURCE_ZERO_ROW) {
+            for (j = i + 1; j < count && rows[j] == SOURCE_ZERO_ROW; ++j) {}
+            memset(at, 0, (size_t)(j - i) * row_bytes);
+            continue;
+        }
+        // adjacent rows merge into one run only when the file has no padding
+        for (j = i + 1; j < count && rows[j] == rows[j - 1] + 1 && st->row_pitch == row_bytes &&
+                        (size_t)(j - i + 1) * row_bytes <= (size_t)INT_MAX; ++j) {}
+        lengths[runs] = (int)((size_t)(j - i) * row_bytes);
+        file_at[runs] = (MPI_Aint)rows[i] * (MPI_Aint)st->row_pitch;
+        mem_at[runs] = (MPI_Aint)(at - (char*)dst);
+        runs++;
+    }
+
+    *req = MPI_REQUEST_NULL;
+    MPI_Datatype file_type, mem_type;
+    if (!rc && runs) {
+        MPI_Type_create_hindexed(runs, lengths, file_at, MPI_BYTE, &file_type);
+        MPI_Type_create_hindexed(runs, lengths, mem_at, MPI_BYTE, &mem_type);
+        MPI_Type_commit(&file_type);
+        MPI_Type_commit(&mem_type);
+        MPI_File fh = st->gather[h].fh;
+        rc = MPI_File_set_view(fh, st->data_offset, MPI_BYTE, file_type, "native", MPI_INFO_NULL) == MPI_SUCCESS &&
+             MPI_File_iread_at(fh, 0, dst, 1, mem_type, req) == MPI_SUCCESS ? 0 : -1;
+        MPI_Type_free(&file_type);
+        MPI_Type_free(&mem_type);
+        if (!rc) {
+            st->gather[h].req = *req;
+            st->gather[h].busy = 1;
+        }
+    }
+    free(lengths);
+    free(file_at);
+    free(mem_at);
+    return rc;
+}
+
+// The strip is one block of cols elements per row, row_pitch bytes apart.
+static int mpi_start_cols(MatrixSource* src, uint32_t row_start, uint32_t rows, uint32_t col_start, uint32_t cols,
+                          void* dst, MPI_Request* req) {
+    MpiState* st = (MpiState*)src->state;
+    const size_t elem_size = dtype_size(src->dtype);
+    const size_t strip_bytes = (size_t)cols * elem_size;
+    int h = rows_direct(src) && strip_bytes <= (size_t)INT_MAX && rows <= (uint32_t)INT_MAX ? view_handle(st) : -1;
+    if (h < 0) return strip_by_rows(src, row_start, rows, col_start, cols, dst, req);
+
+    *req = MPI_REQUEST_NULL;
+    MPI_Datatype strip;
+    MPI_Type_create_hvector((int)rows, (int)strip_bytes, (MPI_Aint)st->row_pitch, MPI_BYTE, &strip);
+    MPI_Type_commit(&strip);
+    MPI_File fh = st->gather[h].fh;
+    MPI_Offset at = st->data_offset + (MPI_Offset)row_start * (MPI_Offset)st->row_pitch +
+                    (MPI_Offset)col_start * (MPI_Offset)elem_size;
+    int rc = MPI_File_set_view(fh, at, MPI_BYTE, strip, "native", MPI_INFO_NULL) == MPI_SUCCESS &&
+             mpi_file_iread_at_big(fh, 0, dst, (size_t)rows * strip_bytes, MPI_BYTE, req) == MPI_SUCCESS ? 0 : -1;
+    MPI_Type_free(&strip);
+    if (!rc) {
+        st->gather[h].req = *req;
+        st->gather[h].busy = 1;
+    }
+    return rc;
+}
+
+static int mpi_wait_rows(MatrixSource* src, MPI_Request* req) {
+    MpiState* st = (MpiState*)src->state;
+    for (int i = 0; i < MPI_SOURCE_GATHER_HANDLES; ++i) {
+        if (st->gather[i].busy && st->gather[i].req == *req) st->gather[i].busy = 0;
+    }
+    MpiPendingRead* slot = NULL;
+    for (int i = 0; i < MPI_SOURCE_MAX_PENDING && !slot; ++i) {
+        if (st->pending[i].busy && st->pending[i].req == *req) slot = &st->pending[i];
+    }
+    int rc = MPI_Wait(req, MPI_STATUS_IGNORE) == MPI_SUCCESS ? 0 : -1;
+    if (slot) {
+        if (!rc) convert_pitched_rows(src, slot->staging, st->row_pitch, slot->dst, slot->rows);
+        slot->busy = 0;
+    }
+    return rc;
+}
+
+static void mpi_close(MatrixSource* src) {
+    MpiState* st = (MpiState*)src->state;
+    for (int i = 0; i < MPI_SOURCE_MAX_PENDING; ++i) {
+        if (st->pending[i].busy) MPI_Wait(&st->pending[i].req, MPI_STATUS_IGNORE);
+        free(st->pending[i].staging);
+    }
+    for (int i = 0; i < MPI_SOURCE_GATHER_HANDLES; ++i) {
+        if (st->gather[i].busy) MPI_Wait(&st->gather[i].req, MPI_STATUS_IGNORE);
+        if (st->gather[i].open) MPI_File_close(&st->gather[i].fh);
+    }
+    MPI_File_close(&st->fh);
+    free(st->path);
+    free(st);
+}
+
+static const MatrixSourceOps mpi_ops = {mpi_start_rows, NULL, mpi_close, mpi_wait_rows, mpi_start_gather, mpi_start_cols,
+                                        mpi_collective, mpi_start_rows_all};
+
+MatrixSource* source_open_mpi(const char* path, MPI_Comm comm) {
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "romio_cb_read", "enable");
+    MPI_Info_set(info, "access_style", "read_once,sequential");
+
+    MpiState* st = (MpiState*)calloc(1, sizeof(MpiState));
+    int mpi_err = st ? MPI_File_open(comm, (char*)path, MPI_MODE_RDONLY, info, &st->fh) : MPI_ERR_NO_MEM;
+    MPI_Info_free(&info);
+    if (mpi_err != MPI_SUCCESS) {
+        char err_string[MPI_MAX_ERROR_STRING];
+        int err_len = 0;
+        MPI_Error_string(mpi_err, err_string, &err_len);
+        fprintf(stderr, "[Rank %d] Failed to open input file '%s': %.*s\n", rank, path, err_len, err_string);
+        free(st);
+        return NULL;
+    }
+
+    unsigned char raw[BIN_HEADER_MAX_BYTES] = {0};
+    MPI_Status status;
+    int got = 0;
+    MPI_File_read_at(st->fh, 0, raw, sizeof(raw), MPI_BYTE, &status);
+    MPI_Get_count(&status, MPI_BYTE, &got);
+
+    BinaryLayout layout = {0, 0, DTYPE_F32, 0, 1.0f, 0, 1, 0};
+    MPI_Offset size = 0;
+    MPI_File_get_size(st->fh, &size);
+    int valid = got > 0 && parse_bin_header(raw, (size_t)got, &layout) == 0;
+    MPI_Offset need = (MPI_Offset)layout.data_offset + ((MPI_Offset)layout.height - 1) * (MPI_Offset)layout.row_pitch
+                    + (MPI_Offset)layout.width * (MPI_Offset)dtype_size(layout.dtype);
+    if (!valid || !layout.height || !layout.width || size < need) {
+        fprintf(stderr, "[Rank %d] Input file '%s' is truncated or has an invalid header\n", rank, path);
+        MPI_File_close(&st->fh);
+        free(st);
+        return NULL;
+    }
+    st->data_offset = (MPI_Offset)layout.data_offset;
+    st->row_pitch = layout.row_pitch;
+    st->path = (char*)malloc(strlen(path) + 1);
+    if (st->path) memcpy(st->path, path, strlen(path) + 1);
+
+    MatrixSource* src = st->path ? new_source(&mpi_ops, "mpi", layout.height, layout.width, st) : NULL;
+    if (!src) {
+        MPI_File_close(&st->fh);
+        free(st->path);
+        free(st);
+        return NULL;
+    }
+    src->dtype = layout.dtype;
+    src->scale = layout.scale;
+    src->zero_point = layout.zero_point;
+    return src;
+}
+
+// compressed: .cbin row blocks, fetched with one pread per request and
+// decoded in parallel
+
+typedef struct {
+    FILE* file;
+    uint32_t block_rows;
+    uint32_t num_blocks;
+    uint64_t* offsets;
+} CompressedState;
+
+static int compressed_start_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    CompressedState* st = (CompressedState*)src->state;
+    const uint32_t br = st->block_rows;
+    const uint32_t b0 = row_start / br;
+    const uint32_t b1 = (row_start + rows - 1) / br;
+    const size_t elem_size = dtype_size(src->dtype);
+    const size_t load_size = dtype_size(src->load_dtype);
+    const size_t row_bytes = (size_t)src->width * elem_size;
+
+    size_t stored = (size_t)(st->offsets[b1 + 1] - st->offsets[b0]);
+    unsigned char* packed = (unsigned char*)malloc(stored);
+    if (!packed) return -1;
+    if (pread_full(fileno(st->file), packed, stored, (off_t)st->offsets[b0]) != 0) {
+        fprintf(stderr, "compressed source: failed to read rows %u-%u (%s)\n",
+                row_start, row_start + rows, errno ? strerror(errno) : "unexpected end of file");
+        free(packed);
+        return -1;
+    }
+
+    int failed = 0;
+    #pragma omp parallel for schedule(dynamic, 1) reduction(|:failed)
+    for (uint32_t b = b0; b <= b1; ++b) {
+        uint32_t block_start = b * br;
+        uint32_t block_count = src->height - block_start < br ? src->height - block_start : br;
+        uint32_t first = row_start > block_start ? row_start : block_start;
+        uint32_t last = row_start + rows < block_start + block_count ? row_start + rows : block_start + block_count;
+        size_t n = (size_t)block_count * src->width;
+        char* out = (char*)dst + (size_t)(first - row_start) * src->width * load_size;
+
+        // whole blocks in the final layout decode straight into dst
+        int in_place = rows_direct(src) && first == block_start && last == block_start + block_count;
+        unsigned char* scratch = (unsigned char*)malloc(n * elem_size);
+        unsigned char* decoded = in_place ? (unsigned char*)out : (unsigned char*)malloc(n * elem_size);
+        if (!scratch || !decoded ||
+            zblock_decode(packed + (st->offsets[b] - st->offsets[b0]), (size_t)(st->offsets[b + 1] - st->offsets[b]),
+                          decoded, n, elem_size, scratch) != 0) {
+            failed = 1;
+        } else if (!in_place) {
+            convert_rows(src, decoded + (size_t)(first - block_start) * row_bytes, out, (size_t)(last - first) * src->width);
+        }
+        free(scratch);
+        if (!in_place) free(decoded);
+    }
+    free(packed);
+    if (failed) {
+        fprintf(stderr, "compressed source: corrupt block in rows %u-%u\n", row_start, row_start + rows);
+        return -1;
+    }
+    // the last block may be short
+    uint32_t raw_end = (b1 + 1) * br < src->height ? (b1 + 1) * br : src->height;
+    src->bytes_stored += stored;
+    src->bytes_raw += (size_t)(raw_end - b0 * br) * row_bytes;
+    return 0;
+}
+
+static void compressed_close(MatrixSource* src) {
+    CompressedState* st = (CompressedState*)src->state;
+    fclose(st->file);
+    free(st->offsets);
+    free(st);
+}
+
+static const MatrixSourceOps compressed_ops = {compressed_start_rows, NULL, compressed_close, NULL};
+
+MatrixSource* source_open_compressed(const char* path) {
+    CompressedHeader header;
+    if (read_compressed_header(path, &header) != 0) return NULL;
+
+    CompressedState* st = (CompressedState*)calloc(1, sizeof(CompressedState));
+    size_t index_bytes = ((size_t)header.num_blocks + 1) * sizeof(uint64_t);
+    if (st) {
+        st->file = fopen(path, "rb");
+        st->offsets = (uint64_t*)malloc(index_bytes);
+    }
+    if (!st || !st->file || !st->offsets ||
+        pread_full(fileno(st->file), st->offsets, index_bytes, (off_t)sizeof(header)) != 0) {
+        fprintf(stderr, "Failed to read block index of %s\n", path);
+        if (st && st->file) fclose(st->file);
+        if (st) free(st->offsets);
+        free(st);
+        return NULL;
+    }
+    st->block_rows = header.block_rows;
+    st->num_blocks = header.num_blocks;
+
+    // blocks follow the index in order and end inside the file
+    struct stat file_st;
+    int index_ok = fstat(fileno(st->file), &file_st) == 0 &&
+                   st->offsets[0] >= sizeof(header) + index_bytes &&
+                   st->offsets[header.num_blocks] <= (uint64_t)file_st.st_size;
+    for (uint32_t b = 0; b < header.num_blocks && index_ok; ++b) index_ok = st->offsets[b] <= st->offsets[b + 1];
+    if (!index_ok) {
+        fprintf(stderr, "Corrupt block index in %s\n", path);
+        compressed_close(&(MatrixSource){.state = st});
+        return NULL;
+    }
+
+    MatrixSource* src = new_source(&compressed_ops, "compressed", header.height, header.width, st);
+    if (!src) {
+        compressed_close(&(MatrixSource){.state = st});
+        return NULL;
+    }
+    src->dtype = header.dtype;
+    src->scale = header.scale;
+    src->zero_point = header.zero_point;
+    return src;
+}
+
+// dispatch
+
+// Rows in tile rows the occupancy index marks empty are zero-filled; only
+// the runs between them are read. Each run completes before the next one
+// starts, so the last run's request still covers the whole read.
+static int start_occupied_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req) {
+    const size_t row_bytes = (size_t)src->width * source_load_size(src);
+    const uint32_t end = row_start + rows;
+    for (uint32_t row = row_start; row < end;) {
+        int zero = 0;
+        uint32_t next = occupancy_row_run(src->occupancy, row, end, &zero);
+        char* at = (char*)dst + (size_t)(row - row_start) * row_bytes;
+        if (zero) {
+            memset(at, 0, (size_t)(next - row) * row_bytes);
+            src->rows_skipped += next - row;
+        } else if (source_wait_rows(src, req) != 0 || src->ops->start_rows(src, row, next - row, at, req) != 0) {
+            return -1;
+        }
+        row = next;
+    }
+    return 0;
+}
+
+static int check_load_dtype(const MatrixSource* src) {
+    if (src->load_dtype != DTYPE_F32 && src->load_dtype != src->dtype && !dtype_is_quantized(src->dtype)) {
+        fprintf(stderr, "%s source: %s storage cannot be loaded as %s\n",
+                src->kind, dtype_name(src->dtype), dtype_name(src->load_dtype));
+        return -1;
+    }
+    return 0;
+}
+
+int source_start_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    if (!rows) return 0;
+    if (check_rows(src, row_start, rows) != 0 || check_load_dtype(src) != 0) return -1;
+    if (src->occupancy) return start_occupied_rows(src, row_start, rows, dst, req);
+    return src->ops->start_rows(src, row_start, rows, dst, req);
+}
+
+int source_start_gather(MatrixSource* src, const uint32_t* rows, uint32_t count, void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (rows[i] != SOURCE_ZERO_ROW && check_rows(src, rows[i], 1) != 0) return -1;
+    }
+    // the occupancy index works per run of rows
+    if (src->ops->start_gather && !src->occupancy) return src->ops->start_gather(src, rows, count, dst, req);
+    return gather_runs(src, rows, count, dst, req);
+}
+
+int source_start_cols(MatrixSource* src, uint32_t row_start, uint32_t rows, uint32_t col_start, uint32_t cols,
+                      void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    if (!rows || !cols) return 0;
+    if (check_rows(src, row_start, rows) != 0 || check_load_dtype(src) != 0) return -1;
+    if ((uint64_t)col_start + cols > src->width) {
+        fprintf(stderr, "%s source: columns %u-%u out of range (width %u)\n",
+                src->kind, col_start, col_start + cols, src->width);
+        return -1;
+    }
+    // the occupancy index works per run of whole rows
+    if (src->ops->start_cols && !src->occupancy) return src->ops->start_cols(src, row_start, rows, col_start, cols, dst, req);
+    return strip_by_rows(src, row_start, rows, col_start, cols, dst, req);
+}
+
+int source_collective(MatrixSource* src, MPI_Comm comm, MPI_Info hints) {
+    if (!src->ops->collective || !src->ops->start_rows_all || src->occupancy) return -1;
+    return src->ops->collective(src, comm, hints);
+}
+
+int source_start_rows_all(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst, MPI_Request* req) {
+    *req = MPI_REQUEST_NULL;
+    if (rows && (check_rows(src, row_start, rows) != 0 || check_load_dtype(src) != 0)) return -1;
+    return src->ops->start_rows_all(src, row_start, rows, dst, req);
+}
+
+int source_wait_rows(MatrixSource* src, MPI_Request* req) {
+    if (*req == MPI_REQUEST_NULL) return 0;
+    if (src->ops->wait_rows) return src->ops->wait_rows(src, req);
+    return MPI_Wait(req, MPI_STATUS_IGNORE) == MPI_SUCCESS ? 0 : -1;
+}
+
+int source_read_rows(MatrixSource* src, uint32_t row_start, uint32_t rows, void* dst) {
+    MPI_Request req;
+    if (source_start_rows(src, row_start, rows, dst, &req) != 0) return -1;
+    return source_wait_rows(src, &req);
+}
+
+const float* source_peek_rows(MatrixSource* src, uint32_t row_start, uint32_t rows) {
+    if (!src->ops->peek_rows || src->load_dtype != DTYPE_F32 || check_rows(src, row_start, rows) != 0) return NULL;
+    return src->ops->peek_rows(src, row_start, rows);
+}
+
+size_t source_load_size(const MatrixSource* src) {
+    return dtype_size(src->load_dtype);
+}
+
+void source_close(MatrixSource* src) {
+    if (!src) return;
+    src->ops->close(src);
+    free_occupancy_index(src->occupancy);
+    free(src->scratch);
+    free(src);
+}